@@ -0,0 +1,421 @@
+// 仓库操作的场景基准：首次快照、重启后的重新扫描、增量快照、undo、回退 N 步、大时间线列表和大文件 diff。
+// 结果以 JSON 输出到标准输出（或 --output 指定的文件），便于长期跟踪回归。
+// 用法: clay_bench [--files N] [--depth N] [--fanout N] [--min-size B] [--max-size B]
+//                  [--binary-ratio R] [--edit-ratio R] [--edit-pattern append|modify|mixed]
+//                  [--rounds N] [--rewind-steps N] [--timeline N] [--large-size B]
+//                  [--memory-budget B] [--seed N] [--dir PATH] [--keep] [--output FILE] [scenario ...]
+#include "synthetic.hpp"
+#include "clay/json.hpp"
+#include "clay/memory.hpp"
+#include "clay/metrics.hpp"
+#include "clay/repository.hpp"
+#include "clay/storage.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace fs = std::filesystem;
+using namespace std::chrono;
+using clay::jsonQuote;
+using clay::bench::EditPattern;
+using clay::bench::SyntheticTree;
+using clay::bench::TreeSpec;
+
+namespace {
+
+struct Options {
+    TreeSpec tree;
+    double editRatio = 0.05;
+    EditPattern editPattern = EditPattern::Mixed;
+    size_t rounds = 10;
+    size_t rewindSteps = 5;
+    size_t timelineSnapshots = 10000;
+    size_t largeSize = 8 * 1024 * 1024;
+    uint64_t memoryBudget = 0; // 写入工作区的 memory_budget，0 表示不限
+    std::string dir;
+    std::string output;
+    bool keep = false;
+    std::set<std::string> scenarios;
+};
+
+const char* const kScenarios[] = {
+    "first_snapshot", "rescan", "incremental_snapshot", "undo", "rewind", "timeline", "diff_large",
+};
+
+// 丢弃库内部打印到 std::cout 的进度信息，避免混入 JSON
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+};
+
+double secondsSince(steady_clock::time_point start) {
+    return duration<double>(steady_clock::now() - start).count();
+}
+
+// 一个场景的结果：若干数值字段，按加入顺序输出
+class Result {
+public:
+    explicit Result(std::string scenario) : scenario_(std::move(scenario)) {}
+
+    Result& set(const std::string& key, double value) {
+        std::ostringstream v;
+        v << value;
+        fields_.emplace_back(key, v.str());
+        return *this;
+    }
+    Result& set(const std::string& key, uint64_t value) {
+        fields_.emplace_back(key, std::to_string(value));
+        return *this;
+    }
+
+    void write(std::ostream& out) const {
+        out << "{\"scenario\":" << jsonQuote(scenario_);
+        for (const auto& [key, value] : fields_) out << "," << jsonQuote(key) << ":" << value;
+        out << "}";
+    }
+
+private:
+    std::string scenario_;
+    std::vector<std::pair<std::string, std::string>> fields_;
+};
+
+void progress(const std::string& message) {
+    std::cerr << "[clay_bench] " << message << std::endl;
+}
+
+// 在同一个工作区上顺序执行首次快照、增量快照、undo 和回退
+void runWorkspaceScenarios(const Options& opts, const fs::path& root, std::vector<Result>& results) {
+    auto want = [&](const char* name) { return opts.scenarios.count(name) > 0; };
+
+    SyntheticTree tree(root.string(), opts.tree);
+    progress("generating " + std::to_string(opts.tree.files) + " files in " + root.string());
+    auto start = steady_clock::now();
+    uint64_t bytes = tree.generate();
+    double generateSeconds = secondsSince(start);
+
+    // 基准需要保留所有快照，并避免后台压缩干扰计时
+    fs::create_directories(root / ".clay");
+    {
+        std::ofstream conf(root / ".clay" / "clay.conf");
+        conf << "[core]\nmax_snapshots = 1000000\ndelta_hot_window = 315360000\n"
+             << "memory_budget = " << opts.memoryBudget << "\n";
+    }
+    auto repo = clay::Repository::open(root.string(), clay::OpenMode::ReadWrite);
+
+    start = steady_clock::now();
+    repo->takeSnapshot("first");
+    double first = secondsSince(start);
+    if (want("first_snapshot")) {
+        results.push_back(Result("first_snapshot")
+            .set("seconds", first)
+            .set("files", static_cast<uint64_t>(tree.files().size()))
+            .set("bytes", bytes)
+            .set("generate_seconds", generateSeconds));
+    }
+
+    // 重新打开仓库（相当于守护进程重启）后对未修改的树做一次快照：目录列表和文件内容
+    // 都应沿用上次扫描的记录。先等过 mtime 不可信的窗口并快照一次，让记录稳定下来
+    if (want("rescan")) {
+        std::this_thread::sleep_for(milliseconds(1100));
+        repo->takeSnapshot("settle");
+        repo.reset();
+        repo = clay::Repository::open(root.string(), clay::OpenMode::ReadWrite);
+        const clay::PipelineMetrics& reopened = repo->core().metrics();
+        start = steady_clock::now();
+        repo->takeSnapshot("rescan");
+        results.push_back(Result("rescan")
+            .set("seconds", secondsSince(start))
+            .set("files", static_cast<uint64_t>(tree.files().size()))
+            .set("files_unread", reopened.counter(clay::PipelineCounter::FilesUnread))
+            .set("dirs_reused", reopened.counter(clay::PipelineCounter::DirsReused)));
+    }
+
+    bool needHistory = want("incremental_snapshot") || want("undo") || want("rewind");
+    if (!needHistory) return;
+
+    size_t rounds = std::max(opts.rounds, opts.rewindSteps + 1);
+    double total = 0, worst = 0;
+    uint64_t edited = 0, written = 0;
+    // 增量快照只应写入变化的文件和目录节点
+    const clay::PipelineMetrics& metrics = repo->core().metrics();
+    uint64_t reusedBefore = metrics.counter(clay::PipelineCounter::FilesReused);
+    uint64_t treesBefore = metrics.counter(clay::PipelineCounter::TreesWritten);
+    for (size_t i = 0; i < rounds; ++i) {
+        auto stats = tree.edit(opts.editRatio, opts.editPattern);
+        edited += stats.modified + stats.created + stats.removed;
+        written += stats.bytesWritten;
+        start = steady_clock::now();
+        repo->takeSnapshot("round " + std::to_string(i + 1));
+        double elapsed = secondsSince(start);
+        total += elapsed;
+        worst = std::max(worst, elapsed);
+    }
+    if (want("incremental_snapshot")) {
+        results.push_back(Result("incremental_snapshot")
+            .set("rounds", static_cast<uint64_t>(rounds))
+            .set("seconds_mean", total / rounds)
+            .set("seconds_max", worst)
+            .set("files_edited", edited)
+            .set("bytes_written", written)
+            .set("files_reused", metrics.counter(clay::PipelineCounter::FilesReused) - reusedBefore)
+            .set("trees_written", metrics.counter(clay::PipelineCounter::TreesWritten) - treesBefore));
+    }
+
+    if (want("undo")) {
+        start = steady_clock::now();
+        bool ok = repo->core().undo();
+        results.push_back(Result("undo").set("seconds", secondsSince(start)).set("ok", uint64_t(ok)));
+    }
+
+    if (want("rewind")) {
+        auto timeline = repo->timeline();
+        size_t steps = std::min(opts.rewindSteps, timeline.size() - 1);
+        const std::string& target = timeline[timeline.size() - 1 - steps].id;
+        start = steady_clock::now();
+        bool ok = repo->restore(target);
+        results.push_back(Result("rewind")
+            .set("steps", static_cast<uint64_t>(steps))
+            .set("seconds", secondsSince(start))
+            .set("ok", uint64_t(ok)));
+    }
+}
+
+// 直接通过存储层写入大量小快照，再计时列出时间线
+void runTimelineScenario(const Options& opts, const fs::path& root, std::vector<Result>& results) {
+    fs::create_directories(root / ".clay");
+    progress("storing " + std::to_string(opts.timelineSnapshots) + " snapshots in " + root.string());
+
+    auto start = steady_clock::now();
+    {
+        clay::Storage storage(root.string());
+        if (!storage.init()) throw std::runtime_error("Failed to open storage in " + root.string());
+        storage.setMaxSnapshots(static_cast<int>(opts.timelineSnapshots) + 1);
+        storage.setDeltaHotWindow(315360000);
+
+        std::mt19937_64 rng(opts.tree.seed);
+        std::time_t base = std::time(nullptr) - static_cast<std::time_t>(opts.timelineSnapshots);
+        for (size_t i = 0; i < opts.timelineSnapshots; ++i) {
+            clay::Snapshot snapshot;
+            char id[32];
+            std::snprintf(id, sizeof(id), "bench%010zu", i);
+            snapshot.id = id;
+            snapshot.timestamp = base + static_cast<std::time_t>(i);
+            snapshot.autoSave = i % 4 != 0;
+            snapshot.message = "snapshot " + std::to_string(i);
+            snapshot.deltas.emplace_back("notes.txt", clay::FileDelta::MODIFY,
+                                         SyntheticTree::textContent(256, rng));
+            storage.store(snapshot);
+        }
+    }
+    double setup = secondsSince(start);
+
+    auto repo = clay::Repository::open(root.string(), clay::OpenMode::ReadOnly);
+    const int iterations = 5;
+    double best = 1e9, total = 0;
+    size_t count = 0;
+    for (int i = 0; i < iterations; ++i) {
+        start = steady_clock::now();
+        count = repo->timeline().size();
+        double elapsed = secondsSince(start);
+        best = std::min(best, elapsed);
+        total += elapsed;
+    }
+    results.push_back(Result("timeline")
+        .set("snapshots", static_cast<uint64_t>(count))
+        .set("iterations", static_cast<uint64_t>(iterations))
+        .set("seconds_mean", total / iterations)
+        .set("seconds_min", best)
+        .set("setup_seconds", setup));
+}
+
+// 一个大文本文件改动若干行后与上一快照比较
+void runDiffScenario(const Options& opts, const fs::path& root, std::vector<Result>& results) {
+    fs::create_directories(root);
+    std::mt19937_64 rng(opts.tree.seed);
+    auto content = SyntheticTree::textContent(opts.largeSize, rng);
+    auto write = [&] {
+        std::ofstream out(root / "large.txt", std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(content.data()), static_cast<std::streamsize>(content.size()));
+    };
+    write();
+
+    auto repo = clay::Repository::open(root.string(), clay::OpenMode::ReadWrite);
+    repo->takeSnapshot("large");
+
+    // 约每 1000 行改一行
+    size_t edits = std::max<size_t>(1, content.size() / 40000);
+    for (size_t i = 0; i < edits; ++i) {
+        size_t offset = rng() % content.size();
+        auto chunk = SyntheticTree::textContent(std::min<size_t>(32, content.size() - offset), rng);
+        std::copy(chunk.begin(), chunk.end(), content.begin() + offset);
+    }
+    write();
+    std::string id = repo->takeSnapshot("large edited");
+
+    struct CountingBuffer : std::streambuf {
+        uint64_t bytes = 0;
+        int overflow(int c) override { bytes++; return c; }
+        std::streamsize xsputn(const char*, std::streamsize n) override { bytes += n; return n; }
+    };
+    auto timeDiff = [&](bool statOnly, uint64_t& outBytes) {
+        CountingBuffer buffer;
+        std::ostream out(&buffer);
+        clay::DiffOptions options;
+        options.statOnly = statOnly;
+        auto start = steady_clock::now();
+        repo->diff(id, out, options);
+        outBytes = buffer.bytes;
+        return secondsSince(start);
+    };
+
+    uint64_t fullBytes = 0, statBytes = 0;
+    double full = timeDiff(false, fullBytes);
+    double stat = timeDiff(true, statBytes);
+    results.push_back(Result("diff_large")
+        .set("file_bytes", static_cast<uint64_t>(content.size()))
+        .set("edits", static_cast<uint64_t>(edits))
+        .set("seconds", full)
+        .set("output_bytes", fullBytes)
+        .set("stat_seconds", stat));
+}
+
+bool parseOptions(int argc, char** argv, Options& opts) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) throw std::runtime_error("Missing value for " + arg);
+            return argv[++i];
+        };
+        if (arg == "--files") opts.tree.files = std::stoull(value());
+        else if (arg == "--depth") opts.tree.depth = std::stoull(value());
+        else if (arg == "--fanout") opts.tree.fanout = std::stoull(value());
+        else if (arg == "--min-size") opts.tree.minSize = std::stoull(value());
+        else if (arg == "--max-size") opts.tree.maxSize = std::stoull(value());
+        else if (arg == "--binary-ratio") opts.tree.binaryRatio = std::stod(value());
+        else if (arg == "--seed") opts.tree.seed = std::stoull(value());
+        else if (arg == "--edit-ratio") opts.editRatio = std::stod(value());
+        else if (arg == "--edit-pattern") {
+            std::string name = value();
+            if (!clay::bench::parseEditPattern(name, opts.editPattern)) {
+                throw std::runtime_error("Unknown edit pattern: " + name);
+            }
+        }
+        else if (arg == "--rounds") opts.rounds = std::stoull(value());
+        else if (arg == "--rewind-steps") opts.rewindSteps = std::stoull(value());
+        else if (arg == "--timeline") opts.timelineSnapshots = std::stoull(value());
+        else if (arg == "--large-size") opts.largeSize = std::stoull(value());
+        else if (arg == "--memory-budget") opts.memoryBudget = std::stoull(value());
+        else if (arg == "--dir") opts.dir = value();
+        else if (arg == "--output") opts.output = value();
+        else if (arg == "--keep") opts.keep = true;
+        else if (!arg.empty() && arg[0] == '-') throw std::runtime_error("Unknown option: " + arg);
+        else {
+            bool known = false;
+            for (const char* name : kScenarios) known = known || arg == name;
+            if (!known) throw std::runtime_error("Unknown scenario: " + arg);
+            opts.scenarios.insert(arg);
+        }
+    }
+    if (opts.scenarios.empty()) opts.scenarios.insert(std::begin(kScenarios), std::end(kScenarios));
+    if (opts.largeSize == 0) opts.largeSize = 1;
+    return true;
+}
+
+void writeJson(std::ostream& out, const Options& opts, const std::vector<Result>& results) {
+    out << "{\"benchmark\":\"clay_bench\",\"version\":1"
+        << ",\"timestamp\":" << std::time(nullptr)
+        << ",\"config\":{"
+        << "\"seed\":" << opts.tree.seed
+        << ",\"files\":" << opts.tree.files
+        << ",\"depth\":" << opts.tree.depth
+        << ",\"fanout\":" << opts.tree.fanout
+        << ",\"min_size\":" << opts.tree.minSize
+        << ",\"max_size\":" << opts.tree.maxSize
+        << ",\"binary_ratio\":" << opts.tree.binaryRatio
+        << ",\"edit_ratio\":" << opts.editRatio
+        << ",\"edit_pattern\":" << jsonQuote(clay::bench::editPatternName(opts.editPattern))
+        << ",\"rounds\":" << opts.rounds
+        << ",\"rewind_steps\":" << opts.rewindSteps
+        << ",\"timeline_snapshots\":" << opts.timelineSnapshots
+        << ",\"large_size\":" << opts.largeSize
+        << ",\"memory_budget\":" << opts.memoryBudget
+        << "},\"results\":[";
+    for (size_t i = 0; i < results.size(); ++i) {
+        if (i) out << ",";
+        results[i].write(out);
+    }
+    auto memory = clay::MemoryBudget::instance().stats();
+    out << "],\"memory\":{\"peak_bytes\":" << memory.peak
+        << ",\"waits\":" << memory.waits
+        << ",\"spills\":" << memory.spills
+        << ",\"overruns\":" << memory.overruns << "}}" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opts;
+    try {
+        parseOptions(argc, argv, opts);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 2;
+    }
+
+    fs::path base = opts.dir.empty()
+        ? fs::temp_directory_path() / ("clay_bench." + std::to_string(getpid()))
+        : fs::path(opts.dir);
+    if (fs::exists(base) && !fs::is_empty(base)) {
+        std::cerr << base << " already exists and is not empty" << std::endl;
+        return 2;
+    }
+
+    NullBuffer discard;
+    std::streambuf* stdoutBuffer = std::cout.rdbuf(&discard);
+    std::ostream json(stdoutBuffer);
+
+    std::vector<Result> results;
+    int code = 0;
+    try {
+        auto want = [&](const char* name) { return opts.scenarios.count(name) > 0; };
+        if (want("first_snapshot") || want("incremental_snapshot") || want("undo") || want("rewind")) {
+            runWorkspaceScenarios(opts, base / "tree", results);
+        }
+        if (want("timeline")) runTimelineScenario(opts, base / "timeline", results);
+        if (want("diff_large")) runDiffScenario(opts, base / "large", results);
+    } catch (const std::exception& e) {
+        std::cerr << "clay_bench: " << e.what() << std::endl;
+        code = 1;
+    }
+
+    if (opts.output.empty()) {
+        writeJson(json, opts, results);
+    } else {
+        std::ofstream file(opts.output);
+        writeJson(file, opts, results);
+        if (!file) {
+            std::cerr << "Failed to write " << opts.output << std::endl;
+            code = 1;
+        }
+    }
+    std::cout.rdbuf(stdoutBuffer);
+
+    if (!opts.keep) {
+        std::error_code ec;
+        fs::remove_all(base, ec);
+    }
+    return code;
+}
@@ -0,0 +1,390 @@
+// 编辑风暴：在临时工作区中模拟编辑器保存（写临时文件再改名覆盖）、git checkout、
+// npm install 和构建产物翻动，测量监视器的事件丢失、从写入到回调的延迟和监视线程 CPU。
+// 结果为 JSON，格式与 clay_bench 一致。
+// 用法: edit_storm_bench [--seed N] [--scale X] [--settle-ms N] [--dir PATH]
+//                        [--daemon-pid PID] [--output FILE] [scenario ...]
+// --dir 指向由守护进程托管的工作区时，配合 --daemon-pid 可同时得到守护进程的 CPU 开销。
+#include "synthetic.hpp"
+#include "clay/json.hpp"
+#include "clay/metrics.hpp"
+#include "clay/watcher.hpp"
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace fs = std::filesystem;
+using namespace std::chrono;
+using clay::jsonQuote;
+
+namespace {
+
+struct Options {
+    uint64_t seed = 1;
+    double scale = 1.0; // 所有场景的文件数按比例缩放
+    int settleMs = 2000; // 最后一次写入后等待未到达事件的上限
+    std::string dir;
+    std::string output;
+    int daemonPid = 0;
+    std::set<std::string> scenarios;
+};
+
+const char* const kScenarios[] = {"editor_save", "git_checkout", "npm_install", "build_churn"};
+
+double cpuSecondsOfPid(int pid) {
+    std::ifstream stat("/proc/" + std::to_string(pid) + "/stat");
+    std::string content((std::istreambuf_iterator<char>(stat)), std::istreambuf_iterator<char>());
+    // comm 可能含空格，从最后一个 ')' 之后开始数字段：utime 和 stime 是第 14、15 个字段
+    size_t pos = content.rfind(')');
+    if (pos == std::string::npos) return 0;
+    std::istringstream fields(content.substr(pos + 2));
+    std::string skip;
+    for (int i = 3; i < 14; ++i) fields >> skip;
+    unsigned long long utime = 0, stime = 0;
+    fields >> utime >> stime;
+    return static_cast<double>(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+double threadCpuSeconds(clockid_t clock) {
+    timespec ts{};
+    if (clock_gettime(clock, &ts) != 0) return 0;
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 记录每次写入的时间和回调到达的时间，统计丢失与延迟
+class Recorder {
+public:
+    // 一个路径多次写入时从最早一次尚未被观察到的写入开始计时
+    void wrote(const std::string& path) {
+        auto now = steady_clock::now();
+        std::lock_guard<std::mutex> lock(mutex_);
+        expected_.insert(path);
+        pending_.emplace(path, now);
+        lastWrite_ = now;
+    }
+
+    void observed(const std::string& path) {
+        auto now = steady_clock::now();
+        if (!clockSet_.exchange(true)) {
+            pthread_getcpuclockid(pthread_self(), &watcherClock_);
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        events_++;
+        lastEvent_ = now;
+        seen_.insert(path);
+        auto it = pending_.find(path);
+        if (it != pending_.end()) {
+            latency_.record(now - it->second);
+            pending_.erase(it);
+        }
+        if (pending_.empty()) drained_.notify_all();
+    }
+
+    // 等到所有写入都被观察到，或超过 settle 仍没有新事件
+    void settle(milliseconds settle) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!pending_.empty()) {
+            auto last = std::max(lastWrite_, lastEvent_);
+            if (steady_clock::now() - last >= settle) break;
+            drained_.wait_until(lock, last + settle);
+        }
+    }
+
+    size_t expected() const { std::lock_guard<std::mutex> lock(mutex_); return expected_.size(); }
+    size_t lost() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t missing = 0;
+        for (const auto& path : expected_) missing += seen_.count(path) == 0;
+        return missing;
+    }
+    uint64_t events() const { std::lock_guard<std::mutex> lock(mutex_); return events_; }
+    steady_clock::time_point lastEvent() const { std::lock_guard<std::mutex> lock(mutex_); return lastEvent_; }
+    const clay::LatencyHistogram& latency() const { return latency_; }
+    double watcherCpu() const { return clockSet_ ? threadCpuSeconds(watcherClock_) : 0; }
+
+private:
+    mutable std::mutex mutex_;
+    std::condition_variable drained_;
+    std::unordered_set<std::string> expected_;
+    std::unordered_set<std::string> seen_;
+    std::unordered_map<std::string, steady_clock::time_point> pending_;
+    steady_clock::time_point lastWrite_{}, lastEvent_{};
+    uint64_t events_ = 0;
+    clay::LatencyHistogram latency_;
+    std::atomic<bool> clockSet_{false};
+    clockid_t watcherClock_{};
+};
+
+// 场景的文件操作；操作开始前把应当产生事件的路径交给 Recorder，事件可能比系统调用返回更早到达
+class Storm {
+public:
+    Storm(fs::path root, Recorder& recorder, uint64_t seed)
+        : root_(std::move(root)), recorder_(recorder), rng_(seed) {}
+
+    void write(const std::string& rel, size_t size) {
+        fs::path path = root_ / rel;
+        fs::create_directories(path.parent_path());
+        recorder_.wrote(path.string());
+        writeRaw(path, size);
+        operations_++;
+    }
+
+    // 编辑器的原子保存：写到同目录的临时文件，再改名覆盖目标
+    void saveViaRename(const std::string& rel, size_t size) {
+        fs::path target = root_ / rel;
+        fs::path temp = target.parent_path() / ("." + target.filename().string() + ".swp");
+        writeRaw(temp, size);
+        recorder_.wrote(target.string());
+        fs::rename(temp, target);
+        operations_++;
+    }
+
+    void remove(const std::string& rel) {
+        fs::path path = root_ / rel;
+        std::error_code ec;
+        if (!fs::exists(path, ec)) return;
+        recorder_.wrote(path.string());
+        fs::remove(path, ec);
+        operations_++;
+    }
+
+    std::mt19937_64& rng() { return rng_; }
+    uint64_t operations() const { return operations_; }
+    uint64_t bytes() const { return bytes_; }
+
+private:
+    void writeRaw(const fs::path& path, size_t size) {
+        auto content = clay::bench::SyntheticTree::textContent(size, rng_);
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(content.data()), static_cast<std::streamsize>(content.size()));
+        bytes_ += content.size();
+    }
+
+    fs::path root_;
+    Recorder& recorder_;
+    std::mt19937_64 rng_;
+    uint64_t operations_ = 0;
+    uint64_t bytes_ = 0;
+};
+
+size_t scaled(const Options& opts, size_t n) {
+    return std::max<size_t>(1, static_cast<size_t>(n * opts.scale));
+}
+
+std::string sourcePath(size_t i) {
+    return "src/m" + std::to_string(i % 16) + "/file" + std::to_string(i) + ".cpp";
+}
+
+// 初始文件在监视开始前写好，不计入结果
+void prepare(const std::string& scenario, const Options& opts, const fs::path& root) {
+    std::mt19937_64 rng(opts.seed);
+    auto put = [&](const std::string& rel, size_t size) {
+        fs::path path = root / rel;
+        fs::create_directories(path.parent_path());
+        auto content = clay::bench::SyntheticTree::textContent(size, rng);
+        std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(content.data()),
+                                                    static_cast<std::streamsize>(content.size()));
+    };
+    if (scenario == "editor_save") {
+        for (size_t i = 0; i < scaled(opts, 200); ++i) put(sourcePath(i), 4096);
+    } else if (scenario == "git_checkout") {
+        for (size_t i = 0; i < scaled(opts, 2000); ++i) put(sourcePath(i), 2048);
+    }
+    fs::create_directories(root);
+}
+
+void runStorm(const std::string& scenario, const Options& opts, Storm& storm) {
+    auto& rng = storm.rng();
+    if (scenario == "editor_save") {
+        // 每轮保存 10% 的文件，轮间稍作停顿
+        size_t files = scaled(opts, 200);
+        for (int round = 0; round < 20; ++round) {
+            for (size_t i = 0; i < std::max<size_t>(1, files / 10); ++i) {
+                storm.saveViaRename(sourcePath(rng() % files), 4096 + rng() % 512);
+            }
+            std::this_thread::sleep_for(milliseconds(5));
+        }
+    } else if (scenario == "git_checkout") {
+        // 切换分支：改写 30%，删除 5%，在新目录中新建 5%
+        size_t files = scaled(opts, 2000);
+        for (int checkout = 0; checkout < 5; ++checkout) {
+            for (size_t i = 0; i < files; ++i) {
+                uint64_t roll = rng() % 100;
+                if (roll < 30) storm.write(sourcePath(i), 2048 + rng() % 256);
+                else if (roll < 35) storm.remove(sourcePath(i));
+            }
+            for (size_t i = 0; i < files / 20; ++i) {
+                storm.write("src/branch" + std::to_string(checkout) + "/d" + std::to_string(i % 8) +
+                            "/new" + std::to_string(i) + ".cpp", 1024);
+            }
+        }
+    } else if (scenario == "npm_install") {
+        // 一次性建出深层的新目录树，新目录的监视总是在文件写入之后才加上
+        size_t packages = scaled(opts, 200);
+        for (size_t p = 0; p < packages; ++p) {
+            std::string pkg = "node_modules/pkg" + std::to_string(p) + "/";
+            storm.write(pkg + "package.json", 512);
+            for (int f = 0; f < 6; ++f) storm.write(pkg + "lib/f" + std::to_string(f) + ".js", 1024 + rng() % 4096);
+            for (int f = 0; f < 6; ++f) storm.write(pkg + "dist/esm/f" + std::to_string(f) + ".mjs", 2048);
+            for (int f = 0; f < 4; ++f) storm.write(pkg + "node_modules/dep/f" + std::to_string(f) + ".js", 512);
+        }
+    } else if (scenario == "build_churn") {
+        // 反复生成并清理目标文件
+        size_t objects = scaled(opts, 500);
+        for (int round = 0; round < 5; ++round) {
+            for (size_t i = 0; i < objects; ++i) {
+                storm.write("build/obj/m" + std::to_string(i % 10) + "/o" + std::to_string(i) + ".o", 8192);
+            }
+            storm.write("build/app", 256 * 1024);
+            for (size_t i = 0; i < objects; i += 2) {
+                storm.remove("build/obj/m" + std::to_string(i % 10) + "/o" + std::to_string(i) + ".o");
+            }
+        }
+    }
+}
+
+std::string runScenario(const std::string& scenario, const Options& opts, const fs::path& base) {
+    fs::path root = base / scenario;
+    prepare(scenario, opts, root);
+
+    Recorder recorder;
+    clay::Watcher watcher(root.string(), {}, [&recorder](const std::string& path, bool isDir) {
+        if (!isDir) recorder.observed(path);
+    });
+    watcher.start();
+    // 等待监视线程完成初始的目录注册
+    for (int i = 0; i < 200 && watcher.stats().watches == 0; ++i) std::this_thread::sleep_for(milliseconds(5));
+    std::this_thread::sleep_for(milliseconds(50));
+
+    double daemonCpuBefore = opts.daemonPid ? cpuSecondsOfPid(opts.daemonPid) : 0;
+    Storm storm(root, recorder, opts.seed);
+    std::cerr << "[edit_storm] " << scenario << std::endl;
+    auto start = steady_clock::now();
+    runStorm(scenario, opts, storm);
+    double generateSeconds = duration<double>(steady_clock::now() - start).count();
+    recorder.settle(milliseconds(opts.settleMs));
+
+    auto lastEvent = recorder.lastEvent();
+    double activeSeconds = duration<double>(std::max(lastEvent, start) - start).count();
+    double watcherCpu = recorder.watcherCpu();
+    double daemonCpu = opts.daemonPid ? cpuSecondsOfPid(opts.daemonPid) - daemonCpuBefore : 0;
+    auto stats = watcher.stats();
+    watcher.stop();
+
+    const auto& latency = recorder.latency();
+    std::ostringstream out;
+    out << "{\"scenario\":" << jsonQuote(scenario)
+        << ",\"operations\":" << storm.operations()
+        << ",\"bytes_written\":" << storm.bytes()
+        << ",\"generate_seconds\":" << generateSeconds
+        << ",\"expected_paths\":" << recorder.expected()
+        << ",\"lost_paths\":" << recorder.lost()
+        << ",\"events\":" << recorder.events()
+        << ",\"events_per_second\":" << (activeSeconds > 0 ? recorder.events() / activeSeconds : 0)
+        << ",\"overflows\":" << stats.overflows
+        << ",\"watches\":" << stats.watches
+        << ",\"latency_us_mean\":" << latency.meanMicros()
+        << ",\"latency_us_p50\":" << latency.percentileMicros(0.50)
+        << ",\"latency_us_p99\":" << latency.percentileMicros(0.99)
+        << ",\"latency_us_max\":" << latency.maxMicros()
+        << ",\"watcher_cpu_seconds\":" << watcherCpu;
+    if (opts.daemonPid) out << ",\"daemon_cpu_seconds\":" << daemonCpu;
+    out << "}";
+    return out.str();
+}
+
+void parseOptions(int argc, char** argv, Options& opts) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) throw std::runtime_error("Missing value for " + arg);
+            return argv[++i];
+        };
+        if (arg == "--seed") opts.seed = std::stoull(value());
+        else if (arg == "--scale") opts.scale = std::stod(value());
+        else if (arg == "--settle-ms") opts.settleMs = std::stoi(value());
+        else if (arg == "--dir") opts.dir = value();
+        else if (arg == "--daemon-pid") opts.daemonPid = std::stoi(value());
+        else if (arg == "--output") opts.output = value();
+        else if (!arg.empty() && arg[0] == '-') throw std::runtime_error("Unknown option: " + arg);
+        else {
+            if (std::find(std::begin(kScenarios), std::end(kScenarios), arg) == std::end(kScenarios)) {
+                throw std::runtime_error("Unknown scenario: " + arg);
+            }
+            opts.scenarios.insert(arg);
+        }
+    }
+    if (opts.scenarios.empty()) opts.scenarios.insert(std::begin(kScenarios), std::end(kScenarios));
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options opts;
+    try {
+        parseOptions(argc, argv, opts);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 2;
+    }
+
+    bool temporary = opts.dir.empty();
+    fs::path base = temporary
+        ? fs::temp_directory_path() / ("clay_edit_storm." + std::to_string(getpid()))
+        : fs::path(opts.dir) / "edit_storm";
+    if (fs::exists(base)) {
+        std::cerr << base << " already exists" << std::endl;
+        return 2;
+    }
+
+    std::vector<std::string> results;
+    int code = 0;
+    try {
+        for (const char* scenario : kScenarios) {
+            if (opts.scenarios.count(scenario)) results.push_back(runScenario(scenario, opts, base));
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "edit_storm_bench: " << e.what() << std::endl;
+        code = 1;
+    }
+
+    std::ostringstream json;
+    json << "{\"benchmark\":\"edit_storm\",\"version\":1"
+         << ",\"timestamp\":" << std::time(nullptr)
+         << ",\"config\":{\"seed\":" << opts.seed << ",\"scale\":" << opts.scale
+         << ",\"settle_ms\":" << opts.settleMs << "},\"results\":[";
+    for (size_t i = 0; i < results.size(); ++i) json << (i ? "," : "") << results[i];
+    json << "]}\n";
+
+    if (opts.output.empty()) {
+        std::cout << json.str();
+    } else {
+        std::ofstream file(opts.output);
+        file << json.str();
+        if (!file) {
+            std::cerr << "Failed to write " << opts.output << std::endl;
+            code = 1;
+        }
+    }
+
+    std::error_code ec;
+    fs::remove_all(base, ec);
+    return code;
+}
@@ -0,0 +1,125 @@
+// 内容哈希的自检与吞吐量测试
+// 用法: hash_bench [最大输入字节数]
+#include "clay/hash.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono;
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const char* what) {
+    if (!ok) {
+        std::fprintf(stderr, "FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+// 官方测试向量的输入：第 i 个字节为 i % 251
+std::vector<uint8_t> vectorInput(size_t size) {
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; ++i) data[i] = static_cast<uint8_t>(i % 251);
+    return data;
+}
+
+void selfTest() {
+    struct Known {
+        size_t size;
+        uint64_t xxh3;
+        const char* blake3;
+    };
+    // XXH3 的值来自 libxxhash 0.8，BLAKE3 的值来自官方 test_vectors.json
+    const Known known[] = {
+        {0, 0x2d06800538d394c2ULL, "af1349b9f5f9a1a6a0404dea36dcc9499bcb25c9adc112b7cc9a93cae41f3262"},
+        {1, 0xc44bdff4074eecdbULL, "2d3adedff11b61f14c886e35afa036736dcd87a74d27b5c1510225d0f592e213"},
+        {1023, 0xd3d91d80ac495685ULL, "10108970eeda3eb932baac1428c7a2163b0e924c9a9e25b35bba72b28f70bd11"},
+        {1024, 0xe5d78bafa45b2aa5ULL, "42214739f095a406f3fc83deb889744ac00df831c10daa55189b5d121c855af7"},
+        {1025, 0xe95c42288f28186eULL, "d00278ae47eb27b34faecf67b4fe263f82d5412916c1ffd97c8cb7fb814b8444"},
+        {2048, 0x25339063db861586ULL, "e776b6028c7cd22a4d0ba182a8bf62205d2ef576467e838ed6f2529b85fba24a"},
+        {102400, 0x1428e17f1cac2837ULL, "bc3e3d41a1146b069abffad3c0d44860cf664390afce4d9661f7902e7943e085"},
+    };
+    for (const auto& k : known) {
+        auto data = vectorInput(k.size);
+        std::string label = std::to_string(k.size) + " bytes";
+        check(clay::fastHash(data.data(), data.size()) == k.xxh3, ("xxh3 " + label).c_str());
+        check(clay::fastHashScalar(data.data(), data.size()) == k.xxh3, ("xxh3 scalar " + label).c_str());
+        check(clay::strongHash(data.data(), data.size(), 1).hex() == k.blake3, ("blake3 " + label).c_str());
+    }
+
+    // 各长度区间的边界上，分派实现与标量实现一致；并行与串行一致
+    std::mt19937_64 rng(42);
+    std::vector<uint8_t> data(1 << 16);
+    for (auto& b : data) b = static_cast<uint8_t>(rng());
+    for (size_t size = 0; size <= 4096; ++size) {
+        if (clay::fastHash(data.data(), size) != clay::fastHashScalar(data.data(), size)) {
+            check(false, ("dispatch vs scalar at " + std::to_string(size)).c_str());
+            break;
+        }
+    }
+    auto large = vectorInput(3 * clay::kParallelHashThreshold + 12345);
+    check(clay::strongHash(large.data(), large.size(), 1) == clay::strongHash(large.data(), large.size(), 8),
+          "blake3 parallel vs serial");
+}
+
+template <typename Fn>
+double throughput(const std::vector<uint8_t>& data, size_t size, Fn fn) {
+    // 小输入在 256 KiB 的工作集内循环，测的是哈希本身而不是内存带宽；至少跑 0.2 秒或 64 MiB
+    size_t span = std::min(data.size(), std::max(size, size_t(256) << 10));
+    size_t bytes = 0;
+    uint64_t sink = 0;
+    auto started = steady_clock::now();
+    double elapsed = 0;
+    do {
+        for (size_t offset = 0; offset + size <= span; offset += size) {
+            sink += fn(data.data() + offset, size);
+            bytes += size;
+        }
+        elapsed = duration<double>(steady_clock::now() - started).count();
+    } while (elapsed < 0.2 || bytes < (64u << 20));
+    if (sink == 42) std::printf(" ");
+    return bytes / elapsed / 1e9;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t maxSize = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : (64u << 20);
+
+    selfTest();
+
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    std::printf("fast hash implementation: %s, %u hardware threads\n",
+                clay::fastHashImplementation(), threads);
+    std::printf("%12s %12s %12s %12s %12s\n", "size", "xxh3", "xxh3-scalar", "blake3", "blake3-par");
+
+    std::vector<uint8_t> data(maxSize);
+    std::mt19937_64 rng(1);
+    for (auto& b : data) b = static_cast<uint8_t>(rng());
+
+    for (size_t size = 64; size <= maxSize; size *= 16) {
+        double fast = throughput(data, size, [](const uint8_t* p, size_t n) { return clay::fastHash(p, n); });
+        double scalar = throughput(data, size, [](const uint8_t* p, size_t n) { return clay::fastHashScalar(p, n); });
+        double strong = throughput(data, size, [](const uint8_t* p, size_t n) {
+            return uint64_t(clay::strongHash(p, n, 1).bytes[0]);
+        });
+        double parallel = throughput(data, size, [](const uint8_t* p, size_t n) {
+            return uint64_t(clay::strongHash(p, n).bytes[0]);
+        });
+        std::printf("%12zu %9.2f GB/s %7.2f GB/s %7.2f GB/s %7.2f GB/s\n", size, fast, scalar, strong, parallel);
+    }
+
+    if (failures) {
+        std::fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
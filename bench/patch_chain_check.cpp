@@ -0,0 +1,122 @@
+// 补丁链随机检查：随机生成 1-6 个版本的编辑链，逐个 bspatch 校验单个补丁，
+// 再用 applyPatchChain 的 vector 和 fd 两种输出校验一次遍历的结果。
+// 配合 -fsanitize=address,undefined 构建可检查越界读写。
+// 用法: patch_chain_check [轮数] [种子]
+#include "clay/delta.hpp"
+#include "bspatch.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace clay;
+
+namespace {
+
+using Bytes = std::vector<uint8_t>;
+
+struct PatchReader {
+    const Bytes* patch;
+    size_t offset = 0;
+};
+
+int readPatch(const struct bspatch_stream* stream, void* buffer, int length) {
+    auto* reader = static_cast<PatchReader*>(stream->opaque);
+    if (reader->offset + static_cast<size_t>(length) > reader->patch->size()) return -1;
+    std::memcpy(buffer, reader->patch->data() + reader->offset, static_cast<size_t>(length));
+    reader->offset += static_cast<size_t>(length);
+    return 0;
+}
+
+// 小字母表让 bsdiff 找到较多匹配；偶尔生成超过一个输出块的版本
+Bytes randomVersion(std::mt19937_64& rng) {
+    size_t size = rng() % 8 == 0 ? BSPATCH_CHUNK_SIZE + rng() % BSPATCH_CHUNK_SIZE : rng() % 5000;
+    Bytes data(size);
+    for (auto& b : data) b = static_cast<uint8_t>('a' + rng() % 4);
+    return data;
+}
+
+Bytes edit(Bytes data, std::mt19937_64& rng) {
+    int edits = static_cast<int>(rng() % 30);
+    for (int i = 0; i < edits; ++i) {
+        size_t pos = data.empty() ? 0 : rng() % data.size();
+        switch (rng() % 4) {
+        case 0:
+            if (!data.empty()) data[pos] ^= 1;
+            break;
+        case 1:
+            data.insert(data.begin() + pos, 1 + rng() % 64, static_cast<uint8_t>(rng()));
+            break;
+        case 2:
+            if (!data.empty()) data.erase(data.begin() + pos, data.begin() + std::min(data.size(), pos + 1 + rng() % 64));
+            break;
+        default:
+            data.resize(rng() % (data.size() + 100), 7);
+            break;
+        }
+    }
+    return data;
+}
+
+bool readBack(FILE* file, Bytes& out) {
+    long size = ftell(file);
+    if (size < 0) return false;
+    out.resize(static_cast<size_t>(size));
+    rewind(file);
+    return out.empty() || fread(out.data(), 1, out.size(), file) == out.size();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int rounds = argc > 1 ? std::atoi(argv[1]) : 500;
+    std::mt19937_64 rng(argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1);
+
+    for (int round = 0; round < rounds; ++round) {
+        std::vector<Bytes> versions{randomVersion(rng)};
+        int length = 1 + static_cast<int>(rng() % 6);
+        for (int i = 0; i < length; ++i) versions.push_back(edit(versions.back(), rng));
+
+        std::vector<Bytes> patches(length);
+        for (int i = 0; i < length; ++i) {
+            if (!makePatch(versions[i], versions[i + 1], patches[i])) {
+                std::printf("round %d: makePatch failed\n", round);
+                return 1;
+            }
+            Bytes out(versions[i + 1].size());
+            PatchReader reader{&patches[i]};
+            struct bspatch_stream stream = {&reader, readPatch};
+            static uint8_t empty = 0;
+            if (bspatch(versions[i].empty() ? &empty : versions[i].data(), static_cast<int64_t>(versions[i].size()),
+                        out.empty() ? &empty : out.data(), static_cast<int64_t>(out.size()), &stream) != 0 ||
+                out != versions[i + 1]) {
+                std::printf("round %d: bspatch mismatch at step %d\n", round, i);
+                return 1;
+            }
+        }
+
+        std::vector<ByteView> views(patches.begin(), patches.end());
+        Bytes out;
+        if (!applyPatchChain(versions[0], views, out) || out != versions.back()) {
+            std::printf("round %d: chain mismatch (vector)\n", round);
+            return 1;
+        }
+
+        FILE* file = tmpfile();
+        if (!file) {
+            std::perror("tmpfile");
+            return 1;
+        }
+        bool ok = applyPatchChain(versions[0], views, fileno(file));
+        fseek(file, 0, SEEK_END);
+        ok = ok && readBack(file, out) && out == versions.back();
+        fclose(file);
+        if (!ok) {
+            std::printf("round %d: chain mismatch (fd)\n", round);
+            return 1;
+        }
+    }
+    std::printf("ok: %d rounds\n", rounds);
+    return 0;
+}
@@ -0,0 +1,296 @@
+// 守护进程协议的模糊测试与吞吐量测试
+// 用法: protocol_bench [请求数] [每个响应字节数] [流水线窗口]
+#include "clay/protocol.hpp"
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace clay::protocol;
+using namespace std::chrono;
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const char* what) {
+    if (!ok) {
+        std::fprintf(stderr, "FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+std::vector<Arg> randomArgs(std::mt19937_64& rng) {
+    std::vector<Arg> args;
+    size_t count = rng() % 8;
+    for (size_t i = 0; i < count; ++i) {
+        if (rng() % 4 == 0) {
+            args.push_back(Arg::integer(static_cast<int64_t>(rng())));
+        } else {
+            // 包含空格、NUL 和任意字节
+            std::string s(rng() % 64, '\0');
+            for (auto& c : s) c = static_cast<char>(rng() % 4 == 0 ? ' ' : rng());
+            args.push_back(Arg::string(std::move(s)));
+        }
+    }
+    return args;
+}
+
+// 模拟守护进程的增量解析：输入按任意边界到达
+struct StreamParser {
+    std::string in;
+    size_t messages = 0;
+    size_t rejected = 0;
+    bool desynced = false;
+
+    void feed(const char* data, size_t len) {
+        in.append(data, len);
+        size_t pos = 0;
+        while (!desynced && in.size() - pos >= kHeaderSize) {
+            Header header;
+            Status status = parseHeader(in.data() + pos, header);
+            if (status == STATUS_BAD_REQUEST) {
+                desynced = true;
+                break;
+            }
+            if (in.size() - pos - kHeaderSize < header.length) break;
+
+            std::vector<Arg> args;
+            if (status != STATUS_OK || header.type != MSG_REQUEST ||
+                !decodeArgs(in.data() + pos + kHeaderSize, header.length, args)) {
+                rejected++;
+            }
+            messages++;
+            pos += kHeaderSize + header.length;
+        }
+        in.erase(0, pos);
+    }
+};
+
+void fuzz(size_t iterations) {
+    std::mt19937_64 rng(42);
+    size_t rejected = 0, desynced = 0;
+    auto start = steady_clock::now();
+
+    for (size_t i = 0; i < iterations; ++i) {
+        // 往返：编码后解码必须得到相同参数
+        std::vector<Arg> args = randomArgs(rng);
+        std::string payload = encodeArgs(args);
+        std::vector<Arg> decoded;
+        check(decodeArgs(payload.data(), payload.size(), decoded) && decoded == args, "args round trip");
+
+        std::string stream;
+        size_t sent = 1 + rng() % 4;
+        for (size_t m = 0; m < sent; ++m) {
+            stream += encodeMessage(MSG_REQUEST, static_cast<uint32_t>(m), payload.data(),
+                                    static_cast<uint32_t>(payload.size()));
+        }
+
+        // 正常流按随机边界切分，必须完整解析
+        StreamParser clean;
+        for (size_t pos = 0; pos < stream.size();) {
+            size_t n = std::min<size_t>(1 + rng() % 32, stream.size() - pos);
+            clean.feed(stream.data() + pos, n);
+            pos += n;
+        }
+        check(clean.messages == sent && clean.rejected == 0 && clean.in.empty(), "chunked stream parse");
+
+        // 变异：翻转字节、截断、插入垃圾；只要求不崩溃、不越界
+        std::string mutated = stream;
+        size_t edits = 1 + rng() % 4;
+        for (size_t e = 0; e < edits && !mutated.empty(); ++e) {
+            size_t pos = rng() % mutated.size();
+            switch (rng() % 3) {
+            case 0: mutated[pos] = static_cast<char>(rng()); break;
+            case 1: mutated.resize(pos); break;
+            default: mutated.insert(pos, std::string(1 + rng() % 8, static_cast<char>(rng()))); break;
+            }
+        }
+        StreamParser fuzzed;
+        fuzzed.feed(mutated.data(), mutated.size());
+        rejected += fuzzed.rejected;
+        desynced += fuzzed.desynced;
+
+        std::vector<Arg> ignored;
+        decodeArgs(mutated.data(), mutated.size(), ignored);
+
+        // 批量请求：往返一致，变异后解码不越界
+        std::vector<std::vector<Arg>> commands;
+        size_t count = rng() % 5;
+        for (size_t c = 0; c < count; ++c) {
+            commands.push_back(randomArgs(rng));
+            if (commands.back().empty()) commands.back().push_back(Arg::string("timeline"));
+        }
+        std::string batch = encodeBatch("/ws", commands);
+        std::string workspace;
+        std::vector<std::vector<Arg>> decodedBatch;
+        check(decodeBatch(batch.data(), batch.size(), workspace, decodedBatch) &&
+              workspace == "/ws" && decodedBatch == commands, "batch round trip");
+        if (!batch.empty()) {
+            batch[rng() % batch.size()] = static_cast<char>(rng());
+            batch.resize(rng() % (batch.size() + 1));
+        }
+        decodeBatch(batch.data(), batch.size(), workspace, decodedBatch);
+    }
+
+    double ms = duration<double, std::milli>(steady_clock::now() - start).count();
+    std::printf("fuzz: %zu iterations in %.0f ms, %zu rejected requests, %zu desynced streams\n",
+                iterations, ms, rejected, desynced);
+}
+
+// 服务端：多个线程并发处理同一连接上的请求，响应乱序写回
+void serve(int fd, size_t responseBytes) {
+    std::mutex writeMutex;
+    std::mutex queueMutex;
+    std::condition_variable queueCv;
+    std::deque<uint32_t> queue;
+    bool done = false;
+
+    auto sink = [&](std::string frame) {
+        std::lock_guard<std::mutex> lock(writeMutex);
+        return writeAll(fd, frame.data(), frame.size());
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < 4; ++i) {
+        workers.emplace_back([&] {
+            std::string chunk(responseBytes, 'x');
+            for (;;) {
+                uint32_t id;
+                {
+                    std::unique_lock<std::mutex> lock(queueMutex);
+                    queueCv.wait(lock, [&] { return done || !queue.empty(); });
+                    if (queue.empty()) return;
+                    id = queue.front();
+                    queue.pop_front();
+                }
+                FrameWriter writer(sink, id);
+                std::ostream out(&writer);
+                out.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+                writer.finish(0);
+            }
+        });
+    }
+
+    Header header;
+    std::string payload;
+    std::vector<Arg> args;
+    while (readMessage(fd, header, payload)) {
+        if (!decodeArgs(payload.data(), payload.size(), args)) break;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            queue.push_back(header.requestId);
+        }
+        queueCv.notify_one();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        done = true;
+    }
+    queueCv.notify_all();
+    for (auto& t : workers) t.join();
+    shutdown(fd, SHUT_WR);
+}
+
+void throughput(size_t requests, size_t responseBytes, size_t window) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        perror("socketpair");
+        failures++;
+        return;
+    }
+
+    std::thread server(serve, fds[1], responseBytes);
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t outstanding = 0;
+
+    auto start = steady_clock::now();
+
+    // 发送线程：保持最多 window 个未完成请求
+    std::thread sender([&] {
+        std::string payload = encodeArgs({Arg::string("diff"), Arg::string("2024-01-01 12:00"), Arg::integer(7)});
+        for (size_t i = 0; i < requests; ++i) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&] { return outstanding < window; });
+                outstanding++;
+            }
+            if (!writeMessage(fds[0], MSG_REQUEST, static_cast<uint32_t>(i), payload.data(),
+                              static_cast<uint32_t>(payload.size()))) {
+                break;
+            }
+        }
+        shutdown(fds[0], SHUT_WR);
+    });
+
+    std::unordered_map<uint32_t, size_t> received;
+    size_t completed = 0, outOfOrder = 0, bytes = 0;
+    uint32_t lastCompleted = 0;
+    Header header;
+    std::string payload;
+
+    while (completed < requests && readMessage(fds[0], header, payload)) {
+        if (header.type == MSG_DATA) {
+            received[header.requestId] += payload.size();
+            bytes += payload.size();
+        } else if (header.type == MSG_END) {
+            uint32_t status;
+            int code;
+            check(decodeEnd(payload, status, code) && status == STATUS_OK, "end status");
+            check(received[header.requestId] == responseBytes, "response size");
+            received.erase(header.requestId);
+
+            if (completed > 0 && header.requestId < lastCompleted) outOfOrder++;
+            lastCompleted = header.requestId;
+            completed++;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                outstanding--;
+            }
+            cv.notify_one();
+        }
+    }
+
+    double secs = duration<double>(steady_clock::now() - start).count();
+    sender.join();
+    close(fds[0]);
+    server.join();
+    close(fds[1]);
+
+    check(completed == requests, "all requests completed");
+    std::printf("throughput: %zu requests x %zu bytes, window %zu: %.0f req/s, %.1f MB/s, %zu out of order\n",
+                completed, responseBytes, window, completed / secs, bytes / secs / (1024.0 * 1024.0), outOfOrder);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t requests = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20000;
+    size_t responseBytes = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 4096;
+    size_t window = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 32;
+
+    fuzz(20000);
+    throughput(requests, responseBytes, 1);
+    throughput(requests, responseBytes, window);
+    throughput(requests / 10, 256 * 1024, window);
+
+    if (failures) {
+        std::fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
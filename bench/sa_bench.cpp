@@ -0,0 +1,141 @@
+// 比较 bsdiff 的两种后缀数组构造：qsufsort 与 SA-IS
+// 用法: bsdiff_sa_bench [大小MB ...]
+#include "bsdiff.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std::chrono;
+
+namespace {
+
+struct Workload {
+    std::string name;
+    std::vector<uint8_t> data;
+};
+
+std::vector<uint8_t> randomBytes(size_t size, std::mt19937_64& rng) {
+    std::vector<uint8_t> data(size);
+    for (auto& b : data) b = static_cast<uint8_t>(rng());
+    return data;
+}
+
+// 类似源码的文本：有限词表随机拼接成行
+std::vector<uint8_t> sourceLike(size_t size, std::mt19937_64& rng) {
+    static const char* words[] = {
+        "int", "return", "const", "std::string", "auto", "for", "if", "else",
+        "{", "}", "(", ")", ";", "clay", "snapshot", "delta", "path", "size",
+    };
+    std::vector<uint8_t> data;
+    data.reserve(size);
+    while (data.size() < size) {
+        int n = 1 + static_cast<int>(rng() % 10);
+        for (int i = 0; i < n && data.size() < size; ++i) {
+            const char* w = words[rng() % (sizeof(words) / sizeof(words[0]))];
+            data.insert(data.end(), w, w + std::strlen(w));
+            data.push_back(' ');
+        }
+        data.push_back('\n');
+    }
+    data.resize(size);
+    return data;
+}
+
+// 长重复段是 qsufsort 的最坏情况之一
+std::vector<uint8_t> repetitive(size_t size, std::mt19937_64& rng) {
+    std::vector<uint8_t> block = randomBytes(4096, rng);
+    std::vector<uint8_t> data(size);
+    for (size_t i = 0; i < size; ++i) data[i] = block[i % block.size()];
+    return data;
+}
+
+std::vector<uint8_t> mutate(const std::vector<uint8_t>& data, std::mt19937_64& rng) {
+    std::vector<uint8_t> out = data;
+    size_t edits = 1 + data.size() / 4096;
+    for (size_t i = 0; i < edits && !out.empty(); ++i) {
+        size_t pos = rng() % out.size();
+        switch (rng() % 3) {
+            case 0: out[pos] ^= 0x5a; break;
+            case 1: out.insert(out.begin() + pos, static_cast<uint8_t>(rng())); break;
+            default: out.erase(out.begin() + pos); break;
+        }
+    }
+    return out;
+}
+
+int collectWrite(struct bsdiff_stream* stream, const void* buffer, int size) {
+    auto* out = static_cast<std::vector<uint8_t>*>(stream->opaque);
+    const uint8_t* p = static_cast<const uint8_t*>(buffer);
+    out->insert(out->end(), p, p + size);
+    return 0;
+}
+
+template <typename F>
+double timeMs(F&& f) {
+    auto start = steady_clock::now();
+    f();
+    return duration<double, std::milli>(steady_clock::now() - start).count();
+}
+
+bool run(const Workload& w, std::mt19937_64& rng) {
+    const int64_t n = static_cast<int64_t>(w.data.size());
+    struct bsdiff_stream stream;
+    stream.malloc = std::malloc;
+    stream.free = std::free;
+    stream.write = collectWrite;
+
+    std::vector<int64_t> I64(n + 1);
+    std::vector<int32_t> I32(n + 1);
+    int rc64 = 0, rc32 = 0;
+    double qsufMs = timeMs([&] { rc64 = bsdiff_qsufsort(w.data.data(), n, I64.data(), &stream); });
+    double saisMs = timeMs([&] { rc32 = bsdiff_sais(w.data.data(), n, I32.data(), &stream); });
+
+    bool same = rc64 == 0 && rc32 == 0;
+    for (int64_t i = 0; same && i <= n; ++i) same = I64[i] == I32[i];
+
+    // 完整 bsdiff：补丁必须逐字节一致
+    std::vector<uint8_t> next = mutate(w.data, rng);
+    std::vector<uint8_t> patchQ, patchS;
+    stream.opaque = &patchQ;
+    double diffQMs = timeMs([&] {
+        bsdiff_ex(w.data.data(), n, next.data(), static_cast<int64_t>(next.size()), &stream, BSDIFF_SA_QSUFSORT);
+    });
+    stream.opaque = &patchS;
+    double diffSMs = timeMs([&] {
+        bsdiff_ex(w.data.data(), n, next.data(), static_cast<int64_t>(next.size()), &stream, BSDIFF_SA_SAIS);
+    });
+    same = same && patchQ == patchS;
+
+    std::printf("%-14s %10.1f %10.1f %7.2fx %10.1f %10.1f %8s\n",
+                w.name.c_str(), qsufMs, saisMs, saisMs > 0 ? qsufMs / saisMs : 0.0,
+                diffQMs, diffSMs, same ? "yes" : "NO");
+    return same;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::vector<size_t> sizesMb;
+    for (int i = 1; i < argc; ++i) sizesMb.push_back(std::strtoul(argv[i], nullptr, 10));
+    if (sizesMb.empty()) sizesMb = {1, 8};
+
+    std::mt19937_64 rng(42);
+    std::printf("%-14s %10s %10s %8s %10s %10s %8s\n",
+                "workload", "qsufsort", "sa-is", "speedup", "diff(q)", "diff(sais)", "match");
+    std::printf("%-14s %10s %10s %8s %10s %10s %8s\n",
+                "", "ms", "ms", "", "ms", "ms", "");
+
+    bool ok = true;
+    for (size_t mb : sizesMb) {
+        size_t size = mb * 1024 * 1024;
+        std::string suffix = "-" + std::to_string(mb) + "MB";
+        ok &= run({"random" + suffix, randomBytes(size, rng)}, rng);
+        ok &= run({"source" + suffix, sourceLike(size, rng)}, rng);
+        ok &= run({"repeat" + suffix, repetitive(size, rng)}, rng);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+#include "synthetic.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+namespace clay::bench {
+
+bool parseEditPattern(const std::string& name, EditPattern& pattern) {
+    if (name == "append") pattern = EditPattern::Append;
+    else if (name == "modify") pattern = EditPattern::Modify;
+    else if (name == "mixed") pattern = EditPattern::Mixed;
+    else return false;
+    return true;
+}
+
+const char* editPatternName(EditPattern pattern) {
+    switch (pattern) {
+        case EditPattern::Append: return "append";
+        case EditPattern::Modify: return "modify";
+        case EditPattern::Mixed: return "mixed";
+    }
+    return "unknown";
+}
+
+SyntheticTree::SyntheticTree(std::string root, TreeSpec spec)
+    : root_(std::move(root)), spec_(spec), rng_(spec.seed) {
+    if (spec_.minSize > spec_.maxSize) std::swap(spec_.minSize, spec_.maxSize);
+    if (spec_.minSize == 0) spec_.minSize = 1;
+    if (spec_.fanout == 0) spec_.fanout = 1;
+}
+
+std::vector<uint8_t> SyntheticTree::textContent(size_t size, std::mt19937_64& rng) {
+    static const char* words[] = {
+        "int", "return", "const", "std::string", "auto", "for", "if", "else",
+        "{", "}", "(", ")", ";", "clay", "snapshot", "delta", "path", "size",
+    };
+    std::vector<uint8_t> data;
+    data.reserve(size);
+    while (data.size() < size) {
+        int n = 1 + static_cast<int>(rng() % 10);
+        for (int i = 0; i < n && data.size() < size; ++i) {
+            const char* w = words[rng() % (sizeof(words) / sizeof(words[0]))];
+            data.insert(data.end(), w, w + std::strlen(w));
+            data.push_back(' ');
+        }
+        data.push_back('\n');
+    }
+    data.resize(size);
+    return data;
+}
+
+std::vector<uint8_t> SyntheticTree::binaryContent(size_t size, std::mt19937_64& rng) {
+    std::vector<uint8_t> data(size);
+    for (auto& b : data) b = static_cast<uint8_t>(rng());
+    return data;
+}
+
+std::string SyntheticTree::randomPath() {
+    std::string path;
+    size_t depth = spec_.depth ? rng_() % (spec_.depth + 1) : 0;
+    for (size_t d = 0; d < depth; ++d) {
+        path += "d" + std::to_string(rng_() % spec_.fanout) + "/";
+    }
+    bool binary = std::uniform_real_distribution<double>(0, 1)(rng_) < spec_.binaryRatio;
+    path += "f" + std::to_string(nextId_++) + (binary ? ".bin" : ".txt");
+    return path;
+}
+
+size_t SyntheticTree::randomSize() {
+    double lo = std::log(static_cast<double>(spec_.minSize));
+    double hi = std::log(static_cast<double>(spec_.maxSize));
+    double size = std::exp(std::uniform_real_distribution<double>(lo, hi)(rng_));
+    return std::clamp(static_cast<size_t>(size), spec_.minSize, spec_.maxSize);
+}
+
+std::vector<uint8_t> SyntheticTree::randomContent(const std::string& path, size_t size) {
+    bool binary = path.size() > 4 && path.compare(path.size() - 4, 4, ".bin") == 0;
+    return binary ? binaryContent(size, rng_) : textContent(size, rng_);
+}
+
+uint64_t SyntheticTree::writeFile(const std::string& path, const std::vector<uint8_t>& content) {
+    fs::path full = fs::path(root_) / path;
+    fs::create_directories(full.parent_path());
+    std::ofstream out(full, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(content.data()), static_cast<std::streamsize>(content.size()));
+    if (!out) throw std::runtime_error("Failed to write " + full.string());
+    return content.size();
+}
+
+uint64_t SyntheticTree::generate() {
+    uint64_t bytes = 0;
+    files_.clear();
+    for (size_t i = 0; i < spec_.files; ++i) {
+        std::string path = randomPath();
+        bytes += writeFile(path, randomContent(path, randomSize()));
+        files_.push_back(path);
+    }
+    return bytes;
+}
+
+EditStats SyntheticTree::edit(double ratio, EditPattern pattern) {
+    EditStats stats;
+    if (files_.empty()) return stats;
+    size_t count = std::max<size_t>(1, static_cast<size_t>(files_.size() * ratio));
+
+    for (size_t i = 0; i < count && !files_.empty(); ++i) {
+        size_t index = rng_() % files_.size();
+        const std::string path = files_[index];
+        fs::path full = fs::path(root_) / path;
+
+        EditPattern op = pattern;
+        if (pattern == EditPattern::Mixed) {
+            uint64_t roll = rng_() % 100;
+            if (roll < 5) {
+                fs::remove(full);
+                files_[index] = files_.back();
+                files_.pop_back();
+                stats.removed++;
+                continue;
+            }
+            if (roll < 10) {
+                std::string created = randomPath();
+                stats.bytesWritten += writeFile(created, randomContent(created, randomSize()));
+                files_.push_back(created);
+                stats.created++;
+                continue;
+            }
+            op = roll < 30 ? EditPattern::Append : EditPattern::Modify;
+        }
+
+        std::vector<uint8_t> content;
+        {
+            std::ifstream in(full, std::ios::binary);
+            content.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+        size_t span = std::max<size_t>(1, std::min<size_t>(content.size() / 10 + 1, 4096));
+        auto chunk = randomContent(path, span);
+        if (op == EditPattern::Append || content.empty()) {
+            content.insert(content.end(), chunk.begin(), chunk.end());
+        } else {
+            size_t offset = rng_() % content.size();
+            size_t n = std::min(chunk.size(), content.size() - offset);
+            std::copy(chunk.begin(), chunk.begin() + n, content.begin() + offset);
+        }
+        stats.bytesWritten += writeFile(path, content);
+        stats.modified++;
+    }
+    return stats;
+}
+
+} // namespace clay::bench
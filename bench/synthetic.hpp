@@ -0,0 +1,66 @@
+#pragma once
+
+// 基准测试用的合成工作区：给定种子时生成的目录树和编辑序列完全确定
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace clay::bench {
+
+enum class EditPattern {
+    Append,  // 在文件末尾追加内容
+    Modify,  // 原地改写文件中的一段
+    Mixed,   // 以改写为主，夹杂追加、新建和删除
+};
+
+bool parseEditPattern(const std::string& name, EditPattern& pattern);
+const char* editPatternName(EditPattern pattern);
+
+struct TreeSpec {
+    uint64_t seed = 1;
+    size_t files = 2000;
+    size_t depth = 4;          // 文件所在目录的最大层数
+    size_t fanout = 4;         // 每层可选的子目录数
+    size_t minSize = 256;
+    size_t maxSize = 64 * 1024; // 大小在 [minSize, maxSize] 内按对数均匀分布
+    double binaryRatio = 0.1;
+};
+
+struct EditStats {
+    size_t modified = 0;
+    size_t created = 0;
+    size_t removed = 0;
+    uint64_t bytesWritten = 0;
+};
+
+class SyntheticTree {
+public:
+    SyntheticTree(std::string root, TreeSpec spec);
+
+    const std::string& root() const { return root_; }
+    const std::vector<std::string>& files() const { return files_; }
+
+    // 写出完整的目录树，返回写入的字节数
+    uint64_t generate();
+    // 按 pattern 编辑约 ratio 比例的文件
+    EditStats edit(double ratio, EditPattern pattern);
+
+    // 类似源码的文本和随机二进制内容
+    static std::vector<uint8_t> textContent(size_t size, std::mt19937_64& rng);
+    static std::vector<uint8_t> binaryContent(size_t size, std::mt19937_64& rng);
+
+private:
+    std::string randomPath();
+    size_t randomSize();
+    std::vector<uint8_t> randomContent(const std::string& path, size_t size);
+    uint64_t writeFile(const std::string& path, const std::vector<uint8_t>& content);
+
+    std::string root_;
+    TreeSpec spec_;
+    std::mt19937_64 rng_;
+    std::vector<std::string> files_;
+    size_t nextId_ = 0;
+};
+
+} // namespace clay::bench
@@ -5,19 +5,34 @@
 
 namespace clay {
 
+class Core;
+
 class Command {
 public:
-    static int execute(const std::vector<std::string>& args, std::ostream& out);
+    // core 为请求所属的工作区；不在工作区中时为 nullptr，只能执行 help/status/jobs
+    static int execute(const std::vector<std::string>& args, std::ostream& out, Core* core = nullptr);
     
-    static void init(const std::vector<std::string>& args, std::ostream& out);
-    static void status(std::ostream& out);
-    static void timeline(std::ostream& out);
-    static void rewind(const std::vector<std::string>& args, std::ostream& out);
-    static void undo(std::ostream& out);
-    static void branch(const std::vector<std::string>& args, std::ostream& out);
-    static void commit(const std::vector<std::string>& args, std::ostream& out);
+    static void init(Core& core, std::ostream& out);
+    static void stop(Core& core, std::ostream& out);
+    static void status(const std::vector<std::string>& args, std::ostream& out, Core* core);
+    // 直接读取工作区的共享内存状态页，不连接守护进程；状态页缺失或过期时返回 false
+    static bool localStatus(const std::string& workspace, std::ostream& out);
+    static void jobs(const std::vector<std::string>& args, std::ostream& out);
+    static void timeline(Core& core, std::ostream& out);
+    static void rewind(Core& core, const std::vector<std::string>& args, std::ostream& out);
+    static void undo(Core& core, std::ostream& out);
+    static void branch(Core& core, const std::vector<std::string>& args, std::ostream& out);
+    static void commit(Core& core, const std::vector<std::string>& args, std::ostream& out);
+    static void stats(Core& core, const std::vector<std::string>& args, std::ostream& out);
     static void help(std::ostream& out);
-    static void diff(const std::vector<std::string>& args, std::ostream& out); // New method for diff command
+    static void diff(Core& core, const std::vector<std::string>& args, std::ostream& out); // New method for diff command
+
+    // 在同一个存储读快照上依次执行只读命令，结果以一个 JSON 对象写出；有命令失败时返回 1
+    static int batch(Core* core, const std::vector<std::vector<std::string>>& commands, std::ostream& out);
+    // 解析 batch 的输入：以 '[' 开头时为 JSON 数组（元素为参数数组或命令行字符串），
+    // 否则每行一条命令，空行和 '#' 开头的行忽略，双引号可包住含空格的参数
+    static bool parseBatch(const std::string& text, std::vector<std::vector<std::string>>& commands,
+                           std::string& error);
 };
 
 } // namespace clay
\ No newline at end of file
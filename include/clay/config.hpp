@@ -0,0 +1,62 @@
+#pragma once
+
+#include "scheduler.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace clay {
+
+// 编译后的忽略规则，匹配相对工作区根目录的路径（'/' 分隔）：
+//   "dir/"  匹配该目录本身及其下所有路径
+//   含 '*'  '*' 匹配任意字符（包括 '/'），不区分大小写
+//   其他    精确匹配
+class IgnoreMatcher {
+public:
+    IgnoreMatcher() = default;
+    explicit IgnoreMatcher(const std::vector<std::string>& patterns);
+
+    bool matches(const std::string& relPath) const;
+    // relDir 下的所有路径都被忽略：被目录规则覆盖，或被以 '*' 结尾的通配符匹配。
+    // 此时整棵子树不必打开；只匹配目录本身的精确规则不算
+    bool matchesTree(const std::string& relDir) const;
+
+    // 规则可能影响的最深目录：第一个通配符之前的字面目录部分；为空表示整个工作区
+    static std::string baseDirectory(const std::string& pattern);
+
+private:
+    enum class Kind { Exact, Directory, Glob };
+    struct Rule {
+        Kind kind;
+        std::string text; // Directory 不含结尾的 '/'；Glob 已转为小写
+    };
+
+    std::vector<Rule> rules_;
+};
+
+// .clay/clay.conf 解析后的不可变配置；更新时整体替换
+struct Config {
+    int autosaveInterval = 30;
+    int idleThreshold = 5;
+    int maxSnapshots = 100;
+    int deltaHotWindow = 300;
+    bool metricsExport = false; // 定期把流水线指标写到 .clay/metrics.prom
+    bool trace = false;         // 记录每次快照和恢复的跨度，写到 .clay/traces/
+    uint64_t memoryBudget = 0;  // 守护进程缓冲区的内存预算（字节），0 表示不限；支持 K/M/G 后缀
+    // 后台作业（自动保存、压缩、清理）的限速，用户命令不受限制
+    uint64_t ioLimit = 0;       // 每秒读写的字节数，0 表示只用内置的类别预算；支持 K/M/G 后缀
+    uint64_t ioOpsLimit = 0;    // 每秒读写的次数
+    IoPriority ioPriority = IoPriority::Low; // idle / low / normal
+    bool pressureBackoff = true; // 系统负载高（/proc/pressure）时自动降低后台速率
+    std::vector<std::string> ignorePatterns;
+    IgnoreMatcher ignore;
+
+    // 新仓库写入的默认配置
+    static const char* const kDefaultText;
+
+    // 无法解析的行被跳过并保留默认值；文件不存在时返回默认配置
+    static std::shared_ptr<const Config> load(const std::string& path);
+};
+
+} // namespace clay
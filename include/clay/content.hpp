@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+namespace clay {
+
+// 文件内容分类：按对象计算一次后随 delta 一起缓存
+enum class ContentKind : int8_t {
+    Unknown = -1,
+    Text = 0,
+    Binary = 1,
+};
+
+// 向量化扫描 NUL 和控制字符（SSE2/NEON，其他平台为标量实现）
+ContentKind classifyContent(const uint8_t* data, size_t size);
+
+inline ContentKind classifyContent(const std::vector<uint8_t>& content) {
+    return classifyContent(content.data(), content.size());
+}
+
+// 用 bsdiff 计算补丁大小（不保留补丁内容）；输入过大时返回 -1
+int64_t bsdiffPatchSize(const std::vector<uint8_t>& oldContent,
+                        const std::vector<uint8_t>& newContent);
+
+// 逐行比较两个文本内容，行以 string_view 指向原始缓冲区，不复制
+// op: ' ' 相同, '-' 删除, '+' 新增
+using LineVisitor = std::function<void(char op, std::string_view line)>;
+void diffLines(const std::vector<uint8_t>& prevContent,
+               const std::vector<uint8_t>& currContent,
+               const LineVisitor& visit);
+
+struct LineStats {
+    size_t insertions = 0;
+    size_t deletions = 0;
+};
+
+LineStats diffLineStats(const std::vector<uint8_t>& prevContent,
+                        const std::vector<uint8_t>& currContent);
+
+} // namespace clay
@@ -1,36 +1,67 @@
 #pragma once
 
+#include "clay/snapshot.hpp"
+#include "clay/storage.hpp"
+#include <functional>
 #include <string>
 #include <vector>
 #include <memory>
+#include <ostream>
 
 namespace clay {
 
+class PipelineMetrics;
+
+struct DiffOptions {
+    bool statOnly = false; // 只输出每个文件的增删行数，不输出具体行
+};
+
+// 一个工作区的快照核心；守护进程为每个托管的工作区持有一个实例
 class Core {
 public:
-    static Core& instance();
+    Core();
+    ~Core();
 
     bool isInitialized() const;  // 新增此方法
-    bool init(const std::string& workspace);
+    // ReadWrite 在需要时创建 .clay；ReadOnly 要求仓库已存在，且不允许创建、恢复快照或监视
+    bool init(const std::string& workspace, OpenMode mode = OpenMode::ReadWrite);
+    bool readOnly() const;
+    // 独立运行：监视工作区并每秒检查一次自动保存，直到 shutdown
     void run();
     void shutdown();
+
+    // 由宿主驱动：启动/停止文件监视，tick 检查是否需要提交自动保存
+    void startWatching();
+    void stopWatching();
+    void tick();
+    std::string workspace() const;
     
-    void takeSnapshot(bool autoSave = false, const std::string& message = "");
+    // 返回新快照的 ID
+    std::string takeSnapshot(bool autoSave = false, const std::string& message = "");
     bool restoreSnapshot(const std::string& snapshotId);
     bool undo();
     std::vector<std::string> listSnapshots();
     std::string currentSnapshotId() const;
+    // 按时间从旧到新，只含元数据
+    std::vector<Snapshot> snapshots() const;
+    Snapshot loadSnapshot(const std::string& snapshotId) const;
+    bool readFile(const std::string& snapshotId, const std::string& path, std::vector<uint8_t>& content) const;
+    // fn 中的所有查询（时间线、diff、加载）基于同一个一致的存储读视图
+    void withReadSnapshot(const std::function<void()>& fn) const;
+    // 快照流水线各阶段的计数与耗时
+    const PipelineMetrics& metrics() const;
     
     void createTempBranch();
     void commitTempBranch(const std::string& name);
     void discardTempBranch();
 
     std::string getDiff(const std::string& snapshotId) const;
+    // 流式输出差异，不在内存中拼接完整结果
+    void diff(const std::string& snapshotId, std::ostream& out,
+              const DiffOptions& options = DiffOptions()) const;
     std::string findClosestSnapshot(const std::string& targetTime) const;
 
 private:
-    Core();
-    ~Core();
     Core(const Core&) = delete;
     Core& operator=(const Core&) = delete;
 
@@ -1,26 +1,42 @@
 #pragma once
 #include <string>
+#include <memory>
+#include <ostream>
 
 namespace clay {
 
+// 每个用户一个守护进程，托管该用户的所有工作区
 class Daemon {
 public:
     static Daemon& instance();
-    
-    bool start(const std::string& workspace);
+
+    // 运行时目录：$CLAY_RUNTIME_DIR，或 $XDG_RUNTIME_DIR/clay，或 /tmp/clay-<uid>
+    static std::string runtimeDir();
+    static std::string socketPath();
+
+    // 守护进程未运行时启动它，并等待其开始接受连接
+    bool start();
     bool stop();
     bool isRunning() const;
-    
+    // 在守护进程内部请求退出（由事件循环处理）
+    void requestStop();
+
+    // 输出连接数、工作线程和请求延迟直方图
+    void writeStats(std::ostream& out) const;
+
 private:
     Daemon();
-    ~Daemon() = default;
-    
+    ~Daemon();
+
     void mainLoop();
-    void handleClient(int fd);
-    
+
+    class EventLoop;
+    std::unique_ptr<EventLoop> loop_;
+
     std::string pidPath_;
     std::string sockPath_;
     bool running_;
+    int lockFd_ = -1; // 持有 pid 文件的排他锁，表示守护进程存活
 };
 
-} // namespace clay
\ No newline at end of file
+} // namespace clay
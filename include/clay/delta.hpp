@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace clay {
+
+// 不持有内存的字节视图（数据库 blob 或 vector）
+struct ByteView {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+    ByteView() = default;
+    ByteView(const uint8_t* d, size_t s) : data(d), size(s) {}
+    ByteView(const std::vector<uint8_t>& v) : data(v.data()), size(v.size()) {}
+};
+
+// LZ4 块压缩；输出带 8 字节原始长度前缀
+bool compressBlock(ByteView in, std::vector<uint8_t>& out);
+bool decompressBlock(ByteView in, std::vector<uint8_t>& out);
+
+// 生成把 from 变为 to 的 bsdiff 补丁（原始格式，无文件头）
+bool makePatch(ByteView from, ByteView to, std::vector<uint8_t>& patch);
+
+// 依次把 patches 应用到 base 上，一次遍历得到最终版本，不生成中间版本
+// 输出按块直接写入文件描述符
+bool applyPatchChain(ByteView base, const std::vector<ByteView>& patches, int fd);
+bool applyPatchChain(ByteView base, const std::vector<ByteView>& patches, std::vector<uint8_t>& out);
+
+} // namespace clay
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace clay {
+
+// 快速哈希：XXH3-64（默认 secret，种子 0），结果与官方实现一致。
+// 用于变化检测，不抗碰撞攻击。长输入的主循环按 CPU 在运行时选择 AVX2、NEON 或标量实现。
+uint64_t fastHash(const void* data, size_t size);
+uint64_t fastHashScalar(const void* data, size_t size);
+// 当前进程选用的实现："avx2"、"neon" 或 "scalar"
+const char* fastHashImplementation();
+
+// 强哈希：BLAKE3-256，用于内容寻址
+struct Digest {
+    std::array<uint8_t, 32> bytes{};
+
+    std::string hex() const;
+    bool operator==(const Digest& other) const { return bytes == other.bytes; }
+    bool operator!=(const Digest& other) const { return bytes != other.bytes; }
+};
+
+// 不小于此大小的输入按 BLAKE3 的树结构把子树分给多个线程计算，结果与串行相同
+constexpr size_t kParallelHashThreshold = 1 << 20;
+
+// maxThreads 为 0 时使用硬件并发数；为 1 时串行
+Digest strongHash(const void* data, size_t size, unsigned maxThreads = 0);
+
+} // namespace clay
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace clay {
+
+// 带引号的 JSON 字符串；控制字符转义为 \uXXXX，非 UTF-8 字节原样保留
+std::string jsonQuote(std::string_view text);
+
+} // namespace clay
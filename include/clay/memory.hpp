@@ -0,0 +1,74 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+namespace clay {
+
+// 守护进程内大块缓冲区的集中记账：捕获时读入的文件内容、恢复时加载的快照、diff 的两侧。
+// 预算取所有托管工作区 memory_budget 中最小的非零值，0 表示不限。
+// 超出预算时调用方改走流式路径（分批写库、逐个文件加载），或等待其他工作释放。
+class MemoryBudget {
+public:
+    static constexpr std::chrono::milliseconds kDefaultWait{2000};
+
+    struct Stats {
+        uint64_t current = 0;
+        uint64_t peak = 0;
+        uint64_t limit = 0;
+        uint64_t waits = 0;    // 因超出预算而等待的次数
+        uint64_t spills = 0;   // 改走流式路径的次数
+        uint64_t overruns = 0; // 等待超时后仍然超出预算记账的次数
+    };
+
+    // 按作用域记账，析构时释放
+    class Reservation {
+    public:
+        Reservation() = default;
+        ~Reservation() { reset(); }
+        Reservation(Reservation&& other) noexcept : bytes_(other.bytes_) { other.bytes_ = 0; }
+        Reservation& operator=(Reservation&& other) noexcept;
+        Reservation(const Reservation&) = delete;
+        Reservation& operator=(const Reservation&) = delete;
+
+        bool tryAdd(uint64_t bytes);
+        void add(uint64_t bytes, std::chrono::milliseconds wait = kDefaultWait);
+        void reset();
+        uint64_t bytes() const { return bytes_; }
+
+    private:
+        uint64_t bytes_ = 0;
+    };
+
+    static MemoryBudget& instance();
+
+    // 每个工作区登记自己的预算；bytes 为 0 表示撤销
+    void setLimit(const std::string& owner, uint64_t bytes);
+    uint64_t limit() const;
+
+    // 不超出预算时记账并返回 true
+    bool tryReserve(uint64_t bytes);
+    // 超出预算时等待其他记账释放；超时（或只有自己在用）时仍然记账，单个超大文件也能处理
+    void reserve(uint64_t bytes, std::chrono::milliseconds wait = kDefaultWait);
+    void release(uint64_t bytes);
+    void noteSpill();
+
+    Stats stats() const;
+    void write(std::ostream& out) const;
+    void writePrometheus(std::ostream& out) const;
+
+private:
+    MemoryBudget() = default;
+
+    mutable std::mutex mutex_;
+    std::condition_variable released_;
+    std::map<std::string, uint64_t> limits_;
+    Stats stats_;
+};
+
+} // namespace clay
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace clay {
+
+// 无锁延迟直方图：第 i 个桶统计 [2^(i-1), 2^i) 微秒的样本
+class LatencyHistogram {
+public:
+    static constexpr size_t kBuckets = 40;
+
+    void record(std::chrono::nanoseconds elapsed);
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t maxMicros() const { return maxUs_.load(std::memory_order_relaxed); }
+    uint64_t sumMicros() const { return sumUs_.load(std::memory_order_relaxed); }
+    uint64_t bucketCount(size_t i) const { return buckets_[i].load(std::memory_order_relaxed); }
+    double meanMicros() const;
+    // 返回分位数所在桶的上界（微秒）
+    uint64_t percentileMicros(double p) const;
+
+    void write(std::ostream& out, const std::string& name) const;
+
+private:
+    std::array<std::atomic<uint64_t>, kBuckets> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sumUs_{0};
+    std::atomic<uint64_t> maxUs_{0};
+};
+
+// 快照流水线的阶段；每次快照（或每次压缩）每个阶段记录一个样本
+enum class PipelinePhase {
+    Walk,     // 遍历目录树（不含匹配和读取）
+    Match,    // 忽略规则匹配
+    Read,     // 读取文件内容
+    Classify, // 内容类型识别
+    Hash,     // 计算内容哈希
+    DbWrite,  // 写入快照和增量行
+    Cleanup,  // 超出上限时删除旧快照
+    Compact,  // 后台把旧快照改写为反向增量（含 bsdiff 和压缩）
+    Total,    // 一次快照从开始捕获到提交完成
+};
+
+enum class PipelineCounter {
+    SnapshotsStored,
+    FilesScanned,      // 遍历到的普通文件
+    FilesIgnored,
+    FilesUnreadable,
+    FilesCaptured,
+    BytesCaptured,
+    SnapshotsPruned,
+    DeltasCompacted,   // 改写为反向补丁
+    DeltasDeduped,     // 与后继快照相同，只保留引用
+    BytesBeforeCompaction,
+    BytesAfterCompaction,
+    WatchEvents,       // 监视器报告的未被忽略的文件事件
+    WatchOverflows,    // 内核事件队列溢出次数
+    FilesReused,       // 内容未变，沿用父快照的项而不写内容行
+    TreesWritten,      // 新写入的目录节点（已存在的节点只增加引用）
+    DirsReused,        // stat 信息未变，沿用上次的目录列表而不重新读取
+    FilesUnread,       // stat 信息未变，不读取内容，沿用父快照的项
+};
+
+// 一个工作区的流水线计数器与各阶段耗时直方图；全部为原子操作，可在捕获线程和压缩线程中并发更新
+class PipelineMetrics {
+public:
+    static constexpr size_t kPhases = static_cast<size_t>(PipelinePhase::Total) + 1;
+    static constexpr size_t kCounters = static_cast<size_t>(PipelineCounter::FilesUnread) + 1;
+
+    void record(PipelinePhase phase, std::chrono::nanoseconds elapsed);
+    void add(PipelineCounter counter, uint64_t n = 1) {
+        counters_[static_cast<size_t>(counter)].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t counter(PipelineCounter counter) const {
+        return counters_[static_cast<size_t>(counter)].load(std::memory_order_relaxed);
+    }
+    const LatencyHistogram& histogram(PipelinePhase phase) const {
+        return phases_[static_cast<size_t>(phase)];
+    }
+    // 每次 record 递增，用于判断导出文件是否需要重写
+    uint64_t generation() const { return generation_.load(std::memory_order_relaxed); }
+
+    // clay stats 的文本输出
+    void write(std::ostream& out) const;
+    // Prometheus 文本格式（node exporter textfile collector 可直接读取）
+    void writePrometheus(std::ostream& out, const std::string& workspace) const;
+
+    static const char* phaseName(PipelinePhase phase);
+    static const char* counterName(PipelineCounter counter);
+
+private:
+    std::array<LatencyHistogram, kPhases> phases_;
+    std::array<std::atomic<uint64_t>, kCounters> counters_{};
+    std::atomic<uint64_t> generation_{0};
+};
+
+// 守护进程启动各阶段的耗时；阶段可以来自不同线程（例如后台恢复工作区）
+class StartupProfile {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static StartupProfile& instance();
+
+    // 设定计时起点并清空已记录的阶段
+    void begin();
+    // 记录从 start 到现在的一个阶段
+    void record(const std::string& phase, Clock::time_point start);
+    // 记录从上一次 mark（或 begin）到现在的阶段，用于主线程顺序执行的步骤
+    void mark(const std::string& phase);
+
+    void write(std::ostream& out) const;
+
+private:
+    struct Phase {
+        std::string name;
+        Clock::duration offset; // 阶段开始时间相对起点
+        Clock::duration elapsed;
+    };
+
+    mutable std::mutex mutex_;
+    Clock::time_point origin_ = Clock::now();
+    Clock::time_point last_ = origin_;
+    std::vector<Phase> phases_;
+};
+
+} // namespace clay
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace clay {
+
+// 单调分配的内存池：只分配不单独释放，整块随对象一起释放。
+// 用于一次快照或一次比较期间的大量小对象（路径分量等）。
+class Arena {
+public:
+    static constexpr size_t kBlockSize = 64 * 1024;
+
+    Arena() = default;
+    Arena(Arena&&) = default;
+    Arena& operator=(Arena&&) = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t align = alignof(std::max_align_t));
+    // 复制到池中，返回的视图与池同生命周期
+    std::string_view copy(std::string_view text);
+
+    // 已向系统申请的字节数
+    size_t capacity() const { return capacity_; }
+
+private:
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char* cursor_ = nullptr;
+    size_t remaining_ = 0;
+    size_t capacity_ = 0;
+};
+
+// 工作区相对路径的扁平表：每个节点只存父节点下标和本级名称，名称驻留在 Arena 中。
+// 同一路径总是得到同一个下标，所以两份清单共用一张表时按下标即可对齐，不必比较字符串。
+// 查找用开放寻址的 (父节点, 名称) 哈希索引，节点和索引都是连续数组。
+class PathTable {
+public:
+    static constexpr uint32_t kRoot = 0;
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    PathTable();
+
+    // 逐级查找或添加 '/' 分隔的相对路径，返回最后一级的下标；空路径返回 kRoot
+    uint32_t intern(std::string_view relPath);
+    // 查找或添加 parent 下名为 name 的节点
+    uint32_t child(uint32_t parent, std::string_view name);
+    // 只查找，不存在时返回 kNone
+    uint32_t find(std::string_view relPath) const;
+    uint32_t findChild(uint32_t parent, std::string_view name) const;
+
+    uint32_t parent(uint32_t node) const { return nodes_[node].parent; }
+    std::string_view name(uint32_t node) const { return {nodes_[node].name, nodes_[node].nameSize}; }
+    uint32_t depth(uint32_t node) const { return nodes_[node].depth; }
+    size_t size() const { return nodes_.size(); }
+
+    // 以 '/' 连接的完整相对路径
+    std::string path(uint32_t node) const;
+    // 追加到 out 末尾，便于复用同一个缓冲区
+    void appendPath(uint32_t node, std::string& out) const;
+    // 按完整路径的字典序比较，与比较 path(a) < path(b) 的结果相同，但不拼接字符串
+    bool less(uint32_t a, uint32_t b) const;
+
+    size_t memoryUsage() const;
+
+private:
+    struct Node {
+        uint32_t parent;
+        uint32_t depth;
+        const char* name;
+        uint32_t nameSize;
+        uint32_t hash; // (parent, name) 的哈希，扩容时不必重算
+    };
+
+    static uint32_t hashOf(uint32_t parent, std::string_view name);
+    uint32_t lookup(uint32_t parent, std::string_view name, uint32_t hash) const;
+    void grow();
+
+    Arena arena_;
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> slots_; // 节点下标 + 1，0 表示空
+};
+
+} // namespace clay
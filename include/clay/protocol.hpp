@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <streambuf>
+#include <vector>
+
+namespace clay {
+namespace protocol {
+
+// 客户端与守护进程之间的二进制协议（双向相同的消息格式）：
+//   magic(4) | version(1) | type(1) | reserved(2) | requestId(4) | length(4) | payload
+// 整数均为网络字节序。一个连接上可以流水线发送多个请求，
+// 响应按 requestId 区分，不同请求的响应可以乱序、交错到达。
+// 版本 2：请求的第一个参数是客户端所在工作区的绝对路径（可为空），其后是命令及其参数。
+constexpr uint32_t kMagic = 0x434C4159; // "CLAY"
+constexpr uint8_t kVersion = 2;
+constexpr size_t kHeaderSize = 16;
+
+// 单个数据块的上限；输出按块以 MSG_DATA 发送
+constexpr size_t kMaxFramePayload = 64 * 1024;
+// 任何消息负载的上限，超过视为协议错误
+constexpr size_t kMaxMessagePayload = 1024 * 1024;
+
+enum MessageType : uint8_t {
+    MSG_REQUEST = 1, // 负载为参数列表
+    MSG_DATA = 2,    // 命令输出块
+    MSG_END = 3,     // 负载为 状态码(4字节) + 退出码(4字节)
+    MSG_BATCH = 4,   // 负载为工作区 + 多条命令，在同一个存储读视图中执行，结果以一个 JSON 文档返回
+};
+
+enum Status : uint32_t {
+    STATUS_OK = 0,
+    STATUS_COMMAND_FAILED = 1,      // 命令执行完毕但退出码非零
+    STATUS_BAD_REQUEST = 2,         // 消息或参数无法解析
+    STATUS_UNSUPPORTED_VERSION = 3,
+    STATUS_INTERNAL_ERROR = 4,
+};
+
+const char* statusName(uint32_t status);
+
+struct Header {
+    uint8_t version = kVersion;
+    uint8_t type = 0;
+    uint32_t requestId = 0;
+    uint32_t length = 0;
+};
+
+// 解析帧头：魔数错误或长度越界返回 STATUS_BAD_REQUEST（连接无法再同步），
+// 版本不符返回 STATUS_UNSUPPORTED_VERSION（可跳过负载继续）
+Status parseHeader(const char* data, Header& header);
+std::string encodeMessage(uint8_t type, uint32_t requestId, const void* payload, uint32_t len);
+
+// 带类型的参数：count(2) 之后每个参数为 tag(1) + length(4) + 值
+enum ArgType : uint8_t {
+    ARG_STRING = 1,
+    ARG_INT = 2, // 8字节有符号整数
+};
+
+struct Arg {
+    ArgType type = ARG_STRING;
+    std::string text;
+    int64_t number = 0;
+
+    static Arg string(std::string s);
+    static Arg integer(int64_t n);
+    // 命令层只处理字符串参数
+    std::string toString() const;
+
+    bool operator==(const Arg& other) const;
+};
+
+std::string encodeArgs(const std::vector<Arg>& args);
+bool decodeArgs(const char* data, size_t len, std::vector<Arg>& args);
+
+// 批量请求：length(4) + 参数列表 [工作区]，count(2)，之后每条命令为 length(4) + 参数列表
+std::string encodeBatch(const std::string& workspace, const std::vector<std::vector<Arg>>& commands);
+bool decodeBatch(const char* data, size_t len, std::string& workspace,
+                 std::vector<std::vector<Arg>>& commands);
+
+std::string encodeEnd(Status status, int exitCode);
+bool decodeEnd(const std::string& payload, uint32_t& status, int& exitCode);
+
+// 循环读写直到传输完整（处理 EINTR 与部分读写）
+bool writeAll(int fd, const void* data, size_t len);
+bool readAll(int fd, void* data, size_t len);
+
+bool writeMessage(int fd, uint8_t type, uint32_t requestId, const void* payload, uint32_t len);
+// 读取完整消息；帧头无效时返回 false
+bool readMessage(int fd, Header& header, std::string& payload);
+
+// 将 ostream 的输出按块封装为某个请求的 MSG_DATA 消息，内存占用固定为一个块缓冲区
+class FrameWriter : public std::streambuf {
+public:
+    // 接收完整编码的消息；返回 false 表示连接已断开
+    using Sink = std::function<bool(std::string frame)>;
+
+    FrameWriter(int fd, uint32_t requestId, size_t chunkSize = kMaxFramePayload);
+    FrameWriter(Sink sink, uint32_t requestId, size_t chunkSize = kMaxFramePayload);
+    ~FrameWriter() override;
+
+    // 发送剩余数据和 MSG_END，只能调用一次；
+    // 未指定状态时按退出码推断 STATUS_OK / STATUS_COMMAND_FAILED
+    bool finish(int exitCode);
+    bool finish(Status status, int exitCode);
+    bool failed() const { return failed_; }
+
+protected:
+    int_type overflow(int_type ch) override;
+    int sync() override;
+
+private:
+    bool flushBuffer();
+    bool emit(uint8_t type, const void* payload, uint32_t len);
+
+    int fd_ = -1;
+    Sink sink_;
+    uint32_t requestId_;
+    std::vector<char> buffer_;
+    bool failed_ = false;
+    bool finished_ = false;
+};
+
+} // namespace protocol
+} // namespace clay
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "clay/core.hpp"
+#include "clay/snapshot.hpp"
+#include "clay/storage.hpp"
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace clay {
+
+// libclay 对外的进程内接口：不经过 CLI 和守护进程直接访问仓库。
+// 只读打开可以与正在运行的守护进程共存，适合扫描时间线、提取文件等工具。
+class Repository {
+public:
+    // 打开 workspace 下的仓库；仓库不存在或无法打开时抛出 std::runtime_error
+    static std::unique_ptr<Repository> open(const std::string& workspace,
+                                            OpenMode mode = OpenMode::ReadOnly);
+    ~Repository();
+
+    std::string workspace() const;
+    bool readOnly() const;
+
+    // 按时间从旧到新，只含元数据
+    std::vector<Snapshot> timeline() const;
+    std::string latestSnapshotId() const;
+    // 最接近 "YYYY-MM-DD HH:MM:SS" 的快照 ID
+    std::string findSnapshot(const std::string& time) const;
+    // 含全部文件内容
+    Snapshot snapshot(const std::string& snapshotId) const;
+    bool readFile(const std::string& snapshotId, const std::string& path,
+                  std::vector<uint8_t>& content) const;
+    void diff(const std::string& snapshotId, std::ostream& out,
+              const DiffOptions& options = DiffOptions()) const;
+
+    // 以下操作要求 ReadWrite
+    std::string takeSnapshot(const std::string& message = "");
+    bool restore(const std::string& snapshotId);
+
+    // 需要其他高级操作时可直接使用底层 Core
+    Core& core();
+
+private:
+    Repository();
+    Repository(const Repository&) = delete;
+    Repository& operator=(const Repository&) = delete;
+
+    std::unique_ptr<Core> core_;
+};
+
+} // namespace clay
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace clay {
+
+// 上一次捕获时每个目录的列表和每个文件的 stat 信息，保存在 .clay/scan.cache。
+// 目录的 stat 信息没变时直接沿用记录的列表，不再 readdir；文件的 stat 信息没变且
+// 内容已存入 snapshotId 时，不读取内容，直接沿用该快照中的项。
+struct ScanCache {
+    // mtime 为 0 表示不可信：记录时距离捕获开始太近，之后的修改可能不改变 mtime
+    struct Stamp {
+        int64_t mtime = 0; // 纳秒
+        uint64_t size = 0;
+        uint64_t inode = 0;
+
+        bool valid() const { return mtime != 0; }
+        bool operator==(const Stamp& other) const {
+            return mtime == other.mtime && size == other.size && inode == other.inode;
+        }
+    };
+
+    struct Entry {
+        std::string name;
+        bool directory = false;
+        bool captured = false; // 文件内容已存入 snapshotId（未被忽略且读取成功）
+        Stamp stamp;           // 只对文件有意义；子目录的信息在它自己的记录里
+    };
+
+    struct Directory {
+        Stamp stamp;
+        std::vector<Entry> entries; // 按名称排序
+    };
+
+    std::string snapshotId;
+    // 键是工作区相对路径，根目录为空串
+    std::unordered_map<std::string, Directory> directories;
+
+    // 文件不存在或格式不对时返回 false，cache 为空
+    static bool load(const std::string& path, ScanCache& cache);
+    // 先写临时文件再改名，中途失败不会留下半个文件
+    bool save(const std::string& path) const;
+};
+
+} // namespace clay
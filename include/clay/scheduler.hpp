@@ -0,0 +1,130 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace clay {
+
+// 优先级从高到低；数值即优先级顺序
+enum class JobClass : int {
+    Interactive = 0, // 用户命令
+    Autosave = 1,    // 空闲自动快照
+    Maintenance = 2, // 压缩、清理等后台维护
+};
+
+const char* jobClassName(JobClass cls);
+
+enum class JobState {
+    Queued,
+    Running,
+    Done,
+    Cancelled,
+    Failed,
+};
+
+// 作业在检查点发现自己被取消时抛出
+class JobCancelled : public std::runtime_error {
+public:
+    explicit JobCancelled(const std::string& name)
+        : std::runtime_error("Job cancelled: " + name) {}
+};
+
+// 每个类别的资源预算；0 表示不限制。速率按令牌桶计：最多攒一秒的量，超支部分从之后的补充中扣除
+struct JobBudget {
+    int maxConcurrent = 0;
+    double cpuShare = 0;         // 每秒可用的 CPU 时间（单核比例）
+    uint64_t ioBytesPerSec = 0;  // 每秒可读写的字节数
+    uint64_t ioOpsPerSec = 0;    // 每秒可读写的次数（文件、内容行）
+    bool yieldToInteractive = false; // 有用户命令执行时在检查点暂停
+};
+
+// 后台作业线程的 I/O 优先级：Idle 只在磁盘空闲时得到服务，Low 为 best-effort 的最低一级，
+// Normal 不调整。只对支持 I/O 优先级的调度器（BFQ 等）有效
+enum class IoPriority {
+    Idle,
+    Low,
+    Normal,
+};
+
+// 所有后台作业（自动保存和维护）共用的限速设置，叠加在各类别预算之上。
+// 用户命令不受限制；有用户命令执行时后台作业也不限速，以便尽快释放命令可能在等的锁
+struct IoGovernor {
+    uint64_t bytesPerSec = 0;    // 0 表示只受各类别预算限制
+    uint64_t opsPerSec = 0;
+    IoPriority priority = IoPriority::Low;
+    bool pressureBackoff = true; // 按 /proc/pressure 报告的系统负载降低后台的 CPU 和 I/O 速率
+};
+
+struct JobCounts {
+    size_t running = 0;
+    size_t queued = 0; // 包括等待准入的同步作业
+};
+
+struct JobInfo {
+    uint64_t id = 0;
+    std::string name;
+    JobClass cls = JobClass::Interactive;
+    JobState state = JobState::Queued;
+    std::chrono::steady_clock::duration age{};  // 从提交到现在（或到结束）
+    std::chrono::nanoseconds cpuTime{};
+    uint64_t ioBytes = 0;
+    std::string error;
+};
+
+// 守护进程内的作业调度器：
+// - 异步作业按类别优先级、先进先出由工作线程执行
+// - 同步作业（run）在调用线程执行，但同样受准入、预算和取消控制
+// - 长作业通过 checkpoint() 协作式地响应取消和预算限流
+class JobScheduler {
+public:
+    using Task = std::function<void()>;
+
+    static JobScheduler& instance();
+
+    void start(size_t threads);
+    // 取消所有作业并等待工作线程退出
+    void stop();
+
+    void setBudget(JobClass cls, const JobBudget& budget);
+    // 按来源（工作区）登记限速设置；多个来源时各项取最严的一份
+    void setGovernor(const std::string& owner, const IoGovernor& governor);
+    void removeGovernor(const std::string& owner);
+
+    // 提交异步作业；coalesce 为 true 时若同名作业已在排队或执行则不重复提交，返回 0
+    uint64_t submit(JobClass cls, const std::string& name, Task task, bool coalesce = false);
+    // 在当前线程以作业身份执行；任务抛出的异常（包括 JobCancelled）会重新抛出
+    void run(JobClass cls, const std::string& name, const Task& task);
+
+    bool cancel(uint64_t id);
+    // 取消某类别所有排队和执行中的作业（name 非空时只取消同名作业），返回数量
+    size_t cancelClass(JobClass cls, const std::string& name = "");
+    // 等待某类别的同名作业全部结束（不再排队或执行）
+    void waitFor(JobClass cls, const std::string& name);
+
+    // 供作业内部调用：检查取消、记账 CPU、在超出预算时等待
+    static void checkpoint();
+    static void chargeIo(uint64_t bytes, uint64_t ops = 1);
+    static bool cancelled();
+
+    // 执行中与排队的作业，以及最近结束的作业
+    std::vector<JobInfo> jobs() const;
+    JobCounts counts() const;
+    void writeJobs(std::ostream& out) const;
+
+private:
+    JobScheduler();
+    ~JobScheduler();
+    JobScheduler(const JobScheduler&) = delete;
+    JobScheduler& operator=(const JobScheduler&) = delete;
+
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+} // namespace clay
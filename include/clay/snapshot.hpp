@@ -4,6 +4,7 @@
 #include <ctime>
 #include <cstdint>
 #include <vector>
+#include "content.hpp"
 
 namespace clay {
 
@@ -13,10 +14,13 @@ struct FileDelta {
     std::string path;
     std::vector<uint8_t> content; // 存储文件内容
     Action action;
+    ContentKind kind = ContentKind::Unknown; // 文本/二进制分类缓存
     
     // 添加构造函数简化创建
     FileDelta(const std::string& p, Action a, const std::vector<uint8_t>& c = {})
-        : path(p), action(a), content(c) {}
+        : path(p), content(c), action(a) {}
+    FileDelta(const std::string& p, Action a, std::vector<uint8_t>&& c)
+        : path(p), content(std::move(c)), action(a) {}
 };
 
 class Snapshot {
@@ -26,6 +30,8 @@ public:
     bool autoSave;
     std::string message;
     std::vector<FileDelta> deltas; // 添加 deltas 成员
+    // 与父快照相同、没有读取内容的文件；存储时沿用父快照中的项
+    std::vector<std::string> unchanged;
 
     std::string shortId() const {
         return id.substr(0, 8);
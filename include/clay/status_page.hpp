@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace clay {
+
+// 状态页内容：定长布局，字符串以 '\0' 结尾并按需截断
+struct StatusData {
+    int32_t daemonPid = 0;        // 0 表示守护进程已不再托管该工作区
+    uint32_t captureInProgress = 0;
+    int64_t updatedAtMs = 0;      // 最近一次发布的 Unix 时间（毫秒），兼作心跳
+    int64_t lastSnapshotTime = 0; // Unix 时间（秒）；0 表示还没有快照
+    uint32_t dirtyFiles = 0;      // 上次快照之后有变化的文件数
+    uint32_t runningJobs = 0;
+    uint32_t queuedJobs = 0;
+    uint32_t reserved = 0;
+    char lastSnapshotId[32] = {};
+    char lastSnapshotMessage[96] = {};
+};
+
+// 守护进程把工作区状态发布到 .clay/status.shm，由 seqlock 保护：
+// 写者在修改前后各递增一次序号，读者在序号为偶数且前后一致时接受读到的副本。
+// 读者只读映射文件，不需要连接守护进程，也不会阻塞写者。
+class StatusPage {
+public:
+    static constexpr uint32_t kMagic = 0x434C5350; // "CLSP"
+    static constexpr uint32_t kVersion = 1;
+
+    StatusPage() = default;
+    ~StatusPage();
+    StatusPage(const StatusPage&) = delete;
+    StatusPage& operator=(const StatusPage&) = delete;
+
+    static std::string pathFor(const std::string& workspace);
+
+    // 创建或打开状态页并映射为可写；已有的有效内容保留为当前内容，供重启后热恢复
+    bool open(const std::string& path);
+    void close();
+
+    // 在写锁内修改当前内容并发布；多个线程可并发调用
+    template <typename F>
+    void update(F&& modify) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!page_) return;
+        modify(current_);
+        publish();
+    }
+
+    // 读取一致的副本；文件不存在、格式不符或多次重试仍在写入时返回 false
+    static bool read(const std::string& path, StatusData& out);
+
+    // 写者自己的当前内容
+    StatusData current();
+
+    static void copyString(char* dest, size_t size, const std::string& src);
+
+private:
+    struct Page;
+
+    void publish();
+
+    std::mutex mutex_;
+    StatusData current_;
+    Page* page_ = nullptr;
+    std::string path_;
+};
+
+} // namespace clay
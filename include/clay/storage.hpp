@@ -1,26 +1,87 @@
 #pragma once
 
 #include "snapshot.hpp"
+#include <functional>
+#include <optional>
 #include <string>
 #include <vector>
 #include <memory>
 
 namespace clay {
 
+class PipelineMetrics;
+
+class PathTable;
+
+// 快照清单中的一项，不含内容；path 是调用方 PathTable 中的节点
+struct ManifestEntry {
+    uint32_t path = 0;
+    FileDelta::Action action = FileDelta::MODIFY;
+    ContentKind kind = ContentKind::Unknown;
+    uint64_t size = 0;            // 完整内容的字节数；旧数据库中已改写为补丁的行是估计值
+    std::optional<uint64_t> hash; // fastHash；旧数据库的行没有
+};
+
+// 两个快照之间不同的一个文件；before 为空表示新增，after 为空表示删除
+struct ManifestChange {
+    uint32_t path = 0;
+    std::optional<ManifestEntry> before;
+    std::optional<ManifestEntry> after;
+};
+
+// ReadOnly 只打开读连接：不建表、不迁移、不启动后台压缩，写操作会失败。
+// 可以与守护进程同时打开同一个仓库。
+enum class OpenMode {
+    ReadWrite,
+    ReadOnly,
+};
+
 class Storage {
 public:
     Storage(const std::string& workspace);
     ~Storage();
     
-    bool init();
+    bool init(OpenMode mode = OpenMode::ReadWrite);
+    bool readOnly() const;
     std::string store(const Snapshot& snapshot);
+    // 分批存储一个快照，内容不必同时留在内存里：beginStore 写入快照行并开启写事务，
+    // storeDeltas 可多次调用，finishStore 提交后读者才能看到；出错时 abortStore 回滚。
+    // 期间持有写锁，各步骤须在同一线程上调用。store 等价于依次调用
+    // beginStore、storeDeltas、storeUnchanged 和 finishStore。
+    void beginStore(const Snapshot& snapshot);
+    void storeDeltas(const std::vector<FileDelta>& deltas);
+    // 沿用父快照（beginStore 时的最新快照）中这些文件的项，不需要内容；
+    // 父快照中没有的路径抛出异常
+    void storeUnchanged(const std::vector<std::string>& paths);
+    std::string finishStore();
+    void abortStore();
     Snapshot load(const std::string& snapshotId) const;
+    // 只读取并重建某个快照中的单个文件；快照或文件不存在时返回 false
+    bool loadFile(const std::string& snapshotId, const std::string& path, std::vector<uint8_t>& content) const;
+    // 同上，但内容按块直接写入 fd：补丁链一次遍历应用，不在内存中组装完整文件
+    bool loadFile(const std::string& snapshotId, const std::string& path, int fd) const;
+    // 快照中所有文件的元数据，不读取内容；快照不存在时为空。
+    // 路径驻留到 paths 中，多份清单共用一张表时同一路径得到同一节点
+    std::vector<ManifestEntry> manifest(const std::string& snapshotId, PathTable& paths) const;
+    // 从 fromId 到 toId 有变化的文件，不含内容。按目录树比较，哈希相同的子树整棵跳过；
+    // 两边哈希和大小都相同的文件不列出。任一快照不存在时抛出异常
+    std::vector<ManifestChange> compare(const std::string& fromId, const std::string& toId, PathTable& paths) const;
     std::vector<Snapshot> list() const;
     bool remove(const std::string& snapshotId);
     void cleanup();
+    // 在当前线程上以同一个读事务执行 fn：其中的所有查询看到同一个已提交版本，
+    // 不受并发写入和压缩影响。可以嵌套，内层直接复用外层的视图。
+    void readSnapshot(const std::function<void()>& fn) const;
     
     std::string lastSnapshotId() const;
     
+    // 比此时间更新的快照保持完整内容，更旧的在后台改写为反向增量
+    void setDeltaHotWindow(int seconds);
+    // 超过上限时在下一次存储后删除最旧的快照
+    void setMaxSnapshots(int count);
+    // 记录写入、清理和压缩阶段的耗时与计数；需在 init 之前设置，metrics 的生命周期须长于本对象
+    void setMetrics(PipelineMetrics* metrics);
+    
 private:
     class Impl;
     std::unique_ptr<Impl> impl_;
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace clay {
+
+// 可选的跨线程跨度追踪，输出 Chrome trace（Perfetto 可直接打开）。
+// 每个线程首次记录时分配自己的环形缓冲区，写入不加锁；满了覆盖最旧的事件。
+// 只有在守护进程级启用（clay.conf 的 trace = true）或当前线程在追踪某个请求时才记录。
+class Tracer {
+public:
+    static constexpr size_t kRingSize = 4096;
+    static constexpr size_t kDetailSize = 32;
+
+    struct Event {
+        const char* category;  // 字符串字面量
+        const char* name;      // 字符串字面量
+        uint64_t startNs;      // 相对进程内追踪起点
+        uint64_t durationNs;
+        uint32_t tid;
+        char detail[kDetailSize]; // 截断的附加信息（命令、路径等）
+    };
+
+    static Tracer& instance();
+
+    static bool active() {
+        return enabledCount_.load(std::memory_order_relaxed) > 0 || threadForced_;
+    }
+
+    // 守护进程级启用计数：每个配置了 trace = true 的工作区持有一个
+    void acquire() { enabledCount_.fetch_add(1, std::memory_order_relaxed); }
+    void release() { enabledCount_.fetch_sub(1, std::memory_order_relaxed); }
+
+    // 在作用域内为当前线程强制启用，用于追踪单个请求
+    class ThreadScope {
+    public:
+        ThreadScope() : previous_(threadForced_) { threadForced_ = true; }
+        ~ThreadScope() { threadForced_ = previous_; }
+    private:
+        bool previous_;
+    };
+
+    static uint64_t now();
+    void record(const char* category, const char* name, uint64_t startNs, uint64_t endNs,
+                std::string_view detail);
+
+    // 所有线程中与 [fromNs, toNs] 有重叠且尚未被覆盖的事件，按开始时间排序
+    std::vector<Event> collect(uint64_t fromNs, uint64_t toNs) const;
+    // 写出 Chrome trace JSON 文件（先写临时文件再改名）
+    static bool writeChromeTrace(const std::string& path, const std::vector<Event>& events);
+    // 写到 <workspace>/.clay/traces/<name>.json（name 中 [A-Za-z0-9_-] 以外的字符换成 _），
+    // 只保留最近 kMaxTraceFiles 个；失败时返回空
+    static constexpr size_t kMaxTraceFiles = 50;
+    static std::string writeWorkspaceTrace(const std::string& workspace, const std::string& name,
+                                           const std::vector<Event>& events);
+
+private:
+    Tracer() = default;
+
+    struct Ring;
+    Ring& threadRing();
+
+    static inline std::atomic<int> enabledCount_{0};
+    static inline thread_local bool threadForced_ = false;
+
+    mutable std::mutex mutex_; // 只保护 rings_ 列表，记录事件不经过它
+    std::vector<std::shared_ptr<Ring>> rings_;
+};
+
+// 记录一个完整跨度；未启用时只有一次原子读和一次线程局部读
+class TraceScope {
+public:
+    TraceScope(const char* category, const char* name, std::string_view detail = {})
+        : category_(category), name_(name) {
+        if (!Tracer::active()) return;
+        detailSize_ = detail.copy(detail_, sizeof(detail_));
+        startNs_ = Tracer::now();
+    }
+    ~TraceScope() {
+        if (startNs_) {
+            Tracer::instance().record(category_, name_, startNs_, Tracer::now(),
+                                      std::string_view(detail_, detailSize_));
+        }
+    }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* category_;
+    const char* name_;
+    uint64_t startNs_ = 0; // 0 表示未启用
+    size_t detailSize_ = 0;
+    char detail_[Tracer::kDetailSize - 1];
+};
+
+} // namespace clay
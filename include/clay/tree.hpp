@@ -0,0 +1,48 @@
+#pragma once
+
+#include "delta.hpp"
+#include "hash.hpp"
+#include "snapshot.hpp"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace clay {
+
+// 目录树节点（类似 git tree）中的一项：文件或子目录。
+// 文件项记录内容元数据和保存其内容的快照（source）；未修改的文件沿用父快照的项，
+// 所以没有变化的目录编码相同、哈希相同，可以在快照之间整棵共用。
+struct TreeEntry {
+    enum Type : uint8_t { File = 0, Directory = 1 };
+
+    Type type = File;
+    std::string name;
+    // 文件
+    FileDelta::Action action = FileDelta::MODIFY;
+    ContentKind kind = ContentKind::Unknown;
+    uint64_t size = 0;
+    std::optional<uint64_t> hash;  // fastHash，只用于快速判断不同
+    std::optional<Digest> digest;  // strongHash；判断内容相同以它为准，旧格式快照（每个文件一行）的项没有
+    std::string source;            // deltas 中保存内容的行的 snapshot_id
+    // 目录
+    Digest tree;
+
+    // 两个文件项指向同一行内容
+    bool sameFile(const TreeEntry& other) const {
+        return source == other.source && size == other.size && hash == other.hash &&
+               digest == other.digest && kind == other.kind && action == other.action;
+    }
+};
+
+// 按 (名称, 类型) 排序，与编码中的顺序一致
+bool treeOrder(const TreeEntry& a, const TreeEntry& b);
+
+// 编码一个目录节点；entries 先就地排序，同样的内容总是得到同样的字节
+void encodeTree(std::vector<TreeEntry>& entries, std::vector<uint8_t>& out);
+// 格式不合法时返回 false
+bool decodeTree(ByteView data, std::vector<TreeEntry>& entries);
+// 节点的 BLAKE3 哈希，用作 trees 表的键
+Digest treeHash(const std::vector<uint8_t>& encoded);
+
+} // namespace clay
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <functional>
 #include <string>
 #include <vector>
@@ -10,14 +11,30 @@ namespace clay {
 class Watcher {
 public:
     using EventCallback = std::function<void(const std::string& path, bool isDir)>;
+    // 返回 false 的目录及其子树不加监视（例如 .clay、build/）
+    using DirectoryFilter = std::function<bool(const std::string& path)>;
+    // 内核事件队列溢出：期间的变化已丢失，调用方需要重新扫描
+    using OverflowCallback = std::function<void()>;
+
+    struct Stats {
+        uint64_t events = 0;    // 交给 EventCallback 的事件
+        uint64_t overflows = 0;
+        uint64_t watches = 0;   // 当前监视的目录数
+    };
     
     Watcher(const std::string& path, 
             const std::vector<std::string>& ignorePatterns,
             EventCallback callback);
     ~Watcher();
     
+    // 监视整个子树；新建的目录在事件到达时加入，其中已有的条目会补报一次
     void start();
     void stop();
+
+    // 以下两项需在 start 之前设置
+    void setDirectoryFilter(DirectoryFilter filter);
+    void setOverflowCallback(OverflowCallback callback);
+    Stats stats() const;
     
 private:
     class Impl;
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace clay {
+
+class Core;
+
+// 守护进程托管的工作区：每个工作区独立的 Core（存储、监视），
+// 共享同一个调度器、工作线程池和自动保存定时线程
+class WorkspaceManager {
+public:
+    static WorkspaceManager& instance();
+
+    // 托管列表保存在 statePath 中；守护进程重启后由后台线程逐个重新打开，
+    // 在此之前到达的请求只等待（或直接打开）自己所在的工作区
+    void start(const std::string& statePath);
+    // 关闭所有工作区（列表保留，供下次启动恢复）
+    void stop();
+
+    // create 为 false 时只打开已初始化（存在 .clay 目录）的工作区。
+    // 存储打开后即返回，文件监视由后台作业注册
+    std::shared_ptr<Core> open(const std::string& path, bool create);
+    // 已托管则直接返回；否则按需打开已初始化的工作区；不是工作区返回 nullptr
+    std::shared_ptr<Core> find(const std::string& path);
+    // 只返回已打开的工作区，不触发打开，也不等待正在打开的
+    std::shared_ptr<Core> opened(const std::string& path) const;
+    bool close(const std::string& path);
+
+    // 所有托管的工作区（包括尚未恢复完成的）
+    std::vector<std::string> paths() const;
+    // 等待后台恢复或正在打开的工作区
+    std::vector<std::string> pending() const;
+    size_t size() const;
+
+    // 规范化路径，作为工作区的唯一键
+    static std::string canonical(const std::string& path);
+
+private:
+    WorkspaceManager();
+    ~WorkspaceManager();
+    WorkspaceManager(const WorkspaceManager&) = delete;
+    WorkspaceManager& operator=(const WorkspaceManager&) = delete;
+
+    class Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+} // namespace clay
@@ -0,0 +1,173 @@
+#include "clay/hash.hpp"
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <thread>
+
+namespace clay {
+
+// BLAKE3-256（无密钥、32 字节输出）。输入按 1 KiB 分块，块的链接值再两两合并成二叉树；
+// 左子树总是不超过剩余长度的最大 2 的幂个块，所以子树可以独立计算，拆分方式不影响结果。
+namespace {
+
+constexpr size_t kBlockLen = 64;
+constexpr size_t kChunkLen = 1024;
+
+constexpr uint32_t kChunkStart = 1 << 0;
+constexpr uint32_t kChunkEnd = 1 << 1;
+constexpr uint32_t kParent = 1 << 2;
+constexpr uint32_t kRoot = 1 << 3;
+
+constexpr uint32_t kIV[8] = {
+    0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19,
+};
+
+constexpr uint8_t kSchedule[7][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8},
+    {3, 4, 10, 12, 13, 2, 7, 14, 6, 5, 9, 0, 11, 15, 8, 1},
+    {10, 7, 12, 9, 14, 3, 13, 15, 4, 0, 11, 2, 5, 8, 1, 6},
+    {12, 13, 9, 11, 15, 10, 14, 8, 7, 2, 5, 3, 0, 1, 6, 4},
+    {9, 14, 11, 5, 8, 12, 15, 1, 13, 3, 0, 10, 2, 6, 4, 7},
+    {11, 15, 5, 0, 1, 9, 8, 6, 14, 10, 2, 12, 3, 4, 7, 13},
+};
+
+struct ChainingValue {
+    uint32_t words[8];
+};
+
+inline uint32_t rotr32(uint32_t v, int r) { return (v >> r) | (v << (32 - r)); }
+
+inline void g(uint32_t* s, int a, int b, int c, int d, uint32_t x, uint32_t y) {
+    s[a] = s[a] + s[b] + x;
+    s[d] = rotr32(s[d] ^ s[a], 16);
+    s[c] = s[c] + s[d];
+    s[b] = rotr32(s[b] ^ s[c], 12);
+    s[a] = s[a] + s[b] + y;
+    s[d] = rotr32(s[d] ^ s[a], 8);
+    s[c] = s[c] + s[d];
+    s[b] = rotr32(s[b] ^ s[c], 7);
+}
+
+// 压缩函数；只需要 32 字节输出，所以只保留前 8 个字
+ChainingValue compress(const ChainingValue& cv, const uint8_t block[kBlockLen], uint8_t blockLen,
+                       uint64_t counter, uint32_t flags) {
+    uint32_t m[16];
+    for (int i = 0; i < 16; ++i) {
+        m[i] = static_cast<uint32_t>(block[4 * i]) | (static_cast<uint32_t>(block[4 * i + 1]) << 8) |
+               (static_cast<uint32_t>(block[4 * i + 2]) << 16) | (static_cast<uint32_t>(block[4 * i + 3]) << 24);
+    }
+
+    uint32_t s[16] = {
+        cv.words[0], cv.words[1], cv.words[2], cv.words[3],
+        cv.words[4], cv.words[5], cv.words[6], cv.words[7],
+        kIV[0], kIV[1], kIV[2], kIV[3],
+        static_cast<uint32_t>(counter), static_cast<uint32_t>(counter >> 32), blockLen, flags,
+    };
+
+    for (const auto& r : kSchedule) {
+        g(s, 0, 4, 8, 12, m[r[0]], m[r[1]]);
+        g(s, 1, 5, 9, 13, m[r[2]], m[r[3]]);
+        g(s, 2, 6, 10, 14, m[r[4]], m[r[5]]);
+        g(s, 3, 7, 11, 15, m[r[6]], m[r[7]]);
+        g(s, 0, 5, 10, 15, m[r[8]], m[r[9]]);
+        g(s, 1, 6, 11, 12, m[r[10]], m[r[11]]);
+        g(s, 2, 7, 8, 13, m[r[12]], m[r[13]]);
+        g(s, 3, 4, 9, 14, m[r[14]], m[r[15]]);
+    }
+
+    ChainingValue out;
+    for (int i = 0; i < 8; ++i) out.words[i] = s[i] ^ s[i + 8];
+    return out;
+}
+
+ChainingValue initialValue() {
+    ChainingValue cv;
+    std::memcpy(cv.words, kIV, sizeof(kIV));
+    return cv;
+}
+
+// 单个块（不超过 1 KiB）的链接值；rootFlag 只加在最后一个压缩上
+ChainingValue chunkValue(const uint8_t* in, size_t len, uint64_t counter, uint32_t rootFlag) {
+    ChainingValue cv = initialValue();
+    size_t blocks = len == 0 ? 1 : (len + kBlockLen - 1) / kBlockLen;
+    for (size_t b = 0; b < blocks; ++b) {
+        size_t offset = b * kBlockLen;
+        size_t n = std::min(kBlockLen, len - offset);
+        uint8_t block[kBlockLen] = {};
+        if (n) std::memcpy(block, in + offset, n);
+
+        uint32_t flags = 0;
+        if (b == 0) flags |= kChunkStart;
+        if (b + 1 == blocks) flags |= kChunkEnd | rootFlag;
+        cv = compress(cv, block, static_cast<uint8_t>(n), counter, flags);
+    }
+    return cv;
+}
+
+ChainingValue parentValue(const ChainingValue& left, const ChainingValue& right, uint32_t rootFlag) {
+    uint8_t block[kBlockLen];
+    for (int i = 0; i < 8; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            block[4 * i + j] = static_cast<uint8_t>(left.words[i] >> (8 * j));
+            block[32 + 4 * i + j] = static_cast<uint8_t>(right.words[i] >> (8 * j));
+        }
+    }
+    return compress(initialValue(), block, kBlockLen, 0, kParent | rootFlag);
+}
+
+// 左子树长度：不超过 (len - 1) 的最大 2 的幂个完整块
+size_t leftSubtreeLen(size_t len) {
+    size_t fullChunks = (len - 1) / kChunkLen;
+    size_t power = 1;
+    while (power * 2 <= fullChunks) power *= 2;
+    return power * kChunkLen;
+}
+
+// threads 为可用于这棵子树的线程数；大于 1 且子树足够大时左子树交给新线程
+ChainingValue subtreeValue(const uint8_t* in, size_t len, uint64_t counter, unsigned threads, uint32_t rootFlag) {
+    if (len <= kChunkLen) return chunkValue(in, len, counter, rootFlag);
+
+    size_t leftLen = leftSubtreeLen(len);
+    uint64_t rightCounter = counter + leftLen / kChunkLen;
+    ChainingValue left, right;
+    if (threads > 1 && len >= kParallelHashThreshold) {
+        unsigned leftThreads = threads / 2;
+        auto pending = std::async(std::launch::async, [=] {
+            return subtreeValue(in, leftLen, counter, leftThreads, 0);
+        });
+        right = subtreeValue(in + leftLen, len - leftLen, rightCounter, threads - leftThreads, 0);
+        left = pending.get();
+    } else {
+        left = subtreeValue(in, leftLen, counter, 1, 0);
+        right = subtreeValue(in + leftLen, len - leftLen, rightCounter, 1, 0);
+    }
+    return parentValue(left, right, rootFlag);
+}
+
+} // namespace
+
+std::string Digest::hex() const {
+    static const char* digits = "0123456789abcdef";
+    std::string out;
+    out.reserve(bytes.size() * 2);
+    for (uint8_t b : bytes) {
+        out.push_back(digits[b >> 4]);
+        out.push_back(digits[b & 0xf]);
+    }
+    return out;
+}
+
+Digest strongHash(const void* data, size_t size, unsigned maxThreads) {
+    static const unsigned hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    if (maxThreads == 0) maxThreads = hardwareThreads;
+    ChainingValue root = subtreeValue(static_cast<const uint8_t*>(data), size, 0, maxThreads, kRoot);
+
+    Digest digest;
+    for (int i = 0; i < 8; ++i) {
+        for (int j = 0; j < 4; ++j) digest.bytes[4 * i + j] = static_cast<uint8_t>(root.words[i] >> (8 * j));
+    }
+    return digest;
+}
+
+} // namespace clay
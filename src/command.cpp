@@ -1,17 +1,223 @@
 #include "clay/command.hpp"
 #include "clay/core.hpp"
+#include "clay/daemon.hpp"
+#include "clay/json.hpp"
+#include "clay/memory.hpp"
+#include "clay/metrics.hpp"
+#include "clay/scheduler.hpp"
+#include "clay/status_page.hpp"
+#include "clay/workspace.hpp"
 #include <vector>
 #include <algorithm>
+#include <cctype>
 #include <iomanip>
 #include <ctime>
 #include <sstream>
 #include <filesystem>
+#include <chrono>
+#include <csignal>
+#include <unistd.h>
 
 namespace fs = std::filesystem;
 
 namespace clay {
 
-int Command::execute(const std::vector<std::string>& args, std::ostream& out) {
+namespace {
+
+Core& requireCore(Core* core) {
+    if (!core) {
+        throw std::runtime_error("Not inside a Clay workspace. Use 'clay init' to start.");
+    }
+    return *core;
+}
+
+// 守护进程每秒刷新一次心跳，超过这个时间视为状态页已失效
+constexpr int64_t kStatusStaleMs = 5000;
+
+int64_t nowMillis() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+void writeStatusData(const StatusData& data, std::ostream& out) {
+    out << "Last snapshot: ";
+    if (data.lastSnapshotTime == 0) {
+        out << "none" << std::endl;
+    } else {
+        time_t t = static_cast<time_t>(data.lastSnapshotTime);
+        out << data.lastSnapshotId << " at " << std::put_time(std::localtime(&t), "%Y-%m-%d %H:%M:%S")
+            << " (" << data.lastSnapshotMessage << ")" << std::endl;
+    }
+    out << "Dirty files: " << data.dirtyFiles << std::endl;
+    out << "Capture: " << (data.captureInProgress ? "in progress" : "idle") << std::endl;
+    out << "Jobs: " << data.runningJobs << " running, " << data.queuedJobs << " queued" << std::endl;
+}
+
+// batch 只允许不修改仓库的命令，保证整批结果来自同一个读快照
+bool isBatchReadCommand(const std::vector<std::string>& args) {
+    const std::string& name = args[0];
+    if (name == "jobs") return args.size() == 1;
+    return name == "timeline" || name == "diff" || name == "status" || name == "stats" || name == "help";
+}
+
+// 按空白切分一行命令，双引号内的空白不切分
+bool splitCommandLine(const std::string& line, std::vector<std::string>& args, std::string& error) {
+    std::string token;
+    bool inToken = false, quoted = false;
+    for (char c : line) {
+        if (quoted) {
+            if (c == '"') quoted = false;
+            else token.push_back(c);
+        } else if (c == '"') {
+            quoted = inToken = true;
+        } else if (std::isspace(static_cast<unsigned char>(c))) {
+            if (inToken) args.push_back(std::move(token));
+            token.clear();
+            inToken = false;
+        } else {
+            token.push_back(c);
+            inToken = true;
+        }
+    }
+    if (quoted) {
+        error = "Unterminated quote in: " + line;
+        return false;
+    }
+    if (inToken) args.push_back(std::move(token));
+    return true;
+}
+
+// 只支持 batch 需要的 JSON 子集：字符串以及由字符串或字符串数组组成的数组
+class JsonInput {
+public:
+    explicit JsonInput(const std::string& text) : text_(text) {}
+
+    bool parse(std::vector<std::vector<std::string>>& commands, std::string& error) {
+        if (!expect('[')) return fail(error, "expected '['");
+        if (!peek(']')) {
+            do {
+                std::vector<std::string> args;
+                if (peek('[')) {
+                    expect('[');
+                    if (!peek(']')) {
+                        do {
+                            std::string arg;
+                            if (!string(arg)) return fail(error, "expected string argument");
+                            args.push_back(std::move(arg));
+                        } while (expect(','));
+                    }
+                    if (!expect(']')) return fail(error, "expected ']'");
+                } else {
+                    std::string line;
+                    if (!string(line)) return fail(error, "expected command array or string");
+                    if (!splitCommandLine(line, args, error)) return false;
+                }
+                commands.push_back(std::move(args));
+            } while (expect(','));
+        }
+        if (!expect(']')) return fail(error, "expected ']'");
+        skipSpace();
+        if (pos_ != text_.size()) return fail(error, "trailing characters");
+        return true;
+    }
+
+private:
+    bool fail(std::string& error, const char* what) {
+        error = "Invalid JSON at offset " + std::to_string(pos_) + ": " + what;
+        return false;
+    }
+
+    void skipSpace() {
+        while (pos_ < text_.size() && std::isspace(static_cast<unsigned char>(text_[pos_]))) pos_++;
+    }
+
+    bool peek(char c) {
+        skipSpace();
+        return pos_ < text_.size() && text_[pos_] == c;
+    }
+
+    bool expect(char c) {
+        if (!peek(c)) return false;
+        pos_++;
+        return true;
+    }
+
+    bool hex4(uint32_t& value) {
+        if (pos_ + 4 > text_.size()) return false;
+        value = 0;
+        for (int i = 0; i < 4; i++) {
+            char c = text_[pos_++];
+            value <<= 4;
+            if (c >= '0' && c <= '9') value |= c - '0';
+            else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+            else return false;
+        }
+        return true;
+    }
+
+    static void appendUtf8(std::string& out, uint32_t cp) {
+        if (cp < 0x80) {
+            out.push_back(static_cast<char>(cp));
+        } else if (cp < 0x800) {
+            out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        } else if (cp < 0x10000) {
+            out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        } else {
+            out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+        }
+    }
+
+    bool string(std::string& out) {
+        if (!expect('"')) return false;
+        while (pos_ < text_.size()) {
+            char c = text_[pos_++];
+            if (c == '"') return true;
+            if (c != '\\') {
+                out.push_back(c);
+                continue;
+            }
+            if (pos_ >= text_.size()) return false;
+            char e = text_[pos_++];
+            switch (e) {
+                case '"': case '\\': case '/': out.push_back(e); break;
+                case 'b': out.push_back('\b'); break;
+                case 'f': out.push_back('\f'); break;
+                case 'n': out.push_back('\n'); break;
+                case 'r': out.push_back('\r'); break;
+                case 't': out.push_back('\t'); break;
+                case 'u': {
+                    uint32_t cp;
+                    if (!hex4(cp)) return false;
+                    // 代理对
+                    if (cp >= 0xD800 && cp < 0xDC00 && text_.compare(pos_, 2, "\\u") == 0) {
+                        pos_ += 2;
+                        uint32_t low;
+                        if (!hex4(low) || low < 0xDC00 || low > 0xDFFF) return false;
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    appendUtf8(out, cp);
+                    break;
+                }
+                default: return false;
+            }
+        }
+        return false;
+    }
+
+    const std::string& text_;
+    size_t pos_ = 0;
+};
+
+} // namespace
+
+int Command::execute(const std::vector<std::string>& args, std::ostream& out, Core* core) {
     if (args.empty()) {
         help(out);
         return 1;
@@ -21,20 +227,27 @@ int Command::execute(const std::vector<std::string>& args, std::ostream& out) {
     
     try {
         if (command == "init") {
-            // 由main.cpp直接处理
-            out << "Initialized Clay repository" << std::endl;
+            init(requireCore(core), out);
+        } else if (command == "stop") {
+            stop(requireCore(core), out);
         } else if (command == "timeline") {
-            timeline(out);
+            timeline(requireCore(core), out);
         } else if (command == "rewind") {
-            rewind(args, out);
+            rewind(requireCore(core), args, out);
         } else if (command == "undo") {
-            undo(out);
+            undo(requireCore(core), out);
         } else if (command == "branch") {
-            branch(args, out);
+            branch(requireCore(core), args, out);
         } else if (command == "commit") {
-            commit(args, out);
+            commit(requireCore(core), args, out);
         } else if (command == "diff") {
-            diff(args, out);
+            diff(requireCore(core), args, out);
+        } else if (command == "status") {
+            status(args, out, core);
+        } else if (command == "jobs") {
+            jobs(args, out);
+        } else if (command == "stats") {
+            stats(requireCore(core), args, out);
         } else {
             out << "Unknown command: " << command << std::endl;
             help(out);
@@ -48,21 +261,25 @@ int Command::execute(const std::vector<std::string>& args, std::ostream& out) {
     return 0;
 }
 
-void Command::init(const std::vector<std::string>& args, std::ostream& out) {
-    std::string path = ".";
-    if (args.size() > 1) {
-        path = args[1];
-    }
+// 工作区由守护进程在路由请求时打开（必要时创建 .clay）
+void Command::init(Core& core, std::ostream& out) {
+    out << "Initialized Clay repository at " << core.workspace() << std::endl;
+}
+
+void Command::stop(Core& core, std::ostream& out) {
+    std::string workspace = core.workspace();
+    WorkspaceManager::instance().close(workspace);
+    out << "Stopped watching " << workspace << std::endl;
     
-    if (!Core::instance().init(path)) {
-        throw std::runtime_error("Failed to initialize Clay repository");
+    // 最后一个工作区关闭后守护进程退出
+    if (WorkspaceManager::instance().size() == 0) {
+        out << "Clay daemon stopped" << std::endl;
+        Daemon::instance().requestStop();
     }
-    
-    out << "Initialized Clay repository at " << path << std::endl;
 }
 
-void Command::timeline(std::ostream& out) {
-    auto snapshots = Core::instance().listSnapshots();
+void Command::timeline(Core& core, std::ostream& out) {
+    auto snapshots = core.listSnapshots();
     
     if (snapshots.empty()) {
         out << "No snapshots available" << std::endl;
@@ -72,11 +289,11 @@ void Command::timeline(std::ostream& out) {
     out << "Snapshot Timeline:" << std::endl;
     out << "------------------------------------------------" << std::endl;
     for (const auto& snap : snapshots) {
-        out << snap << std::endl;
+        out << snap << '\n';
     }
 }
 
-void Command::rewind(const std::vector<std::string>& args, std::ostream& out) {
+void Command::rewind(Core& core, const std::vector<std::string>& args, std::ostream& out) {
     if (args.size() < 2) {
         throw std::runtime_error("Usage: clay rewind <snapshot-id|time>");
     }
@@ -95,31 +312,31 @@ void Command::rewind(const std::vector<std::string>& args, std::ostream& out) {
     }
     // 作为快照ID
     else {
-        if (!Core::instance().restoreSnapshot(target)) {
+        if (!core.restoreSnapshot(target)) {
             throw std::runtime_error("Failed to restore snapshot: " + target);
         }
         out << "Restored snapshot: " << target << std::endl;
     }
 }
 
-void Command::undo(std::ostream& out) {
-    if (!Core::instance().undo()) {
+void Command::undo(Core& core, std::ostream& out) {
+    if (!core.undo()) {
         throw std::runtime_error("Failed to undo last change");
     }
     out << "Undo successful" << std::endl;
 }
 
-void Command::branch(const std::vector<std::string>& args, std::ostream& out) {
+void Command::branch(Core& core, const std::vector<std::string>& args, std::ostream& out) {
     if (args.size() < 2) {
         throw std::runtime_error("Usage: clay branch [--temp|--keep <name>]");
     }
     
     if (args[1] == "--temp") {
-        Core::instance().createTempBranch();
+        core.createTempBranch();
         out << "Created temporary branch" << std::endl;
     } 
     else if (args[1] == "--keep" && args.size() > 2) {
-        Core::instance().commitTempBranch(args[2]);
+        core.commitTempBranch(args[2]);
         out << "Committed branch as: " << args[2] << std::endl;
     }
     else {
@@ -127,21 +344,78 @@ void Command::branch(const std::vector<std::string>& args, std::ostream& out) {
     }
 }
 
-void Command::commit(const std::vector<std::string>& args, std::ostream& out) {
+void Command::commit(Core& core, const std::vector<std::string>& args, std::ostream& out) {
     std::string message = "Manual snapshot";
     if (args.size() > 1) {
         message = args[1];
     }
     
-    Core::instance().takeSnapshot(false, message);
+    core.takeSnapshot(false, message);
     out << "Created manual snapshot" << std::endl;
 }
 
+void Command::status(const std::vector<std::string>& args, std::ostream& out, Core* core) {
+    out << "Clay daemon: running (pid " << getpid() << ")" << std::endl;
+    out << "Workspace: " << (core ? core->workspace() : "not a Clay workspace") << std::endl;
+    StatusData data;
+    if (core && StatusPage::read(StatusPage::pathFor(core->workspace()), data)) {
+        writeStatusData(data, out);
+    }
+    
+    bool verbose = args.size() > 1 && args[1] == "-v";
+    if (!verbose) return;
+    
+    out << "Hosted workspaces:" << std::endl;
+    auto pending = WorkspaceManager::instance().pending();
+    for (const auto& path : WorkspaceManager::instance().paths()) {
+        bool restoring = std::find(pending.begin(), pending.end(), path) != pending.end();
+        out << "  " << path << (restoring ? " (restoring)" : "") << std::endl;
+    }
+    Daemon::instance().writeStats(out);
+}
+
+bool Command::localStatus(const std::string& workspace, std::ostream& out) {
+    StatusData data;
+    if (!StatusPage::read(StatusPage::pathFor(workspace), data)) return false;
+    // 工作区已关闭、守护进程已退出或不再刷新心跳时交给调用方回退
+    if (data.daemonPid <= 0 || kill(data.daemonPid, 0) < 0) return false;
+    if (nowMillis() - data.updatedAtMs > kStatusStaleMs) return false;
+    
+    out << "Clay daemon: running (pid " << data.daemonPid << ")" << std::endl;
+    out << "Workspace: " << workspace << std::endl;
+    writeStatusData(data, out);
+    return true;
+}
+
+void Command::jobs(const std::vector<std::string>& args, std::ostream& out) {
+    if (args.size() >= 3 && args[1] == "cancel") {
+        uint64_t id = std::stoull(args[2]);
+        if (!JobScheduler::instance().cancel(id)) {
+            throw std::runtime_error("No active job with id " + args[2]);
+        }
+        out << "Cancelling job " << id << std::endl;
+        return;
+    }
+    JobScheduler::instance().writeJobs(out);
+}
+
+void Command::stats(Core& core, const std::vector<std::string>& args, std::ostream& out) {
+    if (args.size() > 1 && args[1] == "--prometheus") {
+        core.metrics().writePrometheus(out, core.workspace());
+        MemoryBudget::instance().writePrometheus(out);
+        return;
+    }
+    out << "Workspace: " << core.workspace() << std::endl;
+    core.metrics().write(out);
+    MemoryBudget::instance().write(out);
+}
+
 void Command::help(std::ostream& out) {
     out << "Clay - Lightweight Version Control for Rapid Prototyping\n";
     out << "Usage: clay <command> [options]\n\n";
     out << "Commands:\n";
-    out << "  init [path]      Initialize a new repository\n";
+    out << "  init [path]      Initialize a repository and host it in the per-user daemon\n";
+    out << "  stop [--all]     Stop watching this workspace (--all stops the daemon)\n";
     out << "  timeline         List all snapshots\n";
     out << "  rewind <target>  Restore to snapshot or time (e.g., clay rewind 14:30)\n";
     out << "  undo             Undo last change\n";
@@ -149,22 +423,34 @@ void Command::help(std::ostream& out) {
     out << "  branch --keep <name> Commit temp branch as permanent\n";
     out << "  commit [msg]     Create manual snapshot\n";
     out << "  diff <time>      Show differences for snapshot at specified time\n";
+    out << "  diff --stat <time> Show per-file insert/delete counts only\n";
+    out << "  status [-v]      Show daemon state; -v adds workspaces and request latency\n";
+    out << "  jobs [cancel <id>] List or cancel background and running jobs\n";
+    out << "  stats [--prometheus] Show snapshot pipeline phase timings, counters and memory usage\n";
+    out << "  --trace <command> Record a Chrome trace of the request in .clay/traces/\n";
+    out << "  batch            Run read-only commands from stdin (lines or JSON) in one request; prints JSON\n";
 }
 
-void Command::diff(const std::vector<std::string>& args, std::ostream& out) {
-    if (args.size() < 2) {
-        throw std::runtime_error("Usage: clay diff <snapshot-time|snapshot-id>");
-    }
+void Command::diff(Core& core, const std::vector<std::string>& args, std::ostream& out) {
+    DiffOptions options;
     
     // 合并所有参数（解决带空格的时间格式问题）
     std::string target;
     for (size_t i = 1; i < args.size(); ++i) {
+        if (args[i] == "--stat") {
+            options.statOnly = true;
+            continue;
+        }
         if (!target.empty()) target += " ";
         target += args[i];
     }
     
+    if (target.empty()) {
+        throw std::runtime_error("Usage: clay diff [--stat] <snapshot-time|snapshot-id>");
+    }
+    
     std::string targetId;
-    auto snapshots = Core::instance().listSnapshots();
+    auto snapshots = core.listSnapshots();
     bool found = false;
     
     // 1. 首先尝试直接作为ID匹配
@@ -184,7 +470,7 @@ void Command::diff(const std::vector<std::string>& args, std::ostream& out) {
     if (!found) {
         try {
             // 使用核心功能查找最接近的快照
-            targetId = Core::instance().findClosestSnapshot(target);
+            targetId = core.findClosestSnapshot(target);
             found = true;
         } catch (...) {
             // 忽略错误，继续尝试其他方法
@@ -226,8 +512,82 @@ void Command::diff(const std::vector<std::string>& args, std::ostream& out) {
         throw std::runtime_error("No snapshot found for: " + target);
     }
     
-    // 获取差异并输出
-    std::string diffOutput = Core::instance().getDiff(targetId);
-    out << diffOutput;
+    // 差异边生成边输出
+    core.diff(targetId, out, options);
 }
-} // namespace clay
\ No newline at end of file
+
+int Command::batch(Core* core, const std::vector<std::vector<std::string>>& commands, std::ostream& out) {
+    if (!core) {
+        out << "{\"workspace\":null,\"error\":"
+            << jsonQuote("Not inside a Clay workspace. Use 'clay init' to start.") << "}" << std::endl;
+        return 1;
+    }
+
+    int exitCode = 0;
+    std::ostringstream results;
+    std::string snapshotId;
+    try {
+        core->withReadSnapshot([&] {
+            snapshotId = core->currentSnapshotId();
+            bool first = true;
+            for (const auto& args : commands) {
+                std::ostringstream output;
+                int code;
+                if (args.empty() || !isBatchReadCommand(args)) {
+                    output << "Error: '" << (args.empty() ? "" : args[0]) << "' is not allowed in a batch" << std::endl;
+                    code = 1;
+                } else {
+                    code = execute(args, output, core);
+                }
+                if (code != 0) exitCode = 1;
+
+                results << (first ? "" : ",") << "{\"command\":[";
+                for (size_t i = 0; i < args.size(); i++) {
+                    results << (i ? "," : "") << jsonQuote(args[i]);
+                }
+                results << "],\"exit_code\":" << code << ",\"output\":" << jsonQuote(output.str()) << "}";
+                first = false;
+            }
+        });
+    } catch (const std::exception& e) {
+        out << "{\"workspace\":" << jsonQuote(core->workspace()) << ",\"error\":" << jsonQuote(e.what())
+            << "}" << std::endl;
+        return 1;
+    }
+
+    out << "{\"workspace\":" << jsonQuote(core->workspace()) << ",\"snapshot\":";
+    if (snapshotId.empty()) out << "null";
+    else out << jsonQuote(snapshotId);
+    out << ",\"results\":[" << results.str() << "]}" << std::endl;
+    return exitCode;
+}
+
+bool Command::parseBatch(const std::string& text, std::vector<std::vector<std::string>>& commands,
+                         std::string& error) {
+    size_t start = text.find_first_not_of(" \t\r\n");
+    if (start != std::string::npos && text[start] == '[') {
+        if (!JsonInput(text).parse(commands, error)) return false;
+    } else {
+        std::istringstream in(text);
+        std::string line;
+        while (std::getline(in, line)) {
+            std::vector<std::string> args;
+            if (!splitCommandLine(line, args, error)) return false;
+            if (args.empty() || args[0][0] == '#') continue;
+            commands.push_back(std::move(args));
+        }
+    }
+    for (const auto& args : commands) {
+        if (args.empty()) {
+            error = "Empty command in batch";
+            return false;
+        }
+    }
+    if (commands.empty()) {
+        error = "No commands given";
+        return false;
+    }
+    return true;
+}
+
+} // namespace clay
@@ -0,0 +1,211 @@
+#include "clay/config.hpp"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+namespace clay {
+
+namespace {
+
+std::string trim(const std::string& str) {
+    auto start = std::find_if_not(str.begin(), str.end(),
+        [](unsigned char c) { return std::isspace(c); });
+    auto end = std::find_if_not(str.rbegin(), str.rend(),
+        [](unsigned char c) { return std::isspace(c); }).base();
+    return (start < end) ? std::string(start, end) : "";
+}
+
+std::string lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::tolower(c); });
+    return s;
+}
+
+// '*' 通配的迭代匹配：失配时回退到上一个 '*' 多吞一个字符
+bool wildcardMatch(const std::string& pattern, const std::string& text) {
+    size_t p = 0, t = 0;
+    size_t star = std::string::npos, mark = 0;
+    while (t < text.size()) {
+        if (p < pattern.size() && pattern[p] == '*') {
+            star = p++;
+            mark = t;
+        } else if (p < pattern.size() && pattern[p] == text[t]) {
+            p++;
+            t++;
+        } else if (star != std::string::npos) {
+            p = star + 1;
+            t = ++mark;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*') p++;
+    return p == pattern.size();
+}
+
+bool parseBool(const std::string& value) {
+    std::string v = lower(value);
+    if (v == "true" || v == "yes" || v == "on" || v == "1") return true;
+    if (v == "false" || v == "no" || v == "off" || v == "0") return false;
+    throw std::invalid_argument("not a boolean");
+}
+
+// 字节数，可带 K/M/G 后缀（1024 进制）
+uint64_t parseSize(const std::string& value) {
+    size_t used = 0;
+    uint64_t n = std::stoull(value, &used);
+    std::string suffix = lower(trim(value.substr(used)));
+    if (suffix.empty() || suffix == "b") return n;
+    if (suffix == "k" || suffix == "kb") return n << 10;
+    if (suffix == "m" || suffix == "mb") return n << 20;
+    if (suffix == "g" || suffix == "gb") return n << 30;
+    throw std::invalid_argument("bad size suffix");
+}
+
+IoPriority parseIoPriority(const std::string& value) {
+    std::string v = lower(value);
+    if (v == "idle") return IoPriority::Idle;
+    if (v == "low") return IoPriority::Low;
+    if (v == "normal") return IoPriority::Normal;
+    throw std::invalid_argument("bad io priority");
+}
+
+} // namespace
+
+IgnoreMatcher::IgnoreMatcher(const std::vector<std::string>& patterns) {
+    for (const auto& pattern : patterns) {
+        if (pattern.empty()) continue;
+        if (pattern.find('*') != std::string::npos) {
+            rules_.push_back({Kind::Glob, lower(pattern)});
+        } else if (pattern.back() == '/') {
+            rules_.push_back({Kind::Directory, pattern.substr(0, pattern.size() - 1)});
+        } else {
+            rules_.push_back({Kind::Exact, pattern});
+        }
+    }
+}
+
+bool IgnoreMatcher::matches(const std::string& relPath) const {
+    std::string lowered;
+    for (const auto& rule : rules_) {
+        switch (rule.kind) {
+            case Kind::Exact:
+                if (relPath == rule.text) return true;
+                break;
+            case Kind::Directory:
+                if (relPath.compare(0, rule.text.size(), rule.text) == 0 &&
+                    (relPath.size() == rule.text.size() || relPath[rule.text.size()] == '/')) {
+                    return true;
+                }
+                break;
+            case Kind::Glob:
+                if (lowered.empty()) lowered = lower(relPath);
+                if (wildcardMatch(rule.text, lowered)) return true;
+                break;
+        }
+    }
+    return false;
+}
+
+bool IgnoreMatcher::matchesTree(const std::string& relDir) const {
+    std::string lowered;
+    for (const auto& rule : rules_) {
+        switch (rule.kind) {
+            case Kind::Exact:
+                break;
+            case Kind::Directory:
+                if (relDir.compare(0, rule.text.size(), rule.text) == 0 &&
+                    (relDir.size() == rule.text.size() || relDir[rule.text.size()] == '/')) {
+                    return true;
+                }
+                break;
+            case Kind::Glob:
+                // 结尾的 '*' 能吸收任意后缀：匹配 "relDir/" 就匹配其下所有路径
+                if (rule.text.back() != '*') break;
+                if (lowered.empty()) lowered = lower(relDir) + "/";
+                if (wildcardMatch(rule.text, lowered)) return true;
+                break;
+        }
+    }
+    return false;
+}
+
+std::string IgnoreMatcher::baseDirectory(const std::string& pattern) {
+    std::string literal = pattern.substr(0, pattern.find('*'));
+    size_t slash = literal.rfind('/');
+    return slash == std::string::npos ? "" : literal.substr(0, slash);
+}
+
+const char* const Config::kDefaultText = R"(
+[core]
+autosave_interval = 30
+idle_threshold = 5
+max_snapshots = 100
+delta_hot_window = 300
+metrics_export = false
+trace = false
+memory_budget = 0
+io_limit = 0
+io_ops_limit = 0
+io_priority = low
+pressure_backoff = true
+ignore_patterns = *.tmp, *.swp, build/, .git/
+)";
+
+std::shared_ptr<const Config> Config::load(const std::string& path) {
+    auto config = std::make_shared<Config>();
+
+    std::ifstream confFile(path);
+    std::string line;
+    while (std::getline(confFile, line)) {
+        if (line.empty() || line[0] == '#' || line[0] == '[') continue;
+
+        size_t pos = line.find('=');
+        if (pos == std::string::npos) continue;
+
+        std::string key = trim(line.substr(0, pos));
+        std::string value = trim(line.substr(pos + 1));
+
+        try {
+            if (key == "autosave_interval") {
+                config->autosaveInterval = std::stoi(value);
+            } else if (key == "idle_threshold") {
+                config->idleThreshold = std::stoi(value);
+            } else if (key == "max_snapshots") {
+                config->maxSnapshots = std::stoi(value);
+            } else if (key == "delta_hot_window") {
+                config->deltaHotWindow = std::stoi(value);
+            } else if (key == "metrics_export") {
+                config->metricsExport = parseBool(value);
+            } else if (key == "trace") {
+                config->trace = parseBool(value);
+            } else if (key == "memory_budget") {
+                config->memoryBudget = parseSize(value);
+            } else if (key == "io_limit") {
+                config->ioLimit = parseSize(value);
+            } else if (key == "io_ops_limit") {
+                config->ioOpsLimit = std::stoull(value);
+            } else if (key == "io_priority") {
+                config->ioPriority = parseIoPriority(value);
+            } else if (key == "pressure_backoff") {
+                config->pressureBackoff = parseBool(value);
+            } else if (key == "ignore_patterns") {
+                config->ignorePatterns.clear();
+                size_t start = 0, end;
+                while ((end = value.find(',', start)) != std::string::npos) {
+                    config->ignorePatterns.push_back(trim(value.substr(start, end - start)));
+                    start = end + 1;
+                }
+                config->ignorePatterns.push_back(trim(value.substr(start)));
+            }
+        } catch (const std::exception&) {
+            std::cerr << "Ignoring invalid config value in " << path << ": " << line << std::endl;
+        }
+    }
+
+    config->ignore = IgnoreMatcher(config->ignorePatterns);
+    return config;
+}
+
+} // namespace clay
@@ -0,0 +1,139 @@
+#include "clay/content.hpp"
+#include "bsdiff.h"
+#include <cstdlib>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace clay {
+
+namespace {
+
+// 文本中常见的控制字符：\b \t \n \f \r ESC
+inline bool isTextControl(uint8_t c) {
+    return c == '\b' || c == '\t' || c == '\n' || c == '\f' || c == '\r' || c == 0x1b;
+}
+
+// bsdiff 需要约 16 倍输入大小的临时内存，超过此大小不计算补丁
+constexpr size_t kMaxPatchInput = 32 * 1024 * 1024;
+
+int countingWrite(struct bsdiff_stream* stream, const void*, int size) {
+    *static_cast<int64_t*>(stream->opaque) += size;
+    return 0;
+}
+
+std::vector<std::string_view> splitLines(const std::vector<uint8_t>& content) {
+    std::vector<std::string_view> lines;
+    const char* p = reinterpret_cast<const char*>(content.data());
+    const char* end = p + content.size();
+    while (p < end) {
+        const char* nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (!nl) nl = end;
+        lines.emplace_back(p, nl - p);
+        p = nl + 1;
+    }
+    return lines;
+}
+
+} // namespace
+
+ContentKind classifyContent(const uint8_t* data, size_t size) {
+    size_t control = 0;
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i highBits = _mm_set1_epi8(static_cast<char>(0xE0));
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero))) return ContentKind::Binary;
+
+        // c < 0x20 等价于 (c & 0xE0) == 0
+        __m128i ctrl = _mm_cmpeq_epi8(_mm_and_si128(v, highBits), zero);
+        __m128i allowed = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\b')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+            _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\f'))),
+                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(v, _mm_set1_epi8(0x1b)))));
+        int mask = _mm_movemask_epi8(_mm_andnot_si128(allowed, ctrl));
+        control += static_cast<size_t>(__builtin_popcount(mask));
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    for (; i + 16 <= size; i += 16) {
+        uint8x16_t v = vld1q_u8(data + i);
+        if (vmaxvq_u8(vceqzq_u8(v))) return ContentKind::Binary;
+
+        uint8x16_t ctrl = vcltq_u8(v, vdupq_n_u8(0x20));
+        uint8x16_t allowed = vorrq_u8(
+            vorrq_u8(vceqq_u8(v, vdupq_n_u8('\b')), vceqq_u8(v, vdupq_n_u8('\t'))),
+            vorrq_u8(
+                vorrq_u8(vceqq_u8(v, vdupq_n_u8('\n')), vceqq_u8(v, vdupq_n_u8('\f'))),
+                vorrq_u8(vceqq_u8(v, vdupq_n_u8('\r')), vceqq_u8(v, vdupq_n_u8(0x1b)))));
+        uint8x16_t bad = vbicq_u8(ctrl, allowed);
+        control += vaddvq_u8(vshrq_n_u8(bad, 7));
+    }
+#endif
+
+    for (; i < size; ++i) {
+        if (data[i] == 0) return ContentKind::Binary;
+        if (data[i] < 0x20 && !isTextControl(data[i])) control++;
+    }
+
+    // 控制字符超过约 1/32 视为二进制
+    return control * 32 > size ? ContentKind::Binary : ContentKind::Text;
+}
+
+int64_t bsdiffPatchSize(const std::vector<uint8_t>& oldContent,
+                        const std::vector<uint8_t>& newContent) {
+    if (oldContent.size() > kMaxPatchInput || newContent.size() > kMaxPatchInput) {
+        return -1;
+    }
+
+    int64_t total = 0;
+    struct bsdiff_stream stream;
+    stream.malloc = std::malloc;
+    stream.free = std::free;
+    stream.write = countingWrite;
+    stream.opaque = &total;
+
+    if (bsdiff(oldContent.data(), static_cast<int64_t>(oldContent.size()),
+               newContent.data(), static_cast<int64_t>(newContent.size()), &stream) != 0) {
+        return -1;
+    }
+    return total;
+}
+
+void diffLines(const std::vector<uint8_t>& prevContent,
+               const std::vector<uint8_t>& currContent,
+               const LineVisitor& visit) {
+    std::vector<std::string_view> prevLines = splitLines(prevContent);
+    std::vector<std::string_view> currLines = splitLines(currContent);
+
+    // 简单的行比较
+    size_t i = 0, j = 0;
+    while (i < prevLines.size() || j < currLines.size()) {
+        if (i < prevLines.size() && j < currLines.size() && prevLines[i] == currLines[j]) {
+            visit(' ', prevLines[i]);
+            i++;
+            j++;
+        } else {
+            if (i < prevLines.size()) visit('-', prevLines[i++]);
+            if (j < currLines.size()) visit('+', currLines[j++]);
+        }
+    }
+}
+
+LineStats diffLineStats(const std::vector<uint8_t>& prevContent,
+                        const std::vector<uint8_t>& currContent) {
+    LineStats stats;
+    diffLines(prevContent, currContent, [&stats](char op, std::string_view) {
+        if (op == '+') stats.insertions++;
+        else if (op == '-') stats.deletions++;
+    });
+    return stats;
+}
+
+} // namespace clay
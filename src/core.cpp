@@ -1,17 +1,40 @@
 #include "clay/core.hpp"
+#include "clay/config.hpp"
 #include "clay/snapshot.hpp"
 #include "clay/storage.hpp"
 #include "clay/watcher.hpp"
+#include "clay/content.hpp"
+#include "clay/memory.hpp"
+#include "clay/metrics.hpp"
+#include "clay/path_table.hpp"
+#include "clay/scan_cache.hpp"
+#include "clay/scheduler.hpp"
+#include "clay/status_page.hpp"
+#include "clay/trace.hpp"
+#include <dirent.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <fstream>
 #include <thread>
 #include <chrono>
 #include <iostream>
 #include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
 #include <atomic>
 #include <ctime>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <filesystem>
+#include <iterator>
+#include <set>
 #include <unordered_set>
-#include <regex>
+#include <sstream>
+#include <algorithm>
+#include <iomanip>
+#include <optional>
 
 namespace fs = std::filesystem;
 using namespace std::chrono;
@@ -27,12 +50,36 @@ public:
           running_(false),
           lastActivity_(steady_clock::now()),
           lastSnapshotTime_(steady_clock::now()),
-          tempBranchActive_(false) {}
+          tempBranchActive_(false) {
+        // 先构造调度器单例，保证静态析构时它晚于持有 Core 的对象
+        JobScheduler::instance();
+        Tracer::instance();
+    }
+    
+    ~Impl() {
+        stopWatching();
+        if (traceEnabled_) Tracer::instance().release();
+        if (!readOnly_) {
+            MemoryBudget::instance().setLimit(workspace_.string(), 0);
+            JobScheduler::instance().removeGovernor(workspace_.string());
+        }
+    }
     
-    bool init(const std::string& workspace) {
+    bool init(const std::string& workspace, OpenMode mode) {
         workspace_ = workspace;
         fs::path clayDir = workspace_ / ".clay";
         
+        if (mode == OpenMode::ReadOnly) {
+            storage_ = std::make_unique<Storage>(workspace_);
+            if (!storage_->init(OpenMode::ReadOnly)) {
+                std::cerr << "Failed to open storage read-only" << std::endl;
+                return false;
+            }
+            readOnly_ = true;
+            loadConfig();
+            return true;
+        }
+        
         if (!fs::exists(clayDir)) {
             if (!fs::create_directory(clayDir)) {
                 std::cerr << "Failed to create .clay directory" << std::endl;
@@ -44,60 +91,160 @@ public:
         if (!fs::exists(confPath)) {
             std::ofstream confFile(confPath);
             if (confFile) {
-                confFile << DEFAULT_CONFIG;
+                confFile << Config::kDefaultText;
                 confFile.close();
             }
         }
         
         storage_ = std::make_unique<Storage>(workspace_);
+        storage_->setMetrics(&metrics_);
         if (!storage_->init()) {
             std::cerr << "Failed to initialize storage" << std::endl;
             return false;
         }
+        // 上次运行留下的扫描缓存：启动后的第一次捕获也不必重新读取未修改的文件
+        ScanCache::load((clayDir / "scan.cache").string(), scanCache_);
         
-        loadIgnorePatterns();
+        loadConfig();
         return true;
     }
     
     void run() {
         running_ = true;
+        startWatching();
         
+        while (running_) {
+            tick();
+            std::unique_lock<std::mutex> lock(runMutex_);
+            runWake_.wait_for(lock, seconds(1), [this] { return !running_; });
+        }
+        
+        stopWatching();
+    }
+    
+    bool readOnly() const {
+        return readOnly_;
+    }
+    
+    void startWatching() {
+        requireWritable();
+        std::lock_guard<std::mutex> lock(watchMutex_);
+        if (watcher_) return;
+        openStatusPage();
+        // 忽略规则是通配符，由 isIgnored 统一匹配
         watcher_ = std::make_unique<Watcher>(
             workspace_.string(),
-            ignorePatterns_,
+            std::vector<std::string>(),
             [this](const std::string& path, bool isDir) {
-                if (!isDir) lastActivity_ = steady_clock::now();
+                if (isDir || isIgnored(path)) return;
+                lastActivity_ = steady_clock::now();
+                metrics_.add(PipelineCounter::WatchEvents);
+                markDirty(path);
             }
         );
+        // 被忽略的目录（以及仓库自身）不加监视，避免在 build/、node_modules/ 上耗尽监视数
+        watcher_->setDirectoryFilter([this](const std::string& path) {
+            std::string relPath = fs::path(path).lexically_relative(workspace_).generic_string();
+            return relPath != ".clay" && !config()->ignore.matchesTree(relPath);
+        });
+        // 溢出后脏文件列表不再完整；自动保存本来就全量扫描，只需确保它会发生
+        watcher_->setOverflowCallback([this] {
+            metrics_.add(PipelineCounter::WatchOverflows);
+            lastActivity_ = steady_clock::now();
+            std::cerr << "Watcher queue overflowed for " << workspace_.string() << std::endl;
+        });
         watcher_->start();
+    }
+    
+    // 停止监视并放弃本工作区排队或进行中的自动保存；返回后不再有作业引用本对象
+    void stopWatching() {
+        std::lock_guard<std::mutex> lock(watchMutex_);
+        if (watcher_) {
+            watcher_->stop();
+            watcher_.reset();
+        }
+        JobScheduler::instance().cancelClass(JobClass::Autosave, autosaveJobName());
+        JobScheduler::instance().cancelClass(JobClass::Maintenance, rescanJobName());
+        JobScheduler::instance().waitFor(JobClass::Autosave, autosaveJobName());
+        JobScheduler::instance().waitFor(JobClass::Maintenance, rescanJobName());
         
-        while (running_) {
-            auto now = steady_clock::now();
-            
-            if (duration_cast<seconds>(now - lastActivity_.load()).count() < idleThreshold_) {
-                if (duration_cast<seconds>(now - lastSnapshotTime_.load()).count() >= autosaveInterval_) {
-                    takeSnapshot(true);
-                    lastSnapshotTime_ = now;
-                }
+        // 读者据此判断工作区已不再被托管
+        statusPage_.update([](StatusData& data) {
+            data.daemonPid = 0;
+            data.captureInProgress = 0;
+            data.updatedAtMs = nowMillis();
+        });
+        statusPage_.close();
+    }
+    
+    void tick() {
+        reloadConfigIfChanged();
+        auto now = steady_clock::now();
+        auto current = config();
+        
+        if (duration_cast<seconds>(now - lastActivity_.load()).count() < current->idleThreshold) {
+            if (duration_cast<seconds>(now - lastSnapshotTime_.load()).count() >= current->autosaveInterval) {
+                // 交给调度器执行；上一次自动保存未完成时不重复提交
+                JobScheduler::instance().submit(JobClass::Autosave, autosaveJobName(),
+                                                [this] { takeSnapshot(true); }, true);
+                lastSnapshotTime_ = now;
             }
-            
-            std::this_thread::sleep_for(seconds(1));
         }
         
-        watcher_->stop();
+        if (current->metricsExport) exportMetricsIfChanged();
+        
+        // 心跳：读者据更新时间判断状态是否新鲜
+        JobCounts jobs = JobScheduler::instance().counts();
+        statusPage_.update([&](StatusData& data) {
+            data.updatedAtMs = nowMillis();
+            data.runningJobs = static_cast<uint32_t>(jobs.running);
+            data.queuedJobs = static_cast<uint32_t>(jobs.queued);
+        });
+    }
+    
+    std::string workspace() const {
+        return workspace_.string();
+    }
+    
+    const PipelineMetrics& metrics() const {
+        return metrics_;
     }
     
     void shutdown() { 
-        running_ = false; 
+        {
+            std::lock_guard<std::mutex> lock(runMutex_);
+            running_ = false;
+        }
+        runWake_.notify_all();
+    }
+    
+    std::string takeSnapshot(bool autoSave, const std::string& message = "") {
+        requireWritable();
+        uint64_t traceStart = Tracer::now();
+        std::string snapshotId;
+        {
+            TraceScope span("core", autoSave ? "autosave" : "snapshot", workspace_.filename().string());
+            snapshotId = captureAndStore(autoSave, message);
+        }
+        if (config()->trace) writeTrace("snapshot-" + snapshotId, traceStart);
+        return snapshotId;
     }
     
-    void takeSnapshot(bool autoSave, const std::string& message = "") {
+    std::string captureAndStore(bool autoSave, const std::string& message) {
         std::lock_guard<std::mutex> lock(snapshotMutex_);
         
         auto t = system_clock::to_time_t(system_clock::now());
         char buf[20];
         std::strftime(buf, sizeof(buf), "%Y%m%d%H%M%S", std::localtime(&t));
         std::string snapshotId = buf;
+        // 同一秒内的后续快照追加序号，(timestamp, id) 的排序仍与创建顺序一致
+        std::string last = storage_->lastSnapshotId();
+        if (last.compare(0, snapshotId.size(), snapshotId) == 0) {
+            int seq = last.size() > snapshotId.size() + 1 ? std::atoi(last.c_str() + snapshotId.size() + 1) : 0;
+            char suffix[16];
+            std::snprintf(suffix, sizeof(suffix), "-%04d", seq + 1);
+            snapshotId += suffix;
+        }
         
         Snapshot snapshot;
         snapshot.id = snapshotId;
@@ -105,46 +252,128 @@ public:
         snapshot.autoSave = autoSave;
         snapshot.message = message.empty() ? generateAutoMessage() : message;
         
-        captureFileSystemState(snapshot);
-        storage_->store(snapshot);
+        // 捕获开始前清空脏文件集合，捕获期间的修改会重新记入
+        {
+            std::lock_guard<std::mutex> dirtyLock(dirtyMutex_);
+            dirtyPaths_.clear();
+        }
+        statusPage_.update([](StatusData& data) {
+            data.captureInProgress = 1;
+            data.dirtyFiles = 0;
+            data.updatedAtMs = nowMillis();
+        });
+        struct CaptureDone {
+            StatusPage& page;
+            ~CaptureDone() {
+                page.update([](StatusData& data) { data.captureInProgress = 0; });
+            }
+        } captureDone{statusPage_};
+        
+        // 扫描缓存记录的是父快照时，stat 信息没变的文件沿用父快照的项
+        bool reuseFiles = !last.empty() && scanCache_.snapshotId == last;
+        ScanCache scanned;
+        auto started = steady_clock::now();
+        try {
+            MemoryBudget::Reservation held; // snapshot.deltas 中尚未写库的内容
+            bool streamed;
+            {
+                // 只在读取工作区期间阻止恢复；写库不影响查询
+                std::shared_lock<std::shared_mutex> workspaceLock(workspaceMutex_);
+                TraceScope span("core", "capture");
+                streamed = captureFileSystemState(snapshot, held, scanned, reuseFiles);
+            }
+            if (streamed) {
+                storage_->storeDeltas(snapshot.deltas);
+                storage_->storeUnchanged(snapshot.unchanged);
+                storage_->finishStore();
+            } else {
+                storage_->store(snapshot);
+            }
+        } catch (...) {
+            storage_->abortStore();
+            // 缓存可能与库不一致（例如父快照中没有要沿用的文件），下一次全部重新读取；
+            // 目录列表不依赖快照，仍然可用
+            scanCache_.snapshotId.clear();
+            throw;
+        }
+        scanned.snapshotId = snapshotId;
+        scanCache_ = std::move(scanned);
+        saveScanCache();
+        metrics_.record(PipelinePhase::Total, steady_clock::now() - started);
+        metrics_.add(PipelineCounter::SnapshotsStored);
+        publishSnapshot(snapshot);
         
         lastSnapshotTime_ = steady_clock::now();
         std::cout << "Snapshot created: " << snapshotId << std::endl;
+        return snapshotId;
     }
     
     bool restoreSnapshot(const std::string& snapshotId) {
-        std::lock_guard<std::mutex> lock(snapshotMutex_);
-        
+        requireWritable();
+        uint64_t traceStart = Tracer::now();
+        bool restored = restoreFiles(snapshotId);
+        if (config()->trace) writeTrace("restore-" + snapshotId, traceStart);
+        return restored;
+    }
+    
+    bool restoreFiles(const std::string& snapshotId) {
+        TraceScope span("core", "restore", snapshotId);
         try {
-            Snapshot snapshot = storage_->load(snapshotId);
-            
-            // 修复：正确删除所有现有文件（保留.clay目录）
-            for (const auto& entry : fs::directory_iterator(workspace_)) {
-                // 跳过 .clay 目录
-                if (entry.path().filename() == ".clay") continue;
+            // 文件列表和逐个文件的加载在同一读事务中，期间的压缩和删除不可见
+            storage_->readSnapshot([&] {
+                PathTable paths;
+                std::vector<ManifestEntry> files = storage_->manifest(snapshotId, paths);
+                uint64_t total = 0;
+                for (const auto& file : files) total += file.size;
                 
-                // 删除文件或目录
-                fs::remove_all(entry.path());
-            }
-            
-            // 恢复快照中的文件
-            for (const auto& delta : snapshot.deltas) {
-                fs::path fullPath = workspace_ / delta.path;
+                // 放得下就一次加载整个快照；否则逐个文件加载，同一时间只持有一个文件
+                MemoryBudget::Reservation held;
+                std::optional<Snapshot> snapshot;
+                if (held.tryAdd(total)) {
+                    snapshot = storage_->load(snapshotId);
+                } else {
+                    if (!hasSnapshot(snapshotId)) throw std::runtime_error("Snapshot not found");
+                    MemoryBudget::instance().noteSpill();
+                }
+                
+                // 进行中的自动保存捕获的是即将被覆盖的工作区，直接放弃
+                JobScheduler::instance().cancelClass(JobClass::Autosave, autosaveJobName());
+                std::unique_lock<std::shared_mutex> workspaceLock(workspaceMutex_);
+                TraceScope writeSpan("core", "restore.write");
                 
-                switch (delta.action) {
-                    case FileDelta::CREATE:
-                    case FileDelta::MODIFY: {
-                        fs::create_directories(fullPath.parent_path());
-                        std::ofstream file(fullPath, std::ios::binary);
-                        file.write(reinterpret_cast<const char*>(delta.content.data()), delta.content.size());
-                        break;
+                // 修复：正确删除所有现有文件（保留.clay目录）
+                for (const auto& entry : fs::directory_iterator(workspace_)) {
+                    // 跳过 .clay 目录
+                    if (entry.path().filename() == ".clay") continue;
+                    
+                    // 删除文件或目录
+                    fs::remove_all(entry.path());
+                }
+                
+                // 恢复快照中的文件
+                // 恢复总是作为用户命令执行，不限速；写入量仍记到作业上
+                if (snapshot) {
+                    for (const auto& delta : snapshot->deltas) {
+                        restoreFile(delta.path, delta.action, delta.content);
+                        JobScheduler::chargeIo(delta.content.size());
                     }
-                        
-                    case FileDelta::DELETE:
-                        if (fs::exists(fullPath)) fs::remove(fullPath);
-                        break;
+                    return;
                 }
-            }
+                // 逐个文件直接流式写到目标文件，只持有链底的完整版本和补丁，不组装完整内容
+                std::string path;
+                for (const auto& file : files) {
+                    path.clear();
+                    paths.appendPath(file.path, path);
+                    if (file.action == FileDelta::DELETE) {
+                        restoreFile(path, file.action, {});
+                        continue;
+                    }
+                    MemoryBudget::Reservation fileHeld;
+                    fileHeld.add(file.size);
+                    streamFile(snapshotId, path);
+                    JobScheduler::chargeIo(file.size);
+                }
+            });
             
             std::cout << "Restored snapshot: " << snapshotId << std::endl;
             return true;
@@ -183,6 +412,57 @@ public:
         return storage_->lastSnapshotId();
     }
     
+    std::vector<Snapshot> snapshots() const {
+        return storage_->list();
+    }
+    
+    void restoreFile(const std::string& path, FileDelta::Action action, const std::vector<uint8_t>& content) {
+        fs::path fullPath = workspace_ / path;
+        
+        switch (action) {
+            case FileDelta::CREATE:
+            case FileDelta::MODIFY: {
+                fs::create_directories(fullPath.parent_path());
+                std::ofstream file(fullPath, std::ios::binary);
+                file.write(reinterpret_cast<const char*>(content.data()), content.size());
+                break;
+            }
+                
+            case FileDelta::DELETE:
+                if (fs::exists(fullPath)) fs::remove(fullPath);
+                break;
+        }
+    }
+    
+    // 把快照中的文件内容直接写到工作区，不经过内存中的完整副本
+    void streamFile(const std::string& snapshotId, const std::string& path) {
+        fs::path fullPath = workspace_ / path;
+        fs::create_directories(fullPath.parent_path());
+        int fd = ::open(fullPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (fd < 0) throw std::runtime_error("Failed to create " + path + ": " + strerror(errno));
+        bool ok = storage_->loadFile(snapshotId, path, fd);
+        close(fd);
+        if (!ok) throw std::runtime_error("Failed to load " + path);
+    }
+    
+    bool hasSnapshot(const std::string& snapshotId) const {
+        auto snapshots = storage_->list();
+        return std::any_of(snapshots.begin(), snapshots.end(),
+                           [&](const Snapshot& s) { return s.id == snapshotId; });
+    }
+    
+    Snapshot loadSnapshot(const std::string& snapshotId) const {
+        return storage_->load(snapshotId);
+    }
+    
+    bool readFile(const std::string& snapshotId, const std::string& path, std::vector<uint8_t>& content) const {
+        return storage_->loadFile(snapshotId, path, content);
+    }
+    
+    void withReadSnapshot(const std::function<void()>& fn) const {
+        storage_->readSnapshot(fn);
+    }
+    
     void createTempBranch() {
         if (tempBranchActive_) {
             std::cerr << "Temp branch already active" << std::endl;
@@ -207,45 +487,91 @@ public:
         tempBranchActive_ = false;
     }
 
-    std::string getDiff(const std::string& snapshotId) const {
-        std::lock_guard<std::mutex> lock(snapshotMutex_);
-        std::ostringstream diffOutput;
-        
+    void diff(const std::string& snapshotId, std::ostream& out, const DiffOptions& options) const {
+        TraceScope span("core", "diff", snapshotId);
         try {
-            // 直接加载用户指定的快照
-            Snapshot current = storage_->load(snapshotId);
-            
-            // 获取前一个快照（按时间顺序）
-            auto snapshots = storage_->list();
-            std::string prevId;
-            
-            // 按时间顺序排序快照（从旧到新）
-            std::sort(snapshots.begin(), snapshots.end(), 
-                [](const Snapshot& a, const Snapshot& b) {
-                    return a.timestamp < b.timestamp;
-                });
-            
-            // 找到指定快照的前一个
-            for (size_t i = 0; i < snapshots.size(); i++) {
-                if (snapshots[i].id == snapshotId && i > 0) {
-                    prevId = snapshots[i-1].id;
-                    break;
-                }
+            // 只读文件列表；内容按需逐个加载，哈希相同的文件不加载。
+            // 整个比较在同一读事务中，期间的压缩和删除不可见
+            storage_->readSnapshot([&] { diffSnapshots(snapshotId, out, options); });
+        } catch (const std::exception& e) {
+            out << "Error generating diff: " << e.what() << "\n";
+        }
+    }
+    
+    void diffSnapshots(const std::string& snapshotId, std::ostream& out, const DiffOptions& options) const {
+        // 获取前一个快照（按时间顺序）
+        auto snapshots = storage_->list();
+        std::string prevId;
+        bool found = false;
+        
+        // 按时间顺序排序快照（从旧到新）
+        std::sort(snapshots.begin(), snapshots.end(), 
+            [](const Snapshot& a, const Snapshot& b) {
+                return a.timestamp < b.timestamp;
+            });
+        
+        // 找到指定快照的前一个
+        for (size_t i = 0; i < snapshots.size(); i++) {
+            if (snapshots[i].id == snapshotId) {
+                found = true;
+                if (i > 0) prevId = snapshots[i-1].id;
+                break;
             }
-            
-            if (prevId.empty()) {
-                diffOutput << "No previous snapshot found for comparison\n";
-                return diffOutput.str();
+        }
+        
+        if (!found) throw std::runtime_error("Snapshot not found");
+        if (prevId.empty()) {
+            out << "No previous snapshot found for comparison\n";
+            return;
+        }
+        
+        out << "Comparing " << prevId << " -> " << snapshotId << "\n";
+        
+        // 按目录树比较，两边相同的子树整棵跳过；只有变化的路径被展开和排序
+        PathTable paths;
+        std::vector<ManifestChange> changes = storage_->compare(prevId, snapshotId, paths);
+        std::sort(changes.begin(), changes.end(), [&](const ManifestChange& a, const ManifestChange& b) {
+            return paths.less(a.path, b.path);
+        });
+        
+        // 同一时间最多持有两个文件的内容
+        auto load = [&](const std::string& id, const std::string& path, const ManifestEntry& info,
+                        MemoryBudget::Reservation& held) {
+            FileDelta delta(path, info.action);
+            delta.kind = info.kind;
+            held.add(info.size);
+            if (!storage_->loadFile(id, path, delta.content)) {
+                throw std::runtime_error("Failed to load " + path + " in " + id);
+            }
+            return delta;
+        };
+        
+        static const FileDelta empty("", FileDelta::DELETE);
+        DiffTotals totals;
+        std::string path;
+        for (const auto& change : changes) {
+            if (!out) break;
+            path.clear();
+            paths.appendPath(change.path, path);
+            MemoryBudget::Reservation held;
+            if (!change.after) {
+                outputFileDiff(out, path, "deleted", load(prevId, path, *change.before, held), empty, options, totals);
+            } else if (!change.before) {
+                outputFileDiff(out, path, "added", empty, load(snapshotId, path, *change.after, held), options, totals);
+            } else {
+                FileDelta prev = load(prevId, path, *change.before, held);
+                FileDelta curr = load(snapshotId, path, *change.after, held);
+                if (prev.content != curr.content) {
+                    outputFileDiff(out, path, "modified", prev, curr, options, totals);
+                }
             }
-            
-            Snapshot previous = storage_->load(prevId);
-            
-            // ... 文件差异比较逻辑保持不变 ...
-        } catch (const std::exception& e) {
-            diffOutput << "Error generating diff: " << e.what() << "\n";
         }
         
-        return diffOutput.str();
+        if (options.statOnly) {
+            out << " " << totals.files << " files changed, "
+                << totals.insertions << " insertions(+), "
+                << totals.deletions << " deletions(-)\n";
+        }
     }
 
         std::string findClosestSnapshot(const std::string& targetTime) const {
@@ -273,134 +599,491 @@ public:
     }
 
 private:
-    void captureFileSystemState(Snapshot& snapshot) {
-        for (const auto& entry : fs::recursive_directory_iterator(workspace_)) {
-            if (fs::is_directory(entry)) continue;
-            
-            std::string relPath = fs::relative(entry.path(), workspace_).string();
-            if (isIgnored(relPath)) continue;
-            
-            std::ifstream file(entry.path(), std::ios::binary | std::ios::ate);
-            if (!file) continue;
-            
-            std::streamsize size = file.tellg();
-            file.seekg(0, std::ios::beg);
-            
-            std::vector<uint8_t> buffer(size);
-            if (file.read(reinterpret_cast<char*>(buffer.data()), size)) {
-                snapshot.deltas.emplace_back(relPath, FileDelta::MODIFY, buffer);
+    void requireWritable() const {
+        if (readOnly_) {
+            throw std::runtime_error("Repository " + workspace_.string() + " is opened read-only");
+        }
+    }
+    
+    static int64_t nowMillis() {
+        return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+    }
+    
+    void openStatusPage() {
+        if (!statusPage_.open(StatusPage::pathFor(workspace_.string()))) return;
+        
+        // 上次发布的最新快照仍是库中最新的，则直接沿用，不必扫描时间线
+        std::string lastId = storage_->lastSnapshotId();
+        bool warm = lastId == statusPage_.current().lastSnapshotId;
+        statusPage_.update([&](StatusData& data) {
+            StatusData fresh;
+            if (warm) {
+                fresh.lastSnapshotTime = data.lastSnapshotTime;
+                std::memcpy(fresh.lastSnapshotId, data.lastSnapshotId, sizeof(fresh.lastSnapshotId));
+                std::memcpy(fresh.lastSnapshotMessage, data.lastSnapshotMessage, sizeof(fresh.lastSnapshotMessage));
             }
+            data = fresh;
+            data.daemonPid = static_cast<int32_t>(getpid());
+            data.updatedAtMs = nowMillis();
+        });
+        if (!warm) {
+            std::vector<Snapshot> snapshots = storage_->list();
+            if (!snapshots.empty()) publishSnapshot(snapshots.back());
         }
     }
     
-    void loadIgnorePatterns() {
-        fs::path confPath = workspace_ / ".clay" / "clay.conf";
-        if (!fs::exists(confPath)) return;
+    // 写入 .clay/metrics.prom：先写临时文件再改名，抓取方不会读到半个文件
+    void exportMetricsIfChanged() {
+        uint64_t generation = metrics_.generation();
+        if (generation == exportedGeneration_) return;
         
-        std::ifstream confFile(confPath);
-        std::string line;
+        fs::path target = workspace_ / ".clay" / "metrics.prom";
+        fs::path temp = target;
+        temp += ".tmp";
+        {
+            std::ofstream out(temp, std::ios::trunc);
+            metrics_.writePrometheus(out, workspace_.string());
+            if (!out) {
+                std::cerr << "Failed to write " << temp << std::endl;
+                return;
+            }
+        }
+        std::error_code ec;
+        fs::rename(temp, target, ec);
+        if (ec) {
+            std::cerr << "Failed to write " << target << ": " << ec.message() << std::endl;
+            return;
+        }
+        exportedGeneration_ = generation;
+    }
+    
+    void publishSnapshot(const Snapshot& snapshot) {
+        statusPage_.update([&](StatusData& data) {
+            data.lastSnapshotTime = snapshot.timestamp;
+            StatusPage::copyString(data.lastSnapshotId, sizeof(data.lastSnapshotId), snapshot.id);
+            StatusPage::copyString(data.lastSnapshotMessage, sizeof(data.lastSnapshotMessage), snapshot.message);
+            data.updatedAtMs = nowMillis();
+        });
+    }
+    
+    void markDirty(const std::string& path) {
+        std::string relPath = fs::path(path).lexically_relative(workspace_).generic_string();
+        size_t count;
+        {
+            std::lock_guard<std::mutex> lock(dirtyMutex_);
+            if (!dirtyPaths_.insert(relPath).second) return;
+            count = dirtyPaths_.size();
+        }
+        statusPage_.update([&](StatusData& data) {
+            data.dirtyFiles = static_cast<uint32_t>(count);
+            data.updatedAtMs = nowMillis();
+        });
+    }
+    
+    // 之后修改的文件和目录本次照常处理，但不作为下次沿用的依据：
+    // 同一时间粒度内的再次修改可能不改变 mtime
+    static constexpr int64_t kRacyWindowNs = 1000000000;
+    
+    static ScanCache::Stamp stampOf(const struct stat& st, int64_t racyAfter) {
+        ScanCache::Stamp stamp;
+        stamp.mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        stamp.size = static_cast<uint64_t>(st.st_size);
+        stamp.inode = static_cast<uint64_t>(st.st_ino);
+        if (stamp.mtime >= racyAfter) stamp.mtime = 0;
+        return stamp;
+    }
+    
+    static bool nameLess(const ScanCache::Entry& a, const ScanCache::Entry& b) {
+        return a.name < b.name;
+    }
+    
+    // 目录中的普通文件和子目录，按名称排序。指向普通文件的符号链接按文件处理；
+    // 指向目录的符号链接不跟随，其他特殊文件跳过
+    static bool listDirectory(const std::string& dirPath, std::vector<ScanCache::Entry>& entries) {
+        DIR* dir = ::opendir(dirPath.c_str());
+        if (!dir) return false;
+        std::string childPath;
+        while (struct dirent* ent = ::readdir(dir)) {
+            const char* name = ent->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+            bool directory = ent->d_type == DT_DIR;
+            if (ent->d_type != DT_DIR && ent->d_type != DT_REG) {
+                childPath = dirPath + '/' + name;
+                struct stat st;
+                if (::lstat(childPath.c_str(), &st) != 0) continue;
+                directory = S_ISDIR(st.st_mode);
+                if (!directory && (::stat(childPath.c_str(), &st) != 0 || !S_ISREG(st.st_mode))) continue;
+            }
+            ScanCache::Entry entry;
+            entry.name = name;
+            entry.directory = directory;
+            entries.push_back(std::move(entry));
+        }
+        ::closedir(dir);
+        std::sort(entries.begin(), entries.end(), nameLess);
+        return true;
+    }
+    
+    // held 记账 snapshot.deltas 中的内容。超出内存预算时已读的内容先分批写库并从
+    // snapshot.deltas 中移除，此时返回 true，调用方需写入剩余部分并 finishStore。
+    // next 收集本次遍历的目录列表和文件 stat 信息。reuseFiles 表示 scanCache_ 对应父快照：
+    // stat 信息没变的文件不读取内容，只记入 snapshot.unchanged
+    bool captureFileSystemState(Snapshot& snapshot, MemoryBudget::Reservation& held,
+                                ScanCache& next, bool reuseFiles) {
+        // 整次捕获使用同一份配置，期间的重新加载不会让结果前后不一
+        auto current = config();
+        // 匹配、读取和分批写库按文件累加，遍历时间为总时间减去这几项
+        auto started = steady_clock::now();
+        steady_clock::duration matchTime{}, readTime{}, spillTime{};
+        uint64_t scanned = 0, ignored = 0, unreadable = 0, bytes = 0, spilled = 0, unread = 0, dirsReused = 0;
+        bool streamed = false;
+        int64_t racyAfter = duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count() - kRacyWindowNs;
         
-        while (std::getline(confFile, line)) {
-            if (line.empty() || line[0] == '#' || line[0] == '[') continue;
-            
-            size_t pos = line.find('=');
-            if (pos == std::string::npos) continue;
+        // 本次捕获的路径表：相对路径由节点拼出，整张表随捕获结束一次释放
+        PathTable paths;
+        std::vector<uint32_t> pendingDirs{PathTable::kRoot};
+        const std::string root = workspace_.string();
+        std::string dirRel, dirPath, relPath, filePath;
+        while (!pendingDirs.empty()) {
+            uint32_t dirNode = pendingDirs.back();
+            pendingDirs.pop_back();
+            dirRel.clear();
+            paths.appendPath(dirNode, dirRel);
+            dirPath = dirRel.empty() ? root : root + '/' + dirRel;
             
-            std::string key = trim(line.substr(0, pos));
-            std::string value = trim(line.substr(pos + 1));
+            struct stat dirStat;
+            if (::stat(dirPath.c_str(), &dirStat) != 0) continue; // 遍历期间被删除
+            ScanCache::Directory& listing = next.directories[dirRel];
+            listing.stamp = stampOf(dirStat, racyAfter);
+            // 目录中增删、改名都会更新目录的 mtime：stat 信息没变时记录的列表仍然准确
+            auto cached = scanCache_.directories.find(dirRel);
+            const ScanCache::Directory* previous =
+                cached != scanCache_.directories.end() ? &cached->second : nullptr;
+            bool relisted = !(previous && previous->stamp.valid() && previous->stamp == listing.stamp);
+            if (!relisted) {
+                listing.entries = previous->entries;
+                dirsReused++;
+            } else if (!listDirectory(dirPath, listing.entries)) {
+                next.directories.erase(dirRel);
+                continue;
+            }
             
-            if (key == "autosave_interval") {
-                autosaveInterval_ = std::stoi(value);
-            } else if (key == "idle_threshold") {
-                idleThreshold_ = std::stoi(value);
-            } else if (key == "max_snapshots") {
-                maxSnapshots_ = std::stoi(value);
-            } else if (key == "ignore_patterns") {
-                size_t start = 0, end;
-                while ((end = value.find(',', start)) != std::string::npos) {
-                    ignorePatterns_.push_back(trim(value.substr(start, end - start)));
-                    start = end + 1;
+            for (auto& entry : listing.entries) {
+                uint32_t node = paths.child(dirNode, entry.name);
+                auto matchStart = steady_clock::now();
+                relPath.clear();
+                paths.appendPath(node, relPath);
+                if (entry.directory) {
+                    // 不要把仓库自身的数据库快照进去；整棵被忽略的子树不打开
+                    bool skip = (dirNode == PathTable::kRoot && entry.name == ".clay") ||
+                                current->ignore.matchesTree(relPath);
+                    matchTime += steady_clock::now() - matchStart;
+                    if (!skip) pendingDirs.push_back(node);
+                    continue;
+                }
+                scanned++;
+                
+                bool skip = current->ignore.matches(relPath);
+                auto readStart = steady_clock::now();
+                matchTime += readStart - matchStart;
+                
+                // 上次记录的状态：沿用的列表中就是本项，重新列出的目录按名称查找
+                ScanCache::Stamp before = entry.stamp;
+                bool wasCaptured = entry.captured;
+                if (relisted) {
+                    before = {};
+                    wasCaptured = false;
+                    if (previous) {
+                        auto it = std::lower_bound(previous->entries.begin(), previous->entries.end(), entry, nameLess);
+                        if (it != previous->entries.end() && it->name == entry.name && !it->directory) {
+                            before = it->stamp;
+                            wasCaptured = it->captured;
+                        }
+                    }
+                }
+                entry.captured = false;
+                if (skip) {
+                    ignored++;
+                    continue;
+                }
+                
+                // 每个文件一个检查点：响应取消并遵守所属作业类别的预算
+                JobScheduler::checkpoint();
+                
+                filePath = root + '/' + relPath;
+                struct stat fileStat;
+                if (::stat(filePath.c_str(), &fileStat) != 0) {
+                    // 沿用的列表中的文件不见了：下次重新列出这个目录
+                    if (!relisted) listing.stamp = {};
+                    unreadable++;
+                    continue;
+                }
+                entry.stamp = stampOf(fileStat, racyAfter);
+                if (reuseFiles && wasCaptured && before.valid() && before == entry.stamp) {
+                    entry.captured = true;
+                    snapshot.unchanged.push_back(relPath);
+                    unread++;
+                    continue;
+                }
+                
+                readStart = steady_clock::now();
+                std::ifstream file(filePath, std::ios::binary | std::ios::ate);
+                if (!file) {
+                    unreadable++;
+                    readTime += steady_clock::now() - readStart;
+                    continue;
+                }
+                
+                std::streamsize size = file.tellg();
+                file.seekg(0, std::ios::beg);
+                
+                // 放不下时先把已读的内容写库并释放，仍放不下再等待其他工作释放
+                if (size > 0 && !held.tryAdd(static_cast<uint64_t>(size))) {
+                    auto spillStart = steady_clock::now();
+                    if (!snapshot.deltas.empty()) {
+                        if (!streamed) storage_->beginStore(snapshot);
+                        streamed = true;
+                        storage_->storeDeltas(snapshot.deltas);
+                        spilled += snapshot.deltas.size();
+                        snapshot.deltas.clear();
+                        held.reset();
+                        MemoryBudget::instance().noteSpill();
+                    }
+                    held.add(static_cast<uint64_t>(size));
+                    auto spent = steady_clock::now() - spillStart;
+                    spillTime += spent;
+                    readStart += spent;
+                }
+                
+                std::vector<uint8_t> buffer(size);
+                bool ok = static_cast<bool>(file.read(reinterpret_cast<char*>(buffer.data()), size));
+                readTime += steady_clock::now() - readStart;
+                if (ok) {
+                    JobScheduler::chargeIo(static_cast<uint64_t>(size));
+                    bytes += static_cast<uint64_t>(size);
+                    entry.captured = true;
+                    snapshot.deltas.emplace_back(relPath, FileDelta::MODIFY, std::move(buffer));
+                } else {
+                    unreadable++;
                 }
-                ignorePatterns_.push_back(trim(value.substr(start)));
             }
         }
+        
+        metrics_.record(PipelinePhase::Walk, steady_clock::now() - started - matchTime - readTime - spillTime);
+        metrics_.record(PipelinePhase::Match, matchTime);
+        metrics_.record(PipelinePhase::Read, readTime);
+        metrics_.add(PipelineCounter::FilesScanned, scanned);
+        metrics_.add(PipelineCounter::FilesIgnored, ignored);
+        metrics_.add(PipelineCounter::FilesUnreadable, unreadable);
+        metrics_.add(PipelineCounter::FilesCaptured, spilled + snapshot.deltas.size());
+        metrics_.add(PipelineCounter::BytesCaptured, bytes);
+        metrics_.add(PipelineCounter::FilesUnread, unread);
+        metrics_.add(PipelineCounter::DirsReused, dirsReused);
+        return streamed;
     }
     
-    bool isIgnored(const std::string& path) const {
-        fs::path relPath = fs::relative(path, workspace_);
-        
-        for (const auto& pattern : ignorePatterns_) {
-            if (pattern.find('*') != std::string::npos) {
-                std::string regexPattern = std::regex_replace(
-                    pattern, 
-                    std::regex("\\*"), 
-                    ".*"
-                );
-                std::regex re(regexPattern, std::regex::icase);
-                if (std::regex_match(relPath.string(), re)) {
-                    return true;
+    void saveScanCache() {
+        fs::path path = workspace_ / ".clay" / "scan.cache";
+        if (!scanCache_.save(path.string())) {
+            std::cerr << "Failed to write " << path << std::endl;
+        }
+    }
+    
+    std::shared_ptr<const Config> config() const {
+        return std::atomic_load(&config_);
+    }
+    
+    struct FileStamp {
+        fs::file_time_type mtime{};
+        uintmax_t size = 0;
+        bool exists = false;
+        
+        bool operator==(const FileStamp& other) const {
+            return exists == other.exists && mtime == other.mtime && size == other.size;
+        }
+    };
+    
+    FileStamp configStamp() const {
+        FileStamp stamp;
+        std::error_code ec;
+        fs::path confPath = workspace_ / ".clay" / "clay.conf";
+        stamp.mtime = fs::last_write_time(confPath, ec);
+        if (ec) return stamp;
+        stamp.size = fs::file_size(confPath, ec);
+        stamp.exists = !ec;
+        return stamp;
+    }
+    
+    void loadConfig() {
+        configStamp_ = configStamp();
+        auto loaded = Config::load((workspace_ / ".clay" / "clay.conf").string());
+        std::atomic_store(&config_, loaded);
+        applyStorageSettings(*loaded);
+    }
+    
+    void applyStorageSettings(const Config& current) {
+        storage_->setDeltaHotWindow(current.deltaHotWindow);
+        storage_->setMaxSnapshots(current.maxSnapshots);
+        // 任一托管的工作区启用 trace 时，守护进程内所有线程都记录跨度
+        if (current.trace != traceEnabled_ && !readOnly_) {
+            if (current.trace) Tracer::instance().acquire();
+            else Tracer::instance().release();
+            traceEnabled_ = current.trace;
+        }
+        if (!readOnly_) {
+            MemoryBudget::instance().setLimit(workspace_.string(), current.memoryBudget);
+            IoGovernor governor;
+            governor.bytesPerSec = current.ioLimit;
+            governor.opsPerSec = current.ioOpsLimit;
+            governor.priority = current.ioPriority;
+            governor.pressureBackoff = current.pressureBackoff;
+            JobScheduler::instance().setGovernor(workspace_.string(), governor);
+        }
+    }
+    
+    // 把从 startNs 到现在所有线程的跨度写到 .clay/traces/<name>.json
+    void writeTrace(const std::string& name, uint64_t startNs) const {
+        auto events = Tracer::instance().collect(startNs, Tracer::now());
+        if (Tracer::writeWorkspaceTrace(workspace_.string(), name, events).empty()) {
+            std::cerr << "Failed to write trace " << name << " for " << workspace_.string() << std::endl;
+        }
+    }
+    
+    // 由每秒的 tick 调用：配置文件的修改时间或大小变化时重新解析，并整体替换当前配置。
+    // 配置文件在 .clay 下，而监视器不进入 .clay（快照写入会不断触发事件），所以这里用一次 stat 检查；
+    // 未注册监视时（只读打开、后台注册完成前）同样有效。
+    void reloadConfigIfChanged() {
+        FileStamp stamp = configStamp();
+        if (stamp == configStamp_) return;
+        configStamp_ = stamp;
+        
+        TraceScope span("core", "config.reload");
+        auto previous = config();
+        auto loaded = Config::load((workspace_ / ".clay" / "clay.conf").string());
+        std::atomic_store(&config_, loaded);
+        applyStorageSettings(*loaded);
+        std::cerr << "Reloaded config for " << workspace_.string() << std::endl;
+        
+        if (loaded->ignorePatterns != previous->ignorePatterns) {
+            JobScheduler::instance().submit(JobClass::Maintenance, rescanJobName(),
+                                            [this, previous, loaded] { rescanIgnoreChanges(*previous, *loaded); });
+        }
+    }
+    
+    // 忽略规则变化后只重新检查受影响的子树：每条新增或删除的规则只可能改变
+    // 其字面目录前缀之下的路径。忽略状态改变的文件记为脏文件，由下一次自动保存捕获。
+    void rescanIgnoreChanges(const Config& before, const Config& after) {
+        std::set<std::string> oldPatterns(before.ignorePatterns.begin(), before.ignorePatterns.end());
+        std::set<std::string> newPatterns(after.ignorePatterns.begin(), after.ignorePatterns.end());
+        std::vector<std::string> changed;
+        std::set_symmetric_difference(oldPatterns.begin(), oldPatterns.end(),
+                                      newPatterns.begin(), newPatterns.end(), std::back_inserter(changed));
+        
+        std::set<std::string> bases;
+        for (const auto& pattern : changed) bases.insert(IgnoreMatcher::baseDirectory(pattern));
+        
+        // 已被更浅的前缀覆盖的子树不重复遍历
+        std::vector<std::string> roots;
+        for (const auto& base : bases) {
+            bool covered = std::any_of(roots.begin(), roots.end(), [&](const std::string& root) {
+                return root.empty() || base.compare(0, root.size() + 1, root + "/") == 0;
+            });
+            if (!covered) roots.push_back(base);
+        }
+        
+        size_t affected = 0;
+        for (const auto& root : roots) {
+            fs::path dir = root.empty() ? workspace_ : workspace_ / root;
+            std::error_code ec;
+            if (!fs::is_directory(dir, ec)) continue;
+            
+            for (auto it = fs::recursive_directory_iterator(dir, ec);
+                 !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+                JobScheduler::checkpoint();
+                std::string relPath = it->path().lexically_relative(workspace_).generic_string();
+                if (it->is_directory()) {
+                    // 新旧规则下都整棵被忽略的子树不必打开
+                    if (it->path() == workspace_ / ".clay" ||
+                        (before.ignore.matchesTree(relPath) && after.ignore.matchesTree(relPath))) {
+                        it.disable_recursion_pending();
+                    }
+                    continue;
+                }
+                if (before.ignore.matches(relPath) != after.ignore.matches(relPath)) {
+                    markDirty(it->path().string());
+                    affected++;
                 }
-            } else if (relPath == pattern) {
-                return true;
             }
         }
-        return false;
+        
+        if (affected > 0) lastActivity_ = steady_clock::now();
+        std::cerr << "Ignore rules changed in " << workspace_.string() << ": rescanned "
+                  << roots.size() << " subtree(s), " << affected << " file(s) affected" << std::endl;
+    }
+    
+    bool isIgnored(const std::string& path) const {
+        return config()->ignore.matches(fs::path(path).lexically_relative(workspace_).generic_string());
+    }
+    
+    // 作业名带上工作区路径：同一进程中多个工作区的自动保存互不合并、互不取消
+    std::string autosaveJobName() const {
+        return "autosave " + workspace_.string();
+    }
+    
+    std::string rescanJobName() const {
+        return "rescan " + workspace_.string();
     }
     
     std::string generateAutoMessage() const {
         return "Auto snapshot at " + std::to_string(time(nullptr));
     }
     
-    std::string trim(const std::string& str) {
-        auto start = std::find_if_not(str.begin(), str.end(), 
-            [](unsigned char c){ return std::isspace(c); });
-        auto end = std::find_if_not(str.rbegin(), str.rend(), 
-            [](unsigned char c){ return std::isspace(c); }).base();
-        return (start < end) ? std::string(start, end) : "";
+    struct DiffTotals {
+        size_t files = 0;
+        size_t insertions = 0;
+        size_t deletions = 0;
+    };
+    
+    static ContentKind kindOf(const FileDelta& delta) {
+        return delta.kind != ContentKind::Unknown ? delta.kind : classifyContent(delta.content);
     }
-
-    void outputFileDiff(std::ostream& out, 
-                        const std::vector<uint8_t>& prevContent, 
-                        const std::vector<uint8_t>& currContent) const {
-        // 将二进制内容转换为文本行
-        auto toLines = [](const std::vector<uint8_t>& content) -> std::vector<std::string> {
-            if (content.empty()) return {};
-            
-            std::string text(content.begin(), content.end());
-            std::istringstream stream(text);
-            std::vector<std::string> lines;
-            std::string line;
+    
+    void outputFileDiff(std::ostream& out, const std::string& path, const char* change,
+                        const FileDelta& prev, const FileDelta& curr,
+                        const DiffOptions& options, DiffTotals& totals) const {
+        totals.files++;
+        
+        // 二进制文件只输出大小变化和 bsdiff 补丁大小
+        if (kindOf(prev) == ContentKind::Binary || kindOf(curr) == ContentKind::Binary) {
+            int64_t prevSize = static_cast<int64_t>(prev.content.size());
+            int64_t currSize = static_cast<int64_t>(curr.content.size());
+            if (options.statOnly) {
+                out << " " << path << " | Bin " << prevSize << " -> " << currSize << " bytes\n";
+                return;
+            }
             
-            while (std::getline(stream, line)) {
-                lines.push_back(line);
+            out << "\n*** " << path << " (" << change << ", binary)\n";
+            out << "  size: " << prevSize << " -> " << currSize << " bytes ("
+                << (currSize >= prevSize ? "+" : "") << (currSize - prevSize) << ")\n";
+            int64_t patchSize = bsdiffPatchSize(prev.content, curr.content);
+            if (patchSize >= 0) {
+                out << "  bsdiff patch: " << patchSize << " bytes\n";
             }
-            return lines;
-        };
-        
-        std::vector<std::string> prevLines = toLines(prevContent);
-        std::vector<std::string> currLines = toLines(currContent);
+            return;
+        }
         
-        // 简单的行比较
-        size_t i = 0, j = 0;
-        while (i < prevLines.size() || j < currLines.size()) {
-            if (i < prevLines.size() && j < currLines.size() && prevLines[i] == currLines[j]) {
-                out << "  " << prevLines[i] << "\n";
-                i++;
-                j++;
-            } else {
-                // 输出删除的行
-                if (i < prevLines.size()) {
-                    out << "- " << prevLines[i] << "\n";
-                    i++;
-                }
-                
-                // 输出新增的行
-                if (j < currLines.size()) {
-                    out << "+ " << currLines[j] << "\n";
-                    j++;
-                }
-            }
+        if (options.statOnly) {
+            LineStats stats = diffLineStats(prev.content, curr.content);
+            totals.insertions += stats.insertions;
+            totals.deletions += stats.deletions;
+            out << " " << path << " | +" << stats.insertions << " -" << stats.deletions << "\n";
+            return;
         }
+        
+        out << "\n*** " << path << " (" << change << ")\n";
+        diffLines(prev.content, curr.content, [&out](char op, std::string_view line) {
+            out << op << ' ' << line << '\n';
+        });
     }
 
     time_t parseTimeString(const std::string& timeStr) const {
@@ -416,42 +1099,52 @@ private:
     // 新增：查找最接近的快照ID
 
     fs::path workspace_;
+    // 在 storage_ 之前声明：存储层的后台压缩线程会写入它
+    PipelineMetrics metrics_;
+    uint64_t exportedGeneration_ = 0; // 只在 tick 中访问
     std::unique_ptr<Storage> storage_;
     std::unique_ptr<Watcher> watcher_;
+    // 工作区恢复时在后台注册监视，可能与关闭并发
+    std::mutex watchMutex_;
     
     std::atomic<bool> running_;
     std::atomic<steady_clock::time_point> lastActivity_;
     std::atomic<steady_clock::time_point> lastSnapshotTime_;
     
-    int autosaveInterval_ = 30;
-    int idleThreshold_ = 5;
-    int maxSnapshots_ = 100;
-    std::vector<std::string> ignorePatterns_;
-    
-    bool tempBranchActive_ = false;
-    mutable std::mutex snapshotMutex_;
-    
-    static constexpr const char* DEFAULT_CONFIG = R"(
-[core]
-autosave_interval = 30
-idle_threshold = 5
-max_snapshots = 100
-ignore_patterns = *.tmp, *.swp, build/, .git/
-)";
+    // 当前配置：读者取一份快照后一直使用，重新加载时整体替换（atomic_load/atomic_store）
+    std::shared_ptr<const Config> config_ = std::make_shared<Config>();
+    FileStamp configStamp_;
+    bool traceEnabled_ = false; // 是否持有 Tracer 的启用计数；只在加载配置时修改
+    
+    bool readOnly_ = false;
+    std::atomic<bool> tempBranchActive_{false};
+    // snapshotMutex_ 串行化快照创建；workspaceMutex_ 保护工作区文件（捕获共享，恢复独占）。
+    // 查询走存储层的只读连接，不持有这两个锁。
+    std::mutex snapshotMutex_;
+    std::shared_mutex workspaceMutex_;
+    // 上次快照之后有变化的文件，发布到状态页
+    std::mutex dirtyMutex_;
+    std::unordered_set<std::string> dirtyPaths_;
+    // 上一次捕获的目录列表和文件 stat 信息；由 snapshotMutex_ 保护
+    ScanCache scanCache_;
+    StatusPage statusPage_;
+    // 唤醒 run 循环，使 shutdown 立即生效
+    std::mutex runMutex_;
+    std::condition_variable runWake_;
 };
 
-Core& Core::instance() {
-    static Core instance;
-    return instance;
-}
-
 Core::Core() : impl_(std::make_unique<Impl>()) {}
 Core::~Core() = default;
 
-bool Core::init(const std::string& workspace) { return impl_->init(workspace); }
+bool Core::init(const std::string& workspace, OpenMode mode) { return impl_->init(workspace, mode); }
+bool Core::readOnly() const { return impl_->readOnly(); }
 void Core::run() { impl_->run(); }
 void Core::shutdown() { impl_->shutdown(); }
-void Core::takeSnapshot(bool autoSave, const std::string& message) { impl_->takeSnapshot(autoSave, message); }
+void Core::startWatching() { impl_->startWatching(); }
+void Core::stopWatching() { impl_->stopWatching(); }
+void Core::tick() { impl_->tick(); }
+std::string Core::workspace() const { return impl_->workspace(); }
+std::string Core::takeSnapshot(bool autoSave, const std::string& message) { return impl_->takeSnapshot(autoSave, message); }
 bool Core::restoreSnapshot(const std::string& snapshotId) { return impl_->restoreSnapshot(snapshotId); }
 bool Core::undo() { 
     return impl_->undo(); 
@@ -461,6 +1154,13 @@ std::vector<std::string> Core::listSnapshots() { return impl_->listSnapshots();
 std::string Core::currentSnapshotId() const {
      return impl_->currentSnapshotId(); 
 }
+std::vector<Snapshot> Core::snapshots() const { return impl_->snapshots(); }
+Snapshot Core::loadSnapshot(const std::string& snapshotId) const { return impl_->loadSnapshot(snapshotId); }
+const PipelineMetrics& Core::metrics() const { return impl_->metrics(); }
+void Core::withReadSnapshot(const std::function<void()>& fn) const { impl_->withReadSnapshot(fn); }
+bool Core::readFile(const std::string& snapshotId, const std::string& path, std::vector<uint8_t>& content) const {
+    return impl_->readFile(snapshotId, path, content);
+}
 void Core::createTempBranch() { 
     impl_->createTempBranch(); 
 }
@@ -473,7 +1173,13 @@ void Core::discardTempBranch() {
 }
 
 std::string Core::getDiff(const std::string& snapshotId) const {
-    return impl_->getDiff(snapshotId);
+    std::ostringstream oss;
+    impl_->diff(snapshotId, oss, DiffOptions());
+    return oss.str();
+}
+
+void Core::diff(const std::string& snapshotId, std::ostream& out, const DiffOptions& options) const {
+    impl_->diff(snapshotId, out, options);
 }
 
 std::string Core::findClosestSnapshot(const std::string& targetTime) const {
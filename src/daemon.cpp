@@ -1,6 +1,11 @@
 #include "clay/daemon.hpp"
 #include "clay/command.hpp"
 #include "clay/core.hpp"
+#include "clay/metrics.hpp"
+#include "clay/protocol.hpp"
+#include "clay/scheduler.hpp"
+#include "clay/trace.hpp"
+#include "clay/workspace.hpp"
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -12,8 +17,25 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/file.h>
 #include <sstream>
 #include <cstring> // 添加 memset 头文件
+#include <cerrno>
+#include <chrono>
+#include <ctime>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 namespace fs = std::filesystem;
 
@@ -24,14 +46,55 @@ Daemon& Daemon::instance() {
     return instance;
 }
 
-Daemon::Daemon() : pidPath_(), sockPath_(), running_(false) {}
+Daemon::Daemon()
+    : pidPath_(runtimeDir() + "/daemon.pid"), sockPath_(socketPath()), running_(false) {}
+Daemon::~Daemon() = default;
+
+std::string Daemon::runtimeDir() {
+    std::string dir;
+    if (const char* env = getenv("CLAY_RUNTIME_DIR")) {
+        dir = env;
+    } else if (const char* xdg = getenv("XDG_RUNTIME_DIR")) {
+        dir = std::string(xdg) + "/clay";
+    } else {
+        dir = "/tmp/clay-" + std::to_string(getuid());
+    }
+    // 只允许当前用户访问 socket
+    mkdir(dir.c_str(), 0700);
+    return dir;
+}
 
-bool Daemon::start(const std::string& workspace) {
-    // 检查是否已运行
-    if (isRunning()) {
-        std::cerr << "Daemon is already running" << std::endl;
+namespace {
+
+// 运行时目录必须是当前用户自己的、只有自己能访问的真实目录：
+// /tmp 下的同名目录可能由其他用户预先创建，或者是指向别处的符号链接
+bool runtimeDirSecure(const std::string& dir) {
+    struct stat st;
+    if (lstat(dir.c_str(), &st) < 0) {
+        std::cerr << "Cannot access runtime directory " << dir << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    if (!S_ISDIR(st.st_mode) || st.st_uid != getuid() || (st.st_mode & 0777) != 0700) {
+        std::cerr << "Refusing to use runtime directory " << dir
+                  << ": it must be a directory owned by the current user with mode 0700" << std::endl;
         return false;
     }
+    return true;
+}
+
+} // namespace
+
+std::string Daemon::socketPath() {
+    return runtimeDir() + "/daemon.sock";
+}
+
+bool Daemon::start() {
+    if (!runtimeDirSecure(runtimeDir())) return false;
+
+    // 已有守护进程时直接复用
+    if (isRunning()) {
+        return true;
+    }
 
     // 创建守护进程
     pid_t pid = fork();
@@ -40,12 +103,26 @@ bool Daemon::start(const std::string& workspace) {
         return false;
     }
 
-    if (pid > 0) { // 父进程退出
-        return true;
+    if (pid > 0) { // 父进程等待守护进程开始监听（通常不到 1 毫秒）
+        for (int i = 0; i < 2000; ++i) {
+            int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            struct sockaddr_un addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            strncpy(addr.sun_path, sockPath_.c_str(), sizeof(addr.sun_path)-1);
+            bool ok = connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+            close(fd);
+            if (ok) return true;
+            usleep(1000);
+        }
+        std::cerr << "Clay daemon did not start" << std::endl;
+        return false;
     }
 
     // 子进程成为守护进程
-    umask(0);
+    StartupProfile::instance().begin();
+    // 保留用户的 umask：恢复出来的工作区文件与用户自己创建的权限一致。
+    // 守护进程自己的文件都在 0700 的运行时目录中，socket 另外收紧权限
     setsid();
 
     // 关闭标准文件描述符
@@ -53,48 +130,42 @@ bool Daemon::start(const std::string& workspace) {
     close(STDOUT_FILENO);
     close(STDERR_FILENO);
 
-    // 设置工作目录
-    if (chdir(workspace.c_str())) {
-        perror("chdir");
+    // 工作区以绝对路径打开，守护进程不占用任何工作区目录
+    if (chdir("/")) {
         exit(EXIT_FAILURE);
     }
 
-    // 确保.clay目录存在
-    fs::path clayDir = fs::path(workspace) / ".clay";
-    if (!fs::exists(clayDir)) {
-        if (!fs::create_directories(clayDir)) {
-            perror("create_directories");
-            exit(EXIT_FAILURE);
-        }
+    // pid 文件上的排他锁保证每个用户只有一个守护进程
+    lockFd_ = open(pidPath_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | O_NOFOLLOW, 0600);
+    if (lockFd_ < 0 || flock(lockFd_, LOCK_EX | LOCK_NB) < 0) {
+        exit(EXIT_FAILURE); // 并发启动时另一个进程已获胜
     }
-
-    // 创建PID文件
-    pidPath_ = workspace + "/.clay/clay.pid";
-    std::ofstream pidFile(pidPath_);
-    if (!pidFile) {
-        perror("pid file");
+    std::string pidText = std::to_string(getpid()) + "\n";
+    if (ftruncate(lockFd_, 0) < 0 || write(lockFd_, pidText.data(), pidText.size()) < 0) {
         exit(EXIT_FAILURE);
     }
-    pidFile << getpid() << std::endl;
-    pidFile.close();
+    StartupProfile::instance().mark("detach and lock");
 
-    // 创建socket文件
-    sockPath_ = workspace + "/.clay/clay.sock";
+    // SIGTERM/SIGINT 交给事件循环处理；必须在创建任何线程之前屏蔽
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
 
-    // 初始化核心
-    if (!Core::instance().init(workspace)) {
-        std::cerr << "Core initialization failed" << std::endl;
-        unlink(pidPath_.c_str());
-        exit(EXIT_FAILURE);
-    }
+    // 后台作业：调度器工作线程执行自动保存等异步作业
+    JobScheduler::instance().start(2);
+    StartupProfile::instance().mark("scheduler");
 
     // 启动守护进程主循环
     running_ = true;
     mainLoop();
 
     // 清理
-    unlink(pidPath_.c_str());
     unlink(sockPath_.c_str());
+    WorkspaceManager::instance().stop();
+    JobScheduler::instance().stop();
+    unlink(pidPath_.c_str());
     exit(EXIT_SUCCESS);
 }
 
@@ -106,121 +177,719 @@ bool Daemon::stop() {
 
     // 读取PID
     std::ifstream pidFile(pidPath_);
-    if (!pidFile) {
-        perror("pid file");
+    pid_t pid = 0;
+    if (!(pidFile >> pid) || pid <= 0) {
+        std::cerr << "Invalid pid file: " << pidPath_ << std::endl;
         return false;
     }
 
-    pid_t pid;
-    pidFile >> pid;
-    pidFile.close();
-
     // 发送终止信号
     if (kill(pid, SIGTERM) < 0) {
         perror("kill");
         return false;
     }
 
-    // 等待进程退出
-    sleep(1);
+    // 等待进程释放锁（最多 5 秒）
+    for (int i = 0; i < 100 && isRunning(); ++i) {
+        usleep(50 * 1000);
+    }
     return !isRunning();
 }
 
 bool Daemon::isRunning() const {
-    if (pidPath_.empty()) return false;
-    
-    std::ifstream pidFile(pidPath_);
-    if (!pidFile) return false;
-    
-    pid_t pid;
-    pidFile >> pid;
-    pidFile.close();
-    
-    // 检查进程是否存在
-    return kill(pid, 0) == 0;
+    int fd = open(pidPath_.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (fd < 0) return false;
+
+    // 守护进程持有排他锁；能拿到共享锁说明它已退出
+    bool locked = flock(fd, LOCK_SH | LOCK_NB) < 0 && errno == EWOULDBLOCK;
+    close(fd);
+    return locked;
 }
 
-void Daemon::mainLoop() {
-    // 创建Unix域套接字
-    int sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
-    if (sockfd < 0) {
-        perror("socket");
-        return;
+void Daemon::requestStop() {
+    // 复用 signalfd 路径，让事件循环按正常流程退出
+    kill(getpid(), SIGTERM);
+}
+
+namespace {
+
+// 每个连接待发送数据的上限；超过时工作线程等待客户端读取
+constexpr size_t kMaxPendingOutput = 1024 * 1024;
+// 每个连接同时执行的请求数；其余请求排队，排队过多时暂停读取
+constexpr size_t kMaxInFlight = 16;
+constexpr size_t kMaxQueuedRequests = 256;
+constexpr int kMaxEvents = 64;
+
+// 输出很短的查询命令直接在事件循环线程中执行。循环线程内的回复不受 kMaxPendingOutput 限制，
+// 所以输出随快照数增长的命令（timeline）交给工作线程
+bool isInlineCommand(const std::vector<std::string>& args) {
+    static const std::unordered_set<std::string> inlineCommands = {"status", "help", "jobs"};
+    return !args.empty() && inlineCommands.count(args[0]) > 0;
+}
+
+// 不需要工作区的命令
+bool requiresWorkspace(const std::vector<std::string>& args) {
+    static const std::unordered_set<std::string> global = {"status", "help", "jobs"};
+    return !args.empty() && global.count(args[0]) == 0;
+}
+
+class WorkerPool {
+public:
+    explicit WorkerPool(size_t threads) {
+        for (size_t i = 0; i < threads; ++i) {
+            workers_.emplace_back([this] { run(); });
+        }
     }
 
-    // 绑定套接字
-    struct sockaddr_un addr;
-    memset(&addr, 0, sizeof(addr));
-    addr.sun_family = AF_UNIX;
-    strncpy(addr.sun_path, sockPath_.c_str(), sizeof(addr.sun_path)-1);
+    ~WorkerPool() { stop(); }
 
-    unlink(sockPath_.c_str()); // 移除旧socket
+    // 丢弃排队的任务，等待执行中的任务结束
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+            tasks_.clear();
+        }
+        cv_.notify_all();
+        for (auto& t : workers_) {
+            if (t.joinable()) t.join();
+        }
+    }
 
-    if (bind(sockfd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-        perror("bind");
-        close(sockfd);
-        return;
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push_back(std::move(task));
+        }
+        cv_.notify_one();
     }
 
-    // 监听
-    if (listen(sockfd, 5) < 0) {
-        perror("listen");
-        close(sockfd);
-        return;
+    size_t size() const { return workers_.size(); }
+
+    size_t queued() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return tasks_.size();
+    }
+
+private:
+    void run() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+                if (stop_) return;
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> tasks_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+};
+
+} // namespace
+
+// epoll 驱动的非阻塞事件循环：
+// - 增量解析请求（长度前缀 + 命令），同一连接上的请求按顺序执行
+// - 查询命令在循环线程内执行，其余交给工作线程池
+// - 输出帧进入连接的发送队列，由循环线程非阻塞发送；队列过长时工作线程等待
+class Daemon::EventLoop {
+public:
+    struct Request {
+        uint32_t id = 0;
+        protocol::Status status = protocol::STATUS_OK; // 非 OK 时直接回复错误
+        std::string workspace; // 客户端所在工作区；为空表示不在工作区中
+        std::vector<std::string> args;
+        std::vector<std::vector<std::string>> batch; // MSG_BATCH 的命令列表，此时 args 为 {"batch"}
+        bool trace = false; // 客户端传了 --trace：记录本请求的跨度并写到工作区的 .clay/traces/
+    };
+
+    struct Connection {
+        uint64_t id = 0;
+        int fd = -1;
+        bool writeWatched = false;
+
+        // 仅循环线程访问
+        std::string in;
+        std::deque<Request> requests;
+        size_t inFlight = 0;
+        bool readClosed = false;
+        bool readWatched = true;
+
+        // 工作线程与循环线程共享
+        std::mutex mutex;
+        std::condition_variable drained;
+        std::deque<std::string> out;
+        size_t outBytes = 0;
+        size_t outOffset = 0;
+        bool broken = false;
+    };
+    using ConnectionPtr = std::shared_ptr<Connection>;
+
+    EventLoop()
+        : pool_(std::max<size_t>(2, std::min<size_t>(4, std::thread::hardware_concurrency()))) {}
+
+    ~EventLoop() {
+        // 先让等待发送的工作线程返回并停止线程池：任务结束时会写 wakeFd_，必须在关闭任何 fd 之前
+        for (auto& entry : connections_) markBroken(*entry.second);
+        pool_.stop();
+        for (auto& entry : connections_) close(entry.second->fd);
+        if (wakeFd_ >= 0) close(wakeFd_);
+        if (signalFd_ >= 0) close(signalFd_);
+        if (listenFd_ >= 0) close(listenFd_);
+        if (epollFd_ >= 0) close(epollFd_);
+    }
+
+    bool open(const std::string& sockPath) {
+        // 创建Unix域套接字
+        listenFd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listenFd_ < 0) {
+            perror("socket");
+            return false;
+        }
+
+        // 绑定套接字
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, sockPath.c_str(), sizeof(addr.sun_path)-1);
+
+        unlink(sockPath.c_str()); // 移除旧socket
+
+        if (bind(listenFd_, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            perror("bind");
+            return false;
+        }
+        if (chmod(sockPath.c_str(), 0600) < 0) {
+            perror("chmod");
+            return false;
+        }
+
+        if (listen(listenFd_, SOMAXCONN) < 0) {
+            perror("listen");
+            return false;
+        }
+
+        epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGTERM);
+        sigaddset(&signals, SIGINT);
+        signalFd_ = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+
+        if (epollFd_ < 0 || wakeFd_ < 0 || signalFd_ < 0) {
+            perror("epoll setup");
+            return false;
+        }
+
+        return watch(listenFd_, kListenId, EPOLLIN) &&
+               watch(wakeFd_, kWakeId, EPOLLIN) &&
+               watch(signalFd_, kSignalId, EPOLLIN);
     }
 
-    // 主循环
-    while (running_) {
-        struct sockaddr_un client_addr;
-        memset(&client_addr, 0, sizeof(client_addr));
-        socklen_t client_len = sizeof(client_addr);
-        int client_fd = accept(sockfd, (struct sockaddr*)&client_addr, &client_len);
-        if (client_fd < 0) {
-            if (errno == EINTR) continue;
-            perror("accept");
+    void run(const bool& running) {
+        struct epoll_event events[kMaxEvents];
+
+        while (running && !(stopRequested_ && (idle() || std::chrono::steady_clock::now() >= stopDeadline_))) {
+            // 收到退出信号后不再等待新事件，只把进行中的请求（例如触发退出的 stop）的响应发完
+            int n = epoll_wait(epollFd_, events, kMaxEvents, stopRequested_ ? 50 : -1);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                perror("epoll_wait");
+                break;
+            }
+
+            for (int i = 0; i < n; ++i) {
+                uint64_t id = events[i].data.u64;
+                if (id == kListenId) {
+                    acceptClients();
+                } else if (id == kWakeId) {
+                    handleWake();
+                } else if (id == kSignalId) {
+                    if (!stopRequested_) stopDeadline_ = std::chrono::steady_clock::now() + kStopGrace;
+                    stopRequested_ = true;
+                } else {
+                    handleConnection(id, events[i].events);
+                }
+            }
+        }
+    }
+
+    void writeStats(std::ostream& out) const {
+        out << "Connections: " << connectionCount_.load() << "\n";
+        out << "Workers: " << pool_.size() << " (queued " << pool_.queued() << ")\n";
+        out << "Request latency:\n";
+        allLatency_.write(out, "all");
+        inlineLatency_.write(out, "inline");
+        workerLatency_.write(out, "worker");
+    }
+
+private:
+    static constexpr uint64_t kListenId = 0;
+    static constexpr uint64_t kWakeId = 1;
+    static constexpr uint64_t kSignalId = 2;
+    static constexpr std::chrono::seconds kStopGrace{2};
+
+    // 所有连接都没有进行中的请求和待发送的输出
+    bool idle() {
+        for (auto& entry : connections_) {
+            Connection& conn = *entry.second;
+            if (conn.inFlight > 0) return false;
+            std::lock_guard<std::mutex> lock(conn.mutex);
+            if (conn.outBytes > 0 && !conn.broken) return false;
+        }
+        return true;
+    }
+
+    bool watch(int fd, uint64_t id, uint32_t events, int op = EPOLL_CTL_ADD) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = events;
+        ev.data.u64 = id;
+        if (epoll_ctl(epollFd_, op, fd, &ev) < 0) {
+            perror("epoll_ctl");
+            return false;
+        }
+        return true;
+    }
+
+    void acceptClients() {
+        for (;;) {
+            int fd = accept4(listenFd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept");
+                return;
+            }
+
+            auto conn = std::make_shared<Connection>();
+            conn->id = nextId_++;
+            conn->fd = fd;
+            if (!watch(fd, conn->id, EPOLLIN | EPOLLRDHUP)) {
+                close(fd);
+                continue;
+            }
+            connections_[conn->id] = conn;
+            connectionCount_ = connections_.size();
+        }
+    }
+
+    void handleConnection(uint64_t id, uint32_t ready) {
+        auto it = connections_.find(id);
+        if (it == connections_.end()) return;
+        ConnectionPtr conn = it->second;
+
+        if (ready & EPOLLERR) {
+            closeConnection(conn);
+            return;
+        }
+        if (ready & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) {
+            readRequests(conn);
+        }
+        if (ready & EPOLLOUT) {
+            // 输出积压时暂停的请求在发送后继续
+            startNext(conn);
+        }
+        finishIfIdle(conn);
+    }
+
+    void readRequests(const ConnectionPtr& conn) {
+        char buf[4096];
+        for (;;) {
+            ssize_t n = read(conn->fd, buf, sizeof(buf));
+            if (n > 0) {
+                conn->in.append(buf, static_cast<size_t>(n));
+                continue;
+            }
+            if (n == 0) {
+                conn->readClosed = true;
+            } else if (errno == EINTR) {
+                continue;
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                conn->readClosed = true;
+                markBroken(*conn);
+            }
             break;
         }
 
-        // 处理客户端请求
-        handleClient(client_fd);
-        close(client_fd);
+        parseRequests(*conn);
+        startNext(conn);
     }
 
-    close(sockfd);
-}
+    // 按帧头切分请求；魔数或长度错误时无法再同步，回复错误后关闭连接
+    void parseRequests(Connection& conn) {
+        size_t pos = 0;
+        while (!conn.readClosed && conn.in.size() - pos >= protocol::kHeaderSize) {
+            protocol::Header header;
+            protocol::Status status = protocol::parseHeader(conn.in.data() + pos, header);
+
+            Request request;
+            request.id = header.requestId;
+            if (status == protocol::STATUS_BAD_REQUEST) {
+                request.status = status;
+                conn.requests.push_back(std::move(request));
+                conn.readClosed = true;
+                break;
+            }
+            if (conn.in.size() - pos - protocol::kHeaderSize < header.length) break;
+
+            const char* payload = conn.in.data() + pos + protocol::kHeaderSize;
+            std::vector<protocol::Arg> args;
+            std::vector<std::vector<protocol::Arg>> commands;
+            if (status != protocol::STATUS_OK) {
+                request.status = status;
+            } else if (header.type == protocol::MSG_BATCH) {
+                if (!protocol::decodeBatch(payload, header.length, request.workspace, commands)) {
+                    request.status = protocol::STATUS_BAD_REQUEST;
+                } else {
+                    request.args = {"batch"};
+                    for (const auto& command : commands) {
+                        request.batch.emplace_back();
+                        for (const auto& arg : command) request.batch.back().push_back(arg.toString());
+                    }
+                }
+            } else if (header.type != protocol::MSG_REQUEST ||
+                       !protocol::decodeArgs(payload, header.length, args) || args.empty()) {
+                request.status = protocol::STATUS_BAD_REQUEST;
+            } else {
+                // 第一个参数是工作区路径，其余是命令；没有命令的请求无法执行
+                request.workspace = args[0].toString();
+                size_t first = 1;
+                if (args.size() > 1 && args[1].toString() == "--trace") {
+                    request.trace = true;
+                    first = 2;
+                }
+                for (size_t i = first; i < args.size(); ++i) request.args.push_back(args[i].toString());
+                if (request.args.empty()) request.status = protocol::STATUS_BAD_REQUEST;
+            }
+            conn.requests.push_back(std::move(request));
+            pos += protocol::kHeaderSize + header.length;
+        }
+        conn.in.erase(0, pos);
+    }
 
-void Daemon::handleClient(int fd) {
-    // 简单的协议：命令长度(4字节) + 命令
-    uint32_t cmd_len;
-    if (read(fd, &cmd_len, sizeof(cmd_len)) != sizeof(cmd_len)) {
-        perror("read cmd_len");
-        return;
+    bool outputFull(Connection& conn) {
+        std::lock_guard<std::mutex> lock(conn.mutex);
+        return conn.outBytes >= kMaxPendingOutput;
     }
 
-    cmd_len = ntohl(cmd_len);
-    std::vector<char> buffer(cmd_len);
-    if (read(fd, buffer.data(), cmd_len) != static_cast<ssize_t>(cmd_len)) {
-        perror("read cmd");
-        return;
+    // 同一连接上的请求并发执行，响应按 requestId 区分、可以乱序返回
+    void startNext(const ConnectionPtr& conn) {
+        while (conn->inFlight < kMaxInFlight && !conn->requests.empty() && !outputFull(*conn)) {
+            Request request = std::move(conn->requests.front());
+            conn->requests.pop_front();
+            auto started = std::chrono::steady_clock::now();
+
+            if (request.status != protocol::STATUS_OK) {
+                protocol::FrameWriter writer([this, conn](std::string frame) {
+                    return enqueue(conn, std::move(frame), false);
+                }, request.id);
+                writer.finish(request.status, 1);
+            } else if (isInlineCommand(request.args) && !request.trace &&
+                       (request.workspace.empty() || WorkspaceManager::instance().opened(request.workspace))) {
+                // 打开工作区可能很慢（迁移数据库、等待后台恢复），尚未打开时交给工作线程；
+                // 按请求追踪要写文件，同样不在这里执行
+                execute(conn, request, false);
+                recordLatency(inlineLatency_, started);
+            } else {
+                conn->inFlight++;
+                uint64_t id = conn->id;
+                pool_.submit([this, conn, request, started, id] {
+                    execute(conn, request, true);
+                    recordLatency(workerLatency_, started);
+                    notifyLoop(id, true);
+                });
+            }
+        }
+        flush(conn);
+        updateInterest(*conn);
+    }
+
+    // 排队请求过多时暂停读取，直到执行跟上
+    void updateInterest(Connection& conn) {
+        bool wantRead = !conn.readClosed && conn.requests.size() < kMaxQueuedRequests;
+        if (wantRead == conn.readWatched) return;
+        conn.readWatched = wantRead;
+        watch(conn.fd, conn.id, events(conn), EPOLL_CTL_MOD);
+    }
+
+    static uint32_t events(const Connection& conn) {
+        return (conn.readWatched ? EPOLLIN | EPOLLRDHUP : 0u) | (conn.writeWatched ? EPOLLOUT : 0u);
+    }
+
+    // init 创建并托管工作区；其他命令按需打开已初始化的工作区。
+    // mayOpen 为 false 时（事件循环线程）只使用已打开的工作区
+    static std::shared_ptr<Core> resolveWorkspace(const Request& request, std::ostream& out, bool mayOpen) {
+        if (request.workspace.empty()) return nullptr;
+
+        bool create = !request.args.empty() && request.args[0] == "init";
+        auto core = !mayOpen ? WorkspaceManager::instance().opened(request.workspace)
+                    : create ? WorkspaceManager::instance().open(request.workspace, true)
+                             : WorkspaceManager::instance().find(request.workspace);
+        if (!core && create) {
+            out << "Error: Failed to initialize Clay repository at " << request.workspace << std::endl;
+        } else if (!core && requiresWorkspace(request.args)) {
+            out << "Error: " << request.workspace << " is not a Clay workspace. Use 'clay init' to start."
+                << std::endl;
+        }
+        return core;
+    }
+
+    // 请求期间所有线程的跨度；按请求追踪时只有本线程在记录，其他线程的跨度来自守护进程级追踪
+    static void writeRequestTrace(const std::shared_ptr<Core>& core, const Request& request,
+                                  uint64_t startNs, std::ostream& out) {
+        if (!core) {
+            out << "Trace not written: request has no workspace" << std::endl;
+            return;
+        }
+        auto events = Tracer::instance().collect(startNs, Tracer::now());
+        auto t = std::time(nullptr);
+        char stamp[20];
+        std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", std::localtime(&t));
+        std::string name = "request-" + request.args[0] + "-" + stamp + "-" + std::to_string(request.id);
+        std::string path = Tracer::writeWorkspaceTrace(core->workspace(), name, events);
+        if (path.empty()) {
+            out << "Failed to write trace for " << request.args[0] << std::endl;
+        } else {
+            out << "Trace written to " << path << " (" << events.size() << " spans)" << std::endl;
+        }
+    }
+
+    static std::string describe(const Request& request) {
+        std::string name;
+        for (const auto& arg : request.args) {
+            if (!name.empty()) name += ' ';
+            name += arg;
+        }
+        if (!request.workspace.empty()) name += " [" + fs::path(request.workspace).filename().string() + "]";
+        return name;
+    }
+
+    void execute(const ConnectionPtr& conn, const Request& request, bool fromWorker) {
+        protocol::FrameWriter writer([this, conn, fromWorker](std::string frame) {
+            return enqueue(conn, std::move(frame), fromWorker);
+        }, request.id);
+        std::ostream result(&writer);
+        std::optional<Tracer::ThreadScope> tracing;
+        if (request.trace) tracing.emplace();
+        uint64_t traceStart = Tracer::now();
+        try {
+            int code = 1;
+            std::shared_ptr<Core> tracedCore;
+            auto run = [&] {
+                TraceScope span("daemon", "request", request.args[0]);
+                if (request.args[0] == "batch") {
+                    // 批量结果总是一个 JSON 文档，工作区错误也写在其中
+                    std::ostringstream ignored;
+                    std::shared_ptr<Core> core = resolveWorkspace(request, ignored, fromWorker);
+                    code = clay::Command::batch(core.get(), request.batch, result);
+                    return;
+                }
+                std::shared_ptr<Core> core;
+                {
+                    TraceScope resolveSpan("daemon", "resolve_workspace");
+                    core = resolveWorkspace(request, result, fromWorker);
+                }
+                tracedCore = core;
+                if (!request.workspace.empty() && !core && requiresWorkspace(request.args)) return;
+                code = clay::Command::execute(request.args, result, core.get());
+            };
+            if (fromWorker) {
+                // 用户命令以最高优先级登记，维护作业在其运行期间让路
+                JobScheduler::instance().run(JobClass::Interactive, describe(request), run);
+            } else {
+                run();
+            }
+            if (request.trace) writeRequestTrace(tracedCore, request, traceStart, result);
+            writer.finish(code);
+        } catch (const std::exception& e) {
+            result << "Error: " << e.what() << std::endl;
+            writer.finish(protocol::STATUS_INTERNAL_ERROR, 1);
+        }
+    }
+
+    // 工作线程在队列过长时等待循环线程发送；循环线程内执行的命令不能等待
+    bool enqueue(const ConnectionPtr& conn, std::string frame, bool wait) {
+        {
+            std::unique_lock<std::mutex> lock(conn->mutex);
+            if (wait) {
+                conn->drained.wait(lock, [&conn] {
+                    return conn->broken || conn->outBytes < kMaxPendingOutput;
+                });
+            }
+            if (conn->broken) return false;
+            conn->outBytes += frame.size();
+            conn->out.push_back(std::move(frame));
+        }
+        if (wait) notifyLoop(conn->id, false);
+        return true;
     }
 
-    std::string command(buffer.data(), cmd_len);
-    std::vector<std::string> args;
-    std::istringstream iss(command);
-    std::string arg;
-    while (iss >> arg) {
-        args.push_back(arg);
+    void flush(const ConnectionPtr& conn) {
+        bool wantWrite = false;
+        {
+            std::lock_guard<std::mutex> lock(conn->mutex);
+            while (!conn->broken && !conn->out.empty()) {
+                const std::string& front = conn->out.front();
+                ssize_t n = send(conn->fd, front.data() + conn->outOffset,
+                                 front.size() - conn->outOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+                if (n < 0) {
+                    if (errno == EINTR) continue;
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                        wantWrite = true;
+                    } else {
+                        conn->broken = true;
+                    }
+                    break;
+                }
+                conn->outOffset += static_cast<size_t>(n);
+                conn->outBytes -= static_cast<size_t>(n);
+                if (conn->outOffset == front.size()) {
+                    conn->out.pop_front();
+                    conn->outOffset = 0;
+                }
+            }
+            if (conn->broken) {
+                conn->out.clear();
+                conn->outBytes = 0;
+            }
+        }
+        conn->drained.notify_all();
+
+        if (wantWrite != conn->writeWatched) {
+            conn->writeWatched = wantWrite;
+            watch(conn->fd, conn->id, events(*conn), EPOLL_CTL_MOD);
+        }
+    }
+
+    void notifyLoop(uint64_t id, bool finished) {
+        {
+            std::lock_guard<std::mutex> lock(notifyMutex_);
+            (finished ? finished_ : dirty_).push_back(id);
+        }
+        uint64_t one = 1;
+        ssize_t ignored = write(wakeFd_, &one, sizeof(one));
+        (void)ignored;
+    }
+
+    void handleWake() {
+        uint64_t value;
+        while (read(wakeFd_, &value, sizeof(value)) > 0) {
+        }
+
+        std::vector<uint64_t> dirty, finished;
+        {
+            std::lock_guard<std::mutex> lock(notifyMutex_);
+            dirty.swap(dirty_);
+            finished.swap(finished_);
+        }
+
+        for (uint64_t id : dirty) {
+            auto it = connections_.find(id);
+            if (it != connections_.end()) flush(it->second);
+        }
+        for (uint64_t id : finished) {
+            auto it = connections_.find(id);
+            if (it == connections_.end()) continue;
+            ConnectionPtr conn = it->second;
+            conn->inFlight--;
+            startNext(conn);
+            finishIfIdle(conn);
+        }
+    }
+
+    void finishIfIdle(const ConnectionPtr& conn) {
+        if (conn->inFlight > 0 || !conn->requests.empty()) return;
+
+        bool drained, broken;
+        {
+            std::lock_guard<std::mutex> lock(conn->mutex);
+            drained = conn->out.empty();
+            broken = conn->broken;
+        }
+        if (broken || (conn->readClosed && drained)) {
+            closeConnection(conn);
+        }
     }
 
-    // 执行命令
-    std::ostringstream result;
-    clay::Command::execute(args, result);
+    void markBroken(Connection& conn) {
+        {
+            std::lock_guard<std::mutex> lock(conn.mutex);
+            conn.broken = true;
+            conn.out.clear();
+            conn.outBytes = 0;
+        }
+        conn.drained.notify_all();
+    }
+
+    void closeConnection(const ConnectionPtr& conn) {
+        // 仍在执行的工作线程持有 shared_ptr，输出会因 broken 被丢弃
+        markBroken(*conn);
+        epoll_ctl(epollFd_, EPOLL_CTL_DEL, conn->fd, nullptr);
+        close(conn->fd);
+        connections_.erase(conn->id);
+        connectionCount_ = connections_.size();
+    }
+
+    void recordLatency(LatencyHistogram& histogram, std::chrono::steady_clock::time_point started) {
+        auto elapsed = std::chrono::steady_clock::now() - started;
+        histogram.record(elapsed);
+        allLatency_.record(elapsed);
+    }
+
+    int listenFd_ = -1;
+    int epollFd_ = -1;
+    int wakeFd_ = -1;
+    int signalFd_ = -1;
+    bool stopRequested_ = false;
+    std::chrono::steady_clock::time_point stopDeadline_;
+
+    uint64_t nextId_ = 16;
+    std::unordered_map<uint64_t, ConnectionPtr> connections_;
+    std::atomic<size_t> connectionCount_{0};
+
+    std::mutex notifyMutex_;
+    std::vector<uint64_t> dirty_;
+    std::vector<uint64_t> finished_;
+
+    LatencyHistogram allLatency_;
+    LatencyHistogram inlineLatency_;
+    LatencyHistogram workerLatency_;
 
-    // 发送结果
-    std::string result_str = result.str();
-    uint32_t result_len = htonl(result_str.size());
-    write(fd, &result_len, sizeof(result_len));
-    write(fd, result_str.data(), result_str.size());
+    // 析构函数开头显式停止，这里析构时已没有线程
+    WorkerPool pool_;
+};
+
+void Daemon::mainLoop() {
+    // 先开始监听，客户端不必等待工作区恢复
+    loop_ = std::make_unique<EventLoop>();
+    if (loop_->open(sockPath_)) {
+        StartupProfile::instance().mark("listen");
+
+        // 上次托管的工作区在后台重新打开；请求只等待自己所在的工作区
+        WorkspaceManager::instance().start(runtimeDir() + "/workspaces");
+        StartupProfile::instance().mark("workspace list");
+
+        loop_->run(running_);
+    }
+    loop_.reset();
+}
+
+void Daemon::writeStats(std::ostream& out) const {
+    if (!loop_) {
+        out << "Daemon event loop is not running\n";
+        return;
+    }
+    loop_->writeStats(out);
+    StartupProfile::instance().write(out);
 }
 
 } // namespace clay
@@ -0,0 +1,121 @@
+#include "clay/delta.hpp"
+#include "bsdiff.h"
+#include "bspatch.h"
+#include <lz4.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+
+namespace clay {
+
+namespace {
+
+int vectorWrite(struct bsdiff_stream* stream, const void* buffer, int size) {
+    auto* out = static_cast<std::vector<uint8_t>*>(stream->opaque);
+    const uint8_t* p = static_cast<const uint8_t*>(buffer);
+    out->insert(out->end(), p, p + size);
+    return 0;
+}
+
+int fdSinkWrite(struct bspatch_sink* sink, const void* buffer, int64_t length) {
+    int fd = *static_cast<int*>(sink->opaque);
+    const char* p = static_cast<const char*>(buffer);
+    while (length > 0) {
+        ssize_t n = write(fd, p, static_cast<size_t>(length));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        length -= n;
+    }
+    return 0;
+}
+
+int vectorSinkWrite(struct bspatch_sink* sink, const void* buffer, int64_t length) {
+    auto* out = static_cast<std::vector<uint8_t>*>(sink->opaque);
+    const uint8_t* p = static_cast<const uint8_t*>(buffer);
+    out->insert(out->end(), p, p + length);
+    return 0;
+}
+
+bool runChain(ByteView base, const std::vector<ByteView>& patches, struct bspatch_sink& sink) {
+    std::vector<struct bspatch_view> views;
+    views.reserve(patches.size());
+    for (const auto& p : patches) {
+        views.push_back({p.data, static_cast<int64_t>(p.size)});
+    }
+
+    static const uint8_t empty = 0;
+    return bspatch_chain(base.data ? base.data : &empty, static_cast<int64_t>(base.size),
+                         views.data(), static_cast<int>(views.size()), &sink) == 0;
+}
+
+} // namespace
+
+bool compressBlock(ByteView in, std::vector<uint8_t>& out) {
+    if (in.size > static_cast<size_t>(LZ4_MAX_INPUT_SIZE)) return false;
+
+    int bound = LZ4_compressBound(static_cast<int>(in.size));
+    out.resize(8 + static_cast<size_t>(bound));
+    uint64_t rawSize = in.size;
+    for (int i = 0; i < 8; ++i) out[i] = static_cast<uint8_t>(rawSize >> (8 * i));
+
+    int n = LZ4_compress_default(reinterpret_cast<const char*>(in.data),
+                                 reinterpret_cast<char*>(out.data() + 8),
+                                 static_cast<int>(in.size), bound);
+    if (n <= 0 && in.size > 0) return false;
+    out.resize(8 + static_cast<size_t>(n));
+    return true;
+}
+
+bool decompressBlock(ByteView in, std::vector<uint8_t>& out) {
+    if (in.size < 8) return false;
+
+    uint64_t rawSize = 0;
+    for (int i = 0; i < 8; ++i) rawSize |= static_cast<uint64_t>(in.data[i]) << (8 * i);
+    if (rawSize > static_cast<uint64_t>(LZ4_MAX_INPUT_SIZE)) return false;
+
+    out.resize(static_cast<size_t>(rawSize));
+    if (rawSize == 0) return true;
+    int n = LZ4_decompress_safe(reinterpret_cast<const char*>(in.data + 8),
+                                reinterpret_cast<char*>(out.data()),
+                                static_cast<int>(in.size - 8), static_cast<int>(rawSize));
+    return n >= 0 && static_cast<uint64_t>(n) == rawSize;
+}
+
+bool makePatch(ByteView from, ByteView to, std::vector<uint8_t>& patch) {
+    patch.clear();
+    struct bsdiff_stream stream;
+    stream.malloc = std::malloc;
+    stream.free = std::free;
+    stream.write = vectorWrite;
+    stream.opaque = &patch;
+
+    static const uint8_t empty = 0;
+    return bsdiff(from.data ? from.data : &empty, static_cast<int64_t>(from.size),
+                  to.data ? to.data : &empty, static_cast<int64_t>(to.size), &stream) == 0;
+}
+
+bool applyPatchChain(ByteView base, const std::vector<ByteView>& patches, int fd) {
+    struct bspatch_sink sink;
+    sink.opaque = &fd;
+    sink.write = fdSinkWrite;
+    return runChain(base, patches, sink);
+}
+
+bool applyPatchChain(ByteView base, const std::vector<ByteView>& patches, std::vector<uint8_t>& out) {
+    out.clear();
+    if (!patches.empty()) {
+        struct bspatch_view last = {patches.back().data, static_cast<int64_t>(patches.back().size)};
+        int64_t size = bspatch_newsize(&last);
+        if (size > 0) out.reserve(static_cast<size_t>(size));
+    }
+
+    struct bspatch_sink sink;
+    sink.opaque = &out;
+    sink.write = vectorSinkWrite;
+    return runChain(base, patches, sink);
+}
+
+} // namespace clay
@@ -0,0 +1,344 @@
+#include "clay/hash.hpp"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CLAY_HASH_X86 1
+#elif defined(__aarch64__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define CLAY_HASH_NEON 1
+#endif
+
+namespace clay {
+
+// XXH3-64 的实现，常量与分支结构与 xxhash 0.8 一致
+namespace {
+
+constexpr uint32_t kPrime32_1 = 0x9E3779B1U;
+constexpr uint32_t kPrime32_2 = 0x85EBCA77U;
+constexpr uint32_t kPrime32_3 = 0xC2B2AE3DU;
+constexpr uint64_t kPrime64_1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t kPrime64_2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t kPrime64_3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t kPrime64_4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t kPrime64_5 = 0x27D4EB2F165667C5ULL;
+constexpr uint64_t kPrimeMx1 = 0x165667919E3779F9ULL;
+constexpr uint64_t kPrimeMx2 = 0x9FB21C651E98DF25ULL;
+
+constexpr size_t kSecretSize = 192;
+constexpr size_t kStripeLen = 64;
+constexpr size_t kSecretConsumeRate = 8;
+constexpr size_t kStripesPerBlock = (kSecretSize - kStripeLen) / kSecretConsumeRate;
+constexpr size_t kBlockLen = kStripeLen * kStripesPerBlock;
+constexpr size_t kLastStripeSecretOffset = kSecretSize - kStripeLen - 7;
+constexpr size_t kMergeSecretOffset = 11;
+constexpr size_t kMidSizeMax = 240;
+
+alignas(64) constexpr uint8_t kSecret[kSecretSize] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+    0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+    0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+    0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+    0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+    0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+    0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+    0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+    0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+// 小端读取；目标平台都是小端
+inline uint64_t read64(const uint8_t* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t rotl64(uint64_t v, int r) { return (v << r) | (v >> (64 - r)); }
+
+inline uint64_t mulFold64(uint64_t a, uint64_t b) {
+    unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+    return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+}
+
+inline uint64_t xxh64Avalanche(uint64_t h) {
+    h ^= h >> 33;
+    h *= kPrime64_2;
+    h ^= h >> 29;
+    h *= kPrime64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+inline uint64_t avalanche(uint64_t h) {
+    h ^= h >> 37;
+    h *= kPrimeMx1;
+    h ^= h >> 32;
+    return h;
+}
+
+inline uint64_t rrmxmx(uint64_t h, uint64_t len) {
+    h ^= rotl64(h, 49) ^ rotl64(h, 24);
+    h *= kPrimeMx2;
+    h ^= (h >> 35) + len;
+    h *= kPrimeMx2;
+    h ^= h >> 28;
+    return h;
+}
+
+inline uint64_t mix16(const uint8_t* in, const uint8_t* secret) {
+    return mulFold64(read64(in) ^ read64(secret), read64(in + 8) ^ read64(secret + 8));
+}
+
+uint64_t hash0to16(const uint8_t* in, size_t len) {
+    if (len > 8) {
+        uint64_t lo = read64(in) ^ (read64(kSecret + 24) ^ read64(kSecret + 32));
+        uint64_t hi = read64(in + len - 8) ^ (read64(kSecret + 40) ^ read64(kSecret + 48));
+        uint64_t acc = len + __builtin_bswap64(lo) + hi + mulFold64(lo, hi);
+        return avalanche(acc);
+    }
+    if (len >= 4) {
+        uint64_t combined = read32(in + len - 4) + (static_cast<uint64_t>(read32(in)) << 32);
+        return rrmxmx(combined ^ (read64(kSecret + 8) ^ read64(kSecret + 16)), len);
+    }
+    if (len > 0) {
+        uint32_t combined = (static_cast<uint32_t>(in[0]) << 16) | (static_cast<uint32_t>(in[len >> 1]) << 24) |
+                            static_cast<uint32_t>(in[len - 1]) | (static_cast<uint32_t>(len) << 8);
+        uint64_t flip = read32(kSecret) ^ read32(kSecret + 4);
+        return xxh64Avalanche(combined ^ flip);
+    }
+    return xxh64Avalanche(read64(kSecret + 56) ^ read64(kSecret + 64));
+}
+
+uint64_t hash17to128(const uint8_t* in, size_t len) {
+    uint64_t acc = len * kPrime64_1;
+    if (len > 32) {
+        if (len > 64) {
+            if (len > 96) {
+                acc += mix16(in + 48, kSecret + 96);
+                acc += mix16(in + len - 64, kSecret + 112);
+            }
+            acc += mix16(in + 32, kSecret + 64);
+            acc += mix16(in + len - 48, kSecret + 80);
+        }
+        acc += mix16(in + 16, kSecret + 32);
+        acc += mix16(in + len - 32, kSecret + 48);
+    }
+    acc += mix16(in, kSecret);
+    acc += mix16(in + len - 16, kSecret + 16);
+    return avalanche(acc);
+}
+
+uint64_t hash129to240(const uint8_t* in, size_t len) {
+    uint64_t acc = len * kPrime64_1;
+    size_t rounds = len / 16;
+    for (size_t i = 0; i < 8; ++i) acc += mix16(in + 16 * i, kSecret + 16 * i);
+    acc = avalanche(acc);
+    for (size_t i = 8; i < rounds; ++i) acc += mix16(in + 16 * i, kSecret + 16 * (i - 8) + 3);
+    acc += mix16(in + len - 16, kSecret + 136 - 17);
+    return avalanche(acc);
+}
+
+uint64_t mergeAccumulators(const uint64_t acc[8], uint64_t len) {
+    uint64_t result = len * kPrime64_1;
+    const uint8_t* secret = kSecret + kMergeSecretOffset;
+    for (size_t i = 0; i < 4; ++i) {
+        result += mulFold64(acc[2 * i] ^ read64(secret + 16 * i), acc[2 * i + 1] ^ read64(secret + 16 * i + 8));
+    }
+    return avalanche(result);
+}
+
+constexpr uint64_t kInitAcc[8] = {
+    kPrime32_3, kPrime64_1, kPrime64_2, kPrime64_3, kPrime64_4, kPrime32_2, kPrime64_5, kPrime32_1,
+};
+
+// 长输入：每 64 字节一个条带累加到 8 个 64 位累加器，每 16 个条带（一个块）打乱一次。
+// 各实现只在条带累加和打乱的方式上不同，块的划分相同。
+// 必须内联进带 target 属性的调用者，否则 AVX2 的内核方法无法内联，每个条带都是一次函数调用。
+template <typename Kernel>
+__attribute__((always_inline)) inline uint64_t hashLong(const uint8_t* in, size_t len, Kernel& kernel) {
+    size_t blocks = (len - 1) / kBlockLen;
+    for (size_t b = 0; b < blocks; ++b) {
+        const uint8_t* block = in + b * kBlockLen;
+        for (size_t s = 0; s < kStripesPerBlock; ++s) {
+            kernel.accumulate(block + s * kStripeLen, kSecret + s * kSecretConsumeRate);
+        }
+        kernel.scramble(kSecret + kSecretSize - kStripeLen);
+    }
+
+    const uint8_t* tail = in + blocks * kBlockLen;
+    size_t stripes = ((len - 1) - blocks * kBlockLen) / kStripeLen;
+    for (size_t s = 0; s < stripes; ++s) {
+        kernel.accumulate(tail + s * kStripeLen, kSecret + s * kSecretConsumeRate);
+    }
+    kernel.accumulate(in + len - kStripeLen, kSecret + kLastStripeSecretOffset);
+
+    uint64_t acc[8];
+    kernel.store(acc);
+    return mergeAccumulators(acc, len);
+}
+
+struct ScalarKernel {
+    uint64_t acc[8];
+
+    ScalarKernel() { std::memcpy(acc, kInitAcc, sizeof(acc)); }
+
+    void accumulate(const uint8_t* in, const uint8_t* secret) {
+        for (size_t i = 0; i < 8; ++i) {
+            uint64_t data = read64(in + 8 * i);
+            uint64_t key = data ^ read64(secret + 8 * i);
+            acc[i ^ 1] += data;
+            acc[i] += static_cast<uint64_t>(static_cast<uint32_t>(key)) * (key >> 32);
+        }
+    }
+
+    void scramble(const uint8_t* secret) {
+        for (size_t i = 0; i < 8; ++i) {
+            uint64_t a = acc[i];
+            a ^= a >> 47;
+            a ^= read64(secret + 8 * i);
+            a *= kPrime32_1;
+            acc[i] = a;
+        }
+    }
+
+    void store(uint64_t out[8]) const { std::memcpy(out, acc, sizeof(acc)); }
+};
+
+uint64_t hashLongScalar(const uint8_t* in, size_t len) {
+    ScalarKernel kernel;
+    return hashLong(in, len, kernel);
+}
+
+#if CLAY_HASH_X86
+
+// 整个长输入循环放在带 target 属性的函数里，累加器留在 ymm 寄存器中
+__attribute__((target("avx2"))) uint64_t hashLongAvx2(const uint8_t* in, size_t len) {
+    struct Kernel {
+        __m256i acc[2];
+
+        __attribute__((target("avx2"))) void accumulate(const uint8_t* input, const uint8_t* secret) {
+            for (int i = 0; i < 2; ++i) {
+                __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input) + i);
+                __m256i key = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(secret) + i);
+                __m256i dataKey = _mm256_xor_si256(data, key);
+                __m256i product = _mm256_mul_epu32(dataKey, _mm256_srli_epi64(dataKey, 32));
+                __m256i swapped = _mm256_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+                acc[i] = _mm256_add_epi64(product, _mm256_add_epi64(acc[i], swapped));
+            }
+        }
+
+        __attribute__((target("avx2"))) void scramble(const uint8_t* secret) {
+            const __m256i prime = _mm256_set1_epi32(static_cast<int>(kPrime32_1));
+            for (int i = 0; i < 2; ++i) {
+                __m256i a = _mm256_xor_si256(acc[i], _mm256_srli_epi64(acc[i], 47));
+                __m256i key = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(secret) + i);
+                __m256i dataKey = _mm256_xor_si256(a, key);
+                __m256i lo = _mm256_mul_epu32(dataKey, prime);
+                __m256i hi = _mm256_mul_epu32(_mm256_srli_epi64(dataKey, 32), prime);
+                acc[i] = _mm256_add_epi64(lo, _mm256_slli_epi64(hi, 32));
+            }
+        }
+
+        __attribute__((target("avx2"))) void store(uint64_t out[8]) const {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), acc[0]);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out) + 1, acc[1]);
+        }
+    } kernel;
+    kernel.acc[0] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(kInitAcc));
+    kernel.acc[1] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(kInitAcc) + 1);
+    return hashLong(in, len, kernel);
+}
+
+#elif CLAY_HASH_NEON
+
+uint64_t hashLongNeon(const uint8_t* in, size_t len) {
+    struct Kernel {
+        uint64x2_t acc[4];
+
+        void accumulate(const uint8_t* input, const uint8_t* secret) {
+            for (int i = 0; i < 4; ++i) {
+                uint64x2_t data = vreinterpretq_u64_u8(vld1q_u8(input + 16 * i));
+                uint64x2_t key = vreinterpretq_u64_u8(vld1q_u8(secret + 16 * i));
+                uint64x2_t dataKey = veorq_u64(data, key);
+                uint64x2_t swapped = vextq_u64(data, data, 1);
+                acc[i] = vaddq_u64(acc[i], swapped);
+                acc[i] = vmlal_u32(acc[i], vmovn_u64(dataKey), vshrn_n_u64(dataKey, 32));
+            }
+        }
+
+        void scramble(const uint8_t* secret) {
+            const uint32x2_t prime = vdup_n_u32(kPrime32_1);
+            for (int i = 0; i < 4; ++i) {
+                uint64x2_t a = veorq_u64(acc[i], vshrq_n_u64(acc[i], 47));
+                uint64x2_t dataKey = veorq_u64(a, vreinterpretq_u64_u8(vld1q_u8(secret + 16 * i)));
+                uint64x2_t hi = vshlq_n_u64(vmull_u32(vshrn_n_u64(dataKey, 32), prime), 32);
+                acc[i] = vmlal_u32(hi, vmovn_u64(dataKey), prime);
+            }
+        }
+
+        void store(uint64_t out[8]) const {
+            for (int i = 0; i < 4; ++i) vst1q_u64(out + 2 * i, acc[i]);
+        }
+    } kernel;
+    for (int i = 0; i < 4; ++i) kernel.acc[i] = vld1q_u64(kInitAcc + 2 * i);
+    return hashLong(in, len, kernel);
+}
+
+#endif
+
+using LongHash = uint64_t (*)(const uint8_t*, size_t);
+
+struct Dispatch {
+    LongHash hashLong = hashLongScalar;
+    const char* name = "scalar";
+
+    Dispatch() {
+#if CLAY_HASH_X86
+        if (__builtin_cpu_supports("avx2")) {
+            hashLong = hashLongAvx2;
+            name = "avx2";
+        }
+#elif CLAY_HASH_NEON
+        hashLong = hashLongNeon;
+        name = "neon";
+#endif
+    }
+};
+
+const Dispatch& dispatch() {
+    static const Dispatch instance;
+    return instance;
+}
+
+inline uint64_t hashWith(const void* data, size_t size, LongHash longHash) {
+    const uint8_t* in = static_cast<const uint8_t*>(data);
+    if (size <= 16) return hash0to16(in, size);
+    if (size <= 128) return hash17to128(in, size);
+    if (size <= kMidSizeMax) return hash129to240(in, size);
+    return longHash(in, size);
+}
+
+} // namespace
+
+uint64_t fastHash(const void* data, size_t size) {
+    return hashWith(data, size, dispatch().hashLong);
+}
+
+uint64_t fastHashScalar(const void* data, size_t size) {
+    return hashWith(data, size, hashLongScalar);
+}
+
+const char* fastHashImplementation() {
+    return dispatch().name;
+}
+
+} // namespace clay
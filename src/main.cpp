@@ -1,31 +1,35 @@
 #include "clay/command.hpp"
 #include "clay/daemon.hpp"
+#include "clay/protocol.hpp"
 #include <vector>
 #include <string>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <unistd.h>
+#include <cerrno>
 #include <cstring>
 #include <iostream>
 #include <arpa/inet.h>
 #include <filesystem>
+#include <sstream>
 
 namespace fs = std::filesystem;
 
-int sendCommandToDaemon(const std::vector<std::string>& args) {
-    // 查找守护进程socket
-    std::string sockPath = ".clay/clay.sock";
-    if (!fs::exists(sockPath)) {
-        // 尝试在父目录中查找
-        for (int i = 0; i < 5; i++) {
-            sockPath = "../" + sockPath;
-            if (fs::exists(sockPath)) break;
-        }
-        if (!fs::exists(sockPath)) {
-            std::cerr << "Clay daemon is not running. Use 'clay init' to start." << std::endl;
-            return 1;
-        }
+// 从当前目录向上查找包含 .clay 的工作区根目录；找不到返回空
+std::string findWorkspaceRoot() {
+    std::error_code ec;
+    fs::path dir = fs::current_path(ec);
+    if (ec) return "";
+    while (true) {
+        if (fs::is_directory(dir / ".clay", ec)) return dir.string();
+        if (!dir.has_parent_path() || dir.parent_path() == dir) return "";
+        dir = dir.parent_path();
     }
+}
+
+// 发送一条请求消息并输出响应流，返回命令的退出码
+int sendToDaemon(uint8_t type, const std::string& payload) {
+    std::string sockPath = clay::Daemon::socketPath();
 
     // 连接到守护进程
     int sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
@@ -40,58 +44,65 @@ int sendCommandToDaemon(const std::vector<std::string>& args) {
     strncpy(addr.sun_path, sockPath.c_str(), sizeof(addr.sun_path)-1);
 
     if (connect(sockfd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-        perror("connect");
+        std::cerr << "Cannot connect to Clay daemon at " << sockPath << ": " << strerror(errno) << std::endl;
         close(sockfd);
         return 1;
     }
 
-    // 构造命令
-    std::ostringstream oss;
-    for (const auto& arg : args) {
-        oss << arg << " ";
-    }
-    std::string command = oss.str();
-    uint32_t cmd_len = htonl(command.size());
-
-    // 发送命令
-    if (write(sockfd, &cmd_len, sizeof(cmd_len)) != sizeof(cmd_len)) {
-        perror("write cmd_len");
+    const uint32_t requestId = 1;
+    if (payload.size() > clay::protocol::kMaxMessagePayload) {
+        std::cerr << "Request too large (" << payload.size() << " bytes)" << std::endl;
         close(sockfd);
         return 1;
     }
-    
-    if (write(sockfd, command.data(), command.size()) != static_cast<ssize_t>(command.size())) {
+    if (!clay::protocol::writeMessage(sockfd, type, requestId,
+                                      payload.data(), static_cast<uint32_t>(payload.size()))) {
         perror("write cmd");
         close(sockfd);
         return 1;
     }
 
-    // 接收结果
-    uint32_t result_len;
-    if (read(sockfd, &result_len, sizeof(result_len)) != sizeof(result_len)) {
-        perror("read result_len");
-        close(sockfd);
-        return 1;
-    }
+    // 接收结果：数据块到达即输出，直到结束消息
+    clay::protocol::Header header;
+    std::string response;
+    while (clay::protocol::readMessage(sockfd, header, response)) {
+        if (header.requestId != requestId) continue;
 
-    result_len = ntohl(result_len);
-    std::vector<char> buffer(result_len);
-    ssize_t bytes_read = read(sockfd, buffer.data(), result_len);
-    if (bytes_read < 0) {
-        perror("read result");
-        close(sockfd);
-        return 1;
-    }
-    
-    if (bytes_read != static_cast<ssize_t>(result_len)) {
-        std::cerr << "Incomplete result: " << bytes_read << "/" << result_len << std::endl;
-        close(sockfd);
-        return 1;
+        if (header.type == clay::protocol::MSG_DATA) {
+            std::cout.write(response.data(), response.size());
+            std::cout.flush();
+        } else if (header.type == clay::protocol::MSG_END) {
+            uint32_t status = clay::protocol::STATUS_INTERNAL_ERROR;
+            int code = 1;
+            clay::protocol::decodeEnd(response, status, code);
+            close(sockfd);
+            if (status != clay::protocol::STATUS_OK && status != clay::protocol::STATUS_COMMAND_FAILED) {
+                std::cerr << "Daemon error: " << clay::protocol::statusName(status) << std::endl;
+                return code ? code : 1;
+            }
+            return code;
+        } else {
+            break;
+        }
     }
 
-    std::cout << std::string(buffer.data(), result_len);
+    std::cerr << "Connection to daemon lost before command finished" << std::endl;
     close(sockfd);
-    return 0;
+    return 1;
+}
+
+// clay --trace <command>：让守护进程记录本次请求的跨度
+bool traceRequest = false;
+
+int sendCommandToDaemon(const std::string& workspace, const std::vector<std::string>& args) {
+    // 每个参数单独编码，参数中的空格不会被拆开
+    std::vector<clay::protocol::Arg> request;
+    request.push_back(clay::protocol::Arg::string(workspace));
+    if (traceRequest) request.push_back(clay::protocol::Arg::string("--trace"));
+    for (const auto& arg : args) {
+        request.push_back(clay::protocol::Arg::string(arg));
+    }
+    return sendToDaemon(clay::protocol::MSG_REQUEST, clay::protocol::encodeArgs(request));
 }
 
 int main(int argc, char* argv[]) {
@@ -99,34 +110,93 @@ int main(int argc, char* argv[]) {
     for (int i = 1; i < argc; ++i) {
         args.push_back(argv[i]);
     }
+    if (!args.empty() && args[0] == "--trace") {
+        traceRequest = true;
+        args.erase(args.begin());
+    }
 
     if (args.empty()) {
         clay::Command::help(std::cout);
         return 1;
     }
 
+    auto& daemon = clay::Daemon::instance();
+
     // 特殊命令直接处理
     if (args[0] == "init") {
-        if (args.size() < 2) args.push_back(".");
-        if (!clay::Daemon::instance().start(args[1])) {
+        std::string path = args.size() >= 2 ? args[1] : ".";
+        std::error_code ec;
+        path = fs::absolute(path, ec).lexically_normal().string();
+        if (!daemon.start()) {
             return 1;
         }
-        std::cout << "Clay daemon started in " << args[1] << std::endl;
-        return 0;
+        return sendCommandToDaemon(path, {"init"});
     } else if (args[0] == "stop") {
-        if (clay::Daemon::instance().stop()) {
+        if (args.size() >= 2 && args[1] == "--all") {
+            if (!daemon.stop()) return 1;
             std::cout << "Clay daemon stopped" << std::endl;
             return 0;
         }
-        return 1;
-    } else if (args[0] == "status" && args.size() == 1) {
-        // 状态命令需要特殊处理以显示守护进程状态
-        std::cout << "Clay daemon: "
-                  << (clay::Daemon::instance().isRunning() ? "running" : "stopped")
-                  << std::endl;
+        if (!daemon.isRunning()) {
+            std::cerr << "Clay daemon is not running" << std::endl;
+            return 1;
+        }
+        return sendCommandToDaemon(findWorkspaceRoot(), args);
+    } else if (args[0] == "status" && args.size() == 1 && !traceRequest) {
+        // 优先读取状态页，不经过守护进程
+        std::string root = findWorkspaceRoot();
+        if (!root.empty() && clay::Command::localStatus(root, std::cout)) {
+            return 0;
+        }
+        if (!daemon.isRunning()) {
+            std::cout << "Clay daemon: stopped" << std::endl;
+            return 0;
+        }
+    } else if (args[0] == "status" && !daemon.isRunning()) {
+        std::cout << "Clay daemon: stopped" << std::endl;
+        return 0;
+    } else if (args[0] == "batch") {
+        // 整批命令在一个请求中发送，由守护进程在同一个读快照上执行
+        std::ostringstream input;
+        input << std::cin.rdbuf();
+        std::vector<std::vector<std::string>> commands;
+        std::string error;
+        if (!clay::Command::parseBatch(input.str(), commands, error)) {
+            std::cerr << "batch: " << error << std::endl;
+            return 1;
+        }
+        std::string root = findWorkspaceRoot();
+        if (root.empty()) {
+            std::cerr << "Not inside a Clay workspace. Use 'clay init' to start." << std::endl;
+            return 1;
+        }
+        if (!daemon.start()) {
+            return 1;
+        }
+        if (commands.size() > UINT16_MAX) {
+            std::cerr << "batch: too many commands (" << commands.size() << ")" << std::endl;
+            return 1;
+        }
+        std::vector<std::vector<clay::protocol::Arg>> encoded;
+        for (const auto& command : commands) {
+            std::vector<clay::protocol::Arg> request;
+            for (const auto& arg : command) request.push_back(clay::protocol::Arg::string(arg));
+            encoded.push_back(std::move(request));
+        }
+        return sendToDaemon(clay::protocol::MSG_BATCH, clay::protocol::encodeBatch(root, encoded));
+    } else if (args[0] == "help") {
+        clay::Command::help(std::cout);
         return 0;
     }
 
-    // 其他命令发送到守护进程
-    return sendCommandToDaemon(args);
-}
\ No newline at end of file
+    // 其他命令发送到守护进程；守护进程未运行时按需启动
+    std::string root = findWorkspaceRoot();
+    if (!root.empty() && !daemon.start()) {
+        return 1;
+    }
+    if (root.empty() && !daemon.isRunning()) {
+        std::cerr << "Not inside a Clay workspace. Use 'clay init' to start." << std::endl;
+        return 1;
+    }
+    return sendCommandToDaemon(root, args);
+}
@@ -0,0 +1,122 @@
+#include "clay/memory.hpp"
+#include <algorithm>
+#include <iomanip>
+
+namespace clay {
+
+MemoryBudget::Reservation& MemoryBudget::Reservation::operator=(Reservation&& other) noexcept {
+    if (this != &other) {
+        reset();
+        bytes_ = other.bytes_;
+        other.bytes_ = 0;
+    }
+    return *this;
+}
+
+bool MemoryBudget::Reservation::tryAdd(uint64_t bytes) {
+    if (!MemoryBudget::instance().tryReserve(bytes)) return false;
+    bytes_ += bytes;
+    return true;
+}
+
+void MemoryBudget::Reservation::add(uint64_t bytes, std::chrono::milliseconds wait) {
+    MemoryBudget::instance().reserve(bytes, wait);
+    bytes_ += bytes;
+}
+
+void MemoryBudget::Reservation::reset() {
+    if (bytes_) MemoryBudget::instance().release(bytes_);
+    bytes_ = 0;
+}
+
+MemoryBudget& MemoryBudget::instance() {
+    static MemoryBudget instance;
+    return instance;
+}
+
+void MemoryBudget::setLimit(const std::string& owner, uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (bytes) limits_[owner] = bytes;
+    else limits_.erase(owner);
+
+    stats_.limit = 0;
+    for (const auto& entry : limits_) {
+        stats_.limit = stats_.limit ? std::min(stats_.limit, entry.second) : entry.second;
+    }
+    // 预算放宽后等待者可能已经可以继续
+    released_.notify_all();
+}
+
+uint64_t MemoryBudget::limit() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_.limit;
+}
+
+bool MemoryBudget::tryReserve(uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stats_.limit && stats_.current + bytes > stats_.limit) return false;
+    stats_.current += bytes;
+    stats_.peak = std::max(stats_.peak, stats_.current);
+    return true;
+}
+
+void MemoryBudget::reserve(uint64_t bytes, std::chrono::milliseconds wait) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto fits = [&] { return !stats_.limit || stats_.current + bytes <= stats_.limit || stats_.current == 0; };
+    if (!fits()) {
+        stats_.waits++;
+        released_.wait_for(lock, wait, fits);
+    }
+    if (stats_.limit && stats_.current + bytes > stats_.limit) stats_.overruns++;
+    stats_.current += bytes;
+    stats_.peak = std::max(stats_.peak, stats_.current);
+}
+
+void MemoryBudget::release(uint64_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.current -= std::min(bytes, stats_.current);
+    }
+    released_.notify_all();
+}
+
+void MemoryBudget::noteSpill() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.spills++;
+}
+
+MemoryBudget::Stats MemoryBudget::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void MemoryBudget::write(std::ostream& out) const {
+    Stats s = stats();
+    out << "Memory (daemon-wide buffers):\n";
+    out << "  " << std::left << std::setw(24) << "current_bytes" << std::right << s.current << "\n";
+    out << "  " << std::left << std::setw(24) << "peak_bytes" << std::right << s.peak << "\n";
+    out << "  " << std::left << std::setw(24) << "budget_bytes" << std::right
+        << (s.limit ? std::to_string(s.limit) : "unlimited") << "\n";
+    out << "  " << std::left << std::setw(24) << "budget_waits" << std::right << s.waits << "\n";
+    out << "  " << std::left << std::setw(24) << "budget_spills" << std::right << s.spills << "\n";
+    out << "  " << std::left << std::setw(24) << "budget_overruns" << std::right << s.overruns << "\n";
+}
+
+void MemoryBudget::writePrometheus(std::ostream& out) const {
+    Stats s = stats();
+    out << "# HELP clay_memory_bytes Buffer bytes currently accounted against the memory budget.\n";
+    out << "# TYPE clay_memory_bytes gauge\n";
+    out << "clay_memory_bytes " << s.current << "\n";
+    out << "# TYPE clay_memory_peak_bytes gauge\n";
+    out << "clay_memory_peak_bytes " << s.peak << "\n";
+    out << "# TYPE clay_memory_budget_bytes gauge\n";
+    out << "clay_memory_budget_bytes " << s.limit << "\n";
+    out << "# TYPE clay_memory_budget_waits_total counter\n";
+    out << "clay_memory_budget_waits_total " << s.waits << "\n";
+    out << "# TYPE clay_memory_budget_spills_total counter\n";
+    out << "clay_memory_budget_spills_total " << s.spills << "\n";
+    out << "# TYPE clay_memory_budget_overruns_total counter\n";
+    out << "clay_memory_budget_overruns_total " << s.overruns << "\n";
+}
+
+} // namespace clay
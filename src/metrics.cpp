@@ -0,0 +1,206 @@
+#include "clay/metrics.hpp"
+#include <iomanip>
+#include <sstream>
+
+namespace clay {
+
+void LatencyHistogram::record(std::chrono::nanoseconds elapsed) {
+    uint64_t us = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+
+    size_t bucket = 0;
+    while (bucket + 1 < kBuckets && (uint64_t(1) << bucket) <= us) bucket++;
+
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sumUs_.fetch_add(us, std::memory_order_relaxed);
+
+    uint64_t prev = maxUs_.load(std::memory_order_relaxed);
+    while (us > prev && !maxUs_.compare_exchange_weak(prev, us, std::memory_order_relaxed)) {
+    }
+}
+
+double LatencyHistogram::meanMicros() const {
+    uint64_t n = count();
+    return n ? static_cast<double>(sumUs_.load(std::memory_order_relaxed)) / n : 0.0;
+}
+
+uint64_t LatencyHistogram::percentileMicros(double p) const {
+    uint64_t n = count();
+    if (n == 0) return 0;
+
+    uint64_t target = static_cast<uint64_t>(p * n);
+    if (target >= n) target = n - 1;
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+        seen += buckets_[i].load(std::memory_order_relaxed);
+        if (seen > target) return uint64_t(1) << i;
+    }
+    return maxMicros();
+}
+
+void LatencyHistogram::write(std::ostream& out, const std::string& name) const {
+    out << std::left << std::setw(10) << name << std::right
+        << " count=" << count()
+        << " mean=" << std::fixed << std::setprecision(0) << meanMicros() << "us"
+        << " p50<=" << percentileMicros(0.50) << "us"
+        << " p99<=" << percentileMicros(0.99) << "us"
+        << " max=" << maxMicros() << "us\n";
+
+    for (size_t i = 0; i < kBuckets; ++i) {
+        uint64_t c = buckets_[i].load(std::memory_order_relaxed);
+        if (c == 0) continue;
+        out << "  <" << std::setw(10) << (uint64_t(1) << i) << "us  " << c << "\n";
+    }
+}
+
+void PipelineMetrics::record(PipelinePhase phase, std::chrono::nanoseconds elapsed) {
+    phases_[static_cast<size_t>(phase)].record(elapsed);
+    generation_.fetch_add(1, std::memory_order_relaxed);
+}
+
+const char* PipelineMetrics::phaseName(PipelinePhase phase) {
+    switch (phase) {
+        case PipelinePhase::Walk: return "walk";
+        case PipelinePhase::Match: return "match";
+        case PipelinePhase::Read: return "read";
+        case PipelinePhase::Classify: return "classify";
+        case PipelinePhase::Hash: return "hash";
+        case PipelinePhase::DbWrite: return "db_write";
+        case PipelinePhase::Cleanup: return "cleanup";
+        case PipelinePhase::Compact: return "compact";
+        case PipelinePhase::Total: return "total";
+    }
+    return "unknown";
+}
+
+const char* PipelineMetrics::counterName(PipelineCounter counter) {
+    switch (counter) {
+        case PipelineCounter::SnapshotsStored: return "snapshots_stored";
+        case PipelineCounter::FilesScanned: return "files_scanned";
+        case PipelineCounter::FilesIgnored: return "files_ignored";
+        case PipelineCounter::FilesUnreadable: return "files_unreadable";
+        case PipelineCounter::FilesCaptured: return "files_captured";
+        case PipelineCounter::BytesCaptured: return "bytes_captured";
+        case PipelineCounter::SnapshotsPruned: return "snapshots_pruned";
+        case PipelineCounter::DeltasCompacted: return "deltas_compacted";
+        case PipelineCounter::DeltasDeduped: return "deltas_deduped";
+        case PipelineCounter::BytesBeforeCompaction: return "bytes_before_compaction";
+        case PipelineCounter::BytesAfterCompaction: return "bytes_after_compaction";
+        case PipelineCounter::WatchEvents: return "watch_events";
+        case PipelineCounter::WatchOverflows: return "watch_overflows";
+        case PipelineCounter::FilesReused: return "files_reused";
+        case PipelineCounter::TreesWritten: return "trees_written";
+        case PipelineCounter::DirsReused: return "dirs_reused";
+        case PipelineCounter::FilesUnread: return "files_unread";
+    }
+    return "unknown";
+}
+
+void PipelineMetrics::write(std::ostream& out) const {
+    out << "Snapshot pipeline (per snapshot):\n";
+    out << "  " << std::left << std::setw(10) << "phase" << std::right
+        << std::setw(8) << "count" << std::setw(12) << "mean" << std::setw(12) << "p50<="
+        << std::setw(12) << "p99<=" << std::setw(12) << "max" << std::setw(12) << "total" << "\n";
+    for (size_t i = 0; i < kPhases; ++i) {
+        const auto& h = phases_[i];
+        std::ostringstream mean;
+        mean << std::fixed << std::setprecision(0) << h.meanMicros() << "us";
+        out << "  " << std::left << std::setw(10) << phaseName(static_cast<PipelinePhase>(i)) << std::right
+            << std::setw(8) << h.count()
+            << std::setw(12) << mean.str()
+            << std::setw(12) << (std::to_string(h.percentileMicros(0.50)) + "us")
+            << std::setw(12) << (std::to_string(h.percentileMicros(0.99)) + "us")
+            << std::setw(12) << (std::to_string(h.maxMicros()) + "us")
+            << std::setw(12) << (std::to_string(h.sumMicros() / 1000) + "ms") << "\n";
+    }
+    out << "Counters:\n";
+    for (size_t i = 0; i < kCounters; ++i) {
+        out << "  " << std::left << std::setw(24) << counterName(static_cast<PipelineCounter>(i)) << std::right
+            << counters_[i].load(std::memory_order_relaxed) << "\n";
+    }
+}
+
+namespace {
+
+std::string promLabel(const std::string& value) {
+    std::string out;
+    for (char c : value) {
+        if (c == '\\' || c == '"') out.push_back('\\');
+        if (c == '\n') {
+            out += "\\n";
+            continue;
+        }
+        out.push_back(c);
+    }
+    return out;
+}
+
+} // namespace
+
+void PipelineMetrics::writePrometheus(std::ostream& out, const std::string& workspace) const {
+    std::string ws = "workspace=\"" + promLabel(workspace) + "\"";
+
+    out << "# HELP clay_snapshot_phase_seconds Time spent in each snapshot pipeline phase.\n";
+    out << "# TYPE clay_snapshot_phase_seconds histogram\n";
+    for (size_t i = 0; i < kPhases; ++i) {
+        const auto& h = phases_[i];
+        std::string labels = ws + ",phase=\"" + phaseName(static_cast<PipelinePhase>(i)) + "\"";
+        // 直方图的最后一个桶没有上界，由 +Inf 表示
+        uint64_t cumulative = 0;
+        for (size_t b = 0; b + 1 < LatencyHistogram::kBuckets; ++b) {
+            cumulative += h.bucketCount(b);
+            out << "clay_snapshot_phase_seconds_bucket{" << labels << ",le=\""
+                << static_cast<double>(uint64_t(1) << b) / 1e6 << "\"} " << cumulative << "\n";
+        }
+        out << "clay_snapshot_phase_seconds_bucket{" << labels << ",le=\"+Inf\"} " << h.count() << "\n";
+        out << "clay_snapshot_phase_seconds_sum{" << labels << "} " << static_cast<double>(h.sumMicros()) / 1e6 << "\n";
+        out << "clay_snapshot_phase_seconds_count{" << labels << "} " << h.count() << "\n";
+    }
+
+    for (size_t i = 0; i < kCounters; ++i) {
+        std::string name = std::string("clay_") + counterName(static_cast<PipelineCounter>(i)) + "_total";
+        out << "# TYPE " << name << " counter\n";
+        out << name << "{" << ws << "} " << counters_[i].load(std::memory_order_relaxed) << "\n";
+    }
+}
+
+StartupProfile& StartupProfile::instance() {
+    static StartupProfile instance;
+    return instance;
+}
+
+void StartupProfile::begin() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    origin_ = last_ = Clock::now();
+    phases_.clear();
+}
+
+void StartupProfile::record(const std::string& phase, Clock::time_point start) {
+    auto now = Clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    phases_.push_back({phase, start - origin_, now - start});
+}
+
+void StartupProfile::mark(const std::string& phase) {
+    auto now = Clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    phases_.push_back({phase, last_ - origin_, now - last_});
+    last_ = now;
+}
+
+void StartupProfile::write(std::ostream& out) const {
+    using std::chrono::microseconds;
+    using std::chrono::duration_cast;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    out << "Startup phases (start +offset, duration):\n";
+    for (const auto& phase : phases_) {
+        out << "  +" << std::setw(8) << duration_cast<microseconds>(phase.offset).count() << "us "
+            << std::setw(8) << duration_cast<microseconds>(phase.elapsed).count() << "us  "
+            << phase.name << "\n";
+    }
+}
+
+} // namespace clay
@@ -0,0 +1,163 @@
+#include "clay/path_table.hpp"
+#include "clay/hash.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace clay {
+
+void* Arena::allocate(size_t size, size_t align) {
+    size_t padding = cursor_ ? (align - reinterpret_cast<uintptr_t>(cursor_) % align) % align : 0;
+    if (!cursor_ || padding + size > remaining_) {
+        // 超过块大小的请求单独成块
+        size_t blockSize = std::max(kBlockSize, size + align);
+        blocks_.emplace_back(new char[blockSize]);
+        cursor_ = blocks_.back().get();
+        remaining_ = blockSize;
+        capacity_ += blockSize;
+        padding = (align - reinterpret_cast<uintptr_t>(cursor_) % align) % align;
+    }
+    char* result = cursor_ + padding;
+    cursor_ = result + size;
+    remaining_ -= padding + size;
+    return result;
+}
+
+std::string_view Arena::copy(std::string_view text) {
+    if (text.empty()) return {};
+    char* out = static_cast<char*>(allocate(text.size(), 1));
+    std::memcpy(out, text.data(), text.size());
+    return {out, text.size()};
+}
+
+PathTable::PathTable() {
+    nodes_.push_back({kNone, 0, nullptr, 0, 0});
+    slots_.assign(1024, 0);
+}
+
+uint32_t PathTable::hashOf(uint32_t parent, std::string_view name) {
+    uint64_t h = fastHash(name.data(), name.size()) ^ (uint64_t(parent) * 0x9E3779B97F4A7C15ULL);
+    return static_cast<uint32_t>(h ^ (h >> 32));
+}
+
+uint32_t PathTable::lookup(uint32_t parent, std::string_view name, uint32_t hash) const {
+    size_t mask = slots_.size() - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        uint32_t slot = slots_[i];
+        if (!slot) return kNone;
+        const Node& node = nodes_[slot - 1];
+        if (node.hash == hash && node.parent == parent && name == std::string_view(node.name, node.nameSize)) {
+            return slot - 1;
+        }
+    }
+}
+
+void PathTable::grow() {
+    std::vector<uint32_t> slots(slots_.size() * 2, 0);
+    size_t mask = slots.size() - 1;
+    for (uint32_t n = 1; n < nodes_.size(); ++n) {
+        size_t i = nodes_[n].hash & mask;
+        while (slots[i]) i = (i + 1) & mask;
+        slots[i] = n + 1;
+    }
+    slots_.swap(slots);
+}
+
+uint32_t PathTable::findChild(uint32_t parent, std::string_view name) const {
+    return lookup(parent, name, hashOf(parent, name));
+}
+
+uint32_t PathTable::child(uint32_t parent, std::string_view name) {
+    uint32_t hash = hashOf(parent, name);
+    uint32_t found = lookup(parent, name, hash);
+    if (found != kNone) return found;
+
+    // 负载超过一半时扩容，保证探测序列短
+    if ((nodes_.size() + 1) * 2 > slots_.size()) grow();
+    std::string_view stored = arena_.copy(name);
+    uint32_t node = static_cast<uint32_t>(nodes_.size());
+    nodes_.push_back({parent, nodes_[parent].depth + 1, stored.data(), static_cast<uint32_t>(stored.size()), hash});
+
+    size_t mask = slots_.size() - 1;
+    size_t i = hash & mask;
+    while (slots_[i]) i = (i + 1) & mask;
+    slots_[i] = node + 1;
+    return node;
+}
+
+uint32_t PathTable::intern(std::string_view relPath) {
+    uint32_t node = kRoot;
+    size_t start = 0;
+    while (start < relPath.size()) {
+        size_t end = relPath.find('/', start);
+        if (end == std::string_view::npos) end = relPath.size();
+        if (end > start) node = child(node, relPath.substr(start, end - start));
+        start = end + 1;
+    }
+    return node;
+}
+
+uint32_t PathTable::find(std::string_view relPath) const {
+    uint32_t node = kRoot;
+    size_t start = 0;
+    while (start < relPath.size() && node != kNone) {
+        size_t end = relPath.find('/', start);
+        if (end == std::string_view::npos) end = relPath.size();
+        if (end > start) node = findChild(node, relPath.substr(start, end - start));
+        start = end + 1;
+    }
+    return node;
+}
+
+void PathTable::appendPath(uint32_t node, std::string& out) const {
+    if (node == kRoot) return;
+    // 先算出总长度，再从后往前填，不产生中间字符串
+    size_t length = 0;
+    for (uint32_t n = node; n != kRoot; n = nodes_[n].parent) length += nodes_[n].nameSize + 1;
+    length--;
+
+    size_t base = out.size();
+    out.resize(base + length);
+    size_t pos = base + length;
+    for (uint32_t n = node; n != kRoot; n = nodes_[n].parent) {
+        pos -= nodes_[n].nameSize;
+        std::memcpy(&out[pos], nodes_[n].name, nodes_[n].nameSize);
+        if (pos > base) out[--pos] = '/';
+    }
+}
+
+std::string PathTable::path(uint32_t node) const {
+    std::string out;
+    appendPath(node, out);
+    return out;
+}
+
+bool PathTable::less(uint32_t a, uint32_t b) const {
+    if (a == b) return false;
+    // 走到同一深度；其中一个是另一个的祖先时，祖先是前缀，排在前面
+    uint32_t x = a, y = b;
+    while (nodes_[x].depth > nodes_[y].depth) x = nodes_[x].parent;
+    while (nodes_[y].depth > nodes_[x].depth) y = nodes_[y].parent;
+    if (x == y) return x == a;
+    while (nodes_[x].parent != nodes_[y].parent) {
+        x = nodes_[x].parent;
+        y = nodes_[y].parent;
+    }
+
+    // x、y 是共同祖先下的两个不同子节点；名称之后的字符是 '/'（还有下级）或结束
+    std::string_view nx = name(x), ny = name(y);
+    size_t common = std::min(nx.size(), ny.size());
+    int cmp = common ? std::memcmp(nx.data(), ny.data(), common) : 0;
+    if (cmp != 0) return cmp < 0;
+    if (nx.size() < ny.size()) {
+        if (x == a) return true;
+        return static_cast<unsigned char>('/') < static_cast<unsigned char>(ny[common]);
+    }
+    if (y == b) return false;
+    return static_cast<unsigned char>(nx[common]) < static_cast<unsigned char>('/');
+}
+
+size_t PathTable::memoryUsage() const {
+    return arena_.capacity() + nodes_.capacity() * sizeof(Node) + slots_.capacity() * sizeof(uint32_t);
+}
+
+} // namespace clay
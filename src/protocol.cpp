@@ -0,0 +1,312 @@
+#include "clay/protocol.hpp"
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+
+namespace clay {
+namespace protocol {
+
+namespace {
+
+void putU16(std::string& out, uint16_t v) {
+    v = htons(v);
+    out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+void putU32(std::string& out, uint32_t v) {
+    v = htonl(v);
+    out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+uint16_t getU16(const char* p) {
+    uint16_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return ntohs(v);
+}
+
+uint32_t getU32(const char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return ntohl(v);
+}
+
+void putI64(std::string& out, int64_t n) {
+    uint64_t v = static_cast<uint64_t>(n);
+    putU32(out, static_cast<uint32_t>(v >> 32));
+    putU32(out, static_cast<uint32_t>(v));
+}
+
+int64_t getI64(const char* p) {
+    uint64_t v = (static_cast<uint64_t>(getU32(p)) << 32) | getU32(p + 4);
+    return static_cast<int64_t>(v);
+}
+
+} // namespace
+
+const char* statusName(uint32_t status) {
+    switch (status) {
+    case STATUS_OK: return "ok";
+    case STATUS_COMMAND_FAILED: return "command failed";
+    case STATUS_BAD_REQUEST: return "bad request";
+    case STATUS_UNSUPPORTED_VERSION: return "unsupported protocol version";
+    case STATUS_INTERNAL_ERROR: return "internal error";
+    default: return "unknown status";
+    }
+}
+
+Status parseHeader(const char* data, Header& header) {
+    if (getU32(data) != kMagic) return STATUS_BAD_REQUEST;
+
+    header.version = static_cast<uint8_t>(data[4]);
+    header.type = static_cast<uint8_t>(data[5]);
+    header.requestId = getU32(data + 8);
+    header.length = getU32(data + 12);
+
+    if (header.length > kMaxMessagePayload) return STATUS_BAD_REQUEST;
+    if (header.version != kVersion) return STATUS_UNSUPPORTED_VERSION;
+    return STATUS_OK;
+}
+
+std::string encodeMessage(uint8_t type, uint32_t requestId, const void* payload, uint32_t len) {
+    std::string out;
+    out.reserve(kHeaderSize + len);
+    putU32(out, kMagic);
+    out.push_back(static_cast<char>(kVersion));
+    out.push_back(static_cast<char>(type));
+    putU16(out, 0);
+    putU32(out, requestId);
+    putU32(out, len);
+    if (len > 0) out.append(static_cast<const char*>(payload), len);
+    return out;
+}
+
+Arg Arg::string(std::string s) {
+    Arg arg;
+    arg.type = ARG_STRING;
+    arg.text = std::move(s);
+    return arg;
+}
+
+Arg Arg::integer(int64_t n) {
+    Arg arg;
+    arg.type = ARG_INT;
+    arg.number = n;
+    return arg;
+}
+
+std::string Arg::toString() const {
+    return type == ARG_INT ? std::to_string(number) : text;
+}
+
+bool Arg::operator==(const Arg& other) const {
+    if (type != other.type) return false;
+    return type == ARG_INT ? number == other.number : text == other.text;
+}
+
+std::string encodeArgs(const std::vector<Arg>& args) {
+    std::string out;
+    putU16(out, static_cast<uint16_t>(args.size()));
+    for (const auto& arg : args) {
+        out.push_back(static_cast<char>(arg.type));
+        if (arg.type == ARG_INT) {
+            putU32(out, 8);
+            putI64(out, arg.number);
+        } else {
+            putU32(out, static_cast<uint32_t>(arg.text.size()));
+            out += arg.text;
+        }
+    }
+    return out;
+}
+
+bool decodeArgs(const char* data, size_t len, std::vector<Arg>& args) {
+    args.clear();
+    if (len < 2) return false;
+    uint16_t count = getU16(data);
+    size_t pos = 2;
+
+    for (uint16_t i = 0; i < count; ++i) {
+        if (len - pos < 5) return false;
+        uint8_t tag = static_cast<uint8_t>(data[pos]);
+        uint32_t size = getU32(data + pos + 1);
+        pos += 5;
+        if (size > len - pos) return false;
+
+        if (tag == ARG_STRING) {
+            args.push_back(Arg::string(std::string(data + pos, size)));
+        } else if (tag == ARG_INT && size == 8) {
+            args.push_back(Arg::integer(getI64(data + pos)));
+        } else {
+            return false;
+        }
+        pos += size;
+    }
+    return pos == len; // 不允许尾部多余数据
+}
+
+std::string encodeBatch(const std::string& workspace, const std::vector<std::vector<Arg>>& commands) {
+    std::string out;
+    std::string header = encodeArgs({Arg::string(workspace)});
+    putU32(out, static_cast<uint32_t>(header.size()));
+    out += header;
+    putU16(out, static_cast<uint16_t>(commands.size()));
+    for (const auto& command : commands) {
+        std::string encoded = encodeArgs(command);
+        putU32(out, static_cast<uint32_t>(encoded.size()));
+        out += encoded;
+    }
+    return out;
+}
+
+bool decodeBatch(const char* data, size_t len, std::string& workspace,
+                 std::vector<std::vector<Arg>>& commands) {
+    commands.clear();
+    size_t pos = 0;
+    auto nextBlock = [&](std::vector<Arg>& args) {
+        if (len - pos < 4) return false;
+        uint32_t size = getU32(data + pos);
+        pos += 4;
+        if (size > len - pos) return false;
+        bool ok = decodeArgs(data + pos, size, args);
+        pos += size;
+        return ok;
+    };
+
+    std::vector<Arg> header;
+    if (!nextBlock(header) || header.size() != 1 || header[0].type != ARG_STRING) return false;
+    workspace = header[0].text;
+
+    if (len - pos < 2) return false;
+    uint16_t count = getU16(data + pos);
+    pos += 2;
+    for (uint16_t i = 0; i < count; ++i) {
+        std::vector<Arg> command;
+        if (!nextBlock(command) || command.empty()) return false;
+        commands.push_back(std::move(command));
+    }
+    return pos == len;
+}
+
+std::string encodeEnd(Status status, int exitCode) {
+    std::string out;
+    putU32(out, status);
+    putU32(out, static_cast<uint32_t>(exitCode));
+    return out;
+}
+
+bool decodeEnd(const std::string& payload, uint32_t& status, int& exitCode) {
+    if (payload.size() != 8) return false;
+    status = getU32(payload.data());
+    exitCode = static_cast<int>(getU32(payload.data() + 4));
+    return true;
+}
+
+bool writeAll(int fd, const void* data, size_t len) {
+    const char* p = static_cast<const char*>(data);
+    while (len > 0) {
+        // 对端断开时不要触发 SIGPIPE
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == ENOTSOCK) n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool readAll(int fd, void* data, size_t len) {
+    char* p = static_cast<char*>(data);
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (n == 0) return false; // 连接提前关闭
+        p += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool writeMessage(int fd, uint8_t type, uint32_t requestId, const void* payload, uint32_t len) {
+    std::string message = encodeMessage(type, requestId, payload, len);
+    return writeAll(fd, message.data(), message.size());
+}
+
+bool readMessage(int fd, Header& header, std::string& payload) {
+    char raw[kHeaderSize];
+    if (!readAll(fd, raw, sizeof(raw))) return false;
+    if (parseHeader(raw, header) != STATUS_OK) return false;
+
+    payload.resize(header.length);
+    return header.length == 0 || readAll(fd, &payload[0], header.length);
+}
+
+FrameWriter::FrameWriter(int fd, uint32_t requestId, size_t chunkSize)
+    : fd_(fd), requestId_(requestId),
+      buffer_(chunkSize > kMaxFramePayload ? kMaxFramePayload : chunkSize) {
+    setp(buffer_.data(), buffer_.data() + buffer_.size());
+}
+
+FrameWriter::FrameWriter(Sink sink, uint32_t requestId, size_t chunkSize)
+    : sink_(std::move(sink)), requestId_(requestId),
+      buffer_(chunkSize > kMaxFramePayload ? kMaxFramePayload : chunkSize) {
+    setp(buffer_.data(), buffer_.data() + buffer_.size());
+}
+
+FrameWriter::~FrameWriter() {
+    if (!finished_) flushBuffer();
+}
+
+bool FrameWriter::flushBuffer() {
+    size_t len = static_cast<size_t>(pptr() - pbase());
+    setp(buffer_.data(), buffer_.data() + buffer_.size());
+    if (len == 0 || failed_) return !failed_;
+
+    if (!emit(MSG_DATA, buffer_.data(), static_cast<uint32_t>(len))) {
+        failed_ = true;
+    }
+    return !failed_;
+}
+
+bool FrameWriter::emit(uint8_t type, const void* payload, uint32_t len) {
+    if (sink_) return sink_(encodeMessage(type, requestId_, payload, len));
+    return writeMessage(fd_, type, requestId_, payload, len);
+}
+
+FrameWriter::int_type FrameWriter::overflow(int_type ch) {
+    if (!flushBuffer()) return traits_type::eof();
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+    }
+    return traits_type::not_eof(ch);
+}
+
+int FrameWriter::sync() {
+    return flushBuffer() ? 0 : -1;
+}
+
+bool FrameWriter::finish(int exitCode) {
+    return finish(exitCode == 0 ? STATUS_OK : STATUS_COMMAND_FAILED, exitCode);
+}
+
+bool FrameWriter::finish(Status status, int exitCode) {
+    if (finished_) return !failed_;
+    finished_ = true;
+    if (!flushBuffer()) return false;
+
+    std::string end = encodeEnd(status, exitCode);
+    if (!emit(MSG_END, end.data(), static_cast<uint32_t>(end.size()))) failed_ = true;
+    return !failed_;
+}
+
+} // namespace protocol
+} // namespace clay
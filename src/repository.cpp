@@ -0,0 +1,51 @@
+#include "clay/repository.hpp"
+#include <filesystem>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+namespace clay {
+
+Repository::Repository() : core_(std::make_unique<Core>()) {}
+Repository::~Repository() = default;
+
+std::unique_ptr<Repository> Repository::open(const std::string& workspace, OpenMode mode) {
+    std::error_code ec;
+    fs::path root = fs::absolute(workspace, ec);
+    if (ec) throw std::runtime_error("Invalid workspace path: " + workspace);
+    root = root.lexically_normal();
+
+    if (mode == OpenMode::ReadOnly && !fs::is_directory(root / ".clay")) {
+        throw std::runtime_error(root.string() + " is not a Clay repository");
+    }
+
+    std::unique_ptr<Repository> repo(new Repository());
+    if (!repo->core_->init(root.string(), mode)) {
+        throw std::runtime_error("Failed to open Clay repository at " + root.string());
+    }
+    return repo;
+}
+
+std::string Repository::workspace() const { return core_->workspace(); }
+bool Repository::readOnly() const { return core_->readOnly(); }
+
+std::vector<Snapshot> Repository::timeline() const { return core_->snapshots(); }
+std::string Repository::latestSnapshotId() const { return core_->currentSnapshotId(); }
+std::string Repository::findSnapshot(const std::string& time) const { return core_->findClosestSnapshot(time); }
+Snapshot Repository::snapshot(const std::string& snapshotId) const { return core_->loadSnapshot(snapshotId); }
+
+bool Repository::readFile(const std::string& snapshotId, const std::string& path,
+                          std::vector<uint8_t>& content) const {
+    return core_->readFile(snapshotId, path, content);
+}
+
+void Repository::diff(const std::string& snapshotId, std::ostream& out, const DiffOptions& options) const {
+    core_->diff(snapshotId, out, options);
+}
+
+std::string Repository::takeSnapshot(const std::string& message) { return core_->takeSnapshot(false, message); }
+bool Repository::restore(const std::string& snapshotId) { return core_->restoreSnapshot(snapshotId); }
+
+Core& Repository::core() { return *core_; }
+
+} // namespace clay
@@ -0,0 +1,146 @@
+#include "clay/scan_cache.hpp"
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+namespace clay {
+
+namespace {
+
+constexpr char kMagic[4] = {'C', 'L', 'S', 'C'};
+constexpr uint8_t kFormat = 1;
+constexpr uint8_t kDirectory = 1;
+constexpr uint8_t kCaptured = 2;
+
+void putVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>(static_cast<uint8_t>(value) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+void putString(std::string& out, const std::string& text) {
+    putVarint(out, text.size());
+    out += text;
+}
+
+void putStamp(std::string& out, const ScanCache::Stamp& stamp) {
+    putVarint(out, static_cast<uint64_t>(stamp.mtime));
+    putVarint(out, stamp.size);
+    putVarint(out, stamp.inode);
+}
+
+class Cursor {
+public:
+    Cursor(const char* begin, const char* end) : p_(begin), end_(end) {}
+
+    bool done() const { return p_ == end_; }
+
+    bool byte(uint8_t& value) {
+        if (p_ == end_) return false;
+        value = static_cast<uint8_t>(*p_++);
+        return true;
+    }
+
+    bool varint(uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t b;
+            if (!byte(b)) return false;
+            value |= static_cast<uint64_t>(b & 0x7f) << shift;
+            if (!(b & 0x80)) return true;
+        }
+        return false;
+    }
+
+    bool string(std::string& out) {
+        uint64_t size;
+        if (!varint(size) || static_cast<uint64_t>(end_ - p_) < size) return false;
+        out.assign(p_, size);
+        p_ += size;
+        return true;
+    }
+
+    bool stamp(ScanCache::Stamp& out) {
+        uint64_t mtime;
+        if (!varint(mtime) || !varint(out.size) || !varint(out.inode)) return false;
+        out.mtime = static_cast<int64_t>(mtime);
+        return true;
+    }
+
+private:
+    const char* p_;
+    const char* end_;
+};
+
+bool decode(const std::string& data, ScanCache& cache) {
+    if (data.size() < sizeof(kMagic) + 1 || data.compare(0, sizeof(kMagic), kMagic, sizeof(kMagic)) != 0 ||
+        static_cast<uint8_t>(data[sizeof(kMagic)]) != kFormat) {
+        return false;
+    }
+    Cursor in(data.data() + sizeof(kMagic) + 1, data.data() + data.size());
+    uint64_t count;
+    if (!in.string(cache.snapshotId) || !in.varint(count)) return false;
+    cache.directories.reserve(count);
+    for (uint64_t i = 0; i < count; ++i) {
+        std::string path;
+        uint64_t entries;
+        ScanCache::Directory dir;
+        if (!in.string(path) || !in.stamp(dir.stamp) || !in.varint(entries)) return false;
+        dir.entries.reserve(entries);
+        for (uint64_t j = 0; j < entries; ++j) {
+            ScanCache::Entry entry;
+            uint8_t flags;
+            if (!in.byte(flags) || !in.string(entry.name)) return false;
+            entry.directory = flags & kDirectory;
+            entry.captured = flags & kCaptured;
+            if (!entry.directory && !in.stamp(entry.stamp)) return false;
+            dir.entries.push_back(std::move(entry));
+        }
+        cache.directories.emplace(std::move(path), std::move(dir));
+    }
+    return in.done();
+}
+
+} // namespace
+
+// 格式：魔数 "CLSC"、版本字节、snapshotId、目录数，然后逐个目录
+//   路径 stat(mtime size inode) 项数，逐项：标志(1) 名称 [文件的 stat]
+// 整数都是 varint，字符串是 varint 长度 + 字节
+bool ScanCache::load(const std::string& path, ScanCache& cache) {
+    cache = ScanCache();
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (decode(data, cache)) return true;
+    cache = ScanCache();
+    return false;
+}
+
+bool ScanCache::save(const std::string& path) const {
+    std::string out(kMagic, sizeof(kMagic));
+    out.push_back(static_cast<char>(kFormat));
+    putString(out, snapshotId);
+    putVarint(out, directories.size());
+    for (const auto& [dirPath, dir] : directories) {
+        putString(out, dirPath);
+        putStamp(out, dir.stamp);
+        putVarint(out, dir.entries.size());
+        for (const auto& entry : dir.entries) {
+            out.push_back(static_cast<char>((entry.directory ? kDirectory : 0) | (entry.captured ? kCaptured : 0)));
+            putString(out, entry.name);
+            if (!entry.directory) putStamp(out, entry.stamp);
+        }
+    }
+
+    std::string temp = path + ".tmp";
+    {
+        std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+        file.write(out.data(), static_cast<std::streamsize>(out.size()));
+        if (!file) return false;
+    }
+    return std::rename(temp.c_str(), path.c_str()) == 0;
+}
+
+} // namespace clay
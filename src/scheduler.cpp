@@ -0,0 +1,715 @@
+#include "clay/scheduler.hpp"
+#include "clay/trace.hpp"
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <thread>
+
+using namespace std::chrono;
+
+namespace clay {
+
+namespace {
+
+constexpr size_t kClasses = 3;
+// 令牌桶最多攒的量，按速率折算的时长
+constexpr double kBurstSeconds = 1.0;
+// /proc/pressure 的 avg10 每两秒更新一次，采样更频繁没有意义
+constexpr steady_clock::duration kPressureSample = seconds(1);
+// 停顿比例（%）不超过 kPressureLow 时全速，达到 kPressureHigh 时降到最低比例，中间线性过渡
+constexpr double kPressureLow = 10.0;
+constexpr double kPressureHigh = 40.0;
+constexpr double kMinPressureScale = 0.1;
+// 等待准入或限流时的最长睡眠，预算补充不会主动唤醒
+constexpr milliseconds kThrottlePoll(50);
+constexpr size_t kHistorySize = 32;
+
+nanoseconds threadCpuTime() {
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) return nanoseconds(0);
+    return seconds(ts.tv_sec) + nanoseconds(ts.tv_nsec);
+}
+
+const char* jobStateName(JobState state) {
+    switch (state) {
+    case JobState::Queued: return "queued";
+    case JobState::Running: return "running";
+    case JobState::Done: return "done";
+    case JobState::Cancelled: return "cancelled";
+    case JobState::Failed: return "failed";
+    }
+    return "unknown";
+}
+
+struct Job {
+    uint64_t id = 0;
+    std::string name;
+    JobClass cls = JobClass::Interactive;
+    JobScheduler::Task task;
+    std::atomic<bool> cancelled{false};
+
+    // 以下由调度器互斥锁保护
+    JobState state = JobState::Queued;
+    steady_clock::time_point submitted;
+    steady_clock::time_point finished;
+    nanoseconds cpu{0};
+    uint64_t io = 0;
+    std::string error;
+
+    // 仅执行线程访问
+    nanoseconds lastCpu{0};
+};
+
+using JobPtr = std::shared_ptr<Job>;
+
+// 令牌桶：按速率连续补充，最多攒 kBurstSeconds 的量；用量直接扣除，透支（余额为负）时限流。
+// 速率为 0 表示不限
+class TokenBucket {
+public:
+    void refill(double rate, double seconds) {
+        rate_ = rate;
+        tokens_ = rate > 0 ? std::min(rate * kBurstSeconds, tokens_ + rate * seconds) : 0;
+    }
+    void take(double amount) { tokens_ -= amount; }
+    bool exhausted() const { return rate_ > 0 && tokens_ < 0; }
+
+private:
+    double rate_ = 0;
+    double tokens_ = 0;
+};
+
+// /proc/pressure/<resource> 中 "some avg10=" 的值：最近 10 秒内至少一个任务因该资源停顿的
+// 时间百分比。内核不支持 PSI 或无权读取时为 0
+double readPressure(const char* resource) {
+    std::ifstream in(std::string("/proc/pressure/") + resource);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.compare(0, 5, "some ") != 0) continue;
+        size_t pos = line.find("avg10=");
+        return pos == std::string::npos ? 0 : std::strtod(line.c_str() + pos + 6, nullptr);
+    }
+    return 0;
+}
+
+double pressureScale(double percent) {
+    if (percent <= kPressureLow) return 1.0;
+    if (percent >= kPressureHigh) return kMinPressureScale;
+    return 1.0 - (1.0 - kMinPressureScale) * (percent - kPressureLow) / (kPressureHigh - kPressureLow);
+}
+
+const char* ioPriorityName(IoPriority priority) {
+    switch (priority) {
+    case IoPriority::Idle: return "idle";
+    case IoPriority::Low: return "low";
+    case IoPriority::Normal: return "normal";
+    }
+    return "unknown";
+}
+
+// 在作用域内调整调用线程的 I/O 优先级，离开时恢复。ioprio_set 没有 glibc 包装，直接用系统调用；
+// who=IOPRIO_WHO_PROCESS、id=0 表示调用线程。Normal 不做调整
+class IoPriorityScope {
+public:
+    explicit IoPriorityScope(IoPriority priority) {
+#ifdef SYS_ioprio_set
+        if (priority == IoPriority::Normal) return;
+        saved_ = static_cast<int>(syscall(SYS_ioprio_get, kWhoProcess, 0));
+        if (saved_ < 0) return;
+        int value = priority == IoPriority::Idle ? kClassIdle << kClassShift
+                                                 : (kClassBestEffort << kClassShift) | kLowestLevel;
+        if (syscall(SYS_ioprio_set, kWhoProcess, 0, value) != 0) saved_ = -1;
+#else
+        (void)priority;
+#endif
+    }
+
+    ~IoPriorityScope() {
+#ifdef SYS_ioprio_set
+        if (saved_ >= 0) syscall(SYS_ioprio_set, kWhoProcess, 0, saved_);
+#endif
+    }
+
+    IoPriorityScope(const IoPriorityScope&) = delete;
+    IoPriorityScope& operator=(const IoPriorityScope&) = delete;
+
+private:
+    static constexpr int kWhoProcess = 1;
+    static constexpr int kClassShift = 13;
+    static constexpr int kClassBestEffort = 2;
+    static constexpr int kClassIdle = 3;
+    static constexpr int kLowestLevel = 7;
+
+    int saved_ = -1;
+};
+
+// 当前线程正在执行的作业；执行期间由 running_ 持有
+thread_local Job* currentJob = nullptr;
+
+} // namespace
+
+const char* jobClassName(JobClass cls) {
+    switch (cls) {
+    case JobClass::Interactive: return "interactive";
+    case JobClass::Autosave: return "autosave";
+    case JobClass::Maintenance: return "maintenance";
+    }
+    return "unknown";
+}
+
+class JobScheduler::Impl {
+public:
+    Impl() : lastRefill_(steady_clock::now()) {
+        budgets_[index(JobClass::Autosave)] = JobBudget{1, 0.5, 64ull * 1024 * 1024, 0, false};
+        budgets_[index(JobClass::Maintenance)] = JobBudget{1, 0.25, 16ull * 1024 * 1024, 0, true};
+    }
+
+    ~Impl() { stop(); }
+
+    void start(size_t threads) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!workers_.empty()) return;
+        stop_ = false;
+        for (size_t i = 0; i < threads; ++i) {
+            workers_.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    void stop() {
+        std::vector<std::thread> workers;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+            for (size_t c = 0; c < kClasses; ++c) cancelLocked(static_cast<JobClass>(c));
+            workers.swap(workers_);
+        }
+        cv_.notify_all();
+        for (auto& t : workers) t.join();
+    }
+
+    void setBudget(JobClass cls, const JobBudget& budget) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        budgets_[index(cls)] = budget;
+        cv_.notify_all();
+    }
+
+    void setGovernor(const std::string& owner, const IoGovernor& governor) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        governors_[owner] = governor;
+        mergeGovernors();
+    }
+
+    void removeGovernor(const std::string& owner) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        governors_.erase(owner);
+        mergeGovernors();
+    }
+
+    uint64_t submit(JobClass cls, const std::string& name, Task task, bool coalesce) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (coalesce && findActive(cls, name, false)) return 0;
+
+        JobPtr job = makeJob(cls, name);
+        job->task = std::move(task);
+        queued_[index(cls)].push_back(job);
+        cv_.notify_all();
+        return job->id;
+    }
+
+    void run(JobClass cls, const std::string& name, const Task& task) {
+        // 嵌套调用属于外层作业的一部分
+        if (currentJob) {
+            task();
+            return;
+        }
+
+        JobPtr job;
+        {
+            TraceScope span("scheduler", "admission", name);
+            std::unique_lock<std::mutex> lock(mutex_);
+            job = makeJob(cls, name);
+            waiting_[index(cls)]++;
+            waitingJobs_.push_back(job);
+            while (!job->cancelled && !admissible(cls)) {
+                cv_.wait_for(lock, kThrottlePoll);
+            }
+            waiting_[index(cls)]--;
+            waitingJobs_.erase(std::find(waitingJobs_.begin(), waitingJobs_.end(), job));
+
+            if (job->cancelled) {
+                job->state = JobState::Cancelled;
+                retireLocked(job);
+                throw JobCancelled(name);
+            }
+            beginLocked(job);
+        }
+
+        std::exception_ptr error = execute(*job, task);
+        if (error) std::rethrow_exception(error);
+    }
+
+    bool cancel(uint64_t id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& queue : queued_) {
+            for (auto it = queue.begin(); it != queue.end(); ++it) {
+                if ((*it)->id != id) continue;
+                JobPtr job = *it;
+                queue.erase(it);
+                job->cancelled = true;
+                job->state = JobState::Cancelled;
+                retireLocked(job);
+                return true;
+            }
+        }
+        for (auto* list : {&running_, &waitingJobs_}) {
+            for (auto& job : *list) {
+                if (job->id == id) {
+                    job->cancelled = true;
+                    cv_.notify_all();
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    size_t cancelClass(JobClass cls, const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t n = cancelLocked(cls, name);
+        cv_.notify_all();
+        return n;
+    }
+
+    void waitFor(JobClass cls, const std::string& name) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [&] {
+            if (findActive(cls, name)) return false;
+            for (const auto& job : waitingJobs_) {
+                if (job->cls == cls && job->name == name) return false;
+            }
+            return true;
+        });
+    }
+
+    void checkpoint(Job& job) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        account(job);
+        for (;;) {
+            if (job.cancelled) throw JobCancelled(job.name);
+            if (!throttled(job.cls)) return;
+            cv_.wait_for(lock, kThrottlePoll);
+        }
+    }
+
+    void chargeIo(Job& job, uint64_t bytes, uint64_t ops) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        job.io += bytes;
+        Buckets& buckets = buckets_[index(job.cls)];
+        buckets.io.take(static_cast<double>(bytes));
+        buckets.ops.take(static_cast<double>(ops));
+        if (job.cls != JobClass::Interactive) {
+            governorIo_.take(static_cast<double>(bytes));
+            governorOps_.take(static_cast<double>(ops));
+        }
+    }
+
+    JobCounts counts() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        JobCounts counts;
+        counts.running = running_.size();
+        counts.queued = waitingJobs_.size();
+        for (const auto& queue : queued_) counts.queued += queue.size();
+        return counts;
+    }
+
+    std::vector<JobInfo> jobs() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto now = steady_clock::now();
+        std::vector<JobInfo> result;
+        auto add = [&](const JobPtr& job) {
+            JobInfo info;
+            info.id = job->id;
+            info.name = job->name;
+            info.cls = job->cls;
+            info.state = job->state;
+            bool ended = job->state != JobState::Queued && job->state != JobState::Running;
+            info.age = (ended ? job->finished : now) - job->submitted;
+            info.cpuTime = job->cpu;
+            info.ioBytes = job->io;
+            info.error = job->error;
+            result.push_back(info);
+        };
+        for (const auto& job : running_) add(job);
+        for (const auto& job : waitingJobs_) add(job);
+        for (const auto& queue : queued_) {
+            for (const auto& job : queue) add(job);
+        }
+        for (auto it = history_.rbegin(); it != history_.rend(); ++it) add(*it);
+        return result;
+    }
+
+    void writeBudgets(std::ostream& out) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t c = 0; c < kClasses; ++c) {
+            const JobBudget& b = budgets_[c];
+            out << std::left << std::setw(12) << jobClassName(static_cast<JobClass>(c)) << std::right
+                << " running " << runningCount_[c];
+            if (b.maxConcurrent > 0) out << "/" << b.maxConcurrent;
+            out << ", queued " << queued_[c].size() + waiting_[c];
+            if (b.cpuShare > 0) out << ", cpu " << static_cast<int>(b.cpuShare * 100) << "%";
+            if (b.ioBytesPerSec > 0) out << ", io " << b.ioBytesPerSec / (1024 * 1024) << " MB/s";
+            if (b.ioOpsPerSec > 0) out << ", " << b.ioOpsPerSec << " ops/s";
+            if (b.yieldToInteractive) out << ", yields to interactive";
+            out << "\n";
+        }
+        const IoGovernor& g = governor_;
+        out << std::left << std::setw(12) << "background" << std::right << " priority " << ioPriorityName(g.priority);
+        if (g.bytesPerSec > 0) out << ", io " << g.bytesPerSec / (1024 * 1024) << " MB/s";
+        if (g.opsPerSec > 0) out << ", " << g.opsPerSec << " ops/s";
+        if (g.pressureBackoff) {
+            out << std::fixed << std::setprecision(1) << ", pressure cpu " << cpuPressure_ << "% io " << ioPressure_
+                << "% (x" << std::setprecision(2) << cpuScale_ << " cpu, x" << ioScale_ << " io)";
+            out.unsetf(std::ios::floatfield);
+        }
+        out << "\n";
+    }
+
+private:
+    static size_t index(JobClass cls) { return static_cast<size_t>(cls); }
+
+    JobPtr makeJob(JobClass cls, const std::string& name) {
+        auto job = std::make_shared<Job>();
+        job->id = nextId_++;
+        job->name = name;
+        job->cls = cls;
+        job->submitted = steady_clock::now();
+        return job;
+    }
+
+    // 已取消但仍在执行的作业也算活动作业，waitFor 需要等它退出
+    bool findActive(JobClass cls, const std::string& name, bool includeCancelled = true) const {
+        for (const auto& job : queued_[index(cls)]) {
+            if (job->name == name) return true;
+        }
+        for (const auto& job : running_) {
+            if (job->cls == cls && job->name == name && (includeCancelled || !job->cancelled)) return true;
+        }
+        return false;
+    }
+
+    // 调用方持有锁；name 为空表示整个类别
+    size_t cancelLocked(JobClass cls, const std::string& name = "") {
+        size_t n = 0;
+        auto matches = [&](const JobPtr& job) {
+            return job->cls == cls && (name.empty() || job->name == name);
+        };
+        auto& queue = queued_[index(cls)];
+        for (auto it = queue.begin(); it != queue.end();) {
+            if (!matches(*it)) {
+                ++it;
+                continue;
+            }
+            (*it)->cancelled = true;
+            (*it)->state = JobState::Cancelled;
+            retireLocked(*it);
+            it = queue.erase(it);
+            n++;
+        }
+        for (auto* list : {&running_, &waitingJobs_}) {
+            for (auto& job : *list) {
+                if (matches(job) && !job->cancelled) {
+                    job->cancelled = true;
+                    n++;
+                }
+            }
+        }
+        return n;
+    }
+
+    // 各来源的设置合并为最严的一份：速率取最小的非零值，优先级取最低，任一来源要求退避即退避。
+    // 调用方持有锁
+    void mergeGovernors() {
+        auto strictest = [](uint64_t a, uint64_t b) { return a && b ? std::min(a, b) : std::max(a, b); };
+        IoGovernor merged;
+        bool first = true;
+        for (const auto& entry : governors_) {
+            const IoGovernor& g = entry.second;
+            if (first) {
+                merged = g;
+                first = false;
+                continue;
+            }
+            merged.bytesPerSec = strictest(merged.bytesPerSec, g.bytesPerSec);
+            merged.opsPerSec = strictest(merged.opsPerSec, g.opsPerSec);
+            merged.priority = std::min(merged.priority, g.priority);
+            merged.pressureBackoff = merged.pressureBackoff || g.pressureBackoff;
+        }
+        governor_ = merged;
+        cv_.notify_all();
+    }
+
+    // 系统负载高时按比例降低后台的速率；调用方持有锁
+    void samplePressure(steady_clock::time_point now) {
+        if (!governor_.pressureBackoff) {
+            cpuPressure_ = ioPressure_ = 0;
+            cpuScale_ = ioScale_ = 1.0;
+            return;
+        }
+        if (pressureSampled_ != steady_clock::time_point() && now - pressureSampled_ < kPressureSample) return;
+        pressureSampled_ = now;
+        cpuPressure_ = readPressure("cpu");
+        ioPressure_ = readPressure("io");
+        cpuScale_ = pressureScale(cpuPressure_);
+        ioScale_ = pressureScale(ioPressure_);
+    }
+
+    // 按经过的时间补充各令牌桶；后台类别的速率随系统负载缩放。调用方持有锁
+    void refill() {
+        auto now = steady_clock::now();
+        samplePressure(now);
+        double elapsed = duration<double>(now - lastRefill_).count();
+        lastRefill_ = now;
+        for (size_t c = 0; c < kClasses; ++c) {
+            const JobBudget& b = budgets_[c];
+            bool background = static_cast<JobClass>(c) != JobClass::Interactive;
+            double cpuScale = background ? cpuScale_ : 1.0;
+            double ioScale = background ? ioScale_ : 1.0;
+            Buckets& buckets = buckets_[c];
+            buckets.cpu.refill(b.cpuShare * cpuScale, elapsed);
+            buckets.io.refill(static_cast<double>(b.ioBytesPerSec) * ioScale, elapsed);
+            buckets.ops.refill(static_cast<double>(b.ioOpsPerSec) * ioScale, elapsed);
+        }
+        governorIo_.refill(static_cast<double>(governor_.bytesPerSec) * ioScale_, elapsed);
+        governorOps_.refill(static_cast<double>(governor_.opsPerSec) * ioScale_, elapsed);
+    }
+
+    bool overBudget(JobClass cls) {
+        refill();
+        const Buckets& buckets = buckets_[index(cls)];
+        if (buckets.cpu.exhausted() || buckets.io.exhausted() || buckets.ops.exhausted()) return true;
+        return cls != JobClass::Interactive && (governorIo_.exhausted() || governorOps_.exhausted());
+    }
+
+    bool throttled(JobClass cls) {
+        // 有用户命令执行时：让路的类别暂停；其余后台作业不限速，尽快释放命令可能在等的锁
+        if (cls != JobClass::Interactive && runningCount_[index(JobClass::Interactive)] > 0) {
+            return budgets_[index(cls)].yieldToInteractive;
+        }
+        return overBudget(cls);
+    }
+
+    // 高优先级类别有作业在等待时，低优先级不启动新作业
+    bool admissible(JobClass cls) {
+        for (size_t h = 0; h < index(cls); ++h) {
+            if (!queued_[h].empty() || waiting_[h] > 0) return false;
+        }
+        const JobBudget& b = budgets_[index(cls)];
+        if (b.maxConcurrent > 0 && runningCount_[index(cls)] >= b.maxConcurrent) return false;
+        return !throttled(cls);
+    }
+
+    JobPtr pickNext() {
+        for (size_t c = 0; c < kClasses; ++c) {
+            if (queued_[c].empty()) continue;
+            if (!admissible(static_cast<JobClass>(c))) return nullptr;
+            JobPtr job = queued_[c].front();
+            queued_[c].pop_front();
+            return job;
+        }
+        return nullptr;
+    }
+
+    void beginLocked(const JobPtr& job) {
+        job->state = JobState::Running;
+        runningCount_[index(job->cls)]++;
+        running_.push_back(job);
+    }
+
+    void retireLocked(const JobPtr& job) {
+        job->finished = steady_clock::now();
+        job->task = nullptr;
+        history_.push_back(job);
+        while (history_.size() > kHistorySize) history_.pop_front();
+    }
+
+    // 把执行线程自上次记账以来的 CPU 时间计入作业和类别；调用方持有锁
+    void account(Job& job) {
+        nanoseconds now = threadCpuTime();
+        nanoseconds delta = now - job.lastCpu;
+        job.lastCpu = now;
+        job.cpu += delta;
+        buckets_[index(job.cls)].cpu.take(duration<double>(delta).count());
+    }
+
+    IoPriority priorityFor(JobClass cls) const {
+        if (cls == JobClass::Interactive) return IoPriority::Normal;
+        std::lock_guard<std::mutex> lock(mutex_);
+        return governor_.priority;
+    }
+
+    std::exception_ptr execute(Job& job, const Task& task) {
+        // 后台作业执行期间降低本线程的 I/O 优先级，结束后恢复
+        IoPriorityScope ioPriority(priorityFor(job.cls));
+        currentJob = &job;
+        job.lastCpu = threadCpuTime();
+
+        JobState state = JobState::Done;
+        std::string message;
+        std::exception_ptr error;
+        try {
+            task();
+        } catch (const JobCancelled&) {
+            state = JobState::Cancelled;
+            error = std::current_exception();
+        } catch (const std::exception& e) {
+            state = JobState::Failed;
+            message = e.what();
+            error = std::current_exception();
+        } catch (...) {
+            state = JobState::Failed;
+            message = "unknown error";
+            error = std::current_exception();
+        }
+        currentJob = nullptr;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            account(job);
+            job.state = state;
+            job.error = message;
+            runningCount_[index(job.cls)]--;
+            auto it = std::find_if(running_.begin(), running_.end(),
+                                   [&job](const JobPtr& p) { return p.get() == &job; });
+            JobPtr owned = *it;
+            running_.erase(it);
+            retireLocked(owned);
+        }
+        cv_.notify_all();
+        return error;
+    }
+
+    void workerLoop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stop_) {
+            JobPtr job = pickNext();
+            if (!job) {
+                cv_.wait_for(lock, kThrottlePoll);
+                continue;
+            }
+            beginLocked(job);
+            Task task = std::move(job->task);
+            lock.unlock();
+
+            // 异步作业的错误只记录在作业历史中
+            execute(*job, task);
+            lock.lock();
+        }
+    }
+
+    struct Buckets {
+        TokenBucket cpu; // 秒
+        TokenBucket io;  // 字节
+        TokenBucket ops;
+    };
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::array<std::deque<JobPtr>, kClasses> queued_;
+    std::vector<JobPtr> running_;
+    std::vector<JobPtr> waitingJobs_; // 同步作业等待准入
+    std::deque<JobPtr> history_;
+    std::array<JobBudget, kClasses> budgets_{};
+    std::array<Buckets, kClasses> buckets_{};
+    // 所有后台类别共用的令牌桶
+    TokenBucket governorIo_, governorOps_;
+    std::map<std::string, IoGovernor> governors_;
+    IoGovernor governor_; // 合并后的设置
+    double cpuPressure_ = 0, ioPressure_ = 0;
+    double cpuScale_ = 1.0, ioScale_ = 1.0;
+    steady_clock::time_point pressureSampled_;
+    std::array<int, kClasses> runningCount_{};
+    std::array<int, kClasses> waiting_{};
+    steady_clock::time_point lastRefill_;
+    std::vector<std::thread> workers_;
+    bool stop_ = false;
+    uint64_t nextId_ = 1;
+};
+
+JobScheduler& JobScheduler::instance() {
+    static JobScheduler instance;
+    return instance;
+}
+
+JobScheduler::JobScheduler() : impl_(std::make_unique<Impl>()) {}
+JobScheduler::~JobScheduler() = default;
+
+void JobScheduler::start(size_t threads) { impl_->start(threads); }
+void JobScheduler::stop() { impl_->stop(); }
+void JobScheduler::setBudget(JobClass cls, const JobBudget& budget) { impl_->setBudget(cls, budget); }
+void JobScheduler::setGovernor(const std::string& owner, const IoGovernor& governor) {
+    impl_->setGovernor(owner, governor);
+}
+void JobScheduler::removeGovernor(const std::string& owner) { impl_->removeGovernor(owner); }
+
+uint64_t JobScheduler::submit(JobClass cls, const std::string& name, Task task, bool coalesce) {
+    return impl_->submit(cls, name, std::move(task), coalesce);
+}
+
+void JobScheduler::run(JobClass cls, const std::string& name, const Task& task) {
+    impl_->run(cls, name, task);
+}
+
+bool JobScheduler::cancel(uint64_t id) { return impl_->cancel(id); }
+size_t JobScheduler::cancelClass(JobClass cls, const std::string& name) { return impl_->cancelClass(cls, name); }
+void JobScheduler::waitFor(JobClass cls, const std::string& name) { impl_->waitFor(cls, name); }
+
+void JobScheduler::checkpoint() {
+    if (currentJob) instance().impl_->checkpoint(*currentJob);
+}
+
+void JobScheduler::chargeIo(uint64_t bytes, uint64_t ops) {
+    if (currentJob) instance().impl_->chargeIo(*currentJob, bytes, ops);
+}
+
+bool JobScheduler::cancelled() {
+    return currentJob && currentJob->cancelled;
+}
+
+std::vector<JobInfo> JobScheduler::jobs() const { return impl_->jobs(); }
+JobCounts JobScheduler::counts() const { return impl_->counts(); }
+
+void JobScheduler::writeJobs(std::ostream& out) const {
+    impl_->writeBudgets(out);
+    out << "\n";
+
+    auto list = jobs();
+    if (list.empty()) {
+        out << "No jobs\n";
+        return;
+    }
+
+    out << std::left << std::setw(6) << "ID" << std::setw(13) << "CLASS" << std::setw(11) << "STATE"
+        << std::right << std::setw(9) << "AGE" << std::setw(9) << "CPU" << std::setw(10) << "IO"
+        << "  NAME\n";
+    for (const auto& job : list) {
+        out << std::left << std::setw(6) << job.id << std::setw(13) << jobClassName(job.cls)
+            << std::setw(11) << jobStateName(job.state) << std::right << std::fixed << std::setprecision(2)
+            << std::setw(8) << duration<double>(job.age).count() << "s"
+            << std::setw(8) << duration<double>(job.cpuTime).count() << "s"
+            << std::setw(7) << job.ioBytes / 1024 << " KB"
+            << "  " << job.name;
+        if (!job.error.empty()) out << " (" << job.error << ")";
+        out << "\n";
+    }
+}
+
+} // namespace clay
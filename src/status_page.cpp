@@ -0,0 +1,153 @@
+#include "clay/status_page.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace clay {
+
+namespace {
+
+constexpr size_t kWords = sizeof(StatusData) / sizeof(uint64_t);
+constexpr int kReadAttempts = 1000;
+
+static_assert(sizeof(StatusData) % sizeof(uint64_t) == 0, "StatusData must be a whole number of words");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "seqlock counter must be lock-free to live in shared memory");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "status words must be lock-free to live in shared memory");
+
+} // namespace
+
+// 映射文件的布局；内容按 8 字节原子字复制，读写并发时不构成数据竞争
+struct StatusPage::Page {
+    uint32_t magic;
+    uint32_t version;
+    std::atomic<uint32_t> seq;
+    uint32_t size;
+    std::atomic<uint64_t> words[kWords];
+};
+
+StatusPage::~StatusPage() {
+    close();
+}
+
+std::string StatusPage::pathFor(const std::string& workspace) {
+    return (fs::path(workspace) / ".clay" / "status.shm").string();
+}
+
+bool StatusPage::open(const std::string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "Failed to open status page " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    if (ftruncate(fd, sizeof(Page)) < 0) {
+        std::cerr << "Failed to size status page " << path << ": " << strerror(errno) << std::endl;
+        ::close(fd);
+        return false;
+    }
+    void* addr = mmap(nullptr, sizeof(Page), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        std::cerr << "Failed to map status page " << path << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    page_ = static_cast<Page*>(addr);
+    path_ = path;
+    current_ = StatusData();
+    if (page_->magic == kMagic && page_->version == kVersion && page_->size == sizeof(StatusData) &&
+        (page_->seq.load(std::memory_order_acquire) & 1) == 0) {
+        uint64_t words[kWords];
+        for (size_t i = 0; i < kWords; ++i) {
+            words[i] = page_->words[i].load(std::memory_order_relaxed);
+        }
+        std::memcpy(&current_, words, sizeof(current_));
+    }
+    // 上一个守护进程可能在写入中途退出，序号归零后重新发布
+    page_->seq.store(0, std::memory_order_relaxed);
+    page_->magic = kMagic;
+    page_->version = kVersion;
+    page_->size = sizeof(StatusData);
+    publish();
+    return true;
+}
+
+StatusData StatusPage::current() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return current_;
+}
+
+void StatusPage::close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!page_) return;
+    munmap(page_, sizeof(Page));
+    page_ = nullptr;
+}
+
+void StatusPage::publish() {
+    uint64_t words[kWords];
+    std::memcpy(words, &current_, sizeof(words));
+
+    uint32_t seq = page_->seq.load(std::memory_order_relaxed);
+    page_->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < kWords; ++i) {
+        page_->words[i].store(words[i], std::memory_order_relaxed);
+    }
+    page_->seq.store(seq + 2, std::memory_order_release);
+}
+
+bool StatusPage::read(const std::string& path, StatusData& out) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(Page)) {
+        ::close(fd);
+        return false;
+    }
+    void* addr = mmap(nullptr, sizeof(Page), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) return false;
+
+    const Page* page = static_cast<const Page*>(addr);
+    bool ok = false;
+    if (page->magic == kMagic && page->version == kVersion && page->size == sizeof(StatusData)) {
+        uint64_t words[kWords];
+        for (int attempt = 0; attempt < kReadAttempts && !ok; ++attempt) {
+            uint32_t before = page->seq.load(std::memory_order_acquire);
+            if (before & 1) {
+                std::this_thread::yield();
+                continue;
+            }
+            for (size_t i = 0; i < kWords; ++i) {
+                words[i] = page->words[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            ok = page->seq.load(std::memory_order_relaxed) == before;
+        }
+        if (ok) std::memcpy(&out, words, sizeof(out));
+    }
+
+    munmap(const_cast<Page*>(page), sizeof(Page));
+    return ok;
+}
+
+void StatusPage::copyString(char* dest, size_t size, const std::string& src) {
+    size_t n = std::min(size - 1, src.size());
+    std::memcpy(dest, src.data(), n);
+    std::memset(dest + n, 0, size - n);
+}
+
+} // namespace clay
@@ -1,14 +1,256 @@
 #include "clay/storage.hpp"
 #include "clay/snapshot.hpp"
+#include "clay/delta.hpp"
+#include "clay/hash.hpp"
+#include "clay/metrics.hpp"
+#include "clay/path_table.hpp"
+#include "clay/scheduler.hpp"
+#include "clay/trace.hpp"
+#include "clay/tree.hpp"
 #include <sqlite3.h>
 #include <iostream>
 #include <filesystem>
 #include <stdexcept>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <functional>
+#include <optional>
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
 
 namespace fs = std::filesystem;
 
 namespace clay {
 
+namespace {
+
+// deltas.encoding：最新版本保存完整内容，旧版本保存相对下一个快照的反向补丁
+enum Encoding {
+    ENCODING_FULL = 0,          // content 为完整文件内容
+    ENCODING_REVERSE_PATCH = 1, // content 为 LZ4 压缩的 bsdiff(base 中同路径内容 -> 本版本)
+    ENCODING_SAME_AS_BASE = 2,  // 与 base 中同路径内容相同，content 为空
+};
+
+// 补丁至少要比原内容小四分之一才值得替换
+constexpr size_t kMaxPatchRatioNum = 3;
+constexpr size_t kMaxPatchRatioDen = 4;
+constexpr size_t kMaxDeltaInput = 64 * 1024 * 1024;
+// 链深度上限，限制深历史重建的时间和补丁内存；超过时保留完整内容作为检查点
+constexpr size_t kMaxChainDepth = 32;
+
+// 只读连接数：时间线、加载和 diff 各自取一个连接，不与写入互相等待
+constexpr size_t kReaderConnections = 4;
+constexpr int kBusyTimeoutMs = 5000;
+
+struct DeltaRow {
+    int encoding = ENCODING_FULL;
+    std::string base;
+    std::vector<uint8_t> content;
+    std::optional<uint64_t> hash; // 完整内容的 fastHash；旧数据库的行没有
+};
+
+bool exec(sqlite3* db, const char* sql) {
+    char* errMsg = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &errMsg) != SQLITE_OK) {
+        std::cerr << "SQL error: " << (errMsg ? errMsg : sqlite3_errmsg(db)) << std::endl;
+        sqlite3_free(errMsg);
+        return false;
+    }
+    return true;
+}
+
+// 作用域事务：未 commit 的事务在析构时回滚；读事务保证多条查询看到同一版本
+class Transaction {
+public:
+    Transaction(sqlite3* db, const char* begin = "BEGIN") : db_(db), active_(exec(db, begin)) {
+        if (!active_) throw std::runtime_error("Failed to begin transaction");
+    }
+    ~Transaction() {
+        if (active_) sqlite3_exec(db_, "ROLLBACK", nullptr, nullptr, nullptr);
+    }
+    void commit() {
+        active_ = false;
+        if (!exec(db_, "COMMIT")) {
+            sqlite3_exec(db_, "ROLLBACK", nullptr, nullptr, nullptr);
+            throw std::runtime_error("Failed to commit transaction");
+        }
+    }
+
+private:
+    sqlite3* db_;
+    bool active_;
+};
+
+// WAL 模式下的只读连接池；连接在第一次需要时才打开，用完即归还
+class ReaderPool {
+public:
+    class Lease {
+    public:
+        Lease(const ReaderPool& pool, sqlite3* db) : pool_(&pool), db_(db) {}
+        Lease(Lease&& other) noexcept : pool_(other.pool_), db_(other.db_) { other.db_ = nullptr; }
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        ~Lease() {
+            if (db_) pool_->release(db_);
+        }
+        sqlite3* get() const { return db_; }
+
+    private:
+        const ReaderPool* pool_;
+        sqlite3* db_;
+    };
+
+    ~ReaderPool() {
+        for (sqlite3* db : all_) sqlite3_close(db);
+    }
+
+    // 先打开一个连接以确认数据库可读，其余按需打开
+    bool open(const std::string& path, size_t count) {
+        path_ = path;
+        max_ = count;
+        sqlite3* db = connect();
+        if (!db) return false;
+        all_.push_back(db);
+        idle_.push_back(db);
+        return true;
+    }
+
+    Lease acquire() const {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (idle_.empty() && all_.size() < max_) {
+            sqlite3* db = connect();
+            if (db) {
+                all_.push_back(db);
+                return Lease(*this, db);
+            }
+        }
+        available_.wait(lock, [this] { return !idle_.empty(); });
+        sqlite3* db = idle_.back();
+        idle_.pop_back();
+        return Lease(*this, db);
+    }
+
+private:
+    sqlite3* connect() const {
+        sqlite3* db = nullptr;
+        if (sqlite3_open_v2(path_.c_str(), &db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX,
+                            nullptr) != SQLITE_OK) {
+            std::cerr << "Can't open database reader: " << sqlite3_errmsg(db) << std::endl;
+            sqlite3_close(db);
+            return nullptr;
+        }
+        sqlite3_busy_timeout(db, kBusyTimeoutMs);
+        return db;
+    }
+
+    void release(sqlite3* db) const {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            idle_.push_back(db);
+        }
+        available_.notify_one();
+    }
+
+    std::string path_;
+    size_t max_ = 0;
+    mutable std::vector<sqlite3*> all_;
+    mutable std::vector<sqlite3*> idle_;
+    mutable std::mutex mutex_;
+    mutable std::condition_variable available_;
+};
+
+// 一致读视图期间当前线程固定使用的读连接
+struct PinnedReader {
+    const void* owner;
+    sqlite3* db;
+};
+thread_local PinnedReader* tlsPinnedReader = nullptr;
+
+// 读连接句柄：处于 readSnapshot 中时复用固定的连接和它的读事务，否则从池中借用
+class Reader {
+public:
+    Reader(const ReaderPool& pool, const void* owner) {
+        if (tlsPinnedReader && tlsPinnedReader->owner == owner) {
+            db_ = tlsPinnedReader->db;
+        } else {
+            lease_.emplace(pool.acquire());
+            db_ = lease_->get();
+        }
+    }
+    sqlite3* get() const { return db_; }
+    bool pinned() const { return !lease_; }
+
+private:
+    std::optional<ReaderPool::Lease> lease_;
+    sqlite3* db_ = nullptr;
+};
+
+// 正在存储的快照中的一个文件项；source 是 PendingStore::sources 的下标，0 为本快照
+struct StagedFile {
+    bool present = false;
+    FileDelta::Action action = FileDelta::MODIFY;
+    ContentKind kind = ContentKind::Unknown;
+    uint64_t size = 0;
+    std::optional<uint64_t> hash;
+    std::optional<Digest> digest;
+    uint32_t source = 0;
+};
+
+// 分批存储中的快照：写锁和写事务跨调用持有，所以各步骤必须在同一线程上调用
+struct PendingStore {
+    std::unique_lock<std::recursive_mutex> lock;
+    std::optional<Transaction> txn;
+    std::string id;
+    // 只累计写库调用内的时间，分批存储时不含调用之间的捕获
+    std::chrono::steady_clock::duration writeTime{}, classifyTime{}, hashTime{};
+    
+    // 路径表包含父快照和本快照的所有路径，以下数组都按节点下标索引
+    PathTable paths;
+    std::vector<StagedFile> parent, files;
+    std::vector<std::optional<Digest>> parentTrees; // 父快照中各目录的哈希
+    std::vector<uint8_t> changed;                   // 子树中有文件新增、修改或删除
+    // 内容行的来源快照；superseded 按同一下标标记其中有行被本快照的新内容取代
+    std::vector<std::string> sources;
+    std::vector<uint8_t> superseded;
+    std::unordered_map<std::string, uint32_t> sourceIndex;
+    
+    template <typename T>
+    static T& at(std::vector<T>& items, uint32_t node) {
+        if (node >= items.size()) items.resize(node + 1);
+        return items[node];
+    }
+    
+    uint32_t sourceOf(const std::string& snapshotId) {
+        auto inserted = sourceIndex.emplace(snapshotId, static_cast<uint32_t>(sources.size()));
+        if (inserted.second) {
+            sources.push_back(snapshotId);
+            superseded.push_back(0);
+        }
+        return inserted.first->second;
+    }
+    
+    void markChanged(uint32_t node) {
+        for (;;) {
+            uint8_t& flag = at(changed, node);
+            if (flag) return;
+            flag = 1;
+            if (node == PathTable::kRoot) return;
+            node = paths.parent(node);
+        }
+    }
+    
+    bool isChanged(uint32_t node) const {
+        return node < changed.size() && changed[node];
+    }
+};
+
+} // namespace
+
 class Storage::Impl {
 public:
     Impl(const std::string& workspace) 
@@ -18,14 +260,41 @@ public:
     }
     
     ~Impl() {
+        // 未完成的分批存储持有写锁，先回滚，否则压缩线程无法退出
+        pending_.reset();
+        {
+            std::lock_guard<std::mutex> lock(compactMutex_);
+            stopCompactor_ = true;
+        }
+        compactWake_.notify_all();
+        if (compactor_.joinable()) compactor_.join();
+        readers_.reset();
         if (db_) sqlite3_close(db_);
     }
     
-    bool init() {
+    bool init(OpenMode mode) {
+        if (mode == OpenMode::ReadOnly) {
+            // 只读打开不创建数据库；表结构由读写方负责
+            if (!fs::exists(dbPath_)) {
+                std::cerr << "No Clay database at " << dbPath_ << std::endl;
+                return false;
+            }
+            readOnly_ = true;
+            readers_ = std::make_unique<ReaderPool>();
+            return readers_->open(dbPath_, kReaderConnections);
+        }
+        
+        std::lock_guard<std::recursive_mutex> lock(writeMutex_);
         if (sqlite3_open(dbPath_.c_str(), &db_) != SQLITE_OK) {
             std::cerr << "Can't open database: " << sqlite3_errmsg(db_) << std::endl;
             return false;
         }
+        sqlite3_busy_timeout(db_, kBusyTimeoutMs);
+        
+        // WAL：读连接读取已提交的版本，不被写事务阻塞
+        if (!exec(db_, "PRAGMA journal_mode=WAL") || !exec(db_, "PRAGMA synchronous=NORMAL")) {
+            return false;
+        }
         
         const char* sql = R"(
             CREATE TABLE IF NOT EXISTS snapshots (
@@ -43,6 +312,12 @@ public:
                 PRIMARY KEY (snapshot_id, file_path),
                 FOREIGN KEY (snapshot_id) REFERENCES snapshots(id)
             );
+            
+            CREATE TABLE IF NOT EXISTS trees (
+                hash BLOB PRIMARY KEY,
+                data BLOB NOT NULL,
+                refs INTEGER NOT NULL DEFAULT 0
+            );
         )";
         
         char* errMsg = nullptr;
@@ -52,11 +327,98 @@ public:
             return false;
         }
         
+        // 旧数据库缺少的列按需补上：内容分类（NULL 表示未分类）、反向增量编码、内容哈希、强哈希和大小、
+        // 根目录节点（NULL 表示旧格式快照，每个文件一行）
+        if (!addColumnIfMissing("deltas", "is_binary", "INTEGER") ||
+            !addColumnIfMissing("deltas", "encoding", "INTEGER NOT NULL DEFAULT 0") ||
+            !addColumnIfMissing("deltas", "base_snapshot", "TEXT") ||
+            !addColumnIfMissing("deltas", "content_hash", "INTEGER") ||
+            !addColumnIfMissing("deltas", "content_digest", "BLOB") ||
+            !addColumnIfMissing("deltas", "content_size", "INTEGER") ||
+            !addColumnIfMissing("snapshots", "packed", "INTEGER NOT NULL DEFAULT 0") ||
+            !addColumnIfMissing("snapshots", "root_tree", "BLOB")) {
+            return false;
+        }
+        
+        // idx_deltas_path：压缩时查找同一路径的下一个版本；idx_snapshots_time：每次存储都要找最新的快照
+        if (sqlite3_exec(db_, "CREATE INDEX IF NOT EXISTS idx_deltas_base ON deltas(base_snapshot, file_path);"
+                              "CREATE INDEX IF NOT EXISTS idx_deltas_path ON deltas(file_path);"
+                              "CREATE INDEX IF NOT EXISTS idx_snapshots_time ON snapshots(timestamp, id)",
+                         nullptr, nullptr, &errMsg) != SQLITE_OK) {
+            std::cerr << "SQL error: " << errMsg << std::endl;
+            sqlite3_free(errMsg);
+            return false;
+        }
+        
+        // 读连接在表结构就绪后打开
+        readers_ = std::make_unique<ReaderPool>();
+        if (!readers_->open(dbPath_, kReaderConnections)) {
+            return false;
+        }
+        
+        compactor_ = std::thread([this] { compactLoop(); });
         return true;
     }
     
+    void setMaxSnapshots(int count) {
+        maxSnapshots_ = count < 1 ? 1 : count;
+    }
+    
+    void setDeltaHotWindow(int seconds) {
+        hotWindow_ = seconds < 0 ? 0 : seconds;
+        requestCompaction();
+    }
+    
+    bool readOnly() const {
+        return readOnly_;
+    }
+    
+    void setMetrics(PipelineMetrics* metrics) {
+        metrics_ = metrics ? metrics : &ownMetrics_;
+    }
+    
     std::string store(const Snapshot& snapshot) {
+        TraceScope span("storage", "store", snapshot.id);
+        beginStore(snapshot);
+        try {
+            storeDeltas(snapshot.deltas);
+            storeUnchanged(snapshot.unchanged);
+        } catch (...) {
+            abortStore();
+            throw;
+        }
+        return finishStore();
+    }
+    
+    void beginStore(const Snapshot& snapshot) {
+        if (readOnly_) throw std::runtime_error("Storage is opened read-only");
+        if (pending_) throw std::runtime_error("Another snapshot is being stored");
+        auto pending = std::make_unique<PendingStore>();
+        pending->lock = std::unique_lock<std::recursive_mutex>(writeMutex_);
+        auto started = std::chrono::steady_clock::now();
+        pending->id = snapshot.id;
+        pending->sourceOf(snapshot.id);
+        // 整个快照一次提交：读者要么看到完整快照，要么看不到
+        pending->txn.emplace(db_, "BEGIN IMMEDIATE");
+        
+        // 父快照是当前最新的快照：未修改的文件沿用它的项，不再写内容行
+        std::string parentId;
+        int64_t timestamp = snapshot.timestamp;
         sqlite3_stmt* stmt;
+        const char* latestSql = "SELECT id, timestamp FROM snapshots ORDER BY timestamp DESC, id DESC LIMIT 1";
+        if (sqlite3_prepare_v2(db_, latestSql, -1, &stmt, nullptr) != SQLITE_OK) {
+            throw std::runtime_error("Failed to prepare statement");
+        }
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            parentId = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            int64_t latest = sqlite3_column_int64(stmt, 1);
+            // 时钟回拨时把时间戳推到最新快照之后：删除快照时按时间线上的相邻关系判断
+            // 内容行是否仍被引用，时间线顺序必须与创建顺序一致
+            if (latest > timestamp || (latest == timestamp && snapshot.id < parentId)) timestamp = latest + 1;
+        }
+        sqlite3_finalize(stmt);
+        if (!parentId.empty()) loadParent(*pending, parentId);
+        
         const char* sql = "INSERT INTO snapshots (id, timestamp, auto_save, message) VALUES (?, ?, ?, ?)";
         
         if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
@@ -64,7 +426,7 @@ public:
         }
         
         sqlite3_bind_text(stmt, 1, snapshot.id.c_str(), -1, SQLITE_STATIC);
-        sqlite3_bind_int64(stmt, 2, snapshot.timestamp);
+        sqlite3_bind_int64(stmt, 2, timestamp);
         sqlite3_bind_int(stmt, 3, snapshot.autoSave ? 1 : 0);
         sqlite3_bind_text(stmt, 4, snapshot.message.c_str(), -1, SQLITE_STATIC);
         
@@ -73,20 +435,68 @@ public:
             throw std::runtime_error("Failed to insert snapshot");
         }
         sqlite3_finalize(stmt);
-        
-        for (const auto& delta : snapshot.deltas) {
-            storeDelta(snapshot.id, delta);
+        pending->writeTime += std::chrono::steady_clock::now() - started;
+        pending_ = std::move(pending);
+    }
+    
+    void storeDeltas(const std::vector<FileDelta>& deltas) {
+        if (!pending_) throw std::runtime_error("No snapshot is being stored");
+        auto started = std::chrono::steady_clock::now();
+        for (const auto& delta : deltas) {
+            storeDelta(*pending_, delta);
         }
+        pending_->writeTime += std::chrono::steady_clock::now() - started;
+    }
+    
+    void storeUnchanged(const std::vector<std::string>& paths) {
+        if (!pending_) throw std::runtime_error("No snapshot is being stored");
+        PendingStore& pending = *pending_;
+        for (const auto& path : paths) {
+            uint32_t node = pending.paths.find(path);
+            if (node == PathTable::kNone || node >= pending.parent.size() || !pending.parent[node].present) {
+                throw std::runtime_error("File not in parent snapshot: " + path);
+            }
+            PendingStore::at(pending.files, node) = pending.parent[node];
+        }
+        metrics_->add(PipelineCounter::FilesReused, paths.size());
+    }
+    
+    std::string finishStore() {
+        if (!pending_) throw std::runtime_error("No snapshot is being stored");
+        std::unique_ptr<PendingStore> pending = std::move(pending_);
+        auto started = std::chrono::steady_clock::now();
+        writeRoot(*pending);
+        pending->txn->commit();
+        auto written = std::chrono::steady_clock::now();
+        pending->writeTime += written - started;
+        pending->lock.unlock();
+        metrics_->record(PipelinePhase::Classify, pending->classifyTime);
+        metrics_->record(PipelinePhase::Hash, pending->hashTime);
+        metrics_->record(PipelinePhase::DbWrite, pending->writeTime - pending->classifyTime - pending->hashTime);
         
         cleanup();
-        return snapshot.id;
+        metrics_->record(PipelinePhase::Cleanup, std::chrono::steady_clock::now() - written);
+        
+        // 新快照完整保存；之前的头部在后台改写为反向增量
+        requestCompaction();
+        return pending->id;
+    }
+    
+    void abortStore() {
+        pending_.reset();
     }
     
     Snapshot load(const std::string& snapshotId) const {
+        TraceScope span("storage", "load", snapshotId);
+        Reader reader(*readers_, this);
+        sqlite3* db = reader.get();
+        // 快照行与增量链在同一读事务中读取，期间的压缩和删除不可见
+        std::optional<Transaction> txn;
+        if (!reader.pinned()) txn.emplace(db);
         sqlite3_stmt* stmt;
         const char* sql = "SELECT id, timestamp, auto_save, message FROM snapshots WHERE id = ?";
         
-        if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
             throw std::runtime_error("Failed to prepare statement");
         }
         
@@ -104,16 +514,18 @@ public:
         snapshot.message = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
         
         sqlite3_finalize(stmt);
-        snapshot.deltas = loadDeltas(snapshotId);
+        snapshot.deltas = loadDeltas(db, snapshotId);
         return snapshot;
     }
     
     std::vector<Snapshot> list() const {
+        TraceScope span("storage", "list");
+        Reader reader(*readers_, this);
         std::vector<Snapshot> snapshots;
         sqlite3_stmt* stmt;
         const char* sql = "SELECT id, timestamp, auto_save, message FROM snapshots ORDER BY timestamp ASC";
         
-        if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        if (sqlite3_prepare_v2(reader.get(), sql, -1, &stmt, nullptr) != SQLITE_OK) {
             throw std::runtime_error("Failed to prepare statement");
         }
         
@@ -130,8 +542,116 @@ public:
         return snapshots;
     }
     
+    bool loadFile(const std::string& snapshotId, const std::string& path, std::vector<uint8_t>& content) const {
+        TraceScope span("storage", "load_file", path);
+        return withFileRow(snapshotId, path, [&](sqlite3* db, DeltaRow& row) {
+            return resolveContent(db, path, std::move(row), content);
+        });
+    }
+    
+    bool loadFile(const std::string& snapshotId, const std::string& path, int fd) const {
+        TraceScope span("storage", "load_file", path);
+        return withFileRow(snapshotId, path, [&](sqlite3* db, DeltaRow& row) {
+            std::vector<std::vector<uint8_t>> patches;
+            if (!collectChain(db, path, row, patches)) return false;
+            std::vector<ByteView> views(patches.rbegin(), patches.rend());
+            return applyPatchChain(ByteView(row.content), views, fd);
+        });
+    }
+    
+    // 在读事务中找到快照里保存该文件内容的行，交给 fn
+    bool withFileRow(const std::string& snapshotId, const std::string& path,
+                     const std::function<bool(sqlite3*, DeltaRow&)>& fn) const {
+        Reader reader(*readers_, this);
+        sqlite3* db = reader.get();
+        std::optional<Transaction> txn;
+        if (!reader.pinned()) txn.emplace(db);
+        SnapshotRoot root = readRoot(db, snapshotId);
+        if (!root.exists) return false;
+        // 未修改的文件沿用更早快照的行
+        std::string source = snapshotId;
+        if (root.tree && !findSource(db, *root.tree, path, source)) return false;
+        DeltaRow row;
+        if (!readRow(db, source, path, row)) return false;
+        return fn(db, row);
+    }
+    
+    std::vector<ManifestEntry> manifest(const std::string& snapshotId, PathTable& paths) const {
+        TraceScope span("storage", "manifest", snapshotId);
+        Reader reader(*readers_, this);
+        std::optional<Transaction> txn;
+        if (!reader.pinned()) txn.emplace(reader.get());
+        std::vector<ManifestEntry> files;
+        walkSnapshot(reader.get(), snapshotId, paths, [&](uint32_t node, const TreeEntry& entry) {
+            if (entry.type == TreeEntry::File) files.push_back(toManifest(node, entry));
+        });
+        return files;
+    }
+    
+    std::vector<ManifestChange> compare(const std::string& fromId, const std::string& toId, PathTable& paths) const {
+        TraceScope span("storage", "compare", toId);
+        Reader reader(*readers_, this);
+        std::optional<Transaction> txn;
+        if (!reader.pinned()) txn.emplace(reader.get());
+        std::vector<ManifestChange> changes;
+        std::string path;
+        diffEntries(reader.get(), fromId, toId, paths,
+                    [&](uint32_t node, const TreeEntry* before, const TreeEntry* after) {
+            // 来源不同但内容相同（例如改回原样）不算变化
+            if (before && after) {
+                path.clear();
+                paths.appendPath(node, path);
+                if (sameContent(reader.get(), path, *before, *after)) return;
+            }
+            ManifestChange change;
+            change.path = node;
+            if (before) change.before = toManifest(node, *before);
+            if (after) change.after = toManifest(node, *after);
+            changes.push_back(std::move(change));
+        });
+        return changes;
+    }
+    
+    void readSnapshot(const std::function<void()>& fn) const {
+        TraceScope span("storage", "read_snapshot");
+        Reader reader(*readers_, this);
+        if (reader.pinned()) {
+            fn();
+            return;
+        }
+        
+        sqlite3* db = reader.get();
+        Transaction txn(db);
+        // WAL 的读快照在第一次读取时才确定，这里立即读一次把它固定下来
+        if (!exec(db, "SELECT COUNT(*) FROM snapshots")) {
+            throw std::runtime_error("Failed to start read snapshot");
+        }
+        
+        PinnedReader pin{this, db};
+        PinnedReader* previous = tlsPinnedReader;
+        tlsPinnedReader = &pin;
+        try {
+            fn();
+        } catch (...) {
+            tlsPinnedReader = previous;
+            throw;
+        }
+        tlsPinnedReader = previous;
+    }
+    
     bool remove(const std::string& snapshotId) {
-        const char* sqlDeltas = "DELETE FROM deltas WHERE snapshot_id = ?";
+        if (readOnly_) return false;
+        std::lock_guard<std::recursive_mutex> lock(writeMutex_);
+        Transaction txn(db_, "BEGIN IMMEDIATE");
+        
+        SnapshotRoot root = readRoot(db_, snapshotId);
+        if (root.exists && !releaseRows(snapshotId)) {
+            return false;
+        }
+        if (root.tree) releaseTree(*root.tree);
+        
+        // 旧格式快照中记录删除的行不在清单里，单独删除
+        const char* sqlDeltas = "DELETE FROM deltas WHERE snapshot_id = ? AND action = ?";
         sqlite3_stmt* stmtDeltas;
         
         if (sqlite3_prepare_v2(db_, sqlDeltas, -1, &stmtDeltas, nullptr) != SQLITE_OK) {
@@ -139,6 +659,7 @@ public:
         }
         
         sqlite3_bind_text(stmtDeltas, 1, snapshotId.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_int(stmtDeltas, 2, static_cast<int>(FileDelta::DELETE));
         sqlite3_step(stmtDeltas);
         sqlite3_finalize(stmtDeltas);
         
@@ -152,41 +673,61 @@ public:
         sqlite3_bind_text(stmtSnapshot, 1, snapshotId.c_str(), -1, SQLITE_STATIC);
         int result = sqlite3_step(stmtSnapshot);
         sqlite3_finalize(stmtSnapshot);
+        if (result != SQLITE_DONE) return false;
         
-        return result == SQLITE_DONE;
+        txn.commit();
+        return true;
     }
     
     void cleanup() {
-        sqlite3_stmt* stmt;
-        const char* sql = "SELECT COUNT(*) FROM snapshots";
-        
-        if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) return;
-        
-        if (sqlite3_step(stmt) != SQLITE_ROW) {
+        TraceScope span("storage", "cleanup");
+        if (readOnly_) return;
+        std::vector<std::string> oldest;
+        {
+            std::lock_guard<std::recursive_mutex> lock(writeMutex_);
+            sqlite3_stmt* stmt;
+            const char* sql = "SELECT COUNT(*) FROM snapshots";
+            
+            if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) return;
+            
+            if (sqlite3_step(stmt) != SQLITE_ROW) {
+                sqlite3_finalize(stmt);
+                return;
+            }
+            
+            int count = sqlite3_column_int(stmt, 0);
             sqlite3_finalize(stmt);
-            return;
-        }
-        
-        int count = sqlite3_column_int(stmt, 0);
-        sqlite3_finalize(stmt);
-        
-        if (count > maxSnapshots_) {
-            const char* sqlDelete = "DELETE FROM snapshots WHERE id IN ("
-                "SELECT id FROM snapshots ORDER BY timestamp ASC LIMIT ?)";
+            if (count <= maxSnapshots_) return;
             
-            if (sqlite3_prepare_v2(db_, sqlDelete, -1, &stmt, nullptr) != SQLITE_OK) return;
+            const char* sqlOldest = "SELECT id FROM snapshots ORDER BY timestamp ASC, id ASC LIMIT ?";
+            
+            if (sqlite3_prepare_v2(db_, sqlOldest, -1, &stmt, nullptr) != SQLITE_OK) return;
             
             sqlite3_bind_int(stmt, 1, count - maxSnapshots_);
-            sqlite3_step(stmt);
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                oldest.push_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
+            }
             sqlite3_finalize(stmt);
         }
+        
+        // 同时删除对应的 deltas 行；每个快照之间是检查点，限流时不持有写锁。
+        // 新快照此时已经提交，被取消时不向上抛出，剩下的留到下一次存储之后
+        for (const auto& id : oldest) {
+            try {
+                JobScheduler::checkpoint();
+            } catch (const JobCancelled&) {
+                return;
+            }
+            if (remove(id)) metrics_->add(PipelineCounter::SnapshotsPruned);
+        }
     }
     
     std::string lastSnapshotId() const {
+        Reader reader(*readers_, this);
         sqlite3_stmt* stmt;
-        const char* sql = "SELECT id FROM snapshots ORDER BY timestamp DESC LIMIT 1";
+        const char* sql = "SELECT id FROM snapshots ORDER BY timestamp DESC, id DESC LIMIT 1";
         
-        if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) return "";
+        if (sqlite3_prepare_v2(reader.get(), sql, -1, &stmt, nullptr) != SQLITE_OK) return "";
         
         if (sqlite3_step(stmt) != SQLITE_ROW) {
             sqlite3_finalize(stmt);
@@ -199,16 +740,654 @@ public:
     }
 
 private:
-    void storeDelta(const std::string& snapshotId, const FileDelta& delta) {
+    bool hasColumn(const std::string& table, const std::string& column) const {
+        sqlite3_stmt* stmt;
+        std::string sql = "PRAGMA table_info(" + table + ")";
+        if (sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) return false;
+        
+        bool found = false;
+        while (!found && sqlite3_step(stmt) == SQLITE_ROW) {
+            const char* name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+            found = name && column == name;
+        }
+        sqlite3_finalize(stmt);
+        return found;
+    }
+    
+    bool addColumnIfMissing(const std::string& table, const std::string& column, const std::string& decl) {
+        if (hasColumn(table, column)) return true;
+        
+        std::string sql = "ALTER TABLE " + table + " ADD COLUMN " + column + " " + decl;
+        char* errMsg = nullptr;
+        if (sqlite3_exec(db_, sql.c_str(), nullptr, nullptr, &errMsg) != SQLITE_OK) {
+            std::cerr << "SQL error: " << errMsg << std::endl;
+            sqlite3_free(errMsg);
+            return false;
+        }
+        return true;
+    }
+    
+    // 快照行是否存在及其根目录节点；旧格式的快照没有根节点，文件按行平铺
+    struct SnapshotRoot {
+        bool exists = false;
+        std::optional<Digest> tree;
+    };
+    
+    static SnapshotRoot readRoot(sqlite3* db, const std::string& snapshotId) {
+        SnapshotRoot root;
+        sqlite3_stmt* stmt;
+        const char* sql = "SELECT root_tree FROM snapshots WHERE id = ?";
+        // 只读打开尚未迁移的数据库时没有 root_tree 列，所有快照都是旧格式
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK &&
+            sqlite3_prepare_v2(db, "SELECT NULL FROM snapshots WHERE id = ?", -1, &stmt, nullptr) != SQLITE_OK) {
+            throw std::runtime_error("Failed to prepare root statement");
+        }
+        
+        sqlite3_bind_text(stmt, 1, snapshotId.c_str(), -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            root.exists = true;
+            Digest digest;
+            if (sqlite3_column_bytes(stmt, 0) == static_cast<int>(digest.bytes.size())) {
+                std::memcpy(digest.bytes.data(), sqlite3_column_blob(stmt, 0), digest.bytes.size());
+                root.tree = digest;
+            }
+        }
+        sqlite3_finalize(stmt);
+        return root;
+    }
+    
+    static void readTree(sqlite3* db, const Digest& hash, std::vector<TreeEntry>& entries) {
+        sqlite3_stmt* stmt;
+        const char* sql = "SELECT data FROM trees WHERE hash = ?";
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+            throw std::runtime_error("Failed to prepare tree statement");
+        }
+        
+        sqlite3_bind_blob(stmt, 1, hash.bytes.data(), hash.bytes.size(), SQLITE_STATIC);
+        bool ok = sqlite3_step(stmt) == SQLITE_ROW &&
+                  decodeTree(ByteView(static_cast<const uint8_t*>(sqlite3_column_blob(stmt, 0)),
+                                      static_cast<size_t>(sqlite3_column_bytes(stmt, 0))), entries);
+        sqlite3_finalize(stmt);
+        if (!ok) throw std::runtime_error("Missing or corrupt tree " + hash.hex());
+    }
+    
+    using EntryVisitor = std::function<void(uint32_t node, const TreeEntry& entry)>;
+    using ChangeVisitor = std::function<void(uint32_t node, const TreeEntry* before, const TreeEntry* after)>;
+    
+    // 深度优先遍历整棵树，目录项先于其中的内容访问
+    static void walkTree(sqlite3* db, const Digest& hash, uint32_t dir, PathTable& paths,
+                         const EntryVisitor& visit) {
+        std::vector<TreeEntry> entries;
+        readTree(db, hash, entries);
+        for (const auto& entry : entries) {
+            uint32_t node = paths.child(dir, entry.name);
+            visit(node, entry);
+            if (entry.type == TreeEntry::Directory) walkTree(db, entry.tree, node, paths, visit);
+        }
+    }
+    
+    // 旧格式快照的文件行，内容都在快照自己的行中
+    static void walkRows(sqlite3* db, const std::string& snapshotId, PathTable& paths, const EntryVisitor& visit) {
+        sqlite3_stmt* stmt;
+        // 旧数据库没有 content_size，完整编码的行用内容长度代替，补丁行只能低估
+        const char* sql = "SELECT file_path, action, is_binary, content_hash, "
+                          "COALESCE(content_size, length(content), 0) FROM deltas WHERE snapshot_id = ?";
+        
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+            throw std::runtime_error("Failed to prepare files statement");
+        }
+        
+        sqlite3_bind_text(stmt, 1, snapshotId.c_str(), -1, SQLITE_STATIC);
+        
+        TreeEntry entry;
+        entry.source = snapshotId;
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            const char* path = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            uint32_t node = paths.intern(std::string_view(path, sqlite3_column_bytes(stmt, 0)));
+            entry.action = static_cast<FileDelta::Action>(sqlite3_column_int(stmt, 1));
+            entry.kind = ContentKind::Unknown;
+            if (sqlite3_column_type(stmt, 2) != SQLITE_NULL) {
+                entry.kind = static_cast<ContentKind>(sqlite3_column_int(stmt, 2));
+            }
+            entry.hash.reset();
+            if (sqlite3_column_type(stmt, 3) != SQLITE_NULL) {
+                entry.hash = static_cast<uint64_t>(sqlite3_column_int64(stmt, 3));
+            }
+            entry.size = static_cast<uint64_t>(sqlite3_column_int64(stmt, 4));
+            visit(node, entry);
+        }
+        
+        sqlite3_finalize(stmt);
+    }
+    
+    // 快照中的所有项；快照不存在时返回 false
+    static bool walkSnapshot(sqlite3* db, const std::string& snapshotId, PathTable& paths,
+                             const EntryVisitor& visit) {
+        SnapshotRoot root = readRoot(db, snapshotId);
+        if (!root.exists) return false;
+        if (root.tree) {
+            walkTree(db, *root.tree, PathTable::kRoot, paths, visit);
+        } else {
+            walkRows(db, snapshotId, paths, visit);
+        }
+        return true;
+    }
+    
+    // 两棵树中不同的文件项；两边哈希相同的子树整棵跳过
+    static void diffTrees(sqlite3* db, const Digest* before, const Digest* after, uint32_t dir,
+                          PathTable& paths, const ChangeVisitor& visit) {
+        if (before && after && *before == *after) return;
+        std::vector<TreeEntry> a, b;
+        if (before) readTree(db, *before, a);
+        if (after) readTree(db, *after, b);
+        
+        // 两边都按 (名称, 类型) 排序，归并即可对齐
+        size_t i = 0, j = 0;
+        while (i < a.size() || j < b.size()) {
+            const TreeEntry* x = nullptr;
+            const TreeEntry* y = nullptr;
+            if (j == b.size() || (i < a.size() && treeOrder(a[i], b[j]))) {
+                x = &a[i++];
+            } else if (i == a.size() || treeOrder(b[j], a[i])) {
+                y = &b[j++];
+            } else {
+                x = &a[i++];
+                y = &b[j++];
+            }
+            const TreeEntry& entry = x ? *x : *y;
+            uint32_t node = paths.child(dir, entry.name);
+            if (entry.type == TreeEntry::Directory) {
+                diffTrees(db, x ? &x->tree : nullptr, y ? &y->tree : nullptr, node, paths, visit);
+            } else if (!x || !y || !x->sameFile(*y)) {
+                visit(node, x, y);
+            }
+        }
+    }
+    
+    // 两个快照中不同的文件项；id 为空表示空快照。有一边是旧格式时两边都完整展开后按节点对齐
+    static void diffEntries(sqlite3* db, const std::string& beforeId, const std::string& afterId,
+                            PathTable& paths, const ChangeVisitor& visit) {
+        SnapshotRoot before, after;
+        if (!beforeId.empty()) before = readRoot(db, beforeId);
+        if (!afterId.empty()) after = readRoot(db, afterId);
+        if ((!beforeId.empty() && !before.exists) || (!afterId.empty() && !after.exists)) {
+            throw std::runtime_error("Snapshot not found");
+        }
+        if ((!before.exists || before.tree) && (!after.exists || after.tree)) {
+            diffTrees(db, before.tree ? &*before.tree : nullptr, after.tree ? &*after.tree : nullptr,
+                      PathTable::kRoot, paths, visit);
+            return;
+        }
+        
+        std::vector<std::optional<TreeEntry>> previous;
+        if (before.exists) {
+            walkSnapshot(db, beforeId, paths, [&](uint32_t node, const TreeEntry& entry) {
+                if (entry.type != TreeEntry::File || entry.action == FileDelta::DELETE) return;
+                if (node >= previous.size()) previous.resize(node + 1);
+                previous[node] = entry;
+            });
+        }
+        if (after.exists) {
+            walkSnapshot(db, afterId, paths, [&](uint32_t node, const TreeEntry& entry) {
+                if (entry.type != TreeEntry::File || entry.action == FileDelta::DELETE) return;
+                if (node < previous.size() && previous[node]) {
+                    if (!previous[node]->sameFile(entry)) visit(node, &*previous[node], &entry);
+                    previous[node].reset();
+                } else {
+                    visit(node, nullptr, &entry);
+                }
+            });
+        }
+        for (uint32_t node = 0; node < previous.size(); ++node) {
+            if (previous[node]) visit(node, &*previous[node], nullptr);
+        }
+    }
+    
+    // 沿路径逐级查找文件项，得到保存其内容的快照
+    static bool findSource(sqlite3* db, Digest tree, const std::string& path, std::string& source) {
+        std::vector<TreeEntry> entries;
+        TreeEntry key;
+        size_t start = 0;
+        for (;;) {
+            size_t end = path.find('/', start);
+            bool leaf = end == std::string::npos;
+            key.type = leaf ? TreeEntry::File : TreeEntry::Directory;
+            key.name = path.substr(start, leaf ? std::string::npos : end - start);
+            readTree(db, tree, entries);
+            auto it = std::lower_bound(entries.begin(), entries.end(), key, treeOrder);
+            if (it == entries.end() || it->name != key.name || it->type != key.type) return false;
+            if (leaf) {
+                source = it->source;
+                return true;
+            }
+            tree = it->tree;
+            start = end + 1;
+        }
+    }
+    
+    // 两个文件项的内容是否相同。两边都有强哈希时以它为准；fastHash 只能证明不同，
+    // 相同时（旧格式的项没有强哈希）读出两边的内容逐字节比较
+    static bool sameContent(sqlite3* db, const std::string& path, const TreeEntry& a, const TreeEntry& b) {
+        if (a.size != b.size) return false;
+        if (a.digest && b.digest) return *a.digest == *b.digest;
+        if (!a.hash || a.hash != b.hash) return false;
+        DeltaRow row;
+        std::vector<uint8_t> left, right;
+        if (!readRow(db, a.source, path, row) || !resolveContent(db, path, std::move(row), left)) return false;
+        row = DeltaRow();
+        if (!readRow(db, b.source, path, row) || !resolveContent(db, path, std::move(row), right)) return false;
+        return left == right;
+    }
+    
+    static ManifestEntry toManifest(uint32_t node, const TreeEntry& entry) {
+        ManifestEntry info;
+        info.path = node;
+        info.action = entry.action;
+        info.kind = entry.kind;
+        info.size = entry.size;
+        info.hash = entry.hash;
+        return info;
+    }
+    
+    static constexpr const char* kReadRowSql = "SELECT encoding, base_snapshot, content, content_hash FROM deltas "
+                                               "WHERE snapshot_id = ? AND file_path = ?";
+    
+    // prepared 为调用方用 kReadRowSql 准备好的语句时复用它，逐个文件读取大量行时省去每次的编译
+    static bool readRow(sqlite3* db, const std::string& snapshotId, const std::string& path, DeltaRow& row,
+                        sqlite3_stmt* prepared = nullptr) {
+        sqlite3_stmt* stmt = prepared;
+        if (stmt) {
+            sqlite3_reset(stmt);
+        } else if (sqlite3_prepare_v2(db, kReadRowSql, -1, &stmt, nullptr) != SQLITE_OK) {
+            return false;
+        }
+        
+        sqlite3_bind_text(stmt, 1, snapshotId.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, path.c_str(), -1, SQLITE_STATIC);
+        
+        bool found = sqlite3_step(stmt) == SQLITE_ROW;
+        if (found) {
+            row.encoding = sqlite3_column_int(stmt, 0);
+            const unsigned char* base = sqlite3_column_text(stmt, 1);
+            row.base = base ? reinterpret_cast<const char*>(base) : "";
+            const uint8_t* blob = static_cast<const uint8_t*>(sqlite3_column_blob(stmt, 2));
+            row.content.assign(blob, blob + sqlite3_column_bytes(stmt, 2));
+            row.hash.reset();
+            if (sqlite3_column_type(stmt, 3) != SQLITE_NULL) {
+                row.hash = static_cast<uint64_t>(sqlite3_column_int64(stmt, 3));
+            }
+        }
+        if (prepared) {
+            sqlite3_reset(stmt);
+        } else {
+            sqlite3_finalize(stmt);
+        }
+        return found;
+    }
+    
+    // 沿 base 链找到完整内容，row 变为该行；patches 为链上的反向补丁，离 row 最远的在前
+    static bool collectChain(sqlite3* db, const std::string& path, DeltaRow& row,
+                             std::vector<std::vector<uint8_t>>& patches, size_t* depth = nullptr) {
+        size_t hops = 0;
+        while (row.encoding != ENCODING_FULL) {
+            if (row.encoding == ENCODING_REVERSE_PATCH) {
+                patches.emplace_back();
+                if (!decompressBlock(ByteView(row.content), patches.back())) return false;
+            }
+            std::string base = row.base;
+            // 正常链不会超过 kMaxChainDepth，这里只防御损坏的环
+            if (++hops > kMaxChainDepth * 4 || !readRow(db, base, path, row)) {
+                return false;
+            }
+        }
+        if (depth) *depth = hops;
+        return true;
+    }
+    
+    // 沿 base 链找到完整内容，再一次性应用链上所有反向补丁
+    static bool resolveContent(sqlite3* db, const std::string& path, DeltaRow row,
+                               std::vector<uint8_t>& out, size_t* depth = nullptr) {
+        std::vector<std::vector<uint8_t>> patches;
+        if (!collectChain(db, path, row, patches, depth)) return false;
+        
+        if (patches.empty()) {
+            out = std::move(row.content);
+            return true;
+        }
+        
+        // 从最新的完整版本开始，先应用离它最近的补丁
+        std::vector<ByteView> views(patches.rbegin(), patches.rend());
+        return applyPatchChain(ByteView(row.content), views, out);
+    }
+    
+    // 有多少个更旧的版本（连续地）以此行为 base
+    size_t dependentDepth(const std::string& snapshotId, const std::string& path) const {
+        size_t depth = 0;
+        std::string current = snapshotId;
+        while (depth <= kMaxChainDepth) {
+            sqlite3_stmt* stmt;
+            const char* sql = "SELECT snapshot_id FROM deltas WHERE base_snapshot = ? AND file_path = ?";
+            if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) break;
+            
+            sqlite3_bind_text(stmt, 1, current.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 2, path.c_str(), -1, SQLITE_STATIC);
+            bool found = sqlite3_step(stmt) == SQLITE_ROW;
+            if (found) current = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+            sqlite3_finalize(stmt);
+            
+            if (!found) break;
+            depth++;
+        }
+        return depth;
+    }
+    
+    // 以 (snapshotId, path) 这一行为 base 的反向增量还原为完整内容，避免删除该行后链断开
+    bool materializeDependents(const std::string& snapshotId, const std::string& path) {
+        sqlite3_stmt* stmt;
+        const char* sql = "SELECT snapshot_id FROM deltas WHERE base_snapshot = ? AND file_path = ?";
+        if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) return false;
+        
+        sqlite3_bind_text(stmt, 1, snapshotId.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, path.c_str(), -1, SQLITE_STATIC);
+        std::vector<std::string> dependents;
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            dependents.emplace_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
+        }
+        sqlite3_finalize(stmt);
+        
+        for (const auto& dep : dependents) {
+            DeltaRow row;
+            std::vector<uint8_t> content;
+            if (!readRow(db_, dep, path, row) || !resolveContent(db_, path, row, content)) {
+                std::cerr << "Failed to rebuild " << path << " in " << dep << std::endl;
+                return false;
+            }
+            if (!updateRow(dep, path, ENCODING_FULL, "", content)) return false;
+            JobScheduler::chargeIo(content.size());
+            markPacked(dep, false);
+        }
+        return true;
+    }
+    
+    // 删除快照时释放它引用的内容行。一行从写入它的快照起，被之后未修改该文件的快照连续沿用，
+    // 引用者在时间线上是连续的一段；所以前后相邻的快照都不再引用时，它就没有其他引用者了。
+    // 仍被引用的行留在原 snapshot_id 下，直到最后一个引用者被删除。
+    bool releaseRows(const std::string& snapshotId) {
+        std::string previous = neighbor(snapshotId, true);
+        std::string next = neighbor(snapshotId, false);
+        PathTable paths;
+        // 按节点：前一个快照没有沿用的项的来源
+        std::vector<std::string> unshared;
+        diffEntries(db_, previous, snapshotId, paths,
+                    [&](uint32_t node, const TreeEntry* before, const TreeEntry* own) {
+            if (!own || (before && before->source == own->source)) return;
+            if (node >= unshared.size()) unshared.resize(node + 1);
+            unshared[node] = own->source;
+        });
+        
+        std::vector<std::pair<std::string, std::string>> dead; // (来源快照, 路径)
+        diffEntries(db_, snapshotId, next, paths,
+                    [&](uint32_t node, const TreeEntry* own, const TreeEntry* after) {
+            if (!own || (after && after->source == own->source)) return;
+            if (node < unshared.size() && unshared[node] == own->source) {
+                dead.emplace_back(own->source, paths.path(node));
+            }
+        });
+        
+        for (const auto& row : dead) {
+            if (!materializeDependents(row.first, row.second)) return false;
+            sqlite3_stmt* stmt;
+            const char* sql = "DELETE FROM deltas WHERE snapshot_id = ? AND file_path = ?";
+            if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) return false;
+            sqlite3_bind_text(stmt, 1, row.first.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 2, row.second.c_str(), -1, SQLITE_STATIC);
+            bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+            sqlite3_finalize(stmt);
+            if (!ok) return false;
+        }
+        return true;
+    }
+    
+    // 时间线上紧挨着的前一个（或后一个）快照；没有时为空
+    std::string neighbor(const std::string& snapshotId, bool before) const {
+        auto ids = queryIds(before
+            ? "SELECT id FROM snapshots WHERE (timestamp, id) < "
+              "(SELECT timestamp, id FROM snapshots WHERE id = :id) "
+              "ORDER BY timestamp DESC, id DESC LIMIT 1"
+            : "SELECT id FROM snapshots WHERE (timestamp, id) > "
+              "(SELECT timestamp, id FROM snapshots WHERE id = :id) "
+              "ORDER BY timestamp ASC, id ASC LIMIT 1", snapshotId, 0);
+        return ids.empty() ? "" : ids.front();
+    }
+    
+    bool updateRow(const std::string& snapshotId, const std::string& path, int encoding,
+                   const std::string& base, const std::vector<uint8_t>& content) {
+        sqlite3_stmt* stmt;
+        const char* sql = "UPDATE deltas SET encoding = ?, base_snapshot = ?, content = ? "
+                          "WHERE snapshot_id = ? AND file_path = ?";
+        if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) return false;
+        
+        sqlite3_bind_int(stmt, 1, encoding);
+        if (base.empty()) {
+            sqlite3_bind_null(stmt, 2);
+        } else {
+            sqlite3_bind_text(stmt, 2, base.c_str(), -1, SQLITE_STATIC);
+        }
+        if (content.empty()) {
+            sqlite3_bind_null(stmt, 3);
+        } else {
+            sqlite3_bind_blob(stmt, 3, content.data(), content.size(), SQLITE_STATIC);
+        }
+        sqlite3_bind_text(stmt, 4, snapshotId.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 5, path.c_str(), -1, SQLITE_STATIC);
+        
+        bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_finalize(stmt);
+        return ok;
+    }
+    
+    void markPacked(const std::string& snapshotId, bool packed) {
+        sqlite3_stmt* stmt;
+        const char* sql = "UPDATE snapshots SET packed = ? WHERE id = ?";
+        if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) return;
+        
+        sqlite3_bind_int(stmt, 1, packed ? 1 : 0);
+        sqlite3_bind_text(stmt, 2, snapshotId.c_str(), -1, SQLITE_STATIC);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+    }
+    
+    // 仅供写连接（压缩线程）使用
+    std::vector<std::string> queryIds(const char* sql, const std::string& param, int64_t number) const {
+        std::vector<std::string> ids;
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) return ids;
+        
+        for (int i = 1; i <= sqlite3_bind_parameter_count(stmt); ++i) {
+            const char* name = sqlite3_bind_parameter_name(stmt, i);
+            if (name && std::string(name) == ":id") {
+                sqlite3_bind_text(stmt, i, param.c_str(), -1, SQLITE_STATIC);
+            } else {
+                sqlite3_bind_int64(stmt, i, number);
+            }
+        }
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            ids.push_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
+        }
+        sqlite3_finalize(stmt);
+        return ids;
+    }
+    
+    void requestCompaction() {
+        {
+            std::lock_guard<std::mutex> lock(compactMutex_);
+            compactPending_ = true;
+        }
+        compactWake_.notify_one();
+    }
+    
+    // 后台线程：把离开热窗口的旧头部改写为相对后继快照的反向增量
+    void compactLoop() {
+        std::unique_lock<std::mutex> lock(compactMutex_);
+        while (!stopCompactor_) {
+            // 定期醒来，让离开热窗口的快照也能被处理
+            compactWake_.wait_for(lock, std::chrono::seconds(30),
+                                  [this] { return stopCompactor_ || compactPending_; });
+            if (stopCompactor_) break;
+            compactPending_ = false;
+            
+            lock.unlock();
+            try {
+                // 作为维护作业执行：用户命令运行时让路，并受 CPU/IO 预算限制
+                JobScheduler::instance().run(JobClass::Maintenance, "compact", [this] { compactEligible(); });
+            } catch (const JobCancelled&) {
+                // 被取消的压缩下次唤醒时从未打包的快照继续
+            } catch (const std::exception& e) {
+                std::cerr << "Compaction failed: " << e.what() << std::endl;
+            }
+            lock.lock();
+        }
+    }
+    
+    void compactEligible() {
+        std::vector<std::string> candidates;
+        {
+            std::lock_guard<std::recursive_mutex> lock(writeMutex_);
+            int64_t cutoff = static_cast<int64_t>(std::time(nullptr)) - hotWindow_.load();
+            candidates = queryIds(
+                "SELECT id FROM snapshots WHERE packed = 0 AND timestamp <= :cutoff "
+                "AND id != (SELECT id FROM snapshots ORDER BY timestamp DESC, id DESC LIMIT 1) "
+                "ORDER BY timestamp ASC, id ASC", "", cutoff);
+        }
+        
+        // 从旧到新处理，保证后继快照在被改写前仍是完整内容
+        for (const auto& id : candidates) {
+            if (stopping()) return;
+            compactSnapshot(id);
+        }
+    }
+    
+    void compactSnapshot(const std::string& snapshotId) {
+        TraceScope span("storage", "compact", snapshotId);
+        auto started = std::chrono::steady_clock::now();
+        struct RecordPhase {
+            PipelineMetrics* metrics;
+            std::chrono::steady_clock::time_point started;
+            ~RecordPhase() { metrics->record(PipelinePhase::Compact, std::chrono::steady_clock::now() - started); }
+        } recordPhase{metrics_, started};
+        
+        std::vector<std::string> paths;
+        {
+            std::lock_guard<std::recursive_mutex> lock(writeMutex_);
+            paths = queryIds(
+                "SELECT file_path FROM deltas WHERE snapshot_id = :id "
+                "AND encoding = 0 AND content IS NOT NULL", snapshotId, 0);
+        }
+        
+        for (const auto& path : paths) {
+            if (stopping()) return;
+            JobScheduler::checkpoint();
+            
+            DeltaRow current, baseRow;
+            std::vector<uint8_t> baseContent;
+            std::string base;
+            {
+                std::lock_guard<std::recursive_mutex> lock(writeMutex_);
+                if (!readRow(db_, snapshotId, path, current) || current.encoding != ENCODING_FULL) continue;
+                // 之后的快照沿用本行时没有自己的行；以该路径的下一个版本为 base，
+                // 没有下一个版本（仍是最新内容，或之后已删除）时保持完整
+                base = nextVersion(snapshotId, path);
+                if (base.empty() || !readRow(db_, base, path, baseRow)) continue;
+                
+                size_t above = 0;
+                if (!resolveContent(db_, path, baseRow, baseContent, &above)) continue;
+                if (dependentDepth(snapshotId, path) + 1 + above > kMaxChainDepth) continue;
+            }
+            
+            JobScheduler::chargeIo(current.content.size() + baseContent.size());
+            
+            // bsdiff 在锁外计算
+            int encoding = ENCODING_SAME_AS_BASE;
+            std::vector<uint8_t> patch;
+            // 两边都有哈希且不同就不必逐字节比较
+            bool hashesDiffer = current.hash && baseRow.hash && *current.hash != *baseRow.hash;
+            if (hashesDiffer || current.content != baseContent) {
+                if (current.content.size() > kMaxDeltaInput || baseContent.size() > kMaxDeltaInput) continue;
+                std::vector<uint8_t> rawPatch;
+                if (!makePatch(ByteView(baseContent), ByteView(current.content), rawPatch)) continue;
+                if (!compressBlock(ByteView(rawPatch), patch)) continue;
+                if (patch.size() * kMaxPatchRatioDen > current.content.size() * kMaxPatchRatioNum) continue;
+                encoding = ENCODING_REVERSE_PATCH;
+            }
+            
+            std::lock_guard<std::recursive_mutex> lock(writeMutex_);
+            // 期间 base 行可能已被删除，此时保持完整内容
+            DeltaRow check;
+            if (!readRow(db_, base, path, check)) continue;
+            updateRow(snapshotId, path, encoding, base, patch);
+            metrics_->add(encoding == ENCODING_SAME_AS_BASE ? PipelineCounter::DeltasDeduped
+                                                            : PipelineCounter::DeltasCompacted);
+            metrics_->add(PipelineCounter::BytesBeforeCompaction, current.content.size());
+            metrics_->add(PipelineCounter::BytesAfterCompaction, patch.size());
+        }
+        
+        std::lock_guard<std::recursive_mutex> lock(writeMutex_);
+        markPacked(snapshotId, true);
+    }
+    
+    // 时间线上 snapshotId 之后第一个有 path 内容行的快照
+    std::string nextVersion(const std::string& snapshotId, const std::string& path) const {
         sqlite3_stmt* stmt;
-        const char* sql = "INSERT INTO deltas (snapshot_id, file_path, action, content) "
-                          "VALUES (?, ?, ?, ?)";
+        const char* sql = "SELECT d.snapshot_id FROM deltas d JOIN snapshots s ON s.id = d.snapshot_id "
+                          "WHERE d.file_path = ? AND (s.timestamp, s.id) > "
+                          "(SELECT timestamp, id FROM snapshots WHERE id = ?) "
+                          "ORDER BY s.timestamp ASC, s.id ASC LIMIT 1";
+        if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) return "";
+        
+        sqlite3_bind_text(stmt, 1, path.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, snapshotId.c_str(), -1, SQLITE_STATIC);
+        std::string id;
+        if (sqlite3_step(stmt) == SQLITE_ROW) id = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        sqlite3_finalize(stmt);
+        return id;
+    }
+    
+    bool stopping() {
+        std::lock_guard<std::mutex> lock(compactMutex_);
+        return stopCompactor_;
+    }
+    
+    // 只为新增或修改的文件写内容行；内容与父快照相同的文件沿用父快照的项。
+    // 是否相同以强哈希为准：64 位的 fastHash 碰撞时沿用旧行会悄悄丢掉新内容。
+    // 父快照的项没有强哈希（旧格式）时照常写新行
+    void storeDelta(PendingStore& pending, const FileDelta& delta) {
+        // 树中没有的路径即为已删除，不需要记录
+        if (delta.action == FileDelta::DELETE) return;
+        uint32_t node = pending.paths.intern(delta.path);
+        
+        auto start = std::chrono::steady_clock::now();
+        uint64_t hash = fastHash(delta.content.data(), delta.content.size());
+        Digest digest = strongHash(delta.content.data(), delta.content.size());
+        pending.hashTime += std::chrono::steady_clock::now() - start;
+        
+        const StagedFile* previous =
+            node < pending.parent.size() && pending.parent[node].present ? &pending.parent[node] : nullptr;
+        StagedFile& file = PendingStore::at(pending.files, node);
+        if (previous && previous->digest == digest && previous->size == delta.content.size()) {
+            file = *previous;
+            metrics_->add(PipelineCounter::FilesReused);
+            return;
+        }
+        
+        sqlite3_stmt* stmt;
+        const char* sql = "INSERT INTO deltas (snapshot_id, file_path, action, content, is_binary, content_hash, "
+                          "content_digest, content_size) VALUES (?, ?, ?, ?, ?, ?, ?, ?)";
         
         if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
             throw std::runtime_error("Failed to prepare delta statement");
         }
         
-        sqlite3_bind_text(stmt, 1, snapshotId.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 1, pending.id.c_str(), -1, SQLITE_STATIC);
         sqlite3_bind_text(stmt, 2, delta.path.c_str(), -1, SQLITE_STATIC);
         sqlite3_bind_int(stmt, 3, static_cast<int>(delta.action));
         
@@ -218,19 +1397,226 @@ private:
             sqlite3_bind_blob(stmt, 4, delta.content.data(), delta.content.size(), SQLITE_STATIC);
         }
         
+        ContentKind kind = delta.kind;
+        if (kind == ContentKind::Unknown) {
+            start = std::chrono::steady_clock::now();
+            kind = classifyContent(delta.content);
+            pending.classifyTime += std::chrono::steady_clock::now() - start;
+        }
+        sqlite3_bind_int(stmt, 5, static_cast<int>(kind));
+        sqlite3_bind_int64(stmt, 6, static_cast<sqlite3_int64>(hash));
+        sqlite3_bind_blob(stmt, 7, digest.bytes.data(), digest.bytes.size(), SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 8, static_cast<sqlite3_int64>(delta.content.size()));
+        
         if (sqlite3_step(stmt) != SQLITE_DONE) {
             sqlite3_finalize(stmt);
             throw std::runtime_error("Failed to insert delta");
         }
         sqlite3_finalize(stmt);
+        
+        file.present = true;
+        file.action = delta.action;
+        file.kind = kind;
+        file.size = delta.content.size();
+        file.hash = hash;
+        file.digest = digest;
+        file.source = 0;
+        pending.markChanged(node);
+        if (previous) pending.superseded[previous->source] = 1;
     }
     
-    std::vector<FileDelta> loadDeltas(const std::string& snapshotId) const {
-        std::vector<FileDelta> deltas;
+    // 父快照的文件项和目录哈希读入 pending：前者用于判断文件是否修改，后者让没有变化的目录直接复用
+    void loadParent(PendingStore& pending, const std::string& parentId) {
+        SnapshotRoot root = readRoot(db_, parentId);
+        if (root.tree) PendingStore::at(pending.parentTrees, PathTable::kRoot) = *root.tree;
+        walkSnapshot(db_, parentId, pending.paths, [&](uint32_t node, const TreeEntry& entry) {
+            if (entry.type == TreeEntry::Directory) {
+                PendingStore::at(pending.parentTrees, node) = entry.tree;
+                return;
+            }
+            if (entry.action == FileDelta::DELETE) return;
+            StagedFile& file = PendingStore::at(pending.parent, node);
+            file.present = true;
+            file.action = entry.action;
+            file.kind = entry.kind;
+            file.size = entry.size;
+            file.hash = entry.hash;
+            file.digest = entry.digest;
+            file.source = pending.sourceOf(entry.source);
+        });
+    }
+    
+    // 写入本快照的目录树并记到快照行上；被新内容取代的旧行所在的快照重新参与压缩
+    void writeRoot(PendingStore& pending) {
+        // 父快照中有而本快照没有的文件：所在目录都有变化
+        for (uint32_t node = 1; node < pending.parent.size(); ++node) {
+            if (pending.parent[node].present && (node >= pending.files.size() || !pending.files[node].present)) {
+                pending.markChanged(node);
+            }
+        }
+        
+        // 每个目录下的子项 (节点, 是否目录)；同名的文件和目录各占一项
+        std::vector<std::vector<std::pair<uint32_t, bool>>> children(pending.paths.size());
+        std::vector<uint8_t> listed(pending.paths.size(), 0);
+        for (uint32_t node = 1; node < pending.files.size(); ++node) {
+            if (!pending.files[node].present) continue;
+            children[pending.paths.parent(node)].emplace_back(node, false);
+            for (uint32_t dir = pending.paths.parent(node); dir != PathTable::kRoot && !listed[dir];
+                 dir = pending.paths.parent(dir)) {
+                listed[dir] = 1;
+                children[pending.paths.parent(dir)].emplace_back(dir, true);
+            }
+        }
+        
+        Digest root = writeTree(pending, children, PathTable::kRoot);
+        refTree(root, 1);
+        
         sqlite3_stmt* stmt;
-        const char* sql = "SELECT file_path, action, content FROM deltas WHERE snapshot_id = ?";
+        const char* sql = "UPDATE snapshots SET root_tree = ? WHERE id = ?";
+        if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+            throw std::runtime_error("Failed to prepare root statement");
+        }
+        sqlite3_bind_blob(stmt, 1, root.bytes.data(), root.bytes.size(), SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, pending.id.c_str(), -1, SQLITE_STATIC);
+        bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_finalize(stmt);
+        if (!ok) throw std::runtime_error("Failed to record snapshot tree");
+        
+        for (size_t i = 1; i < pending.sources.size(); ++i) {
+            if (pending.superseded[i]) markPacked(pending.sources[i], false);
+        }
+    }
+    
+    // 自底向上写入目录节点。子树没有变化的目录直接用父快照中的哈希；
+    // 已存在的节点（同样的内容出现在其他快照中）不重复写入，只增加引用
+    Digest writeTree(PendingStore& pending, const std::vector<std::vector<std::pair<uint32_t, bool>>>& children,
+                     uint32_t dir) {
+        if (!pending.isChanged(dir) && dir < pending.parentTrees.size() && pending.parentTrees[dir]) {
+            return *pending.parentTrees[dir];
+        }
+        
+        std::vector<TreeEntry> entries;
+        entries.reserve(children[dir].size());
+        for (const auto& child : children[dir]) {
+            TreeEntry entry;
+            entry.name = std::string(pending.paths.name(child.first));
+            if (child.second) {
+                entry.type = TreeEntry::Directory;
+                entry.tree = writeTree(pending, children, child.first);
+            } else {
+                const StagedFile& file = pending.files[child.first];
+                entry.action = file.action;
+                entry.kind = file.kind;
+                entry.size = file.size;
+                entry.hash = file.hash;
+                entry.digest = file.digest;
+                entry.source = pending.sources[file.source];
+            }
+            entries.push_back(std::move(entry));
+        }
         
+        std::vector<uint8_t> data;
+        encodeTree(entries, data);
+        Digest hash = treeHash(data);
+        
+        sqlite3_stmt* stmt;
+        const char* sql = "INSERT OR IGNORE INTO trees (hash, data, refs) VALUES (?, ?, 0)";
         if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+            throw std::runtime_error("Failed to prepare tree statement");
+        }
+        sqlite3_bind_blob(stmt, 1, hash.bytes.data(), hash.bytes.size(), SQLITE_STATIC);
+        sqlite3_bind_blob(stmt, 2, data.data(), data.size(), SQLITE_STATIC);
+        bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_finalize(stmt);
+        if (!ok) throw std::runtime_error("Failed to insert tree");
+        
+        // 新节点引用的子目录各加一次引用
+        if (sqlite3_changes(db_) > 0) {
+            for (const auto& entry : entries) {
+                if (entry.type == TreeEntry::Directory) refTree(entry.tree, 1);
+            }
+            metrics_->add(PipelineCounter::TreesWritten);
+        }
+        return hash;
+    }
+    
+    void refTree(const Digest& hash, int delta) {
+        sqlite3_stmt* stmt;
+        const char* sql = "UPDATE trees SET refs = refs + ? WHERE hash = ?";
+        if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+            throw std::runtime_error("Failed to prepare tree statement");
+        }
+        sqlite3_bind_int(stmt, 1, delta);
+        sqlite3_bind_blob(stmt, 2, hash.bytes.data(), hash.bytes.size(), SQLITE_STATIC);
+        bool ok = sqlite3_step(stmt) == SQLITE_DONE;
+        sqlite3_finalize(stmt);
+        if (!ok) throw std::runtime_error("Failed to update tree references");
+    }
+    
+    // 去掉一次引用；没有引用时删除节点并释放它的子目录
+    void releaseTree(const Digest& hash) {
+        refTree(hash, -1);
+        sqlite3_stmt* stmt;
+        const char* sql = "SELECT refs FROM trees WHERE hash = ?";
+        if (sqlite3_prepare_v2(db_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+            throw std::runtime_error("Failed to prepare tree statement");
+        }
+        sqlite3_bind_blob(stmt, 1, hash.bytes.data(), hash.bytes.size(), SQLITE_STATIC);
+        bool unused = sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_int64(stmt, 0) <= 0;
+        sqlite3_finalize(stmt);
+        if (!unused) return;
+        
+        std::vector<TreeEntry> entries;
+        readTree(db_, hash, entries);
+        const char* deleteSql = "DELETE FROM trees WHERE hash = ?";
+        if (sqlite3_prepare_v2(db_, deleteSql, -1, &stmt, nullptr) != SQLITE_OK) {
+            throw std::runtime_error("Failed to prepare tree statement");
+        }
+        sqlite3_bind_blob(stmt, 1, hash.bytes.data(), hash.bytes.size(), SQLITE_STATIC);
+        sqlite3_step(stmt);
+        sqlite3_finalize(stmt);
+        for (const auto& entry : entries) {
+            if (entry.type == TreeEntry::Directory) releaseTree(entry.tree);
+        }
+    }
+    
+    static std::vector<FileDelta> loadDeltas(sqlite3* db, const std::string& snapshotId) {
+        std::vector<FileDelta> deltas;
+        SnapshotRoot root = readRoot(db, snapshotId);
+        if (root.tree) {
+            sqlite3_stmt* stmt;
+            if (sqlite3_prepare_v2(db, kReadRowSql, -1, &stmt, nullptr) != SQLITE_OK) {
+                throw std::runtime_error("Failed to prepare deltas statement");
+            }
+            PathTable paths;
+            std::string path;
+            try {
+                walkTree(db, *root.tree, PathTable::kRoot, paths, [&](uint32_t node, const TreeEntry& entry) {
+                    if (entry.type != TreeEntry::File) return;
+                    path.clear();
+                    paths.appendPath(node, path);
+                    DeltaRow row;
+                    std::vector<uint8_t> content;
+                    if (!readRow(db, entry.source, path, row, stmt) ||
+                        !resolveContent(db, path, std::move(row), content)) {
+                        throw std::runtime_error("Failed to reconstruct " + path + " in " + snapshotId);
+                    }
+                    deltas.emplace_back(path, entry.action, std::move(content));
+                    deltas.back().kind = entry.kind;
+                });
+            } catch (...) {
+                sqlite3_finalize(stmt);
+                throw;
+            }
+            sqlite3_finalize(stmt);
+            return deltas;
+        }
+        
+        sqlite3_stmt* stmt;
+        const char* sql = "SELECT file_path, action, content, is_binary, encoding, base_snapshot "
+                          "FROM deltas WHERE snapshot_id = ?";
+        
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
             throw std::runtime_error("Failed to prepare deltas statement");
         }
         
@@ -248,7 +1634,24 @@ private:
                              static_cast<const uint8_t*>(blob) + size);
             }
             
+            // 旧版本以反向增量保存，需要沿链重建
+            int encoding = sqlite3_column_int(stmt, 4);
+            if (encoding != ENCODING_FULL) {
+                DeltaRow row;
+                row.encoding = encoding;
+                const unsigned char* base = sqlite3_column_text(stmt, 5);
+                row.base = base ? reinterpret_cast<const char*>(base) : "";
+                row.content = std::move(content);
+                if (!resolveContent(db, path, std::move(row), content)) {
+                    sqlite3_finalize(stmt);
+                    throw std::runtime_error("Failed to reconstruct " + path + " in " + snapshotId);
+                }
+            }
+            
             deltas.emplace_back(path, action, content);
+            if (sqlite3_column_type(stmt, 3) != SQLITE_NULL) {
+                deltas.back().kind = static_cast<ContentKind>(sqlite3_column_int(stmt, 3));
+            }
         }
         
         sqlite3_finalize(stmt);
@@ -257,20 +1660,61 @@ private:
 
     fs::path workspace_;
     std::string dbPath_;
+    // 写连接：存储、删除和后台压缩共用，由 writeMutex_ 串行化
     sqlite3* db_;
-    int maxSnapshots_ = 100;
+    mutable std::recursive_mutex writeMutex_;
+    // 读连接：load/list 等查询使用，不持有 writeMutex_
+    std::unique_ptr<ReaderPool> readers_;
+    std::atomic<int> maxSnapshots_{100};
+    bool readOnly_ = false;
+    
+    std::thread compactor_;
+    std::mutex compactMutex_;
+    std::condition_variable compactWake_;
+    bool compactPending_ = false;
+    bool stopCompactor_ = false;
+    std::atomic<int> hotWindow_{300};
+    // 未设置外部指标时记入自有实例，调用处不必判空
+    PipelineMetrics ownMetrics_;
+    PipelineMetrics* metrics_ = &ownMetrics_;
+    
+    std::unique_ptr<PendingStore> pending_;
 };
 
 Storage::Storage(const std::string& workspace) 
     : impl_(std::make_unique<Impl>(workspace)) {}
 Storage::~Storage() = default;
 
-bool Storage::init() { return impl_->init(); }
+bool Storage::init(OpenMode mode) { return impl_->init(mode); }
+bool Storage::readOnly() const { return impl_->readOnly(); }
 std::string Storage::store(const Snapshot& snapshot) { return impl_->store(snapshot); }
+void Storage::beginStore(const Snapshot& snapshot) { impl_->beginStore(snapshot); }
+void Storage::storeDeltas(const std::vector<FileDelta>& deltas) { impl_->storeDeltas(deltas); }
+void Storage::storeUnchanged(const std::vector<std::string>& paths) { impl_->storeUnchanged(paths); }
+std::string Storage::finishStore() { return impl_->finishStore(); }
+void Storage::abortStore() { impl_->abortStore(); }
 Snapshot Storage::load(const std::string& snapshotId) const { return impl_->load(snapshotId); }
+bool Storage::loadFile(const std::string& snapshotId, const std::string& path, std::vector<uint8_t>& content) const {
+    return impl_->loadFile(snapshotId, path, content);
+}
+
+bool Storage::loadFile(const std::string& snapshotId, const std::string& path, int fd) const {
+    return impl_->loadFile(snapshotId, path, fd);
+}
+std::vector<ManifestEntry> Storage::manifest(const std::string& snapshotId, PathTable& paths) const {
+    return impl_->manifest(snapshotId, paths);
+}
+std::vector<ManifestChange> Storage::compare(const std::string& fromId, const std::string& toId,
+                                             PathTable& paths) const {
+    return impl_->compare(fromId, toId, paths);
+}
 std::vector<Snapshot> Storage::list() const { return impl_->list(); }
 bool Storage::remove(const std::string& snapshotId) { return impl_->remove(snapshotId); }
 void Storage::cleanup() { impl_->cleanup(); }
+void Storage::readSnapshot(const std::function<void()>& fn) const { impl_->readSnapshot(fn); }
+void Storage::setDeltaHotWindow(int seconds) { impl_->setDeltaHotWindow(seconds); }
+void Storage::setMaxSnapshots(int count) { impl_->setMaxSnapshots(count); }
+void Storage::setMetrics(PipelineMetrics* metrics) { impl_->setMetrics(metrics); }
 std::string Storage::lastSnapshotId() const { return impl_->lastSnapshotId(); }
 
 } // namespace clay
\ No newline at end of file
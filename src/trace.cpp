@@ -0,0 +1,184 @@
+#include "clay/trace.hpp"
+#include "clay/json.hpp"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace clay {
+
+// 每个槽位由序号保护：写入中为奇数，写完为 2*idx+2；读者前后两次读到相同的完成序号才接受。
+// 事件内容按原子字存放，与状态页一样避免并发读写的数据竞争。
+struct Tracer::Ring {
+    static constexpr size_t kWords = 4 + kDetailSize / 8;
+
+    struct Slot {
+        std::atomic<uint64_t> seq{0};
+        std::atomic<uint64_t> words[kWords] = {};
+    };
+
+    uint32_t tid = 0;
+    std::atomic<uint64_t> head{0}; // 只由所属线程递增
+    Slot slots[kRingSize];
+};
+
+namespace {
+
+const auto kOrigin = std::chrono::steady_clock::now();
+
+uint64_t pointerWord(const char* p) { return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(p)); }
+const char* wordPointer(uint64_t w) { return reinterpret_cast<const char*>(static_cast<uintptr_t>(w)); }
+
+} // namespace
+
+Tracer& Tracer::instance() {
+    static Tracer instance;
+    return instance;
+}
+
+uint64_t Tracer::now() {
+    // 加 1 让 0 可以作为“未开始”的标记
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - kOrigin).count()) + 1;
+}
+
+Tracer::Ring& Tracer::threadRing() {
+    // 线程退出后缓冲区仍由 rings_ 持有，已记录的事件可以继续导出
+    thread_local Ring* ring = nullptr;
+    if (!ring) {
+        auto created = std::make_shared<Ring>();
+        created->tid = static_cast<uint32_t>(syscall(SYS_gettid));
+        std::lock_guard<std::mutex> lock(mutex_);
+        rings_.push_back(created);
+        ring = created.get();
+    }
+    return *ring;
+}
+
+void Tracer::record(const char* category, const char* name, uint64_t startNs, uint64_t endNs,
+                    std::string_view detail) {
+    Ring& ring = threadRing();
+    uint64_t idx = ring.head.load(std::memory_order_relaxed);
+    Ring::Slot& slot = ring.slots[idx % kRingSize];
+
+    uint64_t packed[kDetailSize / 8] = {};
+    std::memcpy(packed, detail.data(), std::min(detail.size(), kDetailSize - 1));
+
+    slot.seq.store(2 * idx + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.words[0].store(pointerWord(category), std::memory_order_relaxed);
+    slot.words[1].store(pointerWord(name), std::memory_order_relaxed);
+    slot.words[2].store(startNs, std::memory_order_relaxed);
+    slot.words[3].store(endNs - startNs, std::memory_order_relaxed);
+    for (size_t i = 0; i < kDetailSize / 8; ++i) slot.words[4 + i].store(packed[i], std::memory_order_relaxed);
+    slot.seq.store(2 * idx + 2, std::memory_order_release);
+    ring.head.store(idx + 1, std::memory_order_release);
+}
+
+std::vector<Tracer::Event> Tracer::collect(uint64_t fromNs, uint64_t toNs) const {
+    std::vector<std::shared_ptr<Ring>> rings;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        rings = rings_;
+    }
+
+    std::vector<Event> events;
+    for (const auto& ring : rings) {
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t first = head > kRingSize ? head - kRingSize : 0;
+        for (uint64_t idx = first; idx < head; ++idx) {
+            const Ring::Slot& slot = ring->slots[idx % kRingSize];
+            uint64_t seq = slot.seq.load(std::memory_order_acquire);
+            if (seq != 2 * idx + 2) continue; // 已被覆盖或正在写
+
+            uint64_t words[Ring::kWords];
+            for (size_t i = 0; i < Ring::kWords; ++i) words[i] = slot.words[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) != seq) continue;
+
+            uint64_t start = words[2], duration = words[3];
+            if (start > toNs || start + duration < fromNs) continue;
+
+            Event event;
+            event.category = wordPointer(words[0]);
+            event.name = wordPointer(words[1]);
+            event.startNs = start;
+            event.durationNs = duration;
+            event.tid = ring->tid;
+            std::memcpy(event.detail, &words[4], kDetailSize);
+            event.detail[kDetailSize - 1] = '\0';
+            events.push_back(event);
+        }
+    }
+
+    std::sort(events.begin(), events.end(), [](const Event& a, const Event& b) {
+        return a.startNs != b.startNs ? a.startNs < b.startNs : a.durationNs > b.durationNs;
+    });
+    return events;
+}
+
+bool Tracer::writeChromeTrace(const std::string& path, const std::vector<Event>& events) {
+    std::error_code ec;
+    fs::create_directories(fs::path(path).parent_path(), ec);
+
+    std::string temp = path + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::trunc);
+        if (!out) return false;
+
+        int pid = static_cast<int>(getpid());
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid
+            << ",\"args\":{\"name\":\"clay daemon\"}}";
+        char number[64];
+        for (const auto& event : events) {
+            // Chrome trace 的时间单位是微秒
+            std::snprintf(number, sizeof(number), "%.3f,\"dur\":%.3f",
+                          event.startNs / 1000.0, event.durationNs / 1000.0);
+            out << ",\n{\"name\":" << jsonQuote(event.name)
+                << ",\"cat\":" << jsonQuote(event.category)
+                << ",\"ph\":\"X\",\"ts\":" << number
+                << ",\"pid\":" << pid << ",\"tid\":" << event.tid;
+            if (event.detail[0]) out << ",\"args\":{\"detail\":" << jsonQuote(event.detail) << "}";
+            out << "}";
+        }
+        out << "\n]}\n";
+        if (!out) return false;
+    }
+    fs::rename(temp, path, ec);
+    return !ec;
+}
+
+std::string Tracer::writeWorkspaceTrace(const std::string& workspace, const std::string& name,
+                                        const std::vector<Event>& events) {
+    fs::path dir = fs::path(workspace) / ".clay" / "traces";
+    // 名称可能含客户端传来的命令名；只保留 [A-Za-z0-9_-]，文件不会落到 traces 目录之外
+    std::string safe = name;
+    for (char& c : safe) {
+        if (!isalnum(static_cast<unsigned char>(c)) && c != '_' && c != '-') c = '_';
+    }
+    std::string path = (dir / (safe + ".json")).string();
+    if (!writeChromeTrace(path, events)) return "";
+
+    // 按修改时间删除最旧的文件
+    std::error_code ec;
+    std::vector<std::pair<fs::file_time_type, fs::path>> files;
+    for (const auto& entry : fs::directory_iterator(dir, ec)) {
+        if (entry.path().extension() != ".json") continue;
+        files.emplace_back(entry.last_write_time(ec), entry.path());
+    }
+    if (files.size() > kMaxTraceFiles) {
+        std::sort(files.begin(), files.end());
+        for (size_t i = 0; i + kMaxTraceFiles < files.size(); ++i) fs::remove(files[i].second, ec);
+    }
+    return path;
+}
+
+} // namespace clay
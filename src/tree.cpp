@@ -0,0 +1,146 @@
+#include "clay/tree.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace clay {
+
+namespace {
+
+// 节点格式版本，放在第一个字节
+constexpr uint8_t kTreeFormat = 1;
+constexpr uint8_t kHasHash = 1;
+constexpr uint8_t kHasDigest = 2;
+
+void putVarint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+void putString(std::vector<uint8_t>& out, const std::string& text) {
+    putVarint(out, text.size());
+    out.insert(out.end(), text.begin(), text.end());
+}
+
+class Cursor {
+public:
+    explicit Cursor(ByteView data) : p_(data.data), end_(data.data + data.size) {}
+
+    bool done() const { return p_ == end_; }
+
+    bool byte(uint8_t& value) {
+        if (p_ == end_) return false;
+        value = *p_++;
+        return true;
+    }
+
+    bool varint(uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t b;
+            if (!byte(b)) return false;
+            value |= static_cast<uint64_t>(b & 0x7f) << shift;
+            if (!(b & 0x80)) return true;
+        }
+        return false;
+    }
+
+    bool bytes(void* out, size_t size) {
+        if (static_cast<size_t>(end_ - p_) < size) return false;
+        std::memcpy(out, p_, size);
+        p_ += size;
+        return true;
+    }
+
+    bool string(std::string& out) {
+        uint64_t size;
+        if (!varint(size) || static_cast<uint64_t>(end_ - p_) < size) return false;
+        out.assign(reinterpret_cast<const char*>(p_), size);
+        p_ += size;
+        return true;
+    }
+
+private:
+    const uint8_t* p_;
+    const uint8_t* end_;
+};
+
+} // namespace
+
+bool treeOrder(const TreeEntry& a, const TreeEntry& b) {
+    int cmp = a.name.compare(b.name);
+    return cmp != 0 ? cmp < 0 : a.type < b.type;
+}
+
+// 格式：版本字节，然后逐项
+//   类型(1) 名称(varint 长度 + 字节)
+//   文件：动作(1) 分类(1) 大小(varint) 标志(1) [哈希(8, 小端)] [强哈希(32)] 来源快照(varint 长度 + 字节)
+//   目录：子节点哈希(32)
+void encodeTree(std::vector<TreeEntry>& entries, std::vector<uint8_t>& out) {
+    std::sort(entries.begin(), entries.end(), treeOrder);
+    out.clear();
+    out.push_back(kTreeFormat);
+    for (const auto& entry : entries) {
+        out.push_back(entry.type);
+        putString(out, entry.name);
+        if (entry.type == TreeEntry::Directory) {
+            out.insert(out.end(), entry.tree.bytes.begin(), entry.tree.bytes.end());
+            continue;
+        }
+        out.push_back(static_cast<uint8_t>(entry.action));
+        out.push_back(static_cast<uint8_t>(entry.kind));
+        putVarint(out, entry.size);
+        out.push_back((entry.hash ? kHasHash : 0) | (entry.digest ? kHasDigest : 0));
+        if (entry.hash) {
+            for (int i = 0; i < 8; ++i) out.push_back(static_cast<uint8_t>(*entry.hash >> (8 * i)));
+        }
+        if (entry.digest) out.insert(out.end(), entry.digest->bytes.begin(), entry.digest->bytes.end());
+        putString(out, entry.source);
+    }
+}
+
+bool decodeTree(ByteView data, std::vector<TreeEntry>& entries) {
+    entries.clear();
+    Cursor in(data);
+    uint8_t format;
+    if (!in.byte(format) || format != kTreeFormat) return false;
+    while (!in.done()) {
+        TreeEntry entry;
+        uint8_t type;
+        if (!in.byte(type) || type > TreeEntry::Directory || !in.string(entry.name)) return false;
+        entry.type = static_cast<TreeEntry::Type>(type);
+        if (entry.type == TreeEntry::Directory) {
+            if (!in.bytes(entry.tree.bytes.data(), entry.tree.bytes.size())) return false;
+            entries.push_back(std::move(entry));
+            continue;
+        }
+        uint8_t action, kind, flags;
+        if (!in.byte(action) || !in.byte(kind) || !in.varint(entry.size) || !in.byte(flags)) return false;
+        entry.action = static_cast<FileDelta::Action>(action);
+        entry.kind = static_cast<ContentKind>(static_cast<int8_t>(kind));
+        if (flags & kHasHash) {
+            uint8_t raw[8];
+            if (!in.bytes(raw, sizeof(raw))) return false;
+            uint64_t hash = 0;
+            for (int i = 0; i < 8; ++i) hash |= static_cast<uint64_t>(raw[i]) << (8 * i);
+            entry.hash = hash;
+        }
+        if (flags & kHasDigest) {
+            Digest digest;
+            if (!in.bytes(digest.bytes.data(), digest.bytes.size())) return false;
+            entry.digest = digest;
+        }
+        if (!in.string(entry.source)) return false;
+        entries.push_back(std::move(entry));
+    }
+    return true;
+}
+
+Digest treeHash(const std::vector<uint8_t>& encoded) {
+    // 节点都很小，串行计算
+    return strongHash(encoded.data(), encoded.size(), 1);
+}
+
+} // namespace clay
@@ -1,16 +1,20 @@
 #include "clay/watcher.hpp"
+#include "clay/trace.hpp"
 #ifdef _WIN32
 #include <windows.h>
 #else
 #include <sys/inotify.h>
+#include <sys/eventfd.h>
 #include <unistd.h>
 #include <fcntl.h>
 #endif
+#include <algorithm>
 #include <thread>
 #include <iostream>
 #include <atomic>
 #include <regex>
 #include <filesystem>
+#include <unordered_map>
 
 namespace fs = std::filesystem;
 
@@ -44,7 +48,8 @@ public:
             return;
         }
 
-        char buffer[1024];
+        // ReadDirectoryChangesW 本身递归监视整个子树
+        alignas(DWORD) char buffer[64 * 1024];
         DWORD bytesReturned;
         OVERLAPPED overlapped;
         memset(&overlapped, 0, sizeof(overlapped));
@@ -65,7 +70,15 @@ public:
             )) {
                 WaitForSingleObject(overlapped.hEvent, INFINITE);
                 if (stop_) break;
+                if (!GetOverlappedResult(dir, &overlapped, &bytesReturned, FALSE) || bytesReturned == 0) {
+                    // 缓冲区溢出：这一批变化已丢失
+                    overflows_++;
+                    if (overflowCallback_) overflowCallback_();
+                    ResetEvent(overlapped.hEvent);
+                    continue;
+                }
 
+                TraceScope span("watcher", "events");
                 FILE_NOTIFY_INFORMATION* info = 
                     reinterpret_cast<FILE_NOTIFY_INFORMATION*>(buffer);
                 
@@ -89,6 +102,7 @@ public:
                     }
                     
                     if (!ignore) {
+                        events_++;
                         callback_(fullPath.string(), isDir);
                     }
                     
@@ -113,12 +127,25 @@ private:
     std::vector<std::string> ignorePatterns_;
     EventCallback callback_;
     std::atomic<bool> stop_;
+
+public:
+    DirectoryFilter directoryFilter_; // 不支持按目录排除
+    OverflowCallback overflowCallback_;
+    std::atomic<uint64_t> events_{0};
+    std::atomic<uint64_t> overflows_{0};
+    std::atomic<uint64_t> watches_{1};
+    std::thread thread_;
 };
 
 #else
 
 class Watcher::Impl {
 public:
+    // 一次 read 能取走的事件越多，内核队列越不容易溢出
+    static constexpr size_t kBufferSize = 64 * 1024;
+    static constexpr uint32_t kWatchMask =
+        IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+
     Impl(const std::string& path, 
          const std::vector<std::string>& ignorePatterns,
          EventCallback callback)
@@ -126,90 +153,188 @@ public:
           ignorePatterns_(ignorePatterns),
           callback_(callback),
           inotify_fd_(-1),
+          wake_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
           stop_(false) {}
     
+    ~Impl() {
+        if (wake_fd_ >= 0) close(wake_fd_);
+    }
+    
     void run() {
-        inotify_fd_ = inotify_init1(IN_NONBLOCK);
+        inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
         if (inotify_fd_ < 0) {
             perror("inotify_init1");
             return;
         }
 
-        int wd = inotify_add_watch(inotify_fd_, path_.c_str(), 
-                                  IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO);
-        if (wd < 0) {
-            perror("inotify_add_watch");
+        // inotify 不递归：为根目录下每个未被过滤的子目录各加一个监视
+        if (addTree(fs::path(path_), false) == 0) {
             close(inotify_fd_);
             return;
         }
 
-        char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        std::vector<char> storage(kBufferSize + alignof(struct inotify_event));
+        char* buffer = storage.data();
+        buffer += (alignof(struct inotify_event) - reinterpret_cast<uintptr_t>(buffer) % alignof(struct inotify_event))
+                  % alignof(struct inotify_event);
         
         while (!stop_) {
             fd_set fds;
             FD_ZERO(&fds);
             FD_SET(inotify_fd_, &fds);
+            if (wake_fd_ >= 0) FD_SET(wake_fd_, &fds);
 
             struct timeval timeout;
             timeout.tv_sec = 1;
             timeout.tv_usec = 0;
 
-            int ret = select(inotify_fd_ + 1, &fds, NULL, NULL, &timeout);
+            int ret = select(std::max(inotify_fd_, wake_fd_) + 1, &fds, NULL, NULL, &timeout);
             if (ret < 0) {
+                if (errno == EINTR) continue;
                 perror("select");
                 break;
             } else if (ret == 0) {
                 continue; // Timeout
             }
+            if (stop_) break;
+            if (!FD_ISSET(inotify_fd_, &fds)) continue;
 
-            ssize_t len = read(inotify_fd_, buffer, sizeof(buffer));
+            ssize_t len = read(inotify_fd_, buffer, kBufferSize);
             if (len < 0) {
-                if (errno == EINTR) continue;
+                if (errno == EINTR || errno == EAGAIN) continue;
                 perror("read");
                 break;
             }
 
+            TraceScope span("watcher", "events");
             const struct inotify_event* event;
             for (char* ptr = buffer; ptr < buffer + len; 
                  ptr += sizeof(struct inotify_event) + event->len) {
-                
                 event = reinterpret_cast<const struct inotify_event*>(ptr);
-                
-                if (event->mask & IN_IGNORED) continue;
-                
-                std::string name(event->name);
-                fs::path fullPath = fs::path(path_) / name;
-                
-                bool isDir = (event->mask & IN_ISDIR);
-                
-                // 检查是否应该忽略
-                bool ignore = false;
-                for (const auto& pattern : ignorePatterns_) {
-                    if (std::regex_match(name, std::regex(pattern))) {
-                        ignore = true;
-                        break;
-                    }
-                }
-                
-                if (!ignore) {
-                    callback_(fullPath.string(), isDir);
-                }
+                handle(*event);
             }
         }
 
         close(inotify_fd_);
+        dirs_.clear();
     }
     
     void stop() {
         stop_ = true;
+        // 唤醒 select，停止不必等待超时
+        if (wake_fd_ >= 0) {
+            uint64_t one = 1;
+            ssize_t ignored = write(wake_fd_, &one, sizeof(one));
+            (void)ignored;
+        }
     }
 
 private:
+    void handle(const struct inotify_event& event) {
+        if (event.mask & IN_Q_OVERFLOW) {
+            overflows_++;
+            if (overflowCallback_) overflowCallback_();
+            return;
+        }
+        if (event.mask & IN_IGNORED) {
+            dirs_.erase(event.wd);
+            return;
+        }
+        
+        auto dir = dirs_.find(event.wd);
+        if (dir == dirs_.end() || event.len == 0) return;
+        fs::path fullPath = dir->second / event.name;
+        bool isDir = (event.mask & IN_ISDIR);
+        
+        if (isDir && (event.mask & (IN_CREATE | IN_MOVED_TO))) {
+            // 新目录加监视之前已经写入的文件不会产生事件，由 addTree 补报
+            addTree(fullPath, true);
+        } else if (isDir && (event.mask & IN_MOVED_FROM)) {
+            // 移出的目录仍会以旧路径报告事件，直接停止监视
+            removeTree(fullPath);
+        }
+        
+        if (ignored(event.name)) return;
+        events_++;
+        callback_(fullPath.string(), isDir);
+    }
+    
+    bool ignored(const char* name) const {
+        for (const auto& pattern : ignorePatterns_) {
+            if (std::regex_match(name, std::regex(pattern))) return true;
+        }
+        return false;
+    }
+    
+    bool accept(const fs::path& dir) const {
+        return !directoryFilter_ || directoryFilter_(dir.string());
+    }
+    
+    // 监视 root 及其下所有被接受的目录，返回新增的监视数；report 为 true 时补报已有的条目
+    size_t addTree(const fs::path& root, bool report) {
+        if (!addWatch(root)) return 0;
+        size_t added = 1;
+        std::error_code ec;
+        for (auto it = fs::recursive_directory_iterator(root, fs::directory_options::skip_permission_denied, ec);
+             !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+            bool isDir = it->is_directory(ec) && !it->is_symlink(ec);
+            if (isDir) {
+                if (!accept(it->path()) || !addWatch(it->path())) {
+                    it.disable_recursion_pending();
+                    continue;
+                }
+                added++;
+            }
+            if (report) {
+                events_++;
+                callback_(it->path().string(), isDir);
+            }
+        }
+        return added;
+    }
+    
+    bool addWatch(const fs::path& dir) {
+        int wd = inotify_add_watch(inotify_fd_, dir.c_str(), kWatchMask | IN_ONLYDIR);
+        if (wd < 0) {
+            // ENOSPC 表示达到 max_user_watches，其余目录只能依赖自动保存的全量扫描
+            if (errno != ENOENT) perror("inotify_add_watch");
+            return false;
+        }
+        dirs_[wd] = dir;
+        watches_ = dirs_.size();
+        return true;
+    }
+    
+    void removeTree(const fs::path& root) {
+        std::string prefix = root.string() + "/";
+        for (auto it = dirs_.begin(); it != dirs_.end();) {
+            const std::string dir = it->second.string();
+            if (dir == root.string() || dir.compare(0, prefix.size(), prefix) == 0) {
+                inotify_rm_watch(inotify_fd_, it->first);
+                it = dirs_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        watches_ = dirs_.size();
+    }
+
     std::string path_;
     std::vector<std::string> ignorePatterns_;
     EventCallback callback_;
     int inotify_fd_;
+    int wake_fd_;
     std::atomic<bool> stop_;
+    // 监视描述符到目录的映射，只由监视线程访问
+    std::unordered_map<int, fs::path> dirs_;
+
+public:
+    DirectoryFilter directoryFilter_;
+    OverflowCallback overflowCallback_;
+    std::atomic<uint64_t> events_{0};
+    std::atomic<uint64_t> overflows_{0};
+    std::atomic<uint64_t> watches_{0};
+    std::thread thread_;
 };
 
 #endif
@@ -219,15 +344,26 @@ Watcher::Watcher(const std::string& path,
                  EventCallback callback)
     : impl_(std::make_unique<Impl>(path, ignorePatterns, callback)) {}
 
-Watcher::~Watcher() = default;
+Watcher::~Watcher() {
+    stop();
+}
 
 void Watcher::start() {
-    std::thread t([this] { impl_->run(); });
-    t.detach();
+    if (impl_->thread_.joinable()) return;
+    impl_->thread_ = std::thread([this] { impl_->run(); });
+}
+
+void Watcher::setDirectoryFilter(DirectoryFilter filter) { impl_->directoryFilter_ = std::move(filter); }
+void Watcher::setOverflowCallback(OverflowCallback callback) { impl_->overflowCallback_ = std::move(callback); }
+
+Watcher::Stats Watcher::stats() const {
+    return {impl_->events_.load(), impl_->overflows_.load(), impl_->watches_.load()};
 }
 
+// 等待监视线程退出，之后才能安全析构
 void Watcher::stop() {
     impl_->stop();
+    if (impl_->thread_.joinable()) impl_->thread_.join();
 }
 
 } // namespace clay
\ No newline at end of file
@@ -0,0 +1,284 @@
+#include "clay/workspace.hpp"
+#include "clay/core.hpp"
+#include "clay/metrics.hpp"
+#include "clay/scheduler.hpp"
+#include <sqlite3.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace clay {
+
+namespace {
+
+// 所有工作区的 SQLite 连接共享一个进程级的软内存上限
+constexpr sqlite3_int64 kSharedCacheBudget = 64 * 1024 * 1024;
+
+} // namespace
+
+class WorkspaceManager::Impl {
+public:
+    ~Impl() { stop(); }
+
+    void start(const std::string& statePath) {
+        statePath_ = statePath;
+        sqlite3_soft_heap_limit64(kSharedCacheBudget);
+
+        // 这里只读取列表；打开存储和注册监视交给后台线程，不阻塞守护进程开始接受连接
+        std::ifstream state(statePath_);
+        std::string line;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            while (std::getline(state, line)) {
+                if (!line.empty() && !cores_.count(line)) pending_.push_back(line);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(tickMutex_);
+        if (ticker_.joinable()) return;
+        stopTicker_ = false;
+        restorer_ = std::thread([this] { restoreLoop(); });
+        ticker_ = std::thread([this] { tickLoop(); });
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(tickMutex_);
+            stopTicker_ = true;
+        }
+        tickWake_.notify_all();
+        if (restorer_.joinable()) restorer_.join();
+        if (ticker_.joinable()) ticker_.join();
+
+        std::map<std::string, std::shared_ptr<Core>> cores;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cores.swap(cores_);
+        }
+        for (auto& entry : cores) entry.second->stopWatching();
+    }
+
+    std::shared_ptr<Core> open(const std::string& path, bool create) {
+        std::string key = canonical(path);
+        if (key.empty()) return nullptr;
+
+        {
+            // 同一工作区的打开互斥：正在打开时等待其完成，不同工作区互不阻塞
+            std::unique_lock<std::mutex> lock(mutex_);
+            opened_.wait(lock, [&] { return opening_.count(key) == 0; });
+            auto it = cores_.find(key);
+            if (it != cores_.end()) return it->second;
+            if (!create && !fs::is_directory(fs::path(key) / ".clay")) return nullptr;
+            opening_.insert(key);
+            pending_.erase(std::remove(pending_.begin(), pending_.end(), key), pending_.end());
+        }
+
+        auto start = StartupProfile::Clock::now();
+        auto core = std::make_shared<Core>();
+        bool ok = core->init(key);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (ok) cores_[key] = core;
+            opening_.erase(key);
+        }
+        opened_.notify_all();
+        if (!ok) return nullptr;
+        if (restoring_) StartupProfile::instance().record("open " + key, start);
+
+        // 存储打开后请求即可执行。注册监视要遍历整棵目录树，交给后台作业，不占用请求线程；
+        // 期间的修改由下一次快照的全量捕获覆盖
+        startWatching(key, core);
+        // 恢复期间列表不变，结束时统一保存一次
+        if (!restoring_) save();
+        return core;
+    }
+
+    std::shared_ptr<Core> find(const std::string& path) {
+        std::string key = canonical(path);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = cores_.find(key);
+            if (it != cores_.end()) return it->second;
+        }
+        // 尚未恢复或正在恢复的工作区由当前请求直接打开（或等待其完成）
+        return open(key, false);
+    }
+
+    std::shared_ptr<Core> opened(const std::string& path) const {
+        std::string key = canonical(path);
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = cores_.find(key);
+        return it != cores_.end() ? it->second : nullptr;
+    }
+
+    bool close(const std::string& path) {
+        std::string key = canonical(path);
+        std::shared_ptr<Core> core;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = cores_.find(key);
+            if (it == cores_.end()) return false;
+            core = it->second;
+            cores_.erase(it);
+        }
+        core->stopWatching();
+        save();
+        return true;
+    }
+
+    std::vector<std::string> paths() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return pathsLocked();
+    }
+
+    std::vector<std::string> pending() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<std::string> result(pending_.begin(), pending_.end());
+        result.insert(result.end(), opening_.begin(), opening_.end());
+        return result;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return cores_.size() + pending_.size() + opening_.size();
+    }
+
+private:
+    std::vector<std::string> pathsLocked() const {
+        std::set<std::string> all(pending_.begin(), pending_.end());
+        all.insert(opening_.begin(), opening_.end());
+        for (const auto& entry : cores_) all.insert(entry.first);
+        return std::vector<std::string>(all.begin(), all.end());
+    }
+
+    // 监视只为自动保存服务，与自动保存同一类别。作业执行前后工作区可能已被关闭：
+    // 关闭先移出 cores_ 再停止监视，所以注册完成后仍不在 cores_ 中就撤销
+    void startWatching(const std::string& key, const std::shared_ptr<Core>& core) {
+        bool profile = restoring_;
+        JobScheduler::instance().submit(JobClass::Autosave, "watch " + key, [this, key, core, profile] {
+            if (!managed(key, core)) return;
+            auto start = StartupProfile::Clock::now();
+            core->startWatching();
+            if (profile) StartupProfile::instance().record("watch " + key, start);
+            if (!managed(key, core)) core->stopWatching();
+        });
+    }
+
+    bool managed(const std::string& key, const std::shared_ptr<Core>& core) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = cores_.find(key);
+        return it != cores_.end() && it->second == core;
+    }
+
+    // 按列表顺序逐个打开上次托管的工作区；打不开的从列表中移除
+    void restoreLoop() {
+        auto start = StartupProfile::Clock::now();
+        restoring_ = true;
+        for (;;) {
+            std::string key;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (pending_.empty()) break;
+                key = pending_.front();
+            }
+            {
+                std::lock_guard<std::mutex> lock(tickMutex_);
+                if (stopTicker_) break;
+            }
+            if (!open(key, false)) {
+                std::cerr << "Skipping workspace " << key << std::endl;
+                std::lock_guard<std::mutex> lock(mutex_);
+                pending_.erase(std::remove(pending_.begin(), pending_.end(), key), pending_.end());
+            }
+        }
+        restoring_ = false;
+        save();
+        StartupProfile::instance().record("restore workspaces", start);
+    }
+
+    // 一个线程为所有工作区驱动自动保存检查，代替每个工作区各自轮询
+    void tickLoop() {
+        std::unique_lock<std::mutex> lock(tickMutex_);
+        while (!stopTicker_) {
+            tickWake_.wait_for(lock, std::chrono::seconds(1), [this] { return stopTicker_; });
+            if (stopTicker_) break;
+            lock.unlock();
+
+            std::vector<std::shared_ptr<Core>> cores;
+            {
+                std::lock_guard<std::mutex> coresLock(mutex_);
+                for (const auto& entry : cores_) cores.push_back(entry.second);
+            }
+            for (auto& core : cores) core->tick();
+
+            lock.lock();
+        }
+    }
+
+    void save() const {
+        if (statePath_.empty()) return;
+        std::lock_guard<std::mutex> saveLock(saveMutex_);
+        std::string tmp = statePath_ + ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::trunc);
+            for (const auto& path : paths()) out << path << "\n";
+        }
+        std::error_code ec;
+        fs::rename(tmp, statePath_, ec);
+    }
+
+    std::string statePath_;
+    // 已打开的工作区；pending_ 等待后台恢复，opening_ 正在打开
+    std::map<std::string, std::shared_ptr<Core>> cores_;
+    std::deque<std::string> pending_;
+    std::set<std::string> opening_;
+    mutable std::mutex mutex_;
+    std::condition_variable opened_;
+    mutable std::mutex saveMutex_;
+    std::atomic<bool> restoring_{false};
+
+    std::thread restorer_;
+    std::thread ticker_;
+    std::mutex tickMutex_;
+    std::condition_variable tickWake_;
+    bool stopTicker_ = false;
+};
+
+WorkspaceManager& WorkspaceManager::instance() {
+    static WorkspaceManager instance;
+    return instance;
+}
+
+// 先构造调度器单例，保证静态析构时它晚于这里持有的 Core
+WorkspaceManager::WorkspaceManager() : impl_((JobScheduler::instance(), std::make_unique<Impl>())) {}
+WorkspaceManager::~WorkspaceManager() = default;
+
+void WorkspaceManager::start(const std::string& statePath) { impl_->start(statePath); }
+void WorkspaceManager::stop() { impl_->stop(); }
+std::shared_ptr<Core> WorkspaceManager::open(const std::string& path, bool create) { return impl_->open(path, create); }
+std::shared_ptr<Core> WorkspaceManager::find(const std::string& path) { return impl_->find(path); }
+std::shared_ptr<Core> WorkspaceManager::opened(const std::string& path) const { return impl_->opened(path); }
+bool WorkspaceManager::close(const std::string& path) { return impl_->close(path); }
+std::vector<std::string> WorkspaceManager::paths() const { return impl_->paths(); }
+std::vector<std::string> WorkspaceManager::pending() const { return impl_->pending(); }
+size_t WorkspaceManager::size() const { return impl_->size(); }
+
+std::string WorkspaceManager::canonical(const std::string& path) {
+    if (path.empty()) return "";
+    std::error_code ec;
+    fs::path p = fs::weakly_canonical(fs::absolute(path, ec), ec);
+    return ec ? "" : p.string();
+}
+
+} // namespace clay
@@ -130,6 +130,156 @@ static void qsufsort(int64_t *I,int64_t *V,const uint8_t *old,int64_t oldsize)
 	for(i=0;i<oldsize+1;i++) I[V[i]]=i;
 }
 
+/*
+ * SA-IS suffix sorting (Nong, Zhang & Chan 2009) with 32-bit indices.
+ * The text is terminated by a virtual sentinel at T[n] that sorts before
+ * every symbol, so the result matches qsufsort's order exactly and the
+ * generated patches are byte-identical.  Needs ~4n + n/8 bytes instead of
+ * qsufsort's 16n.
+ */
+#define SAIS_CHR(i) (cs==sizeof(int32_t) ? ((const int32_t*)T)[i] : (int32_t)((const uint8_t*)T)[i])
+#define SAIS_TGET(i) ((t[(i)>>3]>>((i)&7))&1)
+#define SAIS_TSET(i) (t[(i)>>3]|=(uint8_t)(1<<((i)&7)))
+#define SAIS_ISLMS(i) ((i)>0 && SAIS_TGET(i) && !SAIS_TGET((i)-1))
+
+static void sais_buckets(const int32_t *C,int32_t *B,int32_t k,int end)
+{
+	int32_t i,sum=0;
+
+	for(i=0;i<k;i++) {
+		sum+=C[i];
+		B[i]=end ? sum : sum-C[i];
+	};
+}
+
+static void sais_induce(const void *T,int32_t *SA,const uint8_t *t,
+		const int32_t *C,int32_t *B,int32_t n,int32_t k,int cs)
+{
+	int32_t i,j;
+
+	/* L-type suffixes; the sentinel sorts first and T[n-1] is always L-type */
+	sais_buckets(C,B,k,0);
+	SA[B[SAIS_CHR(n-1)]++]=n-1;
+	for(i=0;i<n;i++) {
+		j=SA[i]-1;
+		if(j>=0 && !SAIS_TGET(j)) SA[B[SAIS_CHR(j)]++]=j;
+	};
+
+	/* S-type suffixes */
+	sais_buckets(C,B,k,1);
+	for(i=n-1;i>=0;i--) {
+		j=SA[i]-1;
+		if(j>=0 && SAIS_TGET(j)) SA[--B[SAIS_CHR(j)]]=j;
+	};
+}
+
+static int sais_main(const void *T,int32_t *SA,int32_t n,int32_t k,int cs,
+		struct bsdiff_stream *stream)
+{
+	uint8_t *t;
+	int32_t *C,*B,*s1;
+	int32_t i,j,d,n1,name,prev,pos;
+	int diff,result=0;
+
+	if(n==0) return 0;
+	if(n==1) { SA[0]=0; return 0; };
+
+	if((t=stream->malloc((n>>3)+1))==NULL) return -1;
+	if((C=stream->malloc((k+1)*sizeof(int32_t)))==NULL) {
+		stream->free(t);
+		return -1;
+	};
+	if((B=stream->malloc((k+1)*sizeof(int32_t)))==NULL) {
+		stream->free(C);
+		stream->free(t);
+		return -1;
+	};
+
+	/* Classify suffixes: bit set means S-type; the sentinel at n is S-type */
+	memset(t,0,(n>>3)+1);
+	SAIS_TSET(n);
+	for(i=n-2;i>=0;i--)
+		if(SAIS_CHR(i)<SAIS_CHR(i+1) ||
+			(SAIS_CHR(i)==SAIS_CHR(i+1) && SAIS_TGET(i+1))) SAIS_TSET(i);
+
+	for(i=0;i<k;i++) C[i]=0;
+	for(i=0;i<n;i++) C[SAIS_CHR(i)]++;
+
+	/* Stage 1: sort LMS substrings */
+	for(i=0;i<n;i++) SA[i]=-1;
+	sais_buckets(C,B,k,1);
+	for(i=1;i<n;i++) if(SAIS_ISLMS(i)) SA[--B[SAIS_CHR(i)]]=i;
+	sais_induce(T,SA,t,C,B,n,k,cs);
+
+	n1=0;
+	for(i=0;i<n;i++) if(SAIS_ISLMS(SA[i])) SA[n1++]=SA[i];
+
+	/* Name LMS substrings; LMS positions are never adjacent so pos/2 is unique */
+	for(i=n1;i<n;i++) SA[i]=-1;
+	name=0;prev=-1;
+	for(i=0;i<n1;i++) {
+		pos=SA[i];diff=0;
+		for(d=0;;d++) {
+			if(prev==-1 || pos+d==n || prev+d==n ||
+				SAIS_CHR(pos+d)!=SAIS_CHR(prev+d) ||
+				SAIS_TGET(pos+d)!=SAIS_TGET(prev+d)) {
+				diff=1;
+				break;
+			};
+			if(d>0 && (SAIS_ISLMS(pos+d) || SAIS_ISLMS(prev+d))) break;
+		};
+		if(diff) { name++; prev=pos; };
+		SA[n1+(pos>>1)]=name-1;
+	};
+	for(i=n-1,j=n-1;i>=n1;i--) if(SA[i]>=0) SA[j--]=SA[i];
+
+	/* Stage 2: sort the reduced string of LMS names */
+	s1=SA+n-n1;
+	if(name<n1) {
+		if(sais_main(s1,SA,n1,name,sizeof(int32_t),stream)) {
+			result=-1;
+			goto out;
+		};
+	} else {
+		for(i=0;i<n1;i++) SA[s1[i]]=i;
+	};
+
+	/* Stage 3: induce the full order from the sorted LMS suffixes */
+	for(i=1,j=0;i<n;i++) if(SAIS_ISLMS(i)) s1[j++]=i;
+	for(i=0;i<n1;i++) SA[i]=s1[SA[i]];
+	for(i=n1;i<n;i++) SA[i]=-1;
+	sais_buckets(C,B,k,1);
+	for(i=n1-1;i>=0;i--) {
+		j=SA[i];SA[i]=-1;
+		SA[--B[SAIS_CHR(j)]]=j;
+	};
+	sais_induce(T,SA,t,C,B,n,k,cs);
+
+out:
+	stream->free(B);
+	stream->free(C);
+	stream->free(t);
+	return result;
+}
+
+int bsdiff_sais(const uint8_t* old, int64_t oldsize, int32_t* I, struct bsdiff_stream* stream)
+{
+	if(oldsize<0 || oldsize>=INT32_MAX) return -1;
+
+	I[0]=(int32_t)oldsize;
+	return sais_main(old,I+1,(int32_t)oldsize,256,1,stream);
+}
+
+int bsdiff_qsufsort(const uint8_t* old, int64_t oldsize, int64_t* I, struct bsdiff_stream* stream)
+{
+	int64_t *V;
+
+	if((V=stream->malloc((oldsize+1)*sizeof(int64_t)))==NULL) return -1;
+	qsufsort(I,V,old,oldsize);
+	stream->free(V);
+	return 0;
+}
+
 static int64_t matchlen(const uint8_t *old,int64_t oldsize,const uint8_t *new,int64_t newsize)
 {
 	int64_t i;
@@ -166,6 +316,32 @@ static int64_t search(const int64_t *I,const uint8_t *old,int64_t oldsize,
 	};
 }
 
+static int64_t search32(const int32_t *I,const uint8_t *old,int64_t oldsize,
+		const uint8_t *new,int64_t newsize,int64_t st,int64_t en,int64_t *pos)
+{
+	int64_t x,y;
+
+	if(en-st<2) {
+		x=matchlen(old+I[st],oldsize-I[st],new,newsize);
+		y=matchlen(old+I[en],oldsize-I[en],new,newsize);
+
+		if(x>y) {
+			*pos=I[st];
+			return x;
+		} else {
+			*pos=I[en];
+			return y;
+		}
+	};
+
+	x=st+(en-st)/2;
+	if(memcmp(old+I[x],new,MIN(oldsize-I[x],newsize))<0) {
+		return search32(I,old,oldsize,new,newsize,x,en,pos);
+	} else {
+		return search32(I,old,oldsize,new,newsize,st,x,pos);
+	};
+}
+
 static void offtout(int64_t x,uint8_t *buf)
 {
 	int64_t y;
@@ -213,12 +389,12 @@ struct bsdiff_request
 	int64_t newsize;
 	struct bsdiff_stream* stream;
 	int64_t *I;
+	int32_t *I32;
 	uint8_t *buffer;
 };
 
 static int bsdiff_internal(const struct bsdiff_request req)
 {
-	int64_t *I,*V;
 	int64_t scan,pos,len;
 	int64_t lastscan,lastpos,lastoffset;
 	int64_t oldscore,scsc;
@@ -228,12 +404,6 @@ static int bsdiff_internal(const struct bsdiff_request req)
 	uint8_t *buffer;
 	uint8_t buf[8 * 3];
 
-	if((V=req.stream->malloc((req.oldsize+1)*sizeof(int64_t)))==NULL) return -1;
-	I = req.I;
-
-	qsufsort(I,V,req.old,req.oldsize);
-	req.stream->free(V);
-
 	buffer = req.buffer;
 
 	/* Compute the differences, writing ctrl as we go */
@@ -243,8 +413,12 @@ static int bsdiff_internal(const struct bsdiff_request req)
 		oldscore=0;
 
 		for(scsc=scan+=len;scan<req.newsize;scan++) {
-			len=search(I,req.old,req.oldsize,req.new+scan,req.newsize-scan,
-					0,req.oldsize,&pos);
+			if(req.I32)
+				len=search32(req.I32,req.old,req.oldsize,req.new+scan,req.newsize-scan,
+						0,req.oldsize,&pos);
+			else
+				len=search(req.I,req.old,req.oldsize,req.new+scan,req.newsize-scan,
+						0,req.oldsize,&pos);
 
 			for(;scsc<scan+len;scsc++)
 			if((scsc+lastoffset<req.oldsize) &&
@@ -320,17 +494,30 @@ static int bsdiff_internal(const struct bsdiff_request req)
 	return 0;
 }
 
-int bsdiff(const uint8_t* old, int64_t oldsize, const uint8_t* new, int64_t newsize, struct bsdiff_stream* stream)
+int bsdiff_ex(const uint8_t* old, int64_t oldsize, const uint8_t* new, int64_t newsize,
+		struct bsdiff_stream* stream, enum bsdiff_sa_builder builder)
 {
 	int result;
 	struct bsdiff_request req;
 
-	if((req.I=stream->malloc((oldsize+1)*sizeof(int64_t)))==NULL)
+	if(builder==BSDIFF_SA_AUTO)
+		builder=(oldsize<INT32_MAX) ? BSDIFF_SA_SAIS : BSDIFF_SA_QSUFSORT;
+	if(builder==BSDIFF_SA_SAIS && oldsize>=INT32_MAX)
 		return -1;
 
+	req.I=NULL;
+	req.I32=NULL;
+	if(builder==BSDIFF_SA_SAIS) {
+		if((req.I32=stream->malloc((oldsize+1)*sizeof(int32_t)))==NULL)
+			return -1;
+	} else {
+		if((req.I=stream->malloc((oldsize+1)*sizeof(int64_t)))==NULL)
+			return -1;
+	}
+
 	if((req.buffer=stream->malloc(newsize+1))==NULL)
 	{
-		stream->free(req.I);
+		stream->free(req.I32 ? (void*)req.I32 : (void*)req.I);
 		return -1;
 	}
 
@@ -340,14 +527,25 @@ int bsdiff(const uint8_t* old, int64_t oldsize, const uint8_t* new, int64_t news
 	req.newsize = newsize;
 	req.stream = stream;
 
-	result = bsdiff_internal(req);
+	if(req.I32)
+		result = bsdiff_sais(old, oldsize, req.I32, stream);
+	else
+		result = bsdiff_qsufsort(old, oldsize, req.I, stream);
+
+	if(result == 0)
+		result = bsdiff_internal(req);
 
 	stream->free(req.buffer);
-	stream->free(req.I);
+	stream->free(req.I32 ? (void*)req.I32 : (void*)req.I);
 
 	return result;
 }
 
+int bsdiff(const uint8_t* old, int64_t oldsize, const uint8_t* new, int64_t newsize, struct bsdiff_stream* stream)
+{
+	return bsdiff_ex(old, oldsize, new, newsize, stream, BSDIFF_SA_AUTO);
+}
+
 #if defined(BSDIFF_EXECUTABLE)
 
 #include <sys/types.h>
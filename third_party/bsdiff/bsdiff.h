@@ -38,6 +38,26 @@ struct bsdiff_stream {
     void* opaque;
 };
 
-int bsdiff(const uint8_t* old, int64_t oldsize, const uint8_t* new, int64_t newsize, struct bsdiff_stream* stream);
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum bsdiff_sa_builder {
+    BSDIFF_SA_AUTO = 0,     /* SA-IS when old fits 32-bit indices, qsufsort otherwise */
+    BSDIFF_SA_QSUFSORT = 1, /* Larsson-Sadakane, 64-bit indices */
+    BSDIFF_SA_SAIS = 2      /* SA-IS, 32-bit indices, oldsize < INT32_MAX */
+};
+
+int bsdiff(const uint8_t* old, int64_t oldsize, const uint8_t* new_buf, int64_t newsize, struct bsdiff_stream* stream);
+int bsdiff_ex(const uint8_t* old, int64_t oldsize, const uint8_t* new_buf, int64_t newsize,
+              struct bsdiff_stream* stream, enum bsdiff_sa_builder builder);
+
+/* Suffix arrays as searched by bsdiff: I[0] == oldsize, I holds oldsize+1 entries */
+int bsdiff_sais(const uint8_t* old, int64_t oldsize, int32_t* I, struct bsdiff_stream* stream);
+int bsdiff_qsufsort(const uint8_t* old, int64_t oldsize, int64_t* I, struct bsdiff_stream* stream);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
\ No newline at end of file
@@ -25,421 +25,365 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include "bsdiff.h"
+#include "bspatch.h"
 
 #include <limits.h>
+#include <stdlib.h>
 #include <string.h>
 
-#define MIN(x,y) (((x)<(y)) ? (x) : (y))
+#define MIN_LEN(x,y) (((x)<(y)) ? (x) : (y))
 
-static void bsdiff_split(int64_t *I,int64_t *V,int64_t start,int64_t len,int64_t h)
+static int64_t offtin(const uint8_t *buf)
 {
-	int64_t i,j,k,x,tmp,jj,kk;
-
-	if(len<16) {
-		for(k=start;k<start+len;k+=j) {
-			j=1;x=V[I[k]+h];
-			for(i=1;k+i<start+len;i++) {
-				if(V[I[k+i]+h]<x) {
-					x=V[I[k+i]+h];
-					j=0;
-				};
-				if(V[I[k+i]+h]==x) {
-					tmp=I[k+j];I[k+j]=I[k+i];I[k+i]=tmp;
-					j++;
-				};
-			};
-			for(i=0;i<j;i++) V[I[k+i]]=k+j-1;
-			if(j==1) I[k]=-1;
-		};
-		return;
-	};
-
-	x=V[I[start+len/2]+h];
-	jj=0;kk=0;
-	for(i=start;i<start+len;i++) {
-		if(V[I[i]+h]<x) jj++;
-		if(V[I[i]+h]==x) kk++;
-	};
-	jj+=start;kk+=jj;
-
-	i=start;j=0;k=0;
-	while(i<jj) {
-		if(V[I[i]+h]<x) {
-			i++;
-		} else if(V[I[i]+h]==x) {
-			tmp=I[i];I[i]=I[jj+j];I[jj+j]=tmp;
-			j++;
-		} else {
-			tmp=I[i];I[i]=I[kk+k];I[kk+k]=tmp;
-			k++;
-		};
-	};
-
-	while(jj+j<kk) {
-		if(V[I[jj+j]+h]==x) {
-			j++;
-		} else {
-			tmp=I[jj+j];I[jj+j]=I[kk+k];I[kk+k]=tmp;
-			k++;
-		};
-	};
-
-	if(jj>start) bsdiff_split(I,V,start,jj-start,h);
-
-	for(i=0;i<kk-jj;i++) V[I[jj+i]]=kk-1;
-	if(jj==kk-1) I[jj]=-1;
+	int64_t y;
 
-	if(start+len>kk) bsdiff_split(I,V,kk,start+len-kk,h);
-}
+	y=buf[7]&0x7F;
+	y=y*256;y+=buf[6];
+	y=y*256;y+=buf[5];
+	y=y*256;y+=buf[4];
+	y=y*256;y+=buf[3];
+	y=y*256;y+=buf[2];
+	y=y*256;y+=buf[1];
+	y=y*256;y+=buf[0];
 
-static void qsufsort(int64_t *I,int64_t *V,const uint8_t *old,int64_t oldsize)
-{
-	int64_t buckets[256];
-	int64_t i,h,len;
-
-	for(i=0;i<256;i++) buckets[i]=0;
-	for(i=0;i<oldsize;i++) buckets[old[i]]++;
-	for(i=1;i<256;i++) buckets[i]+=buckets[i-1];
-	for(i=255;i>0;i--) buckets[i]=buckets[i-1];
-	buckets[0]=0;
-
-	for(i=0;i<oldsize;i++) I[++buckets[old[i]]]=i;
-	I[0]=oldsize;
-	for(i=0;i<oldsize;i++) V[i]=buckets[old[i]];
-	V[oldsize]=0;
-	for(i=1;i<256;i++) if(buckets[i]==buckets[i-1]+1) I[buckets[i]]=-1;
-	I[0]=-1;
-
-	for(h=1;I[0]!=-(oldsize+1);h+=h) {
-		len=0;
-		for(i=0;i<oldsize+1;) {
-			if(I[i]<0) {
-				len-=I[i];
-				i-=I[i];
-			} else {
-				if(len) I[i-len]=-len;
-				len=V[I[i]]+1-i;
-				bsdiff_split(I,V,i,len,h);
-				i+=len;
-				len=0;
-			};
-		};
-		if(len) I[i-len]=-len;
-	};
+	if(buf[7]&0x80) y=-y;
 
-	for(i=0;i<oldsize+1;i++) I[V[i]]=i;
+	return y;
 }
 
-static int64_t matchlen(const uint8_t *old,int64_t oldsize,const uint8_t *new,int64_t newsize)
+int bspatch(const uint8_t* old, int64_t oldsize, uint8_t* new, int64_t newsize, struct bspatch_stream* stream)
 {
+	uint8_t buf[8];
+	int64_t oldpos,newpos;
+	int64_t ctrl[3];
 	int64_t i;
 
-	for(i=0;(i<oldsize)&&(i<newsize);i++)
-		if(old[i]!=new[i]) break;
+	oldpos=0;newpos=0;
+	while(newpos<newsize) {
+		/* Read control data */
+		for(i=0;i<=2;i++) {
+			if (stream->read(stream, buf, 8))
+				return -1;
+			ctrl[i]=offtin(buf);
+		};
 
-	return i;
-}
+		/* Sanity-check */
+		if (ctrl[0]<0 || ctrl[0]>INT_MAX ||
+			ctrl[1]<0 || ctrl[1]>INT_MAX ||
+			newpos+ctrl[0]>newsize)
+			return -1;
 
-static int64_t search(const int64_t *I,const uint8_t *old,int64_t oldsize,
-		const uint8_t *new,int64_t newsize,int64_t st,int64_t en,int64_t *pos)
-{
-	int64_t x,y;
-
-	if(en-st<2) {
-		x=matchlen(old+I[st],oldsize-I[st],new,newsize);
-		y=matchlen(old+I[en],oldsize-I[en],new,newsize);
-
-		if(x>y) {
-			*pos=I[st];
-			return x;
-		} else {
-			*pos=I[en];
-			return y;
-		}
-	};
+		/* Read diff string */
+		if (stream->read(stream, new + newpos, ctrl[0]))
+			return -1;
 
-	x=st+(en-st)/2;
-	if(memcmp(old+I[x],new,MIN(oldsize-I[x],newsize))<0) {
-		return search(I,old,oldsize,new,newsize,x,en,pos);
-	} else {
-		return search(I,old,oldsize,new,newsize,st,x,pos);
-	};
-}
+		/* Add old data to diff string */
+		for(i=0;i<ctrl[0];i++)
+			if((oldpos+i>=0) && (oldpos+i<oldsize))
+				new[newpos+i]+=old[oldpos+i];
 
-static void offtout(int64_t x,uint8_t *buf)
-{
-	int64_t y;
+		/* Adjust pointers */
+		newpos+=ctrl[0];
+		oldpos+=ctrl[0];
 
-	if(x<0) y=-x; else y=x;
+		/* Sanity-check */
+		if(newpos+ctrl[1]>newsize)
+			return -1;
 
-	buf[0]=y%256;y-=buf[0];
-	y=y/256;buf[1]=y%256;y-=buf[1];
-	y=y/256;buf[2]=y%256;y-=buf[2];
-	y=y/256;buf[3]=y%256;y-=buf[3];
-	y=y/256;buf[4]=y%256;y-=buf[4];
-	y=y/256;buf[5]=y%256;y-=buf[5];
-	y=y/256;buf[6]=y%256;y-=buf[6];
-	y=y/256;buf[7]=y%256;
+		/* Read extra string */
+		if (stream->read(stream, new + newpos, ctrl[1]))
+			return -1;
 
-	if(x<0) buf[7]|=0x80;
+		/* Adjust pointers */
+		newpos+=ctrl[1];
+		oldpos+=ctrl[2];
+	};
+
+	return 0;
 }
 
-static int64_t writedata(struct bsdiff_stream* stream, const void* buffer, int64_t length)
+/*
+ * Streaming application of one or more patches.  Each patch is indexed
+ * once into its control segments, which point straight into the patch
+ * bytes.  Output is produced a chunk at a time by resolving every byte of
+ * the newest version down through the chain: a diff segment reads the
+ * previous version into the output buffer and adds the diff bytes in
+ * place, an extra segment copies literal bytes.  No intermediate version
+ * is ever materialized, so memory is one chunk plus the segment indices.
+ */
+struct bspatch_seg
 {
-	int64_t result = 0;
-
-	while (length > 0)
-	{
-		const int smallsize = (int)MIN(length, INT_MAX);
-		const int writeresult = stream->write(stream, buffer, smallsize);
-		if (writeresult == -1)
-		{
-			return -1;
-		}
-
-		result += writeresult;
-		length -= smallsize;
-		buffer = (uint8_t*)buffer + smallsize;
-	}
+	int64_t newpos;
+	int64_t oldpos;
+	int64_t difflen;
+	int64_t extralen;
+	const uint8_t* diff;
+	const uint8_t* extra;
+};
 
-	return result;
-}
+struct bspatch_index
+{
+	struct bspatch_seg* segs;
+	int64_t count;
+	int64_t newsize;
+};
 
-struct bsdiff_request
+struct bspatch_chain_state
 {
 	const uint8_t* old;
 	int64_t oldsize;
-	const uint8_t* new;
-	int64_t newsize;
-	struct bsdiff_stream* stream;
-	int64_t *I;
-	uint8_t *buffer;
+	const struct bspatch_index* index;
 };
 
-static int bsdiff_internal(const struct bsdiff_request req)
+static int bspatch_index_build(const struct bspatch_view* patch, struct bspatch_index* index)
 {
-	int64_t *I,*V;
-	int64_t scan,pos,len;
-	int64_t lastscan,lastpos,lastoffset;
-	int64_t oldscore,scsc;
-	int64_t s,Sf,lenf,Sb,lenb;
-	int64_t overlap,Ss,lens;
-	int64_t i;
-	uint8_t *buffer;
-	uint8_t buf[8 * 3];
+	const uint8_t* p = patch->data;
+	const uint8_t* end = patch->data + patch->size;
+	int64_t cap = 0, newpos = 0, oldpos = 0;
+	struct bspatch_seg* seg;
+
+	index->segs = NULL;
+	index->count = 0;
+	index->newsize = 0;
+
+	while (p < end) {
+		if (end - p < 24)
+			return -1;
 
-	if((V=req.stream->malloc((req.oldsize+1)*sizeof(int64_t)))==NULL) return -1;
-	I = req.I;
+		if (index->count == cap) {
+			struct bspatch_seg* grown;
+			cap = cap ? cap * 2 : 64;
+			if ((grown = realloc(index->segs, cap * sizeof(*grown))) == NULL)
+				return -1;
+			index->segs = grown;
+		}
 
-	qsufsort(I,V,req.old,req.oldsize);
-	req.stream->free(V);
+		seg = &index->segs[index->count++];
+		seg->newpos = newpos;
+		seg->oldpos = oldpos;
+		seg->difflen = offtin(p);
+		seg->extralen = offtin(p + 8);
+		if (seg->difflen < 0 || seg->difflen > INT_MAX ||
+			seg->extralen < 0 || seg->extralen > INT_MAX ||
+			end - (p + 24) < seg->difflen + seg->extralen)
+			return -1;
 
-	buffer = req.buffer;
+		seg->diff = p + 24;
+		seg->extra = seg->diff + seg->difflen;
+		p = seg->extra + seg->extralen;
 
-	/* Compute the differences, writing ctrl as we go */
-	scan=0;len=0;pos=0;
-	lastscan=0;lastpos=0;lastoffset=0;
-	while(scan<req.newsize) {
-		oldscore=0;
+		newpos += seg->difflen + seg->extralen;
+		oldpos += seg->difflen + offtin(seg->diff - 8);
+	}
 
-		for(scsc=scan+=len;scan<req.newsize;scan++) {
-			len=search(I,req.old,req.oldsize,req.new+scan,req.newsize-scan,
-					0,req.oldsize,&pos);
+	index->newsize = newpos;
+	return 0;
+}
 
-			for(;scsc<scan+len;scsc++)
-			if((scsc+lastoffset<req.oldsize) &&
-				(req.old[scsc+lastoffset] == req.new[scsc]))
-				oldscore++;
+/* Fills out[0..len) with bytes [pos, pos+len) of version `level` (0 = old) */
+static int bspatch_chain_read(const struct bspatch_chain_state* st, int level,
+		int64_t pos, int64_t len, uint8_t* out)
+{
+	const struct bspatch_index* index;
+	int64_t lo, hi, mid, n, off, size;
+	const struct bspatch_seg* seg;
 
-			if(((len==oldscore) && (len!=0)) || 
-				(len>oldscore+8)) break;
+	size = level == 0 ? st->oldsize : st->index[level - 1].newsize;
 
-			if((scan+lastoffset<req.oldsize) &&
-				(req.old[scan+lastoffset] == req.new[scan]))
-				oldscore--;
-		};
+	/* Bytes outside the previous version read as zero, as in bspatch() */
+	if (pos < 0) {
+		n = MIN_LEN(len, -pos);
+		memset(out, 0, n);
+		out += n; pos += n; len -= n;
+	}
+	if (pos + len > size) {
+		n = MIN_LEN(len, pos + len - size);
+		memset(out + len - n, 0, n);
+		len -= n;
+	}
+	if (len <= 0)
+		return 0;
 
-		if((len!=oldscore) || (scan==req.newsize)) {
-			s=0;Sf=0;lenf=0;
-			for(i=0;(lastscan+i<scan)&&(lastpos+i<req.oldsize);) {
-				if(req.old[lastpos+i]==req.new[lastscan+i]) s++;
-				i++;
-				if(s*2-i>Sf*2-lenf) { Sf=s; lenf=i; };
-			};
-
-			lenb=0;
-			if(scan<req.newsize) {
-				s=0;Sb=0;
-				for(i=1;(scan>=lastscan+i)&&(pos>=i);i++) {
-					if(req.old[pos-i]==req.new[scan-i]) s++;
-					if(s*2-i>Sb*2-lenb) { Sb=s; lenb=i; };
-				};
-			};
-
-			if(lastscan+lenf>scan-lenb) {
-				overlap=(lastscan+lenf)-(scan-lenb);
-				s=0;Ss=0;lens=0;
-				for(i=0;i<overlap;i++) {
-					if(req.new[lastscan+lenf-overlap+i]==
-					   req.old[lastpos+lenf-overlap+i]) s++;
-					if(req.new[scan-lenb+i]==
-					   req.old[pos-lenb+i]) s--;
-					if(s>Ss) { Ss=s; lens=i+1; };
-				};
-
-				lenf+=lens-overlap;
-				lenb-=lens;
-			};
-
-			offtout(lenf,buf);
-			offtout((scan-lenb)-(lastscan+lenf),buf+8);
-			offtout((pos-lenb)-(lastpos+lenf),buf+16);
-
-			/* Write control data */
-			if (writedata(req.stream, buf, sizeof(buf)))
-				return -1;
+	if (level == 0) {
+		memcpy(out, st->old + pos, len);
+		return 0;
+	}
 
-			/* Write diff data */
-			for(i=0;i<lenf;i++)
-				buffer[i]=req.new[lastscan+i]-req.old[lastpos+i];
-			if (writedata(req.stream, buffer, lenf))
-				return -1;
+	index = &st->index[level - 1];
 
-			/* Write extra data */
-			for(i=0;i<(scan-lenb)-(lastscan+lenf);i++)
-				buffer[i]=req.new[lastscan+lenf+i];
-			if (writedata(req.stream, buffer, (scan-lenb)-(lastscan+lenf)))
-				return -1;
+	/* Last segment starting at or before pos */
+	lo = 0; hi = index->count - 1;
+	while (lo < hi) {
+		mid = lo + (hi - lo + 1) / 2;
+		if (index->segs[mid].newpos <= pos) lo = mid; else hi = mid - 1;
+	}
 
-			lastscan=scan-lenb;
-			lastpos=pos-lenb;
-			lastoffset=pos-scan;
-		};
-	};
+	for (seg = &index->segs[lo]; len > 0; seg++) {
+		if (seg >= index->segs + index->count)
+			return -1;
+
+		off = pos - seg->newpos;
+		if (off < seg->difflen) {
+			int64_t i;
+			n = MIN_LEN(len, seg->difflen - off);
+			if (bspatch_chain_read(st, level - 1, seg->oldpos + off, n, out))
+				return -1;
+			for (i = 0; i < n; i++)
+				out[i] += seg->diff[off + i];
+			out += n; pos += n; len -= n;
+			off += n;
+		}
+		if (len > 0 && off < seg->difflen + seg->extralen) {
+			n = MIN_LEN(len, seg->difflen + seg->extralen - off);
+			memcpy(out, seg->extra + (off - seg->difflen), n);
+			out += n; pos += n; len -= n;
+		}
+	}
 
 	return 0;
 }
 
-int bsdiff(const uint8_t* old, int64_t oldsize, const uint8_t* new, int64_t newsize, struct bsdiff_stream* stream)
+int64_t bspatch_newsize(const struct bspatch_view* patch)
 {
-	int result;
-	struct bsdiff_request req;
+	struct bspatch_index index;
+	int64_t size = -1;
 
-	if((req.I=stream->malloc((oldsize+1)*sizeof(int64_t)))==NULL)
-		return -1;
+	if (bspatch_index_build(patch, &index) == 0)
+		size = index.newsize;
+	free(index.segs);
+	return size;
+}
 
-	if((req.buffer=stream->malloc(newsize+1))==NULL)
-	{
-		stream->free(req.I);
+int bspatch_chain(const uint8_t* old, int64_t oldsize,
+		const struct bspatch_view* patches, int count,
+		struct bspatch_sink* sink)
+{
+	struct bspatch_chain_state st;
+	struct bspatch_index* index;
+	uint8_t* chunk;
+	int64_t pos, n, newsize;
+	int i, result = 0;
+
+	if (count <= 0)
+		return sink->write(sink, old, oldsize);
+
+	if ((index = calloc(count, sizeof(*index))) == NULL)
+		return -1;
+	if ((chunk = malloc(BSPATCH_CHUNK_SIZE)) == NULL) {
+		free(index);
 		return -1;
 	}
 
-	req.old = old;
-	req.oldsize = oldsize;
-	req.new = new;
-	req.newsize = newsize;
-	req.stream = stream;
+	for (i = 0; i < count && result == 0; i++)
+		result = bspatch_index_build(&patches[i], &index[i]);
 
-	result = bsdiff_internal(req);
+	st.old = old;
+	st.oldsize = oldsize;
+	st.index = index;
+	newsize = result == 0 ? index[count - 1].newsize : 0;
 
-	stream->free(req.buffer);
-	stream->free(req.I);
+	for (pos = 0; pos < newsize && result == 0; pos += n) {
+		n = MIN_LEN(newsize - pos, BSPATCH_CHUNK_SIZE);
+		result = bspatch_chain_read(&st, count, pos, n, chunk);
+		if (result == 0)
+			result = sink->write(sink, chunk, n);
+	}
 
+	for (i = 0; i < count; i++)
+		free(index[i].segs);
+	free(index);
+	free(chunk);
 	return result;
 }
 
-#if defined(BSDIFF_EXECUTABLE)
-
-#include <sys/types.h>
+#if defined(BSPATCH_EXECUTABLE)
 
 #include <bzlib.h>
-#include <err.h>
-#include <fcntl.h>
 #include <stdio.h>
-#include <stdlib.h>
+#include <err.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
-static int bz2_write(struct bsdiff_stream* stream, const void* buffer, int size)
+static int bz2_read(const struct bspatch_stream* stream, void* buffer, int length)
 {
+	int n;
 	int bz2err;
 	BZFILE* bz2;
 
 	bz2 = (BZFILE*)stream->opaque;
-	BZ2_bzWrite(&bz2err, bz2, (void*)buffer, size);
-	if (bz2err != BZ_STREAM_END && bz2err != BZ_OK)
+	n = BZ2_bzRead(&bz2err, bz2, buffer, length);
+	if (n != length)
 		return -1;
 
 	return 0;
 }
 
-int main(int argc,char *argv[])
+int main(int argc,char * argv[])
 {
+	FILE * f;
 	int fd;
 	int bz2err;
-	uint8_t *old,*new;
-	off_t oldsize,newsize;
-	uint8_t buf[8];
-	FILE * pf;
-	struct bsdiff_stream stream;
+	uint8_t header[24];
+	uint8_t *old, *new;
+	int64_t oldsize, newsize;
 	BZFILE* bz2;
-
-	memset(&bz2, 0, sizeof(bz2));
-	stream.malloc = malloc;
-	stream.free = free;
-	stream.write = bz2_write;
+	struct bspatch_stream stream;
+	struct stat sb;
 
 	if(argc!=4) errx(1,"usage: %s oldfile newfile patchfile\n",argv[0]);
 
-	/* Allocate oldsize+1 bytes instead of oldsize bytes to ensure
-		that we never try to malloc(0) and get a NULL pointer */
+	/* Open patch file */
+	if ((f = fopen(argv[3], "r")) == NULL)
+		err(1, "fopen(%s)", argv[3]);
+
+	/* Read header */
+	if (fread(header, 1, 24, f) != 24) {
+		if (feof(f))
+			errx(1, "Corrupt patch\n");
+		err(1, "fread(%s)", argv[3]);
+	}
+
+	/* Check for appropriate magic */
+	if (memcmp(header, "ENDSLEY/BSDIFF43", 16) != 0)
+		errx(1, "Corrupt patch\n");
+
+	/* Read lengths from header */
+	newsize=offtin(header+16);
+	if(newsize<0)
+		errx(1,"Corrupt patch\n");
+
+	/* Close patch file and re-open it via libbzip2 at the right places */
 	if(((fd=open(argv[1],O_RDONLY,0))<0) ||
 		((oldsize=lseek(fd,0,SEEK_END))==-1) ||
 		((old=malloc(oldsize+1))==NULL) ||
 		(lseek(fd,0,SEEK_SET)!=0) ||
 		(read(fd,old,oldsize)!=oldsize) ||
+		(fstat(fd, &sb)) ||
 		(close(fd)==-1)) err(1,"%s",argv[1]);
+	if((new=malloc(newsize+1))==NULL) err(1,NULL);
 
+	if (NULL == (bz2 = BZ2_bzReadOpen(&bz2err, f, 0, 0, NULL, 0)))
+		errx(1, "BZ2_bzReadOpen, bz2err=%d", bz2err);
 
-	/* Allocate newsize+1 bytes instead of newsize bytes to ensure
-		that we never try to malloc(0) and get a NULL pointer */
-	if(((fd=open(argv[2],O_RDONLY,0))<0) ||
-		((newsize=lseek(fd,0,SEEK_END))==-1) ||
-		((new=malloc(newsize+1))==NULL) ||
-		(lseek(fd,0,SEEK_SET)!=0) ||
-		(read(fd,new,newsize)!=newsize) ||
-		(close(fd)==-1)) err(1,"%s",argv[2]);
-
-	/* Create the patch file */
-	if ((pf = fopen(argv[3], "w")) == NULL)
-		err(1, "%s", argv[3]);
-
-	/* Write header (signature+newsize)*/
-	offtout(newsize, buf);
-	if (fwrite("ENDSLEY/BSDIFF43", 16, 1, pf) != 1 ||
-		fwrite(buf, sizeof(buf), 1, pf) != 1)
-		err(1, "Failed to write header");
-
-
-	if (NULL == (bz2 = BZ2_bzWriteOpen(&bz2err, pf, 9, 0, 0)))
-		errx(1, "BZ2_bzWriteOpen, bz2err=%d", bz2err);
-
+	stream.read = bz2_read;
 	stream.opaque = bz2;
-	if (bsdiff(old, oldsize, new, newsize, &stream))
-		err(1, "bsdiff");
+	if (bspatch(old, oldsize, new, newsize, &stream))
+		errx(1, "bspatch");
 
-	BZ2_bzWriteClose(&bz2err, bz2, 0, NULL, NULL);
-	if (bz2err != BZ_OK)
-		err(1, "BZ2_bzWriteClose, bz2err=%d", bz2err);
+	/* Clean up the bzip2 reads */
+	BZ2_bzReadClose(&bz2err, bz2);
+	fclose(f);
 
-	if (fclose(pf))
-		err(1, "fclose");
+	/* Write the new file */
+	if(((fd=open(argv[2],O_CREAT|O_TRUNC|O_WRONLY,sb.st_mode))<0) ||
+		(write(fd,new,newsize)!=newsize) || (close(fd)==-1))
+		err(1,"%s",argv[2]);
 
-	/* Free the memory we used */
-	free(old);
 	free(new);
+	free(old);
 
 	return 0;
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -36,6 +36,39 @@ struct bspatch_stream
 	int (*read)(const struct bspatch_stream* stream, void* buffer, int length);
 };
 
+# ifdef __cplusplus
+extern "C" {
+# endif
+
 int bspatch(const uint8_t* old, int64_t oldsize, uint8_t* new_buf, int64_t newsize, struct bspatch_stream* stream);
 
+/* A raw patch (as written by bsdiff) held in memory, e.g. mmap'd or a database blob */
+struct bspatch_view
+{
+	const uint8_t* data;
+	int64_t size;
+};
+
+/* Receives output chunks; returns 0 on success */
+struct bspatch_sink
+{
+	void* opaque;
+	int (*write)(struct bspatch_sink* sink, const void* buffer, int64_t length);
+};
+
+# define BSPATCH_CHUNK_SIZE (256 * 1024)
+
+/* Size of the file a patch produces, or -1 if the patch is malformed */
+int64_t bspatch_newsize(const struct bspatch_view* patch);
+
+/* Applies patches[0], patches[1], ... on top of old in a single pass and
+   streams the final version to sink in BSPATCH_CHUNK_SIZE pieces */
+int bspatch_chain(const uint8_t* old, int64_t oldsize,
+		const struct bspatch_view* patches, int count,
+		struct bspatch_sink* sink);
+
+# ifdef __cplusplus
+}
+# endif
+
 #endif
\ No newline at end of file